@@ -101,6 +101,8 @@ Args::Ctor()
 
   doNormalizeTy = true;
 
+  gpuAdvisorThreads = 0;
+
   prof_metrics = Analysis::Args::MetricFlg_NULL;
 
   profflat_computeFinalMetricValues = true;
@@ -130,6 +130,9 @@ public:
   // Static analysis files
   std::vector<std::string> instructionFiles;
 
+  // Threads the GPU advisor uses on instructionFiles; 0 skips the advisor
+  int gpuAdvisorThreads;
+
   // Group files
   std::vector<std::string> groupFiles;
 
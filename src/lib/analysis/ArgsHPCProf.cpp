@@ -135,6 +135,10 @@ Options: Source Code and Static Structure:\n\
                        for which <old-path> is a prefix.  Use '\\' to escape\n\
                        instances of '=' within a path. May pass multiple\n\
                        times.\n\
+  --gpu-advisor [<n>]  Overlay the GPU instructions in the measurement's\n\
+                       structs/nvidia directory and advise the GPU kernels,\n\
+                       using <n> threads. {1}\n\
+                       hpcprof-mpi does not run the advisor.\n\
 \n\
 Options: Metrics:\n\
   -M <metric>, --metric <metric>\n\
@@ -195,6 +199,8 @@ CmdLineParser::OptArgDesc Analysis::ArgsHPCProf::optArgs[] = {
 
   { 'N', "normalize",       CLP::ARG_REQ,  CLP::DUPOPT_CLOB, NULL,
      NULL },
+  {  0 , "gpu-advisor",     CLP::ARG_OPT,  CLP::DUPOPT_CLOB, NULL,
+     CLP::isOptArg_long },
 
   // Metrics
   { 'M', "metric",          CLP::ARG_REQ,  CLP::DUPOPT_CAT,  CLP_SEPARATOR,
@@ -419,6 +425,17 @@ ArgsHPCProf::parse(int argc, const char* const argv[], AppType type)
       doNormalizeTy = parseArg_norm(arg, "--normalize/-N option");
     }
 
+    if (parser.isOpt("gpu-advisor")) {
+      gpuAdvisorThreads = 1;
+      if (parser.isOptArg("gpu-advisor")) {
+	const string& arg = parser.getOptArg("gpu-advisor");
+	gpuAdvisorThreads = (int)CmdLineParser::toLong(arg);
+	if (gpuAdvisorThreads < 1) {
+	  ARG_ERROR("--gpu-advisor needs at least one thread");
+	}
+      }
+    }
+
     if (parser.isOpt("replace-path")) {
       string arg = parser.getOptArg("replace-path");
       
@@ -66,6 +66,11 @@
 #include <vector>
 #include <stack>
 #include <string>
+#include <set>
+#include <unordered_map>
+#include <utility>
+
+#include <stdint.h>
 
 //*************************** User Include Files ****************************
 
@@ -96,127 +101,212 @@ struct CCTEdge {
 };
 
 
+// Nodes are numbered in insertion order.  Neighbors are kept in vectors
+// indexed by node number, and nodes and edges are iterated in insertion
+// order.  Removed edges are only marked, so edge iterators stay valid.
 template<class T>
 class CCTGraph {
  public:
-  typedef std::map<T, std::set<T> > NeighborNodeMap;
+  // <node, neighbors>
+  typedef std::pair<T, std::vector<T> > NeighborNodes;
+  typedef std::vector<NeighborNodes> NeighborNodeMap;
+
+  class EdgeIterator {
+   public:
+    EdgeIterator() : _graph(NULL), _index(0) {}
+
+    const CCTEdge<T> &operator * () const {
+      return _graph->_edges[_index];
+    }
+
+    const CCTEdge<T> *operator -> () const {
+      return &_graph->_edges[_index];
+    }
+
+    EdgeIterator &operator ++ () {
+      ++_index;
+      skipRemoved();
+      return *this;
+    }
+
+    bool operator == (const EdgeIterator &other) const {
+      return _index == other._index;
+    }
+
+    bool operator != (const EdgeIterator &other) const {
+      return _index != other._index;
+    }
+
+   private:
+    EdgeIterator(const CCTGraph *graph, size_t index) : _graph(graph), _index(index) {
+      skipRemoved();
+    }
+
+    void skipRemoved() {
+      while (_index < _graph->_edges.size() && _graph->_edge_removed[_index]) {
+        ++_index;
+      }
+    }
+
+   private:
+    const CCTGraph *_graph;
+    size_t _index;
+
+    friend class CCTGraph;
+  };
 
  public:
-  CCTGraph() {}
+  CCTGraph() : _edge_size(0) {}
 
-  typename std::set<CCTEdge<T> >::iterator edgeBegin() {
-    return _edges.begin();
+  EdgeIterator edgeBegin() const {
+    return EdgeIterator(this, 0);
   }
 
-  typename std::set<CCTEdge<T> >::iterator edgeEnd() {
-    return _edges.end();
+  EdgeIterator edgeEnd() const {
+    return EdgeIterator(this, _edges.size());
   }
 
-  std::set<T> nodes() {
-    return _nodes;
+  std::set<T> nodes() const {
+    return std::set<T>(_nodes.begin(), _nodes.end());
   }
 
-  typename std::set<T>::iterator nodeBegin() {
+  typename std::vector<T>::const_iterator nodeBegin() const {
     return _nodes.begin();
   }
 
-  typename std::set<T>::iterator nodeEnd() {
+  typename std::vector<T>::const_iterator nodeEnd() const {
     return _nodes.end();
   }
 
-  typename NeighborNodeMap::iterator incoming_nodes(T node) {
-    return _incoming_nodes.find(node);
+  typename NeighborNodeMap::const_iterator incoming_nodes(T node) const {
+    auto iter = _node_ids.find(node);
+    if (iter == _node_ids.end()) {
+      return _incoming_nodes.end();
+    }
+    return _incoming_nodes.begin() + iter->second;
   }
 
-  typename NeighborNodeMap::iterator incoming_nodes_end() {
+  typename NeighborNodeMap::const_iterator incoming_nodes_end() const {
     return _incoming_nodes.end();
   }
 
   size_t outgoing_nodes_size(T node) const {
-    auto iter = _outgoing_nodes.find(node); 
-    if (iter == _outgoing_nodes.end()) {
+    auto iter = _node_ids.find(node); 
+    if (iter == _node_ids.end()) {
       return 0;
     }
-    return iter->second.size();
+    return _outgoing_nodes[iter->second].second.size();
   }
 
   size_t incoming_nodes_size(T node) const {
-    auto iter = _incoming_nodes.find(node); 
-    if (iter == _incoming_nodes.end()) {
+    auto iter = _node_ids.find(node); 
+    if (iter == _node_ids.end()) {
       return 0;
     }
-    return iter->second.size();
+    return _incoming_nodes[iter->second].second.size();
   }
 
-  typename NeighborNodeMap::iterator outgoing_nodes(T node) const {
-    return _outgoing_nodes.find(node);
-  }
-  
-  typename NeighborNodeMap::iterator outgoing_nodes_end() const {
-    return _outgoing_nodes.end();
-  }
-
-  typename NeighborNodeMap::iterator outgoing_nodes(T node) {
-    return _outgoing_nodes.find(node);
+  typename NeighborNodeMap::const_iterator outgoing_nodes(T node) const {
+    auto iter = _node_ids.find(node);
+    if (iter == _node_ids.end()) {
+      return _outgoing_nodes.end();
+    }
+    return _outgoing_nodes.begin() + iter->second;
   }
   
-  typename NeighborNodeMap::iterator outgoing_nodes_end() {
+  typename NeighborNodeMap::const_iterator outgoing_nodes_end() const {
     return _outgoing_nodes.end();
   }
  
   void addEdge(T from, T to) {
-    if (_nodes.find(from) == _nodes.end()) {
-      _nodes.insert(from);
-    }
-
-    if (_nodes.find(to) == _nodes.end()) {
-      _nodes.insert(to);
-    }
-
-    CCTEdge<T> edge(from, to);
-    if (_edges.find(edge) == _edges.end()) {
-      _edges.insert(std::move(edge));
-      _incoming_nodes[to].insert(from);
-      _outgoing_nodes[from].insert(to);
+    uint64_t from_id = addNodeId(from);
+    uint64_t to_id = addNodeId(to);
+
+    uint64_t key = (from_id << 32) | to_id;
+    if (_edge_ids.find(key) == _edge_ids.end()) {
+      _edge_ids[key] = _edges.size();
+      _edges.emplace_back(from, to);
+      _edge_removed.push_back(false);
+      _incoming_nodes[to_id].second.push_back(from);
+      _outgoing_nodes[from_id].second.push_back(to);
+      ++_edge_size;
     }
   }
 
-  void removeEdge(typename std::set<CCTEdge<T> >::iterator edge) {
+  void removeEdge(EdgeIterator edge) {
+    if (_edge_removed[edge._index]) {
+      return;
+    }
     T from = edge->from;
     T to = edge->to;
+    uint64_t from_id = _node_ids[from];
+    uint64_t to_id = _node_ids[to];
     // Erase edges
-    _incoming_nodes[to].erase(from);
-    _outgoing_nodes[from].erase(to);
-    _edges.erase(edge);
+    eraseNeighbor(_incoming_nodes[to_id].second, from);
+    eraseNeighbor(_outgoing_nodes[from_id].second, to);
+    _edge_ids.erase((from_id << 32) | to_id);
+    _edge_removed[edge._index] = true;
+    --_edge_size;
     // XXX(Keren): do not erase nodes
   }
 
   void addNode(T node) {
-    if (_nodes.find(node) == _nodes.end()) {
-      _nodes.insert(node);
-    }
+    addNodeId(node);
   }
 
-  size_t size() {
+  size_t size() const {
     return _nodes.size();
   }  
 
-  size_t edge_size() {
-    return _edges.size();
+  size_t edge_size() const {
+    return _edge_size;
   }
 
   void clear() {
     _nodes.clear();
+    _node_ids.clear();
     _edges.clear();
+    _edge_removed.clear();
+    _edge_ids.clear();
+    _edge_size = 0;
     _incoming_nodes.clear();
     _outgoing_nodes.clear();
   }
 
  private:
+  size_t addNodeId(T node) {
+    auto iter = _node_ids.find(node);
+    if (iter != _node_ids.end()) {
+      return iter->second;
+    }
+    size_t id = _nodes.size();
+    _node_ids[node] = id;
+    _nodes.push_back(node);
+    _incoming_nodes.emplace_back(node, std::vector<T>());
+    _outgoing_nodes.emplace_back(node, std::vector<T>());
+    return id;
+  }
+
+  static void eraseNeighbor(std::vector<T> &neighbors, T node) {
+    for (size_t i = 0; i < neighbors.size(); ++i) {
+      if (neighbors[i] == node) {
+        neighbors.erase(neighbors.begin() + i);
+        return;
+      }
+    }
+  }
+
+ private:
+  std::vector<T> _nodes;
+  std::unordered_map<T, size_t> _node_ids;
+  // Indexed by node id
   NeighborNodeMap _incoming_nodes;
   NeighborNodeMap _outgoing_nodes;
-  typename std::set<CCTEdge<T> > _edges;
-  std::set<T> _nodes;
+  std::vector<CCTEdge<T> > _edges;
+  std::vector<bool> _edge_removed;
+  // <from id << 32 | to id, edge index>
+  std::unordered_map<uint64_t, size_t> _edge_ids;
+  size_t _edge_size;
 };
 
 }  // Analysis
@@ -780,6 +780,7 @@ mergeSCCNodes(CCTGraph<Prof::CCT::ANode *> *cct_graph, CCTGraph<Prof::CCT::ANode
   }
 
   // Add edges between SCCs
+  std::unordered_map<Prof::CCT::ANode *, Prof::CCT::ANode *> scc_nodes;
   for (auto it = cct_groups.begin(); it != cct_groups.end(); ++it) {
     Prof::CCT::ANode *scc_node = new Prof::CCT::SCC(NULL);
     auto &vec = it->second;
@@ -789,23 +790,21 @@ mergeSCCNodes(CCTGraph<Prof::CCT::ANode *> *cct_graph, CCTGraph<Prof::CCT::ANode
         cct_graph->addEdge(scc_node, n);
       } 
     }
-    auto *group = it->first;
-    for (auto eit = old_cct_graph->edgeBegin(); eit != old_cct_graph->edgeEnd(); ++eit) {
+    scc_nodes[it->first] = scc_node;
+  }
+
+  // Visit each edge once instead of once per group
+  for (auto eit = old_cct_graph->edgeBegin(); eit != old_cct_graph->edgeEnd(); ++eit) {
+    auto *from_group = cct_group_reverse_map[eit->from];
+    auto *to_group = cct_group_reverse_map[eit->to];
+    bool from_call = getCudaCallStmt(eit->from) != NULL;
+    if (from_call && from_group != to_group) {
       // call->scc
-      if (cct_group_reverse_map[eit->from] != group && getCudaCallStmt(eit->from) != NULL) {
-        bool find = false;
-        for (auto *n : vec) {
-          if (eit->to == n) {
-            find = true;
-            break;
-          }
-        }
-        if (find) {
-          // from->scc_in_node
-          cct_graph->addEdge(eit->from, scc_node);
-        }
-      } else if (cct_group_reverse_map[eit->to] != group && getCudaCallStmt(eit->to) != NULL) {
-        // proc->call
+      cct_graph->addEdge(eit->from, scc_nodes[to_group]);
+    }
+    if (getCudaCallStmt(eit->to) != NULL) {
+      // proc->call, seen from a group that does not contain the call
+      if ((from_call && from_group != to_group) || (!from_call && cct_groups.size() > 1)) {
         cct_graph->addEdge(eit->from, eit->to);
       }
     }
@@ -842,7 +841,7 @@ gatherIncomingSamples(CCTGraph<Prof::CCT::ANode *> *cct_graph, IncomingInstMap &
     Prof::CCT::ANode *node = *it;
     if ((find_recursion && isSCCNode(node)) || (!find_recursion && getProcStmt(node) != NULL)) {
       if (cct_graph->incoming_nodes(node) != cct_graph->incoming_nodes_end()) {
-        std::set<Prof::CCT::ANode *> &vec = cct_graph->incoming_nodes(node)->second;
+        auto &vec = cct_graph->incoming_nodes(node)->second;
         for (auto *neighbor : vec) {
           for (size_t i = 0; i < gpu_inst_index.size(); ++i) {
             node_map[node][neighbor][i] = neighbor->demandMetric(gpu_inst_index[i]);
@@ -1030,3 +1029,235 @@ deleteTree(Prof::CCT::ANode *prof_root) {
 } // namespace CallPath
 
 } // namespace Analysis
+
+
+// #define UNIT_TEST
+
+#ifdef UNIT_TEST
+
+// Benchmark and check: builds a call graph with the shape constructCallGraph
+// builds for a large GPU binary, procedures calling deeper procedures with a
+// few recursive calls.  Procedures are ProcFrm nodes backed by Struct::Proc
+// and call sites are Call nodes backed by CUDA call Struct::Stmt nodes, as in
+// a real profile, so getProcStmt and getCudaCallStmt see them.  Times
+// construction, findRecursion, mergeSCCNodes, and gatherIncomingSamples, and
+// checks that mergeSCCNodes adds the same edges as the per-group scan it
+// replaced.
+//
+// usage: a.out [procedures] [calls per procedure] [percent recursive calls]
+
+#include <chrono>
+#include <cstdlib>
+
+using namespace Analysis;
+using namespace Analysis::CallPath;
+
+typedef std::chrono::steady_clock BenchClock;
+
+typedef std::pair<bool, Prof::CCT::ANode *> GraphEnd;
+
+static double
+elapsedMs(BenchClock::time_point start, BenchClock::time_point end)
+{
+  return std::chrono::duration<double, std::milli>(end - start).count();
+}
+
+
+// mergeSCCNodes as it was: rescans every edge for each group
+static void
+mergeSCCNodesPerGroup(CCTGraph<Prof::CCT::ANode *> *cct_graph, CCTGraph<Prof::CCT::ANode *> *old_cct_graph,
+  std::unordered_map<Prof::CCT::ANode *, std::vector<Prof::CCT::ANode *> > &cct_groups) {
+  std::unordered_map<Prof::CCT::ANode *, Prof::CCT::ANode *> cct_group_reverse_map;
+  for (auto it = cct_groups.begin(); it != cct_groups.end(); ++it) {
+    for (auto *n : it->second) {
+      cct_group_reverse_map[n] = it->first;
+    }
+  }
+
+  for (auto it = cct_groups.begin(); it != cct_groups.end(); ++it) {
+    Prof::CCT::ANode *scc_node = new Prof::CCT::SCC(NULL);
+    auto &vec = it->second;
+    for (auto *n : vec) {
+      if (getProcStmt(n) != NULL) {
+        cct_graph->addEdge(scc_node, n);
+      }
+    }
+    auto *group = it->first;
+    for (auto eit = old_cct_graph->edgeBegin(); eit != old_cct_graph->edgeEnd(); ++eit) {
+      if (cct_group_reverse_map[eit->from] != group && getCudaCallStmt(eit->from) != NULL) {
+        if (std::find(vec.begin(), vec.end(), eit->to) != vec.end()) {
+          cct_graph->addEdge(eit->from, scc_node);
+        }
+      } else if (cct_group_reverse_map[eit->to] != group && getCudaCallStmt(eit->to) != NULL) {
+        cct_graph->addEdge(eit->from, eit->to);
+      }
+    }
+  }
+}
+
+
+// An SCC node has an edge to every procedure of its group and to nothing
+// else, so it is named by the group of its first successor
+static GraphEnd
+graphEnd(CCTGraph<Prof::CCT::ANode *> *cct_graph, Prof::CCT::ANode *node,
+  std::unordered_map<Prof::CCT::ANode *, Prof::CCT::ANode *> &group_of) {
+  if (!isSCCNode(node)) {
+    return GraphEnd(false, node);
+  }
+  auto iter = cct_graph->outgoing_nodes(node);
+  if (iter == cct_graph->outgoing_nodes_end() || iter->second.empty()) {
+    return GraphEnd(true, NULL);
+  }
+  return GraphEnd(true, group_of[iter->second.front()]);
+}
+
+
+static std::set<std::pair<GraphEnd, GraphEnd> >
+graphEdges(CCTGraph<Prof::CCT::ANode *> *cct_graph,
+  std::unordered_map<Prof::CCT::ANode *, Prof::CCT::ANode *> &group_of) {
+  std::set<std::pair<GraphEnd, GraphEnd> > edges;
+  for (auto eit = cct_graph->edgeBegin(); eit != cct_graph->edgeEnd(); ++eit) {
+    edges.insert(std::make_pair(graphEnd(cct_graph, eit->from, group_of),
+      graphEnd(cct_graph, eit->to, group_of)));
+  }
+  return edges;
+}
+
+
+// Procedure and call site nodes backed by structure, as in a real profile
+struct BenchNodes {
+  std::vector<Prof::CCT::ANode *> procs;
+  std::vector<Prof::CCT::ANode *> calls;
+};
+
+
+static void
+makeNodes(Prof::Struct::File *struct_file, int num_procs, int num_calls, BenchNodes &nodes)
+{
+  for (int i = 0; i < num_procs; ++i) {
+    std::string name = "proc" + std::to_string(nodes.procs.size());
+    auto *struct_proc = new Prof::Struct::Proc(name, struct_file, name, true);
+    nodes.procs.push_back(new Prof::CCT::ProcFrm(NULL, struct_proc));
+    for (int j = 0; j < num_calls; ++j) {
+      auto *stmt = new Prof::Struct::Stmt(struct_proc, j + 1, j + 1, 0, 0,
+        Prof::Struct::Stmt::STMT_CALL);
+      stmt->device("NVIDIA");
+      stmt->target(1);
+      auto *call = new Prof::CCT::Call(NULL, 0);
+      call->structure(stmt);
+      nodes.calls.push_back(call);
+    }
+  }
+}
+
+
+// Each call site calls a deeper procedure, or with the given percentage
+// one that is not deeper
+static CCTGraph<Prof::CCT::ANode *> *
+makeGraph(BenchNodes &nodes, int num_calls, int recursive)
+{
+  int num_procs = nodes.procs.size();
+  auto *cct_graph = new CCTGraph<Prof::CCT::ANode *>();
+  for (int i = 0; i < num_procs; ++i) {
+    for (int j = 0; j < num_calls; ++j) {
+      auto *call = nodes.calls[i * num_calls + j];
+      int callee = 0;
+      if (i + 1 < num_procs && rand() % 100 >= recursive) {
+        callee = i + 1 + rand() % (num_procs - i - 1);
+      } else {
+        callee = rand() % (i + 1);
+      }
+      cct_graph->addEdge(call, nodes.procs[callee]);
+      cct_graph->addEdge(nodes.procs[i], call);
+    }
+  }
+  return cct_graph;
+}
+
+
+// Does mergeSCCNodes add the same edges as the per-group scan?
+static bool
+checkMerge(CCTGraph<Prof::CCT::ANode *> *cct_graph)
+{
+  std::unordered_map<Prof::CCT::ANode *, std::vector<Prof::CCT::ANode *> > cct_groups;
+  if (!findRecursion(cct_graph, cct_groups)) {
+    return true;
+  }
+
+  std::unordered_map<Prof::CCT::ANode *, Prof::CCT::ANode *> group_of;
+  for (auto it = cct_groups.begin(); it != cct_groups.end(); ++it) {
+    for (auto *n : it->second) {
+      group_of[n] = it->first;
+    }
+  }
+
+  CCTGraph<Prof::CCT::ANode *> merged, per_group;
+  mergeSCCNodes(&merged, cct_graph, cct_groups);
+  mergeSCCNodesPerGroup(&per_group, cct_graph, cct_groups);
+  return merged.edge_size() > 0 &&
+    graphEdges(&merged, group_of) == graphEdges(&per_group, group_of);
+}
+
+
+int main(int argc, char **argv)
+{
+  int num_procs = argc > 1 ? atoi(argv[1]) : 100000;
+  int num_calls = argc > 2 ? atoi(argv[2]) : 8;
+  int recursive = argc > 3 ? atoi(argv[3]) : 1;
+
+  auto *struct_root = new Prof::Struct::Root("bench");
+  auto *struct_lm = new Prof::Struct::LM("bench.cubin", struct_root);
+  auto *struct_file = new Prof::Struct::File("bench.cu", struct_lm);
+
+  srand(1);
+
+  // The per-group scan is quadratic, so compare on small graphs
+  int checks = 0, differ = 0;
+  for (int seed = 0; seed < 30; ++seed) {
+    BenchNodes nodes;
+    makeNodes(struct_file, 50 + seed * 10, 1 + seed % 4, nodes);
+    auto *cct_graph = makeGraph(nodes, 1 + seed % 4, 5 + seed);
+    checks++;
+    if (!checkMerge(cct_graph)) {
+      differ++;
+    }
+    delete cct_graph;
+  }
+
+  BenchNodes nodes;
+  makeNodes(struct_file, num_procs, num_calls, nodes);
+
+  auto t0 = BenchClock::now();
+  auto *cct_graph = makeGraph(nodes, num_calls, recursive);
+
+  auto t1 = BenchClock::now();
+  std::unordered_map<Prof::CCT::ANode *, std::vector<Prof::CCT::ANode *> > cct_groups;
+  bool find_recursion = findRecursion(cct_graph, cct_groups);
+
+  auto t2 = BenchClock::now();
+  if (find_recursion) {
+    auto *old_cct_graph = cct_graph;
+    cct_graph = new CCTGraph<Prof::CCT::ANode *>();
+    mergeSCCNodes(cct_graph, old_cct_graph, cct_groups);
+    delete old_cct_graph;
+  }
+
+  auto t3 = BenchClock::now();
+  IncomingInstMap incoming_samples;
+  gatherIncomingSamples(cct_graph, incoming_samples, find_recursion);
+
+  auto t4 = BenchClock::now();
+
+  std::cout << "mergeSCCNodes and the per-group scan differ on " << differ << " of "
+    << checks << " graphs" << std::endl;
+  std::cout << "Nodes " << num_procs * (num_calls + 1) << ", groups " << cct_groups.size()
+    << ", edges " << cct_graph->edge_size() << std::endl;
+  std::cout << "construct " << elapsedMs(t0, t1) << " ms" << std::endl;
+  std::cout << "findRecursion " << elapsedMs(t1, t2) << " ms" << std::endl;
+  std::cout << "mergeSCCNodes " << elapsedMs(t2, t3) << " ms" << std::endl;
+  std::cout << "gatherIncomingSamples " << elapsedMs(t3, t4) << " ms" << std::endl;
+
+  return differ == 0 ? 0 : 1;
+}
+
+#endif
@@ -377,9 +377,20 @@ precomputeStructSimple(Prof::Struct::LM * lmStruct,
     return;
   }
 
+  // look up the source info of all the missing vmas in one pass
+  VmaVec missing;
   for (uint i = 0; i < vmaVec->size(); i++) {
     VMA vma = (*vmaVec)[i];
 
+    if (lmStruct->findStmt(vma) == NULL) {
+      missing.push_back(vma);
+    }
+  }
+  lm->cacheSrcCodeInfo(missing);
+
+  for (uint i = 0; i < missing.size(); i++) {
+    VMA vma = missing[i];
+
     if (lmStruct->findStmt(vma) == NULL) {
       BAnal::Struct::makeStructureSimple(lmStruct, lm, vma);
     }
@@ -12,7 +12,9 @@
 #include <bitset>
 #include <iomanip>
 #include <limits>
+#include <map>
 #include <queue>
+#include <set>
 #include <string>
 #include <typeinfo>
 #include <unordered_map>
@@ -266,6 +268,164 @@ void GPUAdvisor::advise(const CCTBlames &cct_blames) {
 }
 
 
+namespace {
+
+struct KernelResult {
+  std::vector<GPUAdvisor::AdviceTuple> advice;
+  std::vector<Prof::CCT::ANode *> nodes;
+};
+
+struct AdviseWork {
+  const std::vector<Prof::CCT::ADynNode *> *gpu_kernels;
+  // Kernel indices of each group in their original order
+  const std::vector<std::vector<size_t> > *groups;
+  std::vector<KernelResult> *results;
+  // Next group to take
+  size_t next;
+};
+
+struct AdviseWorkerArg {
+  GPUAdvisor *advisor;
+  AdviseWork *work;
+};
+
+}  // namespace
+
+
+void *GPUAdvisor::adviseWorker(void *arg) {
+  auto *worker_arg = static_cast<AdviseWorkerArg *>(arg);
+  auto *advisor = worker_arg->advisor;
+  auto *work = worker_arg->work;
+
+  size_t g;
+  while ((g = __sync_fetch_and_add(&work->next, 1)) < work->groups->size()) {
+    for (auto k : (*work->groups)[g]) {
+      auto *gpu_kernel = (*work->gpu_kernels)[k];
+      auto *gpu_root = dynamic_cast<Prof::CCT::ADynNode *>(gpu_kernel->parent());
+
+      advisor->configGPURoot(gpu_root, gpu_kernel);
+
+      CCTBlames cct_blames;
+      advisor->blame(cct_blames);
+      advisor->advise(cct_blames);
+
+      auto &result = (*work->results)[k];
+      result.advice.swap(advisor->_advice);
+      result.nodes.swap(advisor->_new_nodes);
+    }
+  }
+
+  return NULL;
+}
+
+
+void GPUAdvisor::adviseKernels(const std::vector<Prof::CCT::ADynNode *> &gpu_kernels,
+  int threads) {
+  if (threads <= 1 || gpu_kernels.size() <= 1) {
+    // Find each GPU calling context, make recommendation for each calling context
+    for (auto *gpu_kernel : gpu_kernels) {
+      auto *gpu_root = dynamic_cast<Prof::CCT::ADynNode *>(gpu_kernel->parent());
+
+      // Pass current gpu root
+      configGPURoot(gpu_root, gpu_kernel);
+
+      // <mpi_rank, <thread_id, <blames>>>
+      CCTBlames cct_blames;
+
+      // Blame latencies
+      blame(cct_blames);
+
+      // Make advise for the calling context and cache result
+      advise(cct_blames);
+    }
+    return;
+  }
+
+  // Blaming a kernel writes metrics to, and adds nodes under, its gpu root.
+  // Kernels whose roots nest in another kernel's root go to the group of the
+  // outermost root so that no two threads touch the same subtree.
+  std::set<Prof::CCT::ANode *> gpu_roots;
+  for (auto *gpu_kernel : gpu_kernels) {
+    gpu_roots.insert(gpu_kernel->parent());
+  }
+
+  std::map<Prof::CCT::ANode *, size_t> group_index;
+  std::vector<std::vector<size_t> > groups;
+  for (size_t k = 0; k < gpu_kernels.size(); ++k) {
+    Prof::CCT::ANode *top = gpu_kernels[k]->parent();
+    for (auto *node = top; node != NULL; node = node->parent()) {
+      if (gpu_roots.find(node) != gpu_roots.end()) {
+        top = node;
+      }
+    }
+    auto iter = group_index.find(top);
+    if (iter == group_index.end()) {
+      iter = group_index.insert(std::make_pair(top, groups.size())).first;
+      groups.emplace_back();
+    }
+    groups[iter->second].push_back(k);
+  }
+
+  size_t num_workers = std::min(static_cast<size_t>(threads), groups.size());
+
+  pthread_mutex_t node_lock;
+  pthread_mutex_init(&node_lock, NULL);
+
+  // Optimizers keep per-kernel state, so each thread has its own advisor
+  std::vector<GPUAdvisor *> workers;
+  for (size_t i = 0; i < num_workers; ++i) {
+    auto *worker = new GPUAdvisor(_prof, _metric_name_prof_map);
+    worker->init();
+    worker->configWorker(*this);
+    worker->_node_lock = &node_lock;
+    workers.push_back(worker);
+  }
+
+  std::vector<KernelResult> results(gpu_kernels.size());
+  AdviseWork work = { &gpu_kernels, &groups, &results, 0 };
+
+  std::vector<AdviseWorkerArg> worker_args(num_workers);
+  std::vector<pthread_t> tids(num_workers);
+  std::vector<bool> started(num_workers, false);
+  for (size_t i = 0; i < num_workers; ++i) {
+    worker_args[i].advisor = workers[i];
+    worker_args[i].work = &work;
+  }
+
+  // The calling thread is worker 0
+  for (size_t i = 1; i < num_workers; ++i) {
+    started[i] = pthread_create(&tids[i], NULL, adviseWorker, &worker_args[i]) == 0;
+  }
+  adviseWorker(&worker_args[0]);
+  for (size_t i = 1; i < num_workers; ++i) {
+    if (started[i]) {
+      pthread_join(tids[i], NULL);
+    }
+  }
+
+  pthread_mutex_destroy(&node_lock);
+
+  // Merge in kernel order and give new nodes the ids a serial run gives them
+  std::vector<Prof::CCT::ANode *> new_nodes;
+  std::vector<uint> new_ids;
+  for (auto &result : results) {
+    _advice.insert(_advice.end(), result.advice.begin(), result.advice.end());
+    for (auto *node : result.nodes) {
+      new_nodes.push_back(node);
+      new_ids.push_back(node->id());
+    }
+  }
+  std::sort(new_ids.begin(), new_ids.end());
+  for (size_t i = 0; i < new_nodes.size(); ++i) {
+    new_nodes[i]->id(new_ids[i]);
+  }
+
+  for (auto *worker : workers) {
+    delete worker;
+  }
+}
+
+
 std::vector<GPUAdvisor::AdviceTuple> GPUAdvisor::get_advice() {
   if (_advice.size() > 0) {
     std::sort(_advice.begin(), _advice.end(), [](
@@ -338,25 +338,17 @@ void GPUAdvisor::debugCCTDepGraphSinglePath(CCTGraph<Prof::CCT::ADynNode *> &cct
 }
 
 
-void GPUAdvisor::debugCCTDepPaths(CCTEdgePathMap &cct_edge_path_map) {
-  for (auto &from_iter : cct_edge_path_map) {
+void GPUAdvisor::debugCCTDepDistances(CCTEdgeDistanceMap &cct_edge_distance_map) {
+  for (auto &from_iter : cct_edge_distance_map) {
     auto from_vma = from_iter.first;
     for (auto &to_iter : from_iter.second) {
-      if (to_iter.second.size() == 0) {
-        // Skip zero path entries
+      if (to_iter.second < 0) {
+        // Skip entries without a path
         continue;
       }
       auto to_vma = to_iter.first;
       std::cout << debugInstOffset(from_vma) << " -> " <<
-        debugInstOffset(to_vma) << ": ";
-      for (auto &path : to_iter.second) {
-        std::cout << "[";
-        for (auto *b : path) {
-          auto front_vma = b->insts.front()->inst_stat->pc;
-          std::cout << debugInstOffset(front_vma) << ",";
-        }
-        std::cout << "]" << std::endl;
-      }
+        debugInstOffset(to_vma) << ": " << to_iter.second << std::endl;
     }
   }
 }
@@ -428,6 +420,25 @@ int GPUAdvisor::demandNodeMetric(int mpi_rank, int thread_id, Prof::CCT::ADynNod
 }
 
 
+Prof::CCT::ADynNode *GPUAdvisor::newStmtNode(Prof::CCT::ANode *parent, VMA vma) {
+  Prof::Metric::IData metric_data(_prof->metricMgr()->size());
+  metric_data.clearMetrics();
+
+  if (_node_lock == NULL) {
+    return new Prof::CCT::Stmt(parent, HPCRUN_FMT_CCTNodeId_NULL,
+      lush_assoc_info_NULL, _gpu_root->lmId(), vma, 0, NULL, metric_data);
+  }
+
+  // Node ids come from a global counter
+  pthread_mutex_lock(_node_lock);
+  auto *node = new Prof::CCT::Stmt(parent, HPCRUN_FMT_CCTNodeId_NULL,
+    lush_assoc_info_NULL, _gpu_root->lmId(), vma, 0, NULL, metric_data);
+  pthread_mutex_unlock(_node_lock);
+  _new_nodes.push_back(node);
+  return node;
+}
+
+
 void GPUAdvisor::attributeBlameMetric(int mpi_rank, int thread_id,
   Prof::CCT::ANode *node, const std::string &blame_name, double blame) {
   // inclusive and exclusive metrics have the same value
@@ -471,11 +482,7 @@ void GPUAdvisor::initCCTDepGraph(int mpi_rank, int thread_id, CCTGraph<Prof::CCT
         Prof::CCT::ADynNode *prof_node = NULL;
         if (vma_prop_iter->second.prof_node == NULL) {
           // Create a new prof node
-          Prof::Metric::IData metric_data(_prof->metricMgr()->size());
-          metric_data.clearMetrics();
-
-          prof_node = new Prof::CCT::Stmt(node->parent(), HPCRUN_FMT_CCTNodeId_NULL,
-            lush_assoc_info_NULL, _gpu_root->lmId(), vma, 0, NULL, metric_data);
+          prof_node = newStmtNode(node->parent(), vma);
           vma_prop_iter->second.prof_node = prof_node;
         } else {
           prof_node = vma_prop_iter->second.prof_node;
@@ -508,7 +515,7 @@ void GPUAdvisor::pruneCCTDepGraphOpcode(int mpi_rank, int thread_id,
   auto exec_dep_index = _metric_name_prof_map->metric_id(mpi_rank, thread_id, _exec_dep_lat_metric);
 
   // Opcode constraints
-  std::vector<std::set<CCTEdge<Prof::CCT::ADynNode *> >::iterator> remove_edges;
+  std::vector<CCTGraph<Prof::CCT::ADynNode *>::EdgeIterator> remove_edges;
   for (auto iter = cct_dep_graph.edgeBegin(); iter != cct_dep_graph.edgeEnd(); ++iter) {
     auto edge = *iter;
     auto *from = edge.from;
@@ -575,7 +582,7 @@ void GPUAdvisor::pruneCCTDepGraphBarrier(int mpi_rank, int thread_id,
   auto exec_dep_index = _metric_name_prof_map->metric_id(mpi_rank, thread_id, _exec_dep_lat_metric);
 
   // Opcode constraints
-  std::vector<std::set<CCTEdge<Prof::CCT::ADynNode *> >::iterator> remove_edges;
+  std::vector<CCTGraph<Prof::CCT::ADynNode *>::EdgeIterator> remove_edges;
   for (auto iter = cct_dep_graph.edgeBegin(); iter != cct_dep_graph.edgeEnd(); ++iter) {
     auto edge = *iter;
     auto *from = edge.from;
@@ -629,158 +636,26 @@ void GPUAdvisor::pruneCCTDepGraphBarrier(int mpi_rank, int thread_id,
 }
 
 
-// DFS procedure
-void GPUAdvisor::trackDep(int from_vma, int to_vma, int id,
-  CudaParse::Block *from_block, CudaParse::Block *to_block,
-  int latency_issue, int latency,
-  std::set<CudaParse::Block *> &visited_blocks,
-  std::vector<CudaParse::Block *> &path,
-  std::vector<std::vector<CudaParse::Block *>> &paths,
-  TrackType track_type, bool fixed) {
-  // The current block has been visited
-  if (visited_blocks.find(from_block) != visited_blocks.end()) {
-    return;
-  }
-  visited_blocks.insert(from_block);
-  path.push_back(from_block);
-
-  auto front_vma = from_block->insts.front()->inst_stat->pc;
-  auto back_vma = from_block->insts.back()->inst_stat->pc;
-
-  // Accumulate throughput
-  bool find_def = false;
-  bool hidden = false;
-  auto start_vma = front_vma;
-  auto end_vma = back_vma;
-
-  // [front_vma, from_vma, back_vma]
-  if (from_vma <= back_vma && from_vma >= front_vma) {
-    start_vma = from_vma + _arch->inst_size();
-  }
-
-  // [front_vma, to_vma, back_vma]
-  if (to_vma <= back_vma && to_vma >= front_vma) {
-    end_vma = to_vma - _arch->inst_size();
-  }
-
-  // If from_vma and to_vma are in the same block but from_vma >= to_vma
-  // It indicates we have a loop
-  bool loop_block = false;
-  if (from_vma <= back_vma && from_vma >= front_vma &&
-    to_vma <= back_vma && to_vma >= front_vma &&
-    from_vma >= to_vma) {
-    // It only happens in the first block
-    visited_blocks.erase(from_block);
-    end_vma = back_vma;
-    loop_block = true;
-  }
-
-  // Iterate inst until reaching the use inst
-  while (start_vma <= end_vma) {
-    auto *inst = _vma_prop_map.at(start_vma).inst;
-    // 1: instruction issue
-    if (fixed) {
-      latency_issue += 1;
-    } else {
-      latency_issue += inst->control.stall + 1;
-    }
-
-    // 1. id on path constraint
-    bool find = false;
-    if (track_type == TRACK_REG) {
-      find = inst->find_src_reg(id);
-    } else if (track_type == TRACK_PRED_REG) {
-      find = inst->find_src_pred_reg(id);
-    } else if (track_type == TRACK_PREDICATE) {
-      find = (inst->predicate == id || inst->find_src_pred_reg(id));
-    } else {  // track_type == TRACK_BARRIER
-      find = inst->find_src_barrier(id);
-    }
-
-    if (find && start_vma != (from_vma + _arch->inst_size())) {
-      find_def = true;
-      break;
-    }
-
-    // 2. Latency constraint
-    if (latency_issue >= latency) {
-      hidden = true;
-      break;
-    }
-
-    start_vma += _arch->inst_size();
-  }
-
-  // If we find a valid path
-  if (find_def == false && hidden == false) {
-    // Reach the final block
-    // [front_vma, to_vma, back_vma]
-    if (to_vma <= back_vma && to_vma >= front_vma && loop_block == false) {
-      paths.push_back(path);
-    } else {
-      for (auto *target : from_block->targets) {
-        if (target->type != CudaParse::TargetType::CALL) {
-          // We do not need from_vma anymore
-          trackDep(0, to_vma, id, target->block, to_block, latency_issue, latency,
-            visited_blocks, path, paths, track_type, fixed);
-        }
-      }
-    }
-  }
-
-  visited_blocks.erase(from_block);
-  path.pop_back();
-}
-
-
 void GPUAdvisor::trackDepInit(int to_vma, int from_vma,
-  int dst, CCTEdgePathMap &cct_edge_path_map, TrackType track_type, bool fixed) {
-  // Search for all possible paths from dst to src.
-  // Since the single path rate here is expected to be high,
-  // The following code section only executes few times.
+  int dst, CCTEdgeDistanceMap &cct_edge_distance_map,
+  GPUDepTracker::TrackType track_type, bool fixed) {
+  // Search for the longest path from dst to src.
   // Two constraints:
   // 1. A path is eliminated if an instruction on the way uses dst
   // 2. A path is eliminated if the throughput cycles is greater than latency
   auto *from_block = _vma_prop_map.at(from_vma).block;
-  auto *to_block = _vma_prop_map.at(to_vma).block;
-  std::set<CudaParse::Block *> visited_blocks;
-  std::vector<CudaParse::Block *> path;
-  std::vector<std::vector<CudaParse::Block *>> paths;
   auto latency = _vma_prop_map.at(from_vma).latency_upper;
-  trackDep(from_vma, to_vma, dst, from_block, to_block,
-    0, latency, visited_blocks, path, paths, track_type, fixed);
-
-  // Merge paths
-  for (auto &path : paths) {
-    bool new_path = true;
-    // Existing paths
-    for (auto &p : cct_edge_path_map[from_vma][to_vma]) {
-      if (path.size() != p.size()) {
-        continue;
-      }
-      // Same size paths, comparing every element
-      bool same_path = true;
-      for (size_t i = 0; i < p.size(); ++i) {
-        if (p[i] != path[i]) {
-          same_path = false;
-          break;
-        }
-      }
-      if (same_path == true) {
-        new_path = false;
-        break;
-      }
-    }
-    if (new_path == true) {
-      cct_edge_path_map[from_vma][to_vma].push_back(path);
-    }
-  }
+  auto distance = _dep_tracker->distance(from_vma, from_block, to_vma,
+    dst, track_type, fixed, latency);
+
+  auto &edge_distance = cct_edge_distance_map[from_vma][to_vma];
+  edge_distance = std::max(edge_distance, distance);
 }
 
 
 void GPUAdvisor::pruneCCTDepGraphLatency(int mpi_rank, int thread_id,
   CCTGraph<Prof::CCT::ADynNode *> &cct_dep_graph,
-  CCTEdgePathMap &cct_edge_path_map) {
+  CCTEdgeDistanceMap &cct_edge_distance_map) {
   // Profile single path coverage
   if (DEBUG_GPUADVISOR) {
     std::cout << "Single path coverage before latency constraints:" << std::endl;
@@ -791,7 +666,7 @@ void GPUAdvisor::pruneCCTDepGraphLatency(int mpi_rank, int thread_id,
   auto mem_dep_index = _metric_name_prof_map->metric_id(mpi_rank, thread_id, _mem_dep_lat_metric);
   auto exec_dep_index = _metric_name_prof_map->metric_id(mpi_rank, thread_id, _exec_dep_lat_metric);
 
-  std::vector<std::set<CCTEdge<Prof::CCT::ADynNode *> >::iterator> remove_edges;
+  std::vector<CCTGraph<Prof::CCT::ADynNode *>::EdgeIterator> remove_edges;
   for (auto iter = cct_dep_graph.edgeBegin(); iter != cct_dep_graph.edgeEnd(); ++iter) {
     auto edge = *iter;
     auto *from = edge.from;
@@ -802,12 +677,15 @@ void GPUAdvisor::pruneCCTDepGraphLatency(int mpi_rank, int thread_id,
     auto *from_inst = _vma_prop_map.at(from_vma).inst;
     bool fixed = from_inst->control.read == 0 && from_inst->control.write == 0;
 
+    // No path until one is found
+    cct_edge_distance_map[from_vma].emplace(to_vma, -1);
+
     // Regular regs
     for (auto dst : from_inst->dsts) {
       // Find the dst reg that causes dependency
       auto assign_iter = to_inst->assign_pcs.find(dst);
       if (assign_iter != to_inst->assign_pcs.end()) {
-        trackDepInit(to_vma, from_vma, dst, cct_edge_path_map, TRACK_REG, fixed);
+        trackDepInit(to_vma, from_vma, dst, cct_edge_distance_map, GPUDepTracker::TRACK_REG, fixed);
       }
     }
 
@@ -815,7 +693,7 @@ void GPUAdvisor::pruneCCTDepGraphLatency(int mpi_rank, int thread_id,
     for (auto pdst : from_inst->pdsts) {
       auto passign_iter = to_inst->passign_pcs.find(pdst);
       if (passign_iter != to_inst->passign_pcs.end()) {
-        trackDepInit(to_vma, from_vma, pdst, cct_edge_path_map, TRACK_PRED_REG, fixed);
+        trackDepInit(to_vma, from_vma, pdst, cct_edge_distance_map, GPUDepTracker::TRACK_PRED_REG, fixed);
       }
     }
 
@@ -824,7 +702,7 @@ void GPUAdvisor::pruneCCTDepGraphLatency(int mpi_rank, int thread_id,
       // Find the dst barrier that causes dependency
       auto bassign_iter = to_inst->bassign_pcs.find(bdst);
       if (bassign_iter != to_inst->bassign_pcs.end()) {
-        trackDepInit(to_vma, from_vma, bdst, cct_edge_path_map, TRACK_BARRIER, fixed);
+        trackDepInit(to_vma, from_vma, bdst, cct_edge_distance_map, GPUDepTracker::TRACK_BARRIER, fixed);
       }
     }
 
@@ -832,12 +710,12 @@ void GPUAdvisor::pruneCCTDepGraphLatency(int mpi_rank, int thread_id,
     for (auto pred_dst : from_inst->pdsts) {
       // Find the dst barrier that causes dependency
       if (to_inst->predicate == pred_dst) {
-        trackDepInit(to_vma, from_vma, pred_dst, cct_edge_path_map, TRACK_PREDICATE, fixed);
+        trackDepInit(to_vma, from_vma, pred_dst, cct_edge_distance_map, GPUDepTracker::TRACK_PREDICATE, fixed);
       }
     }
 
     // If there's no satisfied path
-    if (cct_edge_path_map[from_vma][to_vma].size() == 0) {
+    if (cct_edge_distance_map[from_vma][to_vma] < 0) {
       // This edge can be removed
       remove_edges.push_back(iter);
     }
@@ -860,8 +738,8 @@ void GPUAdvisor::pruneCCTDepGraphLatency(int mpi_rank, int thread_id,
   }
 
   if (DEBUG_GPUADVISOR_DETAILS) {
-    std::cout << "CCT dependency paths: " << std::endl;
-    debugCCTDepPaths(cct_edge_path_map);
+    std::cout << "CCT dependency distances: " << std::endl;
+    debugCCTDepDistances(cct_edge_distance_map);
     std::cout << std::endl;
   }
 
@@ -874,40 +752,6 @@ void GPUAdvisor::pruneCCTDepGraphLatency(int mpi_rank, int thread_id,
 }
 
 
-double GPUAdvisor::computePathInsts(
-  int mpi_rank, int thread_id, int from_vma, int to_vma,
-  std::vector<CudaParse::Block *> &path) {
-  double insts = 0.0;
-
-  _metric_name_prof_map->metric_id(mpi_rank, thread_id, _inst_metric, true);
-
-  for (size_t i = 0; i < path.size(); ++i) {
-    auto *block = path[i];
-    auto front_vma = block->insts.front()->inst_stat->pc;
-    auto back_vma = block->insts.back()->inst_stat->pc;
-    auto start_vma = front_vma; 
-    auto end_vma = back_vma;
-    if (i == 0) {
-      // Do not count the stall of the first inst
-      start_vma = from_vma + _arch->inst_size();
-    }
-    if (i == path.size() - 1) {
-      end_vma = to_vma;
-    }
-    insts += (end_vma - start_vma) / _arch->inst_size() + 1;
-    // XXX(Keren): which is more reasonable?
-    //for (auto j = start_vma; j <= end_vma; j += _arch->inst_size()) {
-    //  auto *prof_node = _vma_prop_map[j].prof_node;
-    //  if (prof_node != NULL) {
-    //    insts += prof_node->demandMetric(inst_metric_index);
-    //  }
-    //}
-  }
-
-  return insts;
-}
-
-
 void GPUAdvisor::reverseDistance(std::map<Prof::CCT::ADynNode *, double> &distance, std::map<Prof::CCT::ADynNode *, double> &insts) {
   Prof::CCT::ADynNode *pivot = NULL;
   double pivot_inst = 0.0;
@@ -1011,7 +855,7 @@ GPUAdvisor::detailizeMemBlame(CudaParse::InstructionStat *from_inst) {
 
 
 void GPUAdvisor::blameCCTDepGraph(int mpi_rank, int thread_id,
-  CCTGraph<Prof::CCT::ADynNode *> &cct_dep_graph, CCTEdgePathMap &cct_edge_path_map,
+  CCTGraph<Prof::CCT::ADynNode *> &cct_dep_graph, CCTEdgeDistanceMap &cct_edge_distance_map,
   InstBlames &inst_blames) {
   auto mem_stall_metric_index = _metric_name_prof_map->metric_id(
     mpi_rank, thread_id, _mem_dep_stall_metric);
@@ -1130,10 +974,8 @@ void GPUAdvisor::blameCCTDepGraph(int mpi_rank, int thread_id,
         
       for (auto *from_node : from_nodes) {
         auto from_vma = from_node->lmIP();
-        auto ps = cct_edge_path_map[from_vma][to_vma];
-
-        for (auto &path : ps) {
-          auto path_inst = computePathInsts(mpi_rank, thread_id, from_vma, to_vma, path);
+        auto path_inst = cct_edge_distance_map[from_vma][to_vma];
+        if (path_inst >= 0) {
           distance[from_node] = MAX2(distance[from_node], path_inst);
         }
         auto issue = from_node->demandMetric(issue_metric_index);
@@ -1255,11 +1097,7 @@ void GPUAdvisor::blameCCTDepGraph(int mpi_rank, int thread_id,
 
     if (sync_node == NULL) {
       // Create a new prof node
-      Prof::Metric::IData metric_data(_prof->metricMgr()->size());
-      metric_data.clearMetrics();
-
-      sync_node = new Prof::CCT::Stmt(to_node->parent(), HPCRUN_FMT_CCTNodeId_NULL,
-        lush_assoc_info_NULL, _gpu_root->lmId(), sync_vma, 0, NULL, metric_data);
+      sync_node = newStmtNode(to_node->parent(), sync_vma);
     }
 
     auto stall_blame_name = "BLAME " + _sync_stall_metric;
@@ -1377,8 +1215,8 @@ void GPUAdvisor::blame(CCTBlames &cct_blames) {
       }
 
       // 2.3 Issue constraints
-      CCTEdgePathMap cct_edge_path_map;
-      pruneCCTDepGraphLatency(mpi_rank, thread_id, cct_dep_graph, cct_edge_path_map);
+      CCTEdgeDistanceMap cct_edge_distance_map;
+      pruneCCTDepGraphLatency(mpi_rank, thread_id, cct_dep_graph, cct_edge_distance_map);
 
       if (DEBUG_GPUADVISOR_DETAILS) {
         std::cout << "CCT dependency graph after latency pruning: " << std::endl;
@@ -1401,7 +1239,7 @@ void GPUAdvisor::blame(CCTBlames &cct_blames) {
       // 3. Accumulate blames and record significant pairs and paths
       // Apportion based on block latency coverage and def inst issue count
       InstBlames inst_blames;
-      blameCCTDepGraph(mpi_rank, thread_id, cct_dep_graph, cct_edge_path_map, inst_blames);
+      blameCCTDepGraph(mpi_rank, thread_id, cct_dep_graph, cct_edge_distance_map, inst_blames);
 
       if (DEBUG_GPUADVISOR) {
         std::cout << "Inst blames: " << std::endl;
@@ -72,6 +72,7 @@ void GPUAdvisor::init() {
   // TODO(Keren): Find device tag under the root and use the corresponding archtecture
   // Problem: currently we only have device tags for call instructions
   this->_arch = new V100(); 
+  this->_dep_tracker = new GPUDepTracker(_arch->inst_size());
 
   // Init individual metrics
   _issue_metric = GPU_INST_METRIC_NAME":LAT_NONE";
@@ -252,6 +253,8 @@ void GPUAdvisor::configInst(const std::string &lm_name, const std::vector<CudaPa
   _vma_prop_map.clear();
   _inst_dep_graph.clear();
   _function_offset.clear();
+  // Memoized searches refer to blocks of the previous module
+  _dep_tracker->clear();
 
   // Property map
   for (auto *function : functions) {
@@ -337,6 +340,15 @@ void GPUAdvisor::configInst(const std::string &lm_name, const std::vector<CudaPa
 }
 
 
+void GPUAdvisor::configWorker(const GPUAdvisor &advisor) {
+  _vma_prop_map = advisor._vma_prop_map;
+  _vma_struct_map = advisor._vma_struct_map;
+  _inst_dep_graph = advisor._inst_dep_graph;
+  _function_offset = advisor._function_offset;
+  _dep_tracker->clear();
+}
+
+
 void GPUAdvisor::configGPURoot(Prof::CCT::ADynNode *gpu_root, Prof::CCT::ADynNode *gpu_kernel) {
   // Update current root
   this->_gpu_root = gpu_root;
@@ -71,6 +71,8 @@
 #include <queue>
 #include <tuple>
 
+#include <pthread.h>
+
 //*************************** User Include Files ****************************
 
 #include <include/uint.h>
@@ -88,6 +90,7 @@
 #include "GPUOptimizer.hpp"
 #include "GPUEstimator.hpp"
 #include "GPUArchitecture.hpp"
+#include "GPUDepTracker.hpp"
 
 //*************************** Forward Declarations ***************************
 
@@ -103,7 +106,8 @@ class GPUAdvisor {
  public:
   explicit GPUAdvisor(Prof::CallPath::Profile *prof, MetricNameProfMap *metric_name_prof_map) :
     _prof(prof), _metric_name_prof_map(metric_name_prof_map),
-    _gpu_root(NULL), _gpu_kernel(NULL), _arch(NULL) {}
+    _gpu_root(NULL), _gpu_kernel(NULL), _arch(NULL), _dep_tracker(NULL),
+    _node_lock(NULL) {}
 
   MetricNameProfMap *metric_name_prof_map() {
     return this->_metric_name_prof_map;
@@ -119,6 +123,11 @@ class GPUAdvisor {
 
   void advise(const CCTBlames &cct_blames);
 
+  // Blame and advise each kernel in turn, on up to 'threads' threads.
+  // Kernels whose calling contexts are nested share CCT nodes and are
+  // analyzed by the same thread, in order.
+  void adviseKernels(const std::vector<Prof::CCT::ADynNode *> &gpu_kernels, int threads);
+
   std::vector<AdviceTuple> get_advice();
  
   ~GPUAdvisor() {
@@ -137,12 +146,16 @@ class GPUAdvisor {
     if (_arch) {
       delete _arch;
     }
+    if (_dep_tracker) {
+      delete _dep_tracker;
+    }
   }
 
  private:
   typedef std::map<double, std::vector<GPUOptimizer *>, std::greater<double>> OptimizerRank;
 
-  typedef std::map<int, std::map<int, std::vector<std::vector<CudaParse::Block *> > > > CCTEdgePathMap;
+  // <from_vma, <to_vma, instructions on the longest valid path, or -1> >
+  typedef std::map<int, std::map<int, int> > CCTEdgeDistanceMap;
 
   struct VMAProperty {
     VMA vma;
@@ -163,13 +176,6 @@ class GPUAdvisor {
 
   typedef std::map<VMA, Prof::Struct::Stmt *> VMAStructureMap;
 
-  enum TrackType {
-    TRACK_REG = 0,
-    TRACK_PRED_REG = 1,
-    TRACK_PREDICATE = 2,
-    TRACK_BARRIER = 3
-  };
-
  private:
   void attributeBlameMetric(int mpi_rank, int thread_id,
     Prof::CCT::ANode *node, const std::string &blame_name, double blame);
@@ -185,20 +191,11 @@ class GPUAdvisor {
 
   void pruneCCTDepGraphLatency(int mpi_rank, int thread_id,
     CCTGraph<Prof::CCT::ADynNode *> &cct_dep_graph,
-    CCTEdgePathMap &cct_edge_path_map);
-
-  void trackDep(int to_vma, int from_vma, int reg,
-    CudaParse::Block *to_block, CudaParse::Block *from_block,
-    int latency_issue, int latency, std::set<CudaParse::Block *> &visited_blocks,
-    std::vector<CudaParse::Block *> &path,
-    std::vector<std::vector<CudaParse::Block *>> &paths,
-    TrackType track_type, bool fixed);
+    CCTEdgeDistanceMap &cct_edge_distance_map);
 
   void trackDepInit(int to_vma, int from_vma,
-    int dst, CCTEdgePathMap &cct_edge_path_map, TrackType track_type, bool fixed);
-
-  double computePathInsts(int mpi_rank, int thread_id, int from_vma, int to_vma,
-    std::vector<CudaParse::Block *> &path);
+    int dst, CCTEdgeDistanceMap &cct_edge_distance_map,
+    GPUDepTracker::TrackType track_type, bool fixed);
 
   void reverseDistance(std::map<Prof::CCT::ADynNode *, double> &distance,
     std::map<Prof::CCT::ADynNode *, double> &insts);
@@ -212,7 +209,7 @@ class GPUAdvisor {
 
   void blameCCTDepGraph(int mpi_rank, int thread_id,
     CCTGraph<Prof::CCT::ADynNode *> &cct_dep_graph,
-    CCTEdgePathMap &cct_edge_path_map,
+    CCTEdgeDistanceMap &cct_edge_distance_map,
     InstBlames &inst_blames);
 
   void detailizeInstBlames(InstBlames &inst_blames);
@@ -222,6 +219,13 @@ class GPUAdvisor {
   KernelStats readKernelStats(int mpi_rank, int thread_id);
 
   void concatAdvice(const OptimizerRank &optimizer_rank);
+
+  // Copy the module configured by configInst from advisor
+  void configWorker(const GPUAdvisor &advisor);
+
+  static void *adviseWorker(void *arg);
+
+  Prof::CCT::ADynNode *newStmtNode(Prof::CCT::ANode *parent, VMA vma);
   
   // Helper functions
   int demandNodeMetric(int mpi_rank, int thread_id, Prof::CCT::ADynNode *node);
@@ -230,7 +234,7 @@ class GPUAdvisor {
 
   void debugInstDepGraph();
 
-  void debugCCTDepPaths(CCTEdgePathMap &cct_edge_path_map);
+  void debugCCTDepDistances(CCTEdgeDistanceMap &cct_edge_distance_map);
 
   void debugCCTDepGraphSummary(int mpi_rank, int thread_id, CCTGraph<Prof::CCT::ADynNode *> &cct_dep_graph);
 
@@ -322,6 +326,12 @@ class GPUAdvisor {
 
   GPUArchitecture *_arch;
 
+  GPUDepTracker *_dep_tracker;
+
+  // Set for workers of adviseKernels, which create CCT nodes concurrently
+  pthread_mutex_t *_node_lock;
+  std::vector<Prof::CCT::ANode *> _new_nodes;
+
   KernelStats _kernel_stats;
  
   std::vector<AdviceTuple> _advice;
@@ -0,0 +1,567 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2018, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   [The purpose of this file]
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+//************************* System Include Files ****************************
+
+#include <algorithm>
+#include <climits>
+
+//*************************** User Include Files ****************************
+
+#include "GPUDepTracker.hpp"
+
+//*************************** Forward Declarations ***************************
+
+//****************************************************************************
+
+namespace Analysis {
+
+int GPUDepTracker::distance(int from_vma, CudaParse::Block *from_block, int to_vma,
+  int id, TrackType track_type, bool fixed, int latency) {
+  Search s;
+  s.from_vma = from_vma;
+  s.to_vma = to_vma;
+  s.id = id;
+  s.track_type = track_type;
+  s.fixed = fixed;
+  s.latency = latency;
+  s.memo = &_memo[UseKey(to_vma, id, track_type, fixed)];
+
+  Result result;
+  search(s, from_block, true, latency, 0, result);
+  return result.distance;
+}
+
+
+size_t GPUDepTracker::memo_size() const {
+  size_t size = 0;
+  for (auto &use_iter : _memo) {
+    for (auto &iter : use_iter.second) {
+      size += iter.second.size();
+    }
+  }
+  return size;
+}
+
+
+bool GPUDepTracker::onPath(const Search &s,
+  const std::vector<CudaParse::Block *> &blocks) const {
+  if (s.path.size() < blocks.size()) {
+    for (auto &iter : s.path) {
+      if (std::binary_search(blocks.begin(), blocks.end(), iter.first)) {
+        return true;
+      }
+    }
+  } else {
+    for (auto *block : blocks) {
+      if (s.path.find(block) != s.path.end()) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+
+// DFS procedure
+//
+// A search that never ran into a block above 'depth' on the path does not
+// depend on how the path got here, only on which blocks it is made of.
+// Such a search is memoized with the blocks it looked at, and can be
+// reused from any path that avoids all of them.
+//
+// Latency only matters through the comparisons that decide whether a
+// path is hidden, so the search also records the range of latency left
+// for which all of them come out the same.
+void GPUDepTracker::search(Search &s, CudaParse::Block *block, bool first,
+  int latency_left, int depth, Result &result) {
+  result.distance = -1;
+  result.low = INT_MAX;
+  result.latency_lo = INT_MIN / 2;
+  result.latency_hi = INT_MAX / 2;
+  result.blocks.clear();
+
+  // The current block has been visited
+  auto path_iter = s.path.find(block);
+  if (path_iter != s.path.end()) {
+    result.low = path_iter->second;
+    result.blocks.push_back(block);
+    return;
+  }
+
+  if (!first) {
+    auto memo_iter = s.memo->find(block);
+    if (memo_iter != s.memo->end()) {
+      for (auto &memo : memo_iter->second) {
+        if (latency_left > memo.latency_lo && latency_left <= memo.latency_hi &&
+          !onPath(s, memo.blocks)) {
+          result = memo;
+          return;
+        }
+      }
+    }
+  }
+
+  // We do not need from_vma after the first block
+  auto from_vma = first ? s.from_vma : 0;
+  auto to_vma = s.to_vma;
+
+  auto front_vma = block->insts.front()->inst_stat->pc;
+  auto back_vma = block->insts.back()->inst_stat->pc;
+
+  auto start_vma = front_vma;
+  auto end_vma = back_vma;
+
+  // [front_vma, from_vma, back_vma]
+  bool has_from = from_vma <= back_vma && from_vma >= front_vma;
+  if (has_from) {
+    start_vma = from_vma + _inst_size;
+  }
+
+  // [front_vma, to_vma, back_vma]
+  bool has_to = to_vma <= back_vma && to_vma >= front_vma;
+  if (has_to) {
+    end_vma = to_vma - _inst_size;
+  }
+
+  // If from_vma and to_vma are in the same block but from_vma >= to_vma
+  // It indicates we have a loop, and the block may be entered again
+  bool loop_block = has_from && has_to && from_vma >= to_vma;
+  if (loop_block) {
+    end_vma = back_vma;
+  } else {
+    s.path[block] = depth;
+  }
+
+  // Iterate inst until reaching the use inst
+  bool find_def = false;
+  bool hidden = false;
+  int latency_issue = 0;
+  for (auto *_inst : block->insts) {
+    auto *inst = _inst->inst_stat;
+    if (inst->pc < start_vma || inst->pc > end_vma) {
+      continue;
+    }
+
+    // 1: instruction issue
+    if (s.fixed) {
+      latency_issue += 1;
+    } else {
+      latency_issue += inst->control.stall + 1;
+    }
+
+    // 1. id on path constraint
+    bool find = false;
+    if (s.track_type == TRACK_REG) {
+      find = inst->find_src_reg(s.id);
+    } else if (s.track_type == TRACK_PRED_REG) {
+      find = inst->find_src_pred_reg(s.id);
+    } else if (s.track_type == TRACK_PREDICATE) {
+      find = (inst->predicate == s.id || inst->find_src_pred_reg(s.id));
+    } else {  // track_type == TRACK_BARRIER
+      find = inst->find_src_barrier(s.id);
+    }
+
+    if (find && inst->pc != (from_vma + _inst_size)) {
+      find_def = true;
+      break;
+    }
+
+    // 2. Latency constraint
+    if (latency_issue >= latency_left) {
+      result.latency_hi = std::min(result.latency_hi, latency_issue);
+      hidden = true;
+      break;
+    }
+    result.latency_lo = std::max(result.latency_lo, latency_issue);
+  }
+
+  // Instructions counted on the path: after the def in the first block,
+  // up to the use in the last block
+  auto count_begin = first ? s.from_vma + _inst_size : front_vma;
+
+  if (find_def == false && hidden == false) {
+    if (has_to && loop_block == false) {
+      // Reach the final block
+      result.distance = (to_vma - count_begin) / _inst_size + 1;
+    } else {
+      auto insts = (back_vma - count_begin) / _inst_size + 1;
+      Result target_result;
+      for (auto *target : block->targets) {
+        if (target->type != CudaParse::TargetType::CALL) {
+          search(s, target->block, false, latency_left - latency_issue,
+            depth + 1, target_result);
+          result.low = std::min(result.low, target_result.low);
+          result.latency_lo = std::max(result.latency_lo,
+            target_result.latency_lo + latency_issue);
+          result.latency_hi = std::min(result.latency_hi,
+            target_result.latency_hi + latency_issue);
+          result.blocks.insert(result.blocks.end(),
+            target_result.blocks.begin(), target_result.blocks.end());
+          if (target_result.distance >= 0) {
+            result.distance = std::max(result.distance, target_result.distance + insts);
+          }
+        }
+      }
+    }
+  }
+
+  if (loop_block == false) {
+    s.path.erase(block);
+  }
+
+  result.blocks.push_back(block);
+  std::sort(result.blocks.begin(), result.blocks.end());
+  result.blocks.erase(std::unique(result.blocks.begin(), result.blocks.end()),
+    result.blocks.end());
+
+  if (!first && !loop_block && result.low >= depth) {
+    (*s.memo)[block].push_back(result);
+    // Reused from other paths, where it ran into nothing
+    (*s.memo)[block].back().low = INT_MAX;
+  }
+}
+
+}  // namespace Analysis
+
+
+//****************************************************************************
+// unit test
+//****************************************************************************
+// #define UNIT_TEST
+
+#ifdef UNIT_TEST
+
+// Regression harness: replays every def-use pair of recorded instruction
+// files (hpcstruct --gpucfg yes) through the memoized search and through
+// the exhaustive path enumeration it replaced, and reports differences.
+// With -m, only the memoized search runs.
+
+#include <chrono>
+#include <iostream>
+#include <set>
+
+#include <lib/cuda/AnalyzeInstruction.hpp>
+
+#include "GPUArchitecture.hpp"
+
+using namespace Analysis;
+
+typedef std::map<int, std::pair<CudaParse::InstructionStat *, CudaParse::Block *> > InstMap;
+
+static int inst_size = 0;
+
+
+// Enumerates all valid paths
+static void
+trackDepAll(InstMap &insts, int from_vma, int to_vma, int id,
+  CudaParse::Block *from_block, int latency_issue, int latency,
+  std::set<CudaParse::Block *> &visited_blocks,
+  std::vector<CudaParse::Block *> &path,
+  std::vector<std::vector<CudaParse::Block *>> &paths,
+  GPUDepTracker::TrackType track_type, bool fixed)
+{
+  if (visited_blocks.find(from_block) != visited_blocks.end()) {
+    return;
+  }
+  visited_blocks.insert(from_block);
+  path.push_back(from_block);
+
+  int front_vma = from_block->insts.front()->inst_stat->pc;
+  int back_vma = from_block->insts.back()->inst_stat->pc;
+  bool find_def = false;
+  bool hidden = false;
+  int start_vma = front_vma;
+  int end_vma = back_vma;
+
+  if (from_vma <= back_vma && from_vma >= front_vma) {
+    start_vma = from_vma + inst_size;
+  }
+  if (to_vma <= back_vma && to_vma >= front_vma) {
+    end_vma = to_vma - inst_size;
+  }
+  bool loop_block = false;
+  if (from_vma <= back_vma && from_vma >= front_vma &&
+    to_vma <= back_vma && to_vma >= front_vma && from_vma >= to_vma) {
+    visited_blocks.erase(from_block);
+    end_vma = back_vma;
+    loop_block = true;
+  }
+
+  while (start_vma <= end_vma) {
+    auto *inst = insts.at(start_vma).first;
+    latency_issue += fixed ? 1 : inst->control.stall + 1;
+
+    bool find = false;
+    if (track_type == GPUDepTracker::TRACK_REG) {
+      find = inst->find_src_reg(id);
+    } else if (track_type == GPUDepTracker::TRACK_PRED_REG) {
+      find = inst->find_src_pred_reg(id);
+    } else if (track_type == GPUDepTracker::TRACK_PREDICATE) {
+      find = (inst->predicate == id || inst->find_src_pred_reg(id));
+    } else {
+      find = inst->find_src_barrier(id);
+    }
+
+    if (find && start_vma != (from_vma + inst_size)) {
+      find_def = true;
+      break;
+    }
+    if (latency_issue >= latency) {
+      hidden = true;
+      break;
+    }
+    start_vma += inst_size;
+  }
+
+  if (find_def == false && hidden == false) {
+    if (to_vma <= back_vma && to_vma >= front_vma && loop_block == false) {
+      paths.push_back(path);
+    } else {
+      for (auto *target : from_block->targets) {
+        if (target->type != CudaParse::TargetType::CALL) {
+          trackDepAll(insts, 0, to_vma, id, target->block, latency_issue, latency,
+            visited_blocks, path, paths, track_type, fixed);
+        }
+      }
+    }
+  }
+
+  visited_blocks.erase(from_block);
+  path.pop_back();
+}
+
+
+static int
+pathInsts(int from_vma, int to_vma, std::vector<CudaParse::Block *> &path)
+{
+  int insts = 0;
+  for (size_t i = 0; i < path.size(); ++i) {
+    int start_vma = path[i]->insts.front()->inst_stat->pc;
+    int end_vma = path[i]->insts.back()->inst_stat->pc;
+    if (i == 0) {
+      start_vma = from_vma + inst_size;
+    }
+    if (i == path.size() - 1) {
+      end_vma = to_vma;
+    }
+    insts += (end_vma - start_vma) / inst_size + 1;
+  }
+  return insts;
+}
+
+
+static int
+distanceAll(InstMap &insts, int from_vma, int to_vma, int id,
+  GPUDepTracker::TrackType track_type, bool fixed, int latency)
+{
+  std::set<CudaParse::Block *> visited_blocks;
+  std::vector<CudaParse::Block *> path;
+  std::vector<std::vector<CudaParse::Block *>> paths;
+  trackDepAll(insts, from_vma, to_vma, id, insts.at(from_vma).second, 0, latency,
+    visited_blocks, path, paths, track_type, fixed);
+
+  int distance = -1;
+  for (auto &p : paths) {
+    distance = std::max(distance, pathInsts(from_vma, to_vma, p));
+  }
+  return distance;
+}
+
+
+// Calls f(id, track_type) for each id through which from_inst reaches to_inst
+template <typename F>
+static void
+forEachDep(CudaParse::InstructionStat *from_inst,
+  CudaParse::InstructionStat *to_inst, F f)
+{
+  for (auto dst : from_inst->dsts) {
+    if (to_inst->assign_pcs.find(dst) != to_inst->assign_pcs.end()) {
+      f(dst, GPUDepTracker::TRACK_REG);
+    }
+  }
+  for (auto pdst : from_inst->pdsts) {
+    if (to_inst->passign_pcs.find(pdst) != to_inst->passign_pcs.end()) {
+      f(pdst, GPUDepTracker::TRACK_PRED_REG);
+    }
+  }
+  for (auto bdst : from_inst->bdsts) {
+    if (to_inst->bassign_pcs.find(bdst) != to_inst->bassign_pcs.end()) {
+      f(bdst, GPUDepTracker::TRACK_BARRIER);
+    }
+  }
+  for (auto pred_dst : from_inst->pdsts) {
+    if (to_inst->predicate == pred_dst) {
+      f(pred_dst, GPUDepTracker::TRACK_PREDICATE);
+    }
+  }
+}
+
+
+int main(int argc, char **argv)
+{
+  bool compare = !(argc > 1 && std::string(argv[1]) == "-m");
+  int first_file = compare ? 1 : 2;
+  if (argc <= first_file) {
+    std::cerr << "usage: " << argv[0] << " [-m] <instruction json>..." << std::endl;
+    return 1;
+  }
+
+  V100 arch;
+  inst_size = arch.inst_size();
+  int mismatches = 0;
+  int unreadable = 0;
+
+  for (int i = first_file; i < argc; ++i) {
+    std::vector<CudaParse::Function *> functions;
+    if (!CudaParse::readCudaInstructions(argv[i], functions)) {
+      std::cerr << argv[i] << ": cannot read instruction file" << std::endl;
+      ++unreadable;
+      continue;
+    }
+    CudaParse::relocateCudaInstructionStats(functions);
+
+    InstMap insts;
+    for (auto *function : functions) {
+      for (auto *block : function->blocks) {
+        for (auto *inst : block->insts) {
+          insts[inst->inst_stat->pc] = std::make_pair(inst->inst_stat, block);
+        }
+      }
+    }
+
+    // <from_vma, to_vma>
+    std::set<std::pair<int, int> > deps;
+    for (auto &iter : insts) {
+      auto *inst = iter.second.first;
+      for (auto *assign_pcs : { &inst->assign_pcs, &inst->passign_pcs, &inst->bassign_pcs }) {
+        for (auto &assign_iter : *assign_pcs) {
+          for (auto pc : assign_iter.second) {
+            deps.insert(std::make_pair(pc, iter.first));
+          }
+        }
+      }
+      for (auto pc : inst->predicate_assign_pcs) {
+        deps.insert(std::make_pair(pc, iter.first));
+      }
+    }
+
+    std::map<std::pair<int, int>, int> all_distances;
+    std::map<std::pair<int, int>, int> memo_distances;
+
+    auto t0 = std::chrono::steady_clock::now();
+
+    for (auto &dep : deps) {
+      if (!compare) {
+        break;
+      }
+      auto *from_inst = insts.at(dep.first).first;
+      auto *to_inst = insts.at(dep.second).first;
+      bool fixed = from_inst->control.read == 0 && from_inst->control.write == 0;
+      int latency = arch.latency(from_inst->op).second;
+      int &distance = all_distances[dep];
+      distance = -1;
+      forEachDep(from_inst, to_inst, [&](int id, GPUDepTracker::TrackType track_type) {
+        distance = std::max(distance, distanceAll(insts, dep.first, dep.second,
+          id, track_type, fixed, latency));
+      });
+    }
+
+    auto t1 = std::chrono::steady_clock::now();
+
+    GPUDepTracker tracker(inst_size);
+    for (auto &dep : deps) {
+      auto *from_inst = insts.at(dep.first).first;
+      auto *to_inst = insts.at(dep.second).first;
+      auto *from_block = insts.at(dep.first).second;
+      bool fixed = from_inst->control.read == 0 && from_inst->control.write == 0;
+      int latency = arch.latency(from_inst->op).second;
+      int &distance = memo_distances[dep];
+      distance = -1;
+      forEachDep(from_inst, to_inst, [&](int id, GPUDepTracker::TrackType track_type) {
+        distance = std::max(distance, tracker.distance(dep.first, from_block, dep.second,
+          id, track_type, fixed, latency));
+      });
+    }
+
+    auto t2 = std::chrono::steady_clock::now();
+
+    int file_mismatches = 0;
+    for (auto &iter : all_distances) {
+      if (memo_distances[iter.first] != iter.second) {
+        if (file_mismatches++ < 10) {
+          std::cout << "  0x" << std::hex << iter.first.first << " -> 0x" <<
+            iter.first.second << std::dec << ": " << iter.second << " != " <<
+            memo_distances[iter.first] << std::endl;
+        }
+      }
+    }
+    mismatches += file_mismatches;
+
+    std::cout << argv[i] << ": " << deps.size() << " deps, " <<
+      file_mismatches << " mismatches, paths " <<
+      std::chrono::duration<double, std::milli>(t1 - t0).count() << " ms, memoized " <<
+      std::chrono::duration<double, std::milli>(t2 - t1).count() << " ms (" <<
+      tracker.memo_size() << " entries)" << std::endl;
+  }
+
+  return mismatches == 0 && unreadable == 0 ? 0 : 1;
+}
+
+#endif
@@ -0,0 +1,153 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2018, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   Latency-bounded search for the paths along which a def reaches a use
+//
+// Description:
+//   A path from a def to a use is valid if no instruction on it reads the
+//   tracked id and the issue cycles along it stay below the latency of
+//   the def.  Blocks are not repeated, except that a def in a loop may
+//   reach a use above it in its own block.
+//
+//   Searches from a block are memoized per use and id, along with the
+//   range of latency left over which they take the same turns, and reused
+//   while none of the blocks they visited is on the path.
+//
+//***************************************************************************
+
+#ifndef Analysis_Advisor_GPUDepTracker_hpp
+#define Analysis_Advisor_GPUDepTracker_hpp
+
+//************************* System Include Files ****************************
+
+#include <map>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+//*************************** User Include Files ****************************
+
+#include <lib/cuda/DotCFG.hpp>
+
+//*************************** Forward Declarations ***************************
+
+//****************************************************************************
+
+namespace Analysis {
+
+class GPUDepTracker {
+ public:
+  enum TrackType {
+    TRACK_REG = 0,
+    TRACK_PRED_REG = 1,
+    TRACK_PREDICATE = 2,
+    TRACK_BARRIER = 3
+  };
+
+ public:
+  explicit GPUDepTracker(int inst_size) : _inst_size(inst_size) {}
+
+  // Largest number of instructions after from_vma up to and including
+  // to_vma on a valid path, or -1 if there is no valid path
+  int distance(int from_vma, CudaParse::Block *from_block, int to_vma,
+    int id, TrackType track_type, bool fixed, int latency);
+
+  // Drop memoized searches; blocks of a previous kernel may be gone
+  void clear() {
+    _memo.clear();
+  }
+
+  size_t memo_size() const;
+
+ private:
+  struct Result {
+    int distance;
+    // Smallest depth of a block on the path that the search ran into
+    int low;
+    // The same result holds for latency left in (latency_lo, latency_hi]
+    int latency_lo;
+    int latency_hi;
+    // Blocks the search looked at, sorted
+    std::vector<CudaParse::Block *> blocks;
+  };
+
+  // <to_vma, id, track_type, fixed>
+  typedef std::tuple<int, int, int, bool> UseKey;
+
+  typedef std::unordered_map<CudaParse::Block *, std::vector<Result> > MemoMap;
+
+  struct Search {
+    int from_vma;
+    int to_vma;
+    int id;
+    TrackType track_type;
+    bool fixed;
+    int latency;
+    // blocks on the path -> depth
+    std::unordered_map<CudaParse::Block *, int> path;
+    MemoMap *memo;
+  };
+
+  void search(Search &s, CudaParse::Block *block, bool first,
+    int latency_left, int depth, Result &result);
+
+  bool onPath(const Search &s, const std::vector<CudaParse::Block *> &blocks) const;
+
+ private:
+  int _inst_size;
+  std::map<UseKey, MemoMap> _memo;
+};
+
+}  // Analysis
+
+#endif  // Analysis_Advisor_GPUDepTracker_hpp
@@ -227,7 +227,7 @@ associateInstStmts(const std::vector<VMAStmt> &vma_stmts,
 
 std::vector<GPUAdvisor::AdviceTuple>
 overlayGPUInstructionsMain(Prof::CallPath::Profile &prof,
-  const std::vector<std::string> &instruction_files) {
+  const std::vector<std::string> &instruction_files, int threads) {
   auto *mgr = prof.metricMgr(); 
   MetricNameProfMap metric_name_prof_map(mgr);
   metric_name_prof_map.init();
@@ -265,7 +265,10 @@ overlayGPUInstructionsMain(Prof::CallPath::Profile &prof,
 
     // Step 1: Read metrics
     std::vector<CudaParse::Function *> functions;
-    CudaParse::readCudaInstructions(file, functions);
+    if (!CudaParse::readCudaInstructions(file, functions)) {
+      DIAG_WMsgIf(1, "Cannot read instruction file " << file << ", skipping it");
+      continue;
+    }
 
     // Step 2: Sort the instructions by PC
     // Assign absolute addresses to instructions
@@ -292,22 +295,9 @@ overlayGPUInstructionsMain(Prof::CallPath::Profile &prof,
     gpu_advisor.configInst(lm_name, functions);
 
     // Step 6: Make advise
-    // Find each GPU calling context, make recommendation for each calling context 
-    for (auto *gpu_kernel : gpu_kernels) {
-      auto *gpu_root = dynamic_cast<Prof::CCT::ADynNode *>(gpu_kernel->parent());
-
-      // Pass current gpu root 
-      gpu_advisor.configGPURoot(gpu_root, gpu_kernel);
-
-      // <mpi_rank, <thread_id, <blames>>>
-      CCTBlames cct_blames;
-
-      // Blame latencies
-      gpu_advisor.blame(cct_blames);
-
-      // Make advise for the calling context and cache result
-      gpu_advisor.advise(cct_blames);
-    }
+    // Kernels in different calling contexts are analyzed concurrently
+    std::vector<Prof::CCT::ADynNode *> kernels(gpu_kernels.begin(), gpu_kernels.end());
+    gpu_advisor.adviseKernels(kernels, threads);
     
     if (DEBUG_CALLPATH_CUDAINSTRUCTION) {
       std::cout << "Finish reading instruction file " << file << std::endl;
@@ -320,3 +310,118 @@ overlayGPUInstructionsMain(Prof::CallPath::Profile &prof,
 }  // namespace CallPath
 
 }  // namespace Analysis
+
+
+//****************************************************************************
+// unit test
+//****************************************************************************
+// #define UNIT_TEST
+
+#ifdef UNIT_TEST
+
+// Regression harness: advises the GPU kernels of a measurement directory
+// (hpcrun with PC sampling, then hpcstruct --gpucfg yes) on one thread and
+// on several, and checks that both give the same advice and the same CCT.
+// The parallel run is repeated, since a race may show only in some runs.
+// Build it with -fsanitize=thread and run it with
+// TSAN_OPTIONS=halt_on_error=1 to also fail on a reported race.
+//
+// usage: a.out <measurement-dir> [threads [repeats]]
+
+#include <dirent.h>
+#include <sstream>
+
+#include <lib/analysis/CallPath.hpp>
+#include <lib/analysis/Util.hpp>
+
+// Reads the profile as hpcprof does and returns the advice and the CCT
+// with its metrics, as text
+static std::string
+adviseProfile(const std::string &measurements,
+  const std::vector<std::string> &instruction_files, int threads)
+{
+  Analysis::Util::StringVec paths(1, measurements);
+  Analysis::Util::NormalizeProfileArgs_t nArgs =
+    Analysis::Util::normalizeProfileArgs(paths);
+
+  int mergeTy = Prof::CallPath::Profile::Merge_MergeMetricByName;
+  uint rFlags = Prof::CallPath::Profile::RFlg_MakeInclExcl;
+  uint mrgFlags = Prof::CCT::MrgFlg_NormalizeTraceFileY;
+  Prof::CallPath::Profile *prof =
+    Analysis::CallPath::read(*nArgs.paths, NULL, mergeTy, rFlags, mrgFlags);
+  nArgs.destroy();
+
+  auto advice = Analysis::CallPath::overlayGPUInstructionsMain(*prof,
+    instruction_files, threads);
+
+  // Node ids depend on what was read before, so compare the ones hpcprof
+  // writes
+  prof->cct()->makeDensePreorderIds();
+
+  // Kernels are visited in pointer order, so advice with the same time may
+  // come in either order
+  std::vector<std::string> entries;
+  for (auto &tuple : advice) {
+    std::ostringstream entry;
+    entry << std::get<0>(tuple) << " kernel " << std::get<1>(tuple)->id() << std::endl
+          << std::get<2>(tuple) << std::endl;
+    entries.push_back(entry.str());
+  }
+  std::sort(entries.begin(), entries.end());
+
+  std::ostringstream os;
+  for (auto &entry : entries) {
+    os << entry;
+  }
+  prof->cct()->writeXML(os, 0, prof->metricMgr()->size());
+
+  delete prof;
+  return os.str();
+}
+
+
+int main(int argc, char **argv)
+{
+  if (argc < 2) {
+    std::cerr << "usage: " << argv[0] << " <measurement-dir> [threads [repeats]]" << std::endl;
+    return 1;
+  }
+  std::string measurements = argv[1];
+  int threads = argc > 2 ? atoi(argv[2]) : 4;
+  int repeats = argc > 3 ? atoi(argv[3]) : 3;
+
+  std::vector<std::string> instruction_files;
+  std::string nvidia_dir = measurements + "/structs/nvidia";
+  DIR *dir = opendir(nvidia_dir.c_str());
+  if (dir != NULL) {
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL) {
+      std::string file_name = ent->d_name;
+      if (file_name.find(".inst") != std::string::npos) {
+        instruction_files.push_back(nvidia_dir + "/" + file_name);
+      }
+    }
+    closedir(dir);
+  }
+  if (instruction_files.empty()) {
+    std::cerr << "no instruction files in " << nvidia_dir << std::endl;
+    return 1;
+  }
+
+  std::string serial = adviseProfile(measurements, instruction_files, 1);
+
+  int differ = 0;
+  for (int i = 0; i < repeats; ++i) {
+    std::string parallel = adviseProfile(measurements, instruction_files, threads);
+    if (parallel != serial) {
+      differ++;
+    }
+  }
+
+  std::cout << instruction_files.size() << " instruction files, 1 and " <<
+    threads << " threads: " << repeats - differ << " of " << repeats <<
+    " parallel runs give the same advice and CCT" << std::endl;
+  return differ == 0 ? 0 : 1;
+}
+
+#endif
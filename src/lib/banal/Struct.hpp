@@ -68,6 +68,7 @@ public:
   bool show_time;
   long gpu_size;
   bool compute_gpu_cfg;
+  bool gpu_inst_json;
   bool ourDemangle;
 
   Options()
@@ -79,6 +80,7 @@ public:
     show_time = false;
     gpu_size = 0;
     compute_gpu_cfg = false;
+    gpu_inst_json = false;
     ourDemangle = false;
   }
 };
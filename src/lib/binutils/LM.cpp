@@ -73,6 +73,9 @@ using std::endl;
 
 #include <cstring>
 
+#include <algorithm>
+#include <vector>
+
 //*************************** User Include Files ****************************
 
 #include <include/hpctoolkit-config.h>
@@ -512,6 +515,7 @@ BinUtil::LM::read(const std::set<std::string> &directorySet, LM::ReadFlg readflg
 
   readSymbolTables();
   readSegs();
+  buildProcIndex();
   computeNoReturns();
 }
 
@@ -569,32 +573,23 @@ BinUtil::LM::findSrcCodeInfo(VMA vma, ushort opIndex,
   
   VMA unrelocVMA = unrelocate(vma);
   VMA opVMA = isa->convertVMAToOpVMA(unrelocVMA, opIndex);
-  
-  // Find the Seg where this vma lives.
-  asection* bfdSeg = NULL;
-  VMA base = 0;
-
-  Seg* seg = findSeg(opVMA);
-  if (seg) {
-    bfdSeg = bfd_get_section_by_name(m_bfd, seg->name().c_str());
-#ifdef BINUTILS_234
-    base = bfd_section_vma(bfdSeg);
-#else
-    base = bfd_section_vma(m_bfd, bfdSeg);
-#endif
-  }
 
-  if (!bfdSeg) {
-    return STATUS;
+  // Use the information kept by cacheSrcCodeInfo(), if any
+  if (m_srcCodeIndex.isBuilt()) {
+    const SrcCodeInfo* info = m_srcCodeIndex.find(opVMA);
+    if (info) {
+      func = m_srcStrTab.index2str(info->func);
+      file = m_srcStrTab.index2str(info->file);
+      line = info->line;
+      return info->status;
+    }
   }
 
   // Obtain the source line information.
   const char *bfd_func = NULL, *bfd_file = NULL;
   uint bfd_line = 0;
 
-  bfd_boolean fnd = 
-    bfd_find_nearest_line(m_bfd, bfdSeg, m_bfdSymTabSort,
-			  opVMA - base, &bfd_file, &bfd_func, &bfd_line);
+  bool fnd = findNearestLine(opVMA, bfd_func, bfd_file, bfd_line);
 
   if (fnd) {
     STATUS = (bfd_file && bfd_func && SrcFile::isValid(bfd_line));
@@ -613,6 +608,74 @@ BinUtil::LM::findSrcCodeInfo(VMA vma, ushort opIndex,
 }
 
 
+void
+BinUtil::LM::cacheSrcCodeInfo(const std::vector<VMA>& vmas)
+{
+  if (m_simpleSymbols || m_bfdSymTabSortSz == 0) {
+    return;
+  }
+
+  // Collect the operations that findSrcCodeInfo() will be asked
+  // about: each vma and the beginning of its procedure.
+  std::vector<Proc*> procs;
+  findProc(vmas, procs);
+
+  std::vector<VMA> opVMAs;
+  opVMAs.reserve(2 * vmas.size());
+  for (uint i = 0; i < vmas.size(); ++i) {
+    opVMAs.push_back(isa->convertVMAToOpVMA(unrelocate(vmas[i]), 0));
+    if (procs[i]) {
+      VMA procVMA = unrelocate(procs[i]->begVMA());
+      opVMAs.push_back(isa->convertVMAToOpVMA(procVMA, 0));
+    }
+  }
+
+  // BFD's DWARF reader starts each search at the compilation unit and
+  // function of the previous one: looking up in address order is
+  // cheapest.
+  std::sort(opVMAs.begin(), opVMAs.end());
+  opVMAs.erase(std::unique(opVMAs.begin(), opVMAs.end()), opVMAs.end());
+
+  // Normalize each distinct file name only once
+  std::map<string, long> fileIdx;
+  long emptyIdx = m_srcStrTab.str2index("");
+
+  std::vector<VMA> todo;
+  for (uint i = 0; i < opVMAs.size(); ++i) {
+    if (!m_srcCodeIndex.isBuilt() || !m_srcCodeIndex.find(opVMAs[i])) {
+      todo.push_back(opVMAs[i]);
+    }
+  }
+
+  for (uint i = 0; i < todo.size(); ++i) {
+    const char *bfd_func = NULL, *bfd_file = NULL;
+    uint bfd_line = 0;
+    SrcCodeInfo info = { emptyIdx, emptyIdx, 0, false };
+
+    if (findNearestLine(todo[i], bfd_func, bfd_file, bfd_line)) {
+      info.status = (bfd_file && bfd_func && SrcFile::isValid(bfd_line));
+      if (bfd_func) {
+	info.func = m_srcStrTab.str2index(bfd_func);
+      }
+      if (bfd_file) {
+	std::map<string, long>::iterator it = fileIdx.find(bfd_file);
+	if (it == fileIdx.end()) {
+	  string file = bfd_file;
+	  m_realpathMgr.realpath(file);
+	  it = fileIdx.insert(std::make_pair(string(bfd_file),
+					     m_srcStrTab.str2index(file))).first;
+	}
+	info.file = it->second;
+      }
+      info.line = (SrcFile::ln)bfd_line;
+    }
+    m_srcCodeIndex.insert(todo[i], todo[i] + 1, info);
+  }
+
+  m_srcCodeIndex.build();
+}
+
+
 bool
 BinUtil::LM::findSrcCodeInfo(VMA begVMA, ushort bOpIndex,
 			     VMA endVMA, ushort eOpIndex,
@@ -701,9 +764,16 @@ BinUtil::LM::findProcSrcCodeInfo(VMA vma, ushort opIndex,
 
   VMAInterval ival(opVMA, opVMA + 1); // [opVMA, opVMA + 1)
 
-  ProcMap::const_iterator it = m_procMap.find(ival);
-  if (it != m_procMap.end()) {
-    Proc* proc = it->second;
+  Proc* proc = NULL;
+  if (m_procIndex.isBuilt()) {
+    Proc* const* x = m_procIndex.find(opVMA);
+    proc = (x) ? *x : NULL;
+  }
+  else {
+    ProcMap::const_iterator it = m_procMap.find(ival);
+    proc = (it != m_procMap.end()) ? it->second : NULL;
+  }
+  if (proc) {
     line = proc->begLine();
     isfound = true;
   }
@@ -714,6 +784,32 @@ BinUtil::LM::findProcSrcCodeInfo(VMA vma, ushort opIndex,
 }
 
 
+void
+BinUtil::LM::findProc(const std::vector<VMA>& vmas,
+		      std::vector<Proc*>& procs) const
+{
+  procs.resize(vmas.size());
+
+  if (!m_procIndex.isBuilt()) {
+    for (uint i = 0; i < vmas.size(); ++i) {
+      procs[i] = findProc(vmas[i]);
+    }
+    return;
+  }
+
+  std::vector<VMA> vmas_ur(vmas.size());
+  for (uint i = 0; i < vmas.size(); ++i) {
+    vmas_ur[i] = unrelocate(vmas[i]);
+  }
+
+  std::vector<Proc* const*> found(vmas.size());
+  m_procIndex.find(vmas_ur.data(), vmas_ur.size(), found.data());
+  for (uint i = 0; i < vmas.size(); ++i) {
+    procs[i] = (found[i]) ? *found[i] : NULL;
+  }
+}
+
+
 bool
 BinUtil::LM::findSimpleFunction(VMA vma, string& func)
 {
@@ -982,6 +1078,46 @@ BinUtil::LM::readSegs()
   m_dbgInfo.clear();
 }
 
+void
+BinUtil::LM::buildProcIndex()
+{
+  m_procIndex.clear();
+  for (ProcMap::iterator it = m_procMap.begin(); it != m_procMap.end(); ++it) {
+    m_procIndex.insert(it->first.beg(), it->first.end(), it->second);
+  }
+  m_procIndex.build();
+}
+
+
+bool
+BinUtil::LM::findNearestLine(VMA opVMA, const char*& func,
+			     const char*& file, uint& line) const
+{
+  // Find the Seg where this vma lives.
+  asection* bfdSeg = NULL;
+  VMA base = 0;
+
+  Seg* seg = findSeg(opVMA);
+  if (seg) {
+    bfdSeg = bfd_get_section_by_name(m_bfd, seg->name().c_str());
+#ifdef BINUTILS_234
+    base = bfd_section_vma(bfdSeg);
+#else
+    base = bfd_section_vma(m_bfd, bfdSeg);
+#endif
+  }
+
+  if (!bfdSeg) {
+    return false;
+  }
+
+  bfd_boolean fnd = 
+    bfd_find_nearest_line(m_bfd, bfdSeg, m_bfdSymTabSort,
+			  opVMA - base, &file, &func, &line);
+  return fnd;
+}
+
+
 void
 BinUtil::LM::computeNoReturns()
 {
@@ -65,6 +65,7 @@
 #include <string>
 #include <deque>
 #include <map>
+#include <vector>
 #include <iostream>
 
 #include <string.h>
@@ -86,6 +87,7 @@
 #include <lib/support/Exception.hpp>
 #include <lib/support/RealPathMgr.hpp>
 #include <lib/support/SrcFile.hpp>
+#include <lib/support/StringTable.hpp>
 
 #include <include/linux_info.h> // linux kernel macros
 
@@ -137,6 +139,8 @@ public:
   typedef VMAIntervalMap<Seg*>  SegMap;
   typedef VMAIntervalMap<Proc*> ProcMap;
   typedef std::map<VMA, Insn*>  InsnMap;
+
+  typedef VMAIntervalIndex<Proc*> ProcIndex;
   
 public:
   // -------------------------------------------------------
@@ -277,22 +281,33 @@ public:
   procs() const
   { return m_procMap; }
 
+  // findProc: Once the module is read, procedures are found with
+  // m_procIndex rather than m_procMap.
   Proc*
   findProc(VMA vma) const
   {
     VMA vma_ur = unrelocate(vma);
+    if (m_procIndex.isBuilt()) {
+      Proc* const* proc = m_procIndex.find(vma_ur);
+      return (proc) ? *proc : NULL;
+    }
     VMAInterval ival_ur(vma_ur, vma_ur + 1); // size must be > 0
     ProcMap::const_iterator it = m_procMap.find(ival_ur);
     Proc* proc = (it != m_procMap.end()) ? it->second : NULL;
     return proc;
   }
 
+  // findProc: Batched form: set 'procs[i]' to findProc(vmas[i]).
+  void
+  findProc(const std::vector<VMA>& vmas, std::vector<Proc*>& procs) const;
+
   bool
   insertProc(VMAInterval ival, Proc* proc)
   {
     VMAInterval ival_ur(unrelocate(ival.beg()), unrelocate(ival.end()));
     std::pair<ProcMap::iterator, bool> ret =
       m_procMap.insert(ProcMap::value_type(ival_ur, proc));
+    m_procIndex.clear(); // rebuilt by buildProcIndex()
     return ret.second;
   }
 
@@ -413,6 +428,15 @@ public:
 		  SrcFile::ln& begLine, SrcFile::ln& endLine,
 		  unsigned flags = 1) /*const*/;
 
+  // cacheSrcCodeInfo: Batched form of the first findSrcCodeInfo(),
+  // for clients that know all their VMAs up front: look up the source
+  // information of each of 'vmas' and of the beginning of its
+  // procedure, in address order, and keep it in a flat index so that
+  // later findSrcCodeInfo() calls for those VMAs (with opIndex 0) do
+  // not consult BFD.  May be called more than once.
+  void
+  cacheSrcCodeInfo(const std::vector<VMA>& vmas);
+
   // used for kernel symbols
   bool
   findSimpleFunction(VMA vma, std::string& func);
@@ -542,6 +566,28 @@ private:
   getDebugInfo()
   { return &m_dbgInfo; }
 
+private:
+  // buildProcIndex: (Re)build m_procIndex from m_procMap
+  void
+  buildProcIndex();
+
+  // findNearestLine: bfd_find_nearest_line() for the (unrelocated)
+  // operation 'opVMA'
+  bool
+  findNearestLine(VMA opVMA, const char*& func, const char*& file,
+		  uint& line) const;
+
+  // source code information kept by cacheSrcCodeInfo(); 'func' and
+  // 'file' index m_srcStrTab
+  struct SrcCodeInfo {
+    long func;
+    long file;
+    SrcFile::ln line;
+    bool status;
+  };
+
+  typedef VMAIntervalIndex<SrcCodeInfo> SrcCodeIndex;
+
 private:
   std::string m_name;
 
@@ -564,6 +610,15 @@ private:
   ProcMap m_procMap;
   InsnMap m_insnMap; // owns all Insn*
 
+  // - m_procIndex: a read-only copy of m_procMap for lookups, built
+  //   once the module is read
+  //
+  // - m_srcCodeIndex: source code information of the operations given
+  //   to cacheSrcCodeInfo(), indexed by [opVMA, opVMA + 1)
+  ProcIndex        m_procIndex;
+  SrcCodeIndex     m_srcCodeIndex;
+  HPC::StringTable m_srcStrTab;
+
   // symbolic info used in building procedures
   BinUtil::Dbg::LM m_dbgInfo;
 
@@ -453,3 +453,158 @@ VMAIntervalMap_ddump(VMAIntervalMap<T>* x)
   x->ddump();
 }
 */
+
+
+//******************************************************************************
+// unit test
+//******************************************************************************
+// #define UNIT_TEST
+
+// Benchmark VMAIntervalIndex against VMAIntervalMap on the function
+// symbols of an ELF shared library, e.g.,
+//   VMAInterval-test /usr/lib/x86_64-linux-gnu/libLLVM-15.so.1
+
+#ifdef UNIT_TEST
+
+#include <elf.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+static double
+now()
+{
+  struct timeval tv;
+  gettimeofday(&tv, NULL);
+  return tv.tv_sec + 1.0e-6 * tv.tv_usec;
+}
+
+// Insert the (64-bit) function symbols of 'filenm' into both maps
+static bool
+readFuncSymbols(const char* filenm, VMAIntervalMap<int>& map,
+		VMAIntervalIndex<int>& index)
+{
+  int fd = open(filenm, O_RDONLY);
+  struct stat st;
+  if (fd < 0 || fstat(fd, &st) != 0) {
+    return false;
+  }
+  char* img = (char*)mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (img == MAP_FAILED) {
+    return false;
+  }
+
+  Elf64_Ehdr* ehdr = (Elf64_Ehdr*)img;
+  Elf64_Shdr* shdr = (Elf64_Shdr*)(img + ehdr->e_shoff);
+
+  // prefer the full symbol table, if the library was not stripped
+  Elf64_Shdr* symsec = NULL;
+  for (int i = 0; i < ehdr->e_shnum; i++) {
+    if (shdr[i].sh_type == SHT_SYMTAB
+	|| (shdr[i].sh_type == SHT_DYNSYM && symsec == NULL)) {
+      symsec = &shdr[i];
+    }
+  }
+  if (symsec == NULL) {
+    return false;
+  }
+
+  Elf64_Sym* sym = (Elf64_Sym*)(img + symsec->sh_offset);
+  size_t nsym = symsec->sh_size / sizeof(Elf64_Sym);
+  for (size_t i = 0; i < nsym; i++) {
+    if (ELF64_ST_TYPE(sym[i].st_info) == STT_FUNC
+	&& sym[i].st_shndx != SHN_UNDEF && sym[i].st_size > 0) {
+      VMAInterval ival(sym[i].st_value, sym[i].st_value + sym[i].st_size);
+      if (map.insert(std::make_pair(ival, (int)i)).second) {
+	index.insert(ival.beg(), ival.end(), (int)i);
+      }
+    }
+  }
+  munmap(img, st.st_size);
+  return true;
+}
+
+int
+main(int argc, char** argv)
+{
+  const char* filenm =
+    (argc > 1) ? argv[1] : "/usr/lib/x86_64-linux-gnu/libLLVM-15.so.1";
+  size_t nqueries = (argc > 2) ? strtoul(argv[2], NULL, 10) : 4000000;
+
+  VMAIntervalMap<int> map;
+  VMAIntervalIndex<int> index;
+  if (!readFuncSymbols(filenm, map, index) || map.empty()) {
+    fprintf(stderr, "no function symbols in %s\n", filenm);
+    return 1;
+  }
+
+  double t0 = now();
+  index.build();
+  double tbuild = now() - t0;
+
+  // random VMAs in the text of the library, and the same sorted, as
+  // sample addresses of a profile tend to arrive
+  VMA lo = map.begin()->first.beg();
+  VMA hi = map.rbegin()->first.end();
+  std::vector<VMA> rnd(nqueries), srt;
+  srand(12345);
+  for (size_t i = 0; i < nqueries; i++) {
+    rnd[i] = lo + (VMA)(((double)rand() / RAND_MAX) * (hi - lo - 1));
+  }
+  srt = rnd;
+  std::sort(srt.begin(), srt.end());
+
+  const char* vecnm[2] = { "random", "sorted" };
+  std::vector<VMA>* vec[2] = { &rnd, &srt };
+  std::vector<const int*> out(nqueries);
+
+  printf("%s: %zu functions, %zu queries, index built in %.1f ms\n",
+	 filenm, index.size(), nqueries, 1000 * tbuild);
+
+  for (int v = 0; v < 2; v++) {
+    const std::vector<VMA>& q = *vec[v];
+    long sum1 = 0, sum2 = 0, sum3 = 0, found = 0;
+
+    t0 = now();
+    for (size_t i = 0; i < nqueries; i++) {
+      VMAIntervalMap<int>::const_iterator it =
+	map.find(VMAInterval(q[i], q[i] + 1));
+      sum1 += (it != map.end()) ? it->second : -1;
+    }
+    double tmap = now() - t0;
+
+    t0 = now();
+    for (size_t i = 0; i < nqueries; i++) {
+      const int* x = index.find(q[i]);
+      sum2 += (x) ? *x : -1;
+      found += (x != NULL);
+    }
+    double tidx = now() - t0;
+
+    t0 = now();
+    index.find(q.data(), nqueries, out.data());
+    for (size_t i = 0; i < nqueries; i++) {
+      sum3 += (out[i]) ? *out[i] : -1;
+    }
+    double tbat = now() - t0;
+
+    printf("  %s: map %.1f ns, index %.1f ns, batched %.1f ns per lookup"
+	   " (%ld found)%s\n", vecnm[v],
+	   1.0e9 * tmap / nqueries, 1.0e9 * tidx / nqueries,
+	   1.0e9 * tbat / nqueries, found,
+	   (sum1 == sum2 && sum2 == sum3) ? "" : "  MISMATCH");
+    if (sum1 != sum2 || sum2 != sum3) {
+      return 1;
+    }
+  }
+  return 0;
+}
+
+#endif
@@ -67,6 +67,8 @@
 
 #include <set>
 #include <map>
+#include <vector>
+#include <algorithm>
 
 //*************************** User Include Files ****************************
 
@@ -505,6 +507,220 @@ private:
 };
 
 
+
+//***************************************************************************
+// VMAIntervalIndex
+//***************************************************************************
+
+// --------------------------------------------------------------------------
+// VMAIntervalIndex: a read-only index from intervals [beg, end) to some
+// type T, for intervals that are all known before the first lookup.
+// Intervals are insert()ed, the index is build()t once and then
+// searched with find().  insert() invalidates the index until the
+// next build().
+//
+// The interval begins are stored in Eytzinger (breadth-first) order:
+// a search walks down a single array whose top levels stay in cache,
+// and the nodes three levels below the current one share a cache line
+// that is prefetched while the current level is compared.  Ends and
+// values are stored in sorted order and are touched once per search.
+//
+// Intervals should not overlap.  Where they nest, a VMA is looked up
+// in the last interval (in VMAInterval order) that begins at or before
+// it, as VMAIntervalMap::find() does.
+// --------------------------------------------------------------------------
+
+template <typename T>
+class VMAIntervalIndex
+{
+public:
+  typedef T        mapped_type;
+  typedef size_t   size_type;
+
+public:
+  // -------------------------------------------------------
+  // constructor/destructor
+  // -------------------------------------------------------
+  VMAIntervalIndex()
+    : m_built(false), m_levels(0)
+  { }
+
+  ~VMAIntervalIndex()
+  { }
+
+  // -------------------------------------------------------
+  // insert/build
+  // -------------------------------------------------------
+  void
+  insert(VMA beg, VMA end, const T& x)
+  {
+    m_staged.push_back(Entry(VMAInterval(beg, end), x));
+    m_built = false;
+  }
+
+  void
+  build()
+  {
+    // merge the previous contents with the staged intervals
+    m_staged.insert(m_staged.end(), m_sorted.begin(), m_sorted.end());
+    std::stable_sort(m_staged.begin(), m_staged.end(), lt_Entry());
+    m_sorted.swap(m_staged);
+    m_staged.clear();
+
+    size_type n = m_sorted.size();
+    m_levels = 0;
+    while (((size_type)1 << m_levels) - 1 < n) {
+      m_levels++;
+    }
+
+    // node 0 is unused; nodes past the last interval are padding
+    // that no VMA is below
+    size_type nodes = (size_type)1 << m_levels;
+    m_eytz.assign(nodes, VMA_MAX);
+    m_rank.assign(nodes, n);
+    size_type i = 0;
+    layout(1, i);
+
+    m_built = true;
+  }
+
+  void
+  clear()
+  {
+    m_staged.clear();
+    m_sorted.clear();
+    m_eytz.clear();
+    m_rank.clear();
+    m_levels = 0;
+    m_built = false;
+  }
+
+  bool
+  isBuilt() const
+  { return m_built; }
+
+  size_type
+  size() const
+  { return m_sorted.size(); }
+
+  bool
+  empty() const
+  { return m_sorted.empty(); }
+
+  // -------------------------------------------------------
+  // find
+  // -------------------------------------------------------
+
+  // find: Return the value of the interval that contains 'vma', or
+  // NULL if there is none.
+  const T*
+  find(VMA vma) const
+  {
+    size_type k = 1;
+    for (uint l = 0; l < m_levels; l++) {
+      __builtin_prefetch(m_eytz.data() + ((k << 3) & prefetchMask()));
+      k = 2 * k + (m_eytz[k] <= vma);
+    }
+    return value(k, vma);
+  }
+
+  // find: Batched form of find(): set 'x[i]' to find(vma[i]) for
+  // each of the 'n' VMAs.  The searches proceed level by level in
+  // groups, so that their cache misses overlap.
+  void
+  find(const VMA* vma, size_type n, const T** x) const
+  {
+    const size_type GroupSz = 16;
+    size_type k[GroupSz];
+
+    for (size_type beg = 0; beg < n; beg += GroupSz) {
+      size_type m = std::min(GroupSz, n - beg);
+      const VMA* v = vma + beg;
+
+      for (size_type j = 0; j < m; j++) {
+	k[j] = 1;
+      }
+      for (uint l = 0; l < m_levels; l++) {
+	for (size_type j = 0; j < m; j++) {
+	  __builtin_prefetch(m_eytz.data() + ((k[j] << 3) & prefetchMask()));
+	  k[j] = 2 * k[j] + (m_eytz[k[j]] <= v[j]);
+	}
+      }
+      for (size_type j = 0; j < m; j++) {
+	x[beg + j] = value(k[j], v[j]);
+      }
+    }
+  }
+
+  // interval(i), at(i): the i'th interval in VMAInterval order and its
+  // value (requires isBuilt())
+  const VMAInterval&
+  interval(size_type i) const
+  { return m_sorted[i].first; }
+
+  const T&
+  at(size_type i) const
+  { return m_sorted[i].second; }
+
+private:
+  typedef std::pair<VMAInterval, T> Entry;
+
+  class lt_Entry {
+  public:
+    bool
+    operator() (const Entry& x, const Entry& y) const
+    { return (x.first < y.first); }
+  };
+
+  // layout: Fill the subtree rooted at node 'k' with the sorted
+  // intervals starting at 'i' (in-order)
+  void
+  layout(size_type k, size_type& i)
+  {
+    if (k < m_eytz.size()) {
+      layout(2 * k, i);
+      if (i < m_sorted.size()) {
+	m_eytz[k] = m_sorted[i].first.beg();
+	m_rank[k] = i;
+      }
+      i++;
+      layout(2 * k + 1, i);
+    }
+  }
+
+  // value: Given the leaf position 'k' where a search for 'vma'
+  // ended, return the value of the interval containing 'vma'.
+  // Stripping the trailing right turns from 'k' gives the node of the
+  // first begin above 'vma' (or 0 if there is none); the interval
+  // before it is the only candidate.
+  const T*
+  value(size_type k, VMA vma) const
+  {
+    k >>= __builtin_ffsll(~(unsigned long long)k);
+    size_type upper = (k == 0) ? m_sorted.size() : m_rank[k];
+    if (upper == 0) {
+      return NULL;
+    }
+    const Entry& e = m_sorted[upper - 1];
+    return (vma < e.first.end()) ? &e.second : NULL;
+  }
+
+  // keep prefetch addresses inside the node array
+  size_type
+  prefetchMask() const
+  { return m_eytz.empty() ? 0 : m_eytz.size() - 1; }
+
+private:
+  bool m_built;
+  uint m_levels;
+
+  std::vector<Entry>     m_staged; // inserted since the last build()
+  std::vector<Entry>     m_sorted; // intervals in VMAInterval order
+  std::vector<VMA>       m_eytz;   // begins in Eytzinger order (1-based)
+  std::vector<size_type> m_rank;   // position in m_sorted of each node
+};
+
+
 //***************************************************************************
 
 #endif 
@@ -5,6 +5,15 @@
 #include <slicing.h>
 #include <Graph.h>
 
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
 #include <boost/property_tree/ptree.hpp>
 #include <boost/property_tree/json_parser.hpp>
 #include <boost/lexical_cast.hpp>
@@ -899,7 +908,28 @@ void processLivenessCudaInstructions(const Dyninst::ParseAPI::CodeObject::funcli
 }
 
 
-bool dumpCudaInstructions(const std::string &file_path,
+// block-> <target block id, <pc, type> >
+typedef std::map<Block *, std::map<int, std::pair<int, int> > > BlockTargetMap;
+
+
+static void linkCudaTargets(BlockTargetMap &block_target_map,
+  std::map<int, Block *> &block_map, std::map<int, Instruction *> &inst_map) {
+  // Reconstruct targets
+  for (auto &block_iter : block_target_map) {
+    auto *block = block_iter.first;
+    for (auto &iter : block_iter.second) {
+      auto target_id = iter.first;
+      auto pc = iter.second.first;
+      auto type = iter.second.second;
+      auto *inst = inst_map[pc];
+      auto *target_block = block_map[target_id];
+      block->targets.push_back(new Target(inst, target_block, (TargetType)(type)));
+    }
+  }
+}
+
+
+static bool dumpCudaInstructionsJSON(const std::string &file_path,
   const std::vector<Function *> &functions) {
   boost::property_tree::ptree root;
 
@@ -1051,14 +1081,23 @@ bool dumpCudaInstructions(const std::string &file_path,
 }
 
 
-bool readCudaInstructions(const std::string &file_path, std::vector<Function *> &functions) {
+// Frees what a failed read added to functions
+static void discardCudaInstructions(std::vector<Function *> &functions, size_t first) {
+  for (size_t i = first; i < functions.size(); ++i) {
+    delete functions[i];
+  }
+  functions.resize(first);
+}
+
+
+// Throws on a malformed file, with what was read so far in functions
+static void parseCudaInstructionsJSON(const std::string &file_path, std::vector<Function *> &functions) {
   boost::property_tree::ptree root;
 
   boost::property_tree::read_json(file_path, root);
 
   // CFG does not have parallel edges
-  // block-> <target block id, <pc, type> > 
-  std::map<Block *, std::map<int, std::pair<int, int> > > block_target_map;
+  BlockTargetMap block_target_map;
   std::map<int, Block *> block_map;
   std::map<int, Instruction *> inst_map;
 
@@ -1078,8 +1117,10 @@ bool readCudaInstructions(const std::string &file_path, std::vector<Function *>
 
     if (function->unparsable) {
       // Skip unparsable functions
+      delete function;
       continue;
     }
+    functions.emplace_back(function);
 
     auto &ptree_blocks = ptree_function.second.get_child("blocks");
     for (auto &ptree_block : ptree_blocks) {
@@ -1087,6 +1128,7 @@ bool readCudaInstructions(const std::string &file_path, std::vector<Function *>
       std::string name = ptree_block.second.get<std::string>("name", "");
       auto *block = new Block(block_id, name);
       block_map[block_id] = block;
+      function->blocks.emplace_back(block);
 
       if (INSTRUCTION_ANALYZER_DEBUG) {
         std::cout << "Block id: " << block_id << std::endl;
@@ -1289,6 +1331,334 @@ bool readCudaInstructions(const std::string &file_path, std::vector<Function *>
 
         block->insts.emplace_back(inst);
       }
+    }
+  }
+
+  linkCudaTargets(block_target_map, block_map, inst_map);
+}
+
+
+static bool readCudaInstructionsJSON(const std::string &file_path, std::vector<Function *> &functions) {
+  size_t first = functions.size();
+  try {
+    parseCudaInstructionsJSON(file_path, functions);
+  } catch (std::exception &e) {
+    // A parse error, or a bad number from lexical_cast
+    discardCudaInstructions(functions, first);
+    return false;
+  }
+  return true;
+}
+
+//
+// Binary instruction files
+//
+// All integers are 32-bit in the byte order of the writer, which is
+// checked through the byte order mark.  Strings and lists are prefixed
+// with their length.  Records follow each other without padding, so a
+// file can be written and read as a stream.
+//
+//   header:   magic, version, byte order mark, #functions
+//   function: id, index, address, size, global, name, #blocks, blocks
+//   block:    id, address, name, #targets, targets, #insts, insts
+//   target:   block id, pc, type
+//   inst:     pc, op, pred, pred_flag, pred_assign_pcs,
+//             reuse, wait, read, write, yield, stall,
+//             dsts, udsts, pdsts, updsts, bdsts,
+//             srcs, usrcs, psrcs, upsrcs, bsrcs
+//   srcs:     #srcs, then the id and the assign pcs of each source
+//
+// Unparsable functions are not written.
+//
+
+static const char INST_FILE_MAGIC[8] = { 'H', 'P', 'C', 'I', 'N', 'S', 'T', '\0' };
+static const int32_t INST_FILE_VERSION = 1;
+static const int32_t INST_FILE_BYTE_ORDER = 0x01020304;
+
+
+class InstFileWriter {
+ public:
+  explicit InstFileWriter(std::ostream &os) : _os(os) {}
+
+  void put(int32_t value) {
+    _os.write(reinterpret_cast<const char *>(&value), sizeof(value));
+  }
+
+  void put(const std::string &str) {
+    put(static_cast<int32_t>(str.size()));
+    _os.write(str.data(), str.size());
+  }
+
+  void put(const std::vector<int> &values) {
+    put(static_cast<int32_t>(values.size()));
+    for (auto value : values) {
+      put(static_cast<int32_t>(value));
+    }
+  }
+
+  // A register read twice has its assign pcs written once
+  void put(const std::vector<int> &srcs, const std::map<int, std::vector<int> > &assign_pcs) {
+    static const std::vector<int> empty;
+    put(static_cast<int32_t>(srcs.size()));
+    for (size_t i = 0; i < srcs.size(); ++i) {
+      auto src = srcs[i];
+      put(static_cast<int32_t>(src));
+      auto iter = assign_pcs.find(src);
+      bool first = std::find(srcs.begin(), srcs.begin() + i, src) == srcs.begin() + i;
+      put(iter == assign_pcs.end() || !first ? empty : iter->second);
+    }
+  }
+
+ private:
+  std::ostream &_os;
+};
+
+
+class InstFileReader {
+ public:
+  InstFileReader(const char *begin, const char *end) : _cur(begin), _end(end), _good(true) {}
+
+  bool good() const {
+    return _good;
+  }
+
+  int32_t getInt() {
+    int32_t value = 0;
+    if (_end - _cur < static_cast<ptrdiff_t>(sizeof(value))) {
+      _good = false;
+      return 0;
+    }
+    memcpy(&value, _cur, sizeof(value));
+    _cur += sizeof(value);
+    return value;
+  }
+
+  // Returns 0 for a length that runs past the end
+  int32_t getLength(size_t elem_size) {
+    int32_t len = getInt();
+    if (len < 0 || static_cast<size_t>(_end - _cur) / elem_size < static_cast<size_t>(len)) {
+      _good = false;
+      return 0;
+    }
+    return len;
+  }
+
+  std::string getString() {
+    int32_t len = getLength(1);
+    std::string str(_cur, len);
+    _cur += len;
+    return str;
+  }
+
+  void getInts(std::vector<int> &values) {
+    int32_t len = getLength(sizeof(int32_t));
+    values.reserve(len);
+    for (int32_t i = 0; i < len; ++i) {
+      values.push_back(getInt());
+    }
+  }
+
+  void getSrcs(std::vector<int> &srcs, std::map<int, std::vector<int> > &assign_pcs) {
+    // Each source takes at least an id and a length
+    int32_t len = getLength(2 * sizeof(int32_t));
+    srcs.reserve(len);
+    for (int32_t i = 0; i < len && _good; ++i) {
+      int src = getInt();
+      srcs.push_back(src);
+      int32_t num_pcs = getLength(sizeof(int32_t));
+      for (int32_t j = 0; j < num_pcs; ++j) {
+        assign_pcs[src].push_back(getInt());
+      }
+    }
+  }
+
+ private:
+  const char *_cur;
+  const char *_end;
+  bool _good;
+};
+
+
+static bool dumpCudaInstructionsBinary(const std::string &file_path,
+  const std::vector<Function *> &functions) {
+  std::ofstream ofs(file_path, std::ios::out | std::ios::binary | std::ios::trunc);
+  if (!ofs.is_open()) {
+    return false;
+  }
+
+  InstFileWriter writer(ofs);
+
+  ofs.write(INST_FILE_MAGIC, sizeof(INST_FILE_MAGIC));
+  writer.put(INST_FILE_VERSION);
+  writer.put(INST_FILE_BYTE_ORDER);
+
+  int32_t num_functions = 0;
+  for (auto *function : functions) {
+    if (function->unparsable == false) {
+      ++num_functions;
+    }
+  }
+  writer.put(num_functions);
+
+  // Artificial NOP instructions have no stats, write what the JSON reader
+  // fills in for them
+  InstructionStat nop_stat;
+  nop_stat.op = "MISC.OTHER";
+  nop_stat.predicate = -1;
+  nop_stat.predicate_flag = InstructionStat::PREDICATE_NONE;
+  nop_stat.control.read = 0;
+  nop_stat.control.write = 0;
+  nop_stat.control.stall = 0;
+
+  for (auto *function : functions) {
+    if (function->unparsable == true) {
+      continue;
+    }
+
+    writer.put(static_cast<int32_t>(function->id));
+    writer.put(static_cast<int32_t>(function->index));
+    writer.put(static_cast<int32_t>(function->address));
+    writer.put(static_cast<int32_t>(function->size));
+    writer.put(static_cast<int32_t>(function->global));
+    writer.put(function->name);
+    writer.put(static_cast<int32_t>(function->blocks.size()));
+
+    for (auto *block : function->blocks) {
+      writer.put(static_cast<int32_t>(block->id));
+      writer.put(static_cast<int32_t>(block->address));
+      writer.put(block->name);
+
+      writer.put(static_cast<int32_t>(block->targets.size()));
+      for (auto *target : block->targets) {
+        writer.put(static_cast<int32_t>(target->block->id));
+        writer.put(static_cast<int32_t>(target->inst->inst_stat->pc));
+        writer.put(static_cast<int32_t>(target->type));
+      }
+
+      writer.put(static_cast<int32_t>(block->insts.size()));
+      for (auto *inst : block->insts) {
+        // Instruction offsets have been relocated
+        writer.put(static_cast<int32_t>(inst->offset - function->address));
+
+        auto *inst_stat = inst->inst_stat == NULL ? &nop_stat : inst->inst_stat;
+
+        writer.put(inst_stat->op);
+        writer.put(static_cast<int32_t>(inst_stat->predicate));
+        writer.put(static_cast<int32_t>(inst_stat->predicate_flag));
+        writer.put(inst_stat->predicate_assign_pcs);
+
+        writer.put(static_cast<int32_t>(inst_stat->control.reuse));
+        writer.put(static_cast<int32_t>(inst_stat->control.wait));
+        writer.put(static_cast<int32_t>(inst_stat->control.read));
+        writer.put(static_cast<int32_t>(inst_stat->control.write));
+        writer.put(static_cast<int32_t>(inst_stat->control.yield));
+        writer.put(static_cast<int32_t>(inst_stat->control.stall));
+
+        writer.put(inst_stat->dsts);
+        writer.put(inst_stat->udsts);
+        writer.put(inst_stat->pdsts);
+        writer.put(inst_stat->updsts);
+        writer.put(inst_stat->bdsts);
+
+        writer.put(inst_stat->srcs, inst_stat->assign_pcs);
+        writer.put(inst_stat->usrcs, inst_stat->uassign_pcs);
+        writer.put(inst_stat->psrcs, inst_stat->passign_pcs);
+        writer.put(inst_stat->upsrcs, inst_stat->upassign_pcs);
+        writer.put(inst_stat->bsrcs, inst_stat->bassign_pcs);
+      }
+    }
+  }
+
+  ofs.close();
+  return !ofs.fail();
+}
+
+
+// On a truncated file the loops stop early, with everything read so far in
+// functions
+static bool readCudaInstructionsBinary(InstFileReader &reader,
+  std::vector<Function *> &functions) {
+  size_t first = functions.size();
+  if (reader.getInt() != INST_FILE_VERSION) {
+    return false;
+  }
+  if (reader.getInt() != INST_FILE_BYTE_ORDER) {
+    return false;
+  }
+
+  // CFG does not have parallel edges
+  BlockTargetMap block_target_map;
+  std::map<int, Block *> block_map;
+  std::map<int, Instruction *> inst_map;
+
+  int32_t num_functions = reader.getLength(1);
+  for (int32_t f = 0; f < num_functions && reader.good(); ++f) {
+    int function_id = reader.getInt();
+    int function_index = reader.getInt();
+    int function_address = reader.getInt();
+    int size = reader.getInt();
+    bool global = reader.getInt() != 0;
+    std::string name = reader.getString();
+    auto *function = new Function(function_id, function_index, name, function_address, false, global, size);
+
+    int32_t num_blocks = reader.getLength(1);
+    for (int32_t b = 0; b < num_blocks && reader.good(); ++b) {
+      int block_id = reader.getInt();
+      reader.getInt();  // address
+      std::string name = reader.getString();
+      auto *block = new Block(block_id, name);
+      block_map[block_id] = block;
+
+      // Record targets id first
+      int32_t num_targets = reader.getLength(3 * sizeof(int32_t));
+      for (int32_t t = 0; t < num_targets; ++t) {
+        int target_id = reader.getInt();
+        int inst_pc = reader.getInt();
+        int type = reader.getInt();
+        block_target_map[block][target_id] = std::make_pair(inst_pc, type);
+      }
+
+      int32_t num_insts = reader.getLength(1);
+      for (int32_t i = 0; i < num_insts && reader.good(); ++i) {
+        int pc = reader.getInt();
+        std::string op = reader.getString();
+        int pred = reader.getInt();
+        auto pred_flag = static_cast<InstructionStat::PredicateFlag>(reader.getInt());
+        std::vector<int> pred_assign_pcs;
+        reader.getInts(pred_assign_pcs);
+
+        InstructionStat::Control control;
+        control.reuse = reader.getInt();
+        control.wait = reader.getInt();
+        control.read = reader.getInt();
+        control.write = reader.getInt();
+        control.yield = reader.getInt();
+        control.stall = reader.getInt();
+
+        std::vector<int> dsts, udsts, pdsts, updsts, bdsts;
+        reader.getInts(dsts);
+        reader.getInts(udsts);
+        reader.getInts(pdsts);
+        reader.getInts(updsts);
+        reader.getInts(bdsts);
+
+        std::vector<int> srcs, usrcs, psrcs, upsrcs, bsrcs;
+        std::map<int, std::vector<int> > assign_pcs, uassign_pcs, passign_pcs,
+          upassign_pcs, bassign_pcs;
+        reader.getSrcs(srcs, assign_pcs);
+        reader.getSrcs(usrcs, uassign_pcs);
+        reader.getSrcs(psrcs, passign_pcs);
+        reader.getSrcs(upsrcs, upassign_pcs);
+        reader.getSrcs(bsrcs, bassign_pcs);
+
+        auto *inst_stat = new InstructionStat(op, pc, pred, pred_flag, pred_assign_pcs, dsts, srcs,
+          pdsts, psrcs, bdsts, bsrcs, udsts, usrcs, updsts, upsrcs,
+          assign_pcs, passign_pcs, bassign_pcs, uassign_pcs, upassign_pcs, control);
+        auto *inst = new Instruction(inst_stat);
+        inst_map[pc] = inst;
+
+        block->insts.emplace_back(inst);
+      }
 
       function->blocks.emplace_back(block);
     }
@@ -1296,20 +1666,58 @@ bool readCudaInstructions(const std::string &file_path, std::vector<Function *>
     functions.emplace_back(function);
   }
 
-  // Reconstruct targets
-  for (auto &block_iter : block_target_map) {
-    auto *block = block_iter.first;
-    for (auto &iter : block_iter.second) {
-      auto target_id = iter.first;
-      auto pc = iter.second.first;
-      auto type = iter.second.second;
-      auto *inst = inst_map[pc];
-      auto *target_block = block_map[target_id];
-      block->targets.push_back(new Target(inst, target_block, (TargetType)(type)));
-    }
+  if (reader.good() == false) {
+    discardCudaInstructions(functions, first);
+    return false;
   }
 
+  linkCudaTargets(block_target_map, block_map, inst_map);
+
   return true;
 }
 
+
+bool dumpCudaInstructions(const std::string &file_path,
+  const std::vector<Function *> &functions, bool json) {
+  if (json) {
+    return dumpCudaInstructionsJSON(file_path, functions);
+  }
+  return dumpCudaInstructionsBinary(file_path, functions);
+}
+
+
+bool readCudaInstructions(const std::string &file_path, std::vector<Function *> &functions) {
+  int fd = open(file_path.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return false;
+  }
+
+  struct stat sb;
+  if (fstat(fd, &sb) != 0) {
+    close(fd);
+    return false;
+  }
+
+  size_t size = sb.st_size;
+  void *addr = MAP_FAILED;
+  if (size >= sizeof(INST_FILE_MAGIC)) {
+    addr = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+
+  if (addr != MAP_FAILED) {
+    const char *begin = static_cast<const char *>(addr);
+    if (memcmp(begin, INST_FILE_MAGIC, sizeof(INST_FILE_MAGIC)) == 0) {
+      InstFileReader reader(begin + sizeof(INST_FILE_MAGIC), begin + size);
+      bool ret = readCudaInstructionsBinary(reader, functions);
+      munmap(addr, size);
+      return ret;
+    }
+    munmap(addr, size);
+  }
+
+  // Files written with hpcstruct --gpu-inst-json, or before the binary format
+  return readCudaInstructionsJSON(file_path, functions);
+}
+
 }  // namespace CudaParse
@@ -143,8 +143,11 @@ void sliceCudaInstructions(const Dyninst::ParseAPI::CodeObject::funclist &func_s
 void processLivenessCudaInstructions(const Dyninst::ParseAPI::CodeObject::funclist &func_set,
   std::vector<Function *> &functions);
 
-bool dumpCudaInstructions(const std::string &file_path, const std::vector<Function *> &functions);
+// Writes a binary instruction file, or JSON if json is set
+bool dumpCudaInstructions(const std::string &file_path, const std::vector<Function *> &functions,
+  bool json = false);
 
+// Reads either format
 bool readCudaInstructions(const std::string &file_path, std::vector<Function *> &Function_stats);
 
 
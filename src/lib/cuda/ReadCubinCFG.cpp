@@ -301,7 +301,8 @@ dumpCudaInstructions
 (
  const std::string &search_path,
  const std::string &elf_filename,
- const std::vector<CudaParse::Function *> &functions
+ const std::vector<CudaParse::Function *> &functions,
+ bool json
 )
 {
   // Create a nvidia directory and dump instruction files
@@ -314,7 +315,7 @@ dumpCudaInstructions
     }
 
     const std::string inst_output = search_path + "/nvidia/" + FileUtil::basename(elf_filename) + ".inst";
-    if (CudaParse::dumpCudaInstructions(inst_output, functions) != true) {
+    if (CudaParse::dumpCudaInstructions(inst_output, functions, json) != true) {
       std::cout << "WARNING: failed to dump static database file: " << inst_output << std::endl;
     }
   }
@@ -345,6 +346,7 @@ readCubinCFG
  Dyninst::ParseAPI::CodeSource **code_src, 
  Dyninst::ParseAPI::CodeObject **code_obj,
  bool dump_insts,
+ bool json_insts,
  bool control,
  bool slice,
  bool liveness
@@ -391,7 +393,7 @@ readCubinCFG
       }
 
       if (dump_insts) {
-        dumpCudaInstructions(search_path, elfFile->getFileName(), functions);
+        dumpCudaInstructions(search_path, elfFile->getFileName(), functions, json_insts);
       }
 
       unlink(dot.c_str());
@@ -0,0 +1,442 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+
+//*****************************************************************************
+// system includes
+//*****************************************************************************
+
+#include <string.h>
+#include <sys/types.h>
+
+
+
+//*****************************************************************************
+// local includes
+//*****************************************************************************
+
+#include "hashmap-uint64.h"
+
+
+
+//*****************************************************************************
+// macros
+//*****************************************************************************
+
+#define SHARD_MASK ((uint64_t) HASHMAP_UINT64_SHARDS - 1)
+
+
+
+//*****************************************************************************
+// private operations
+//*****************************************************************************
+
+static inline hashmap_uint64_shard_t *
+shard_get
+(
+ hashmap_uint64_t *map,
+ uint64_t key
+)
+{
+  return &map->shards[key & SHARD_MASK];
+}
+
+
+// consecutive keys land in consecutive slots of a shard
+static inline size_t
+slot_home
+(
+ hashmap_uint64_shard_t *shard,
+ uint64_t key
+)
+{
+  return (key >> HASHMAP_UINT64_SHARDS_LOG2) & (shard->capacity - 1);
+}
+
+
+// distance of the entry in slot i from its home slot
+static inline size_t
+slot_displacement
+(
+ hashmap_uint64_shard_t *shard,
+ size_t i
+)
+{
+  return (i - slot_home(shard, shard->slots[i].key)) & (shard->capacity - 1);
+}
+
+
+// return the slot holding key, or -1. entries of a probe run are
+// ordered by home slot, so the search ends at the first entry that is
+// closer to its home than key would be.
+static ssize_t
+slot_find
+(
+ hashmap_uint64_shard_t *shard,
+ uint64_t key
+)
+{
+  size_t mask = shard->capacity - 1;
+  size_t i = slot_home(shard, key);
+
+  for (size_t d = 0; shard->slots[i].value; d++, i = (i + 1) & mask) {
+    if (shard->slots[i].key == key) return i;
+    if (slot_displacement(shard, i) < d) break;
+  }
+
+  return -1;
+}
+
+
+// robin hood placement: an entry displaces any resident that is closer
+// to its home, which keeps each probe run ordered by home slot
+static void
+slot_place
+(
+ hashmap_uint64_shard_t *shard,
+ hashmap_uint64_slot_t entry
+)
+{
+  size_t mask = shard->capacity - 1;
+  size_t i = slot_home(shard, entry.key);
+
+  for (size_t d = 0; shard->slots[i].value; d++, i = (i + 1) & mask) {
+    size_t resident_d = slot_displacement(shard, i);
+    if (resident_d < d) {
+      hashmap_uint64_slot_t resident = shard->slots[i];
+      shard->slots[i] = entry;
+      entry = resident;
+      d = resident_d;
+    }
+  }
+
+  shard->slots[i] = entry;
+}
+
+
+static void
+shard_resize
+(
+ hashmap_uint64_t *map,
+ hashmap_uint64_shard_t *shard,
+ size_t capacity
+)
+{
+  size_t nbytes = capacity * sizeof(hashmap_uint64_slot_t);
+  hashmap_uint64_slot_t *old_slots = shard->slots;
+  size_t old_capacity = shard->capacity;
+
+  shard->slots = (hashmap_uint64_slot_t *) map->alloc(nbytes);
+  memset(shard->slots, 0, nbytes);
+  shard->capacity = capacity;
+
+  for (size_t i = 0; i < old_capacity; i++) {
+    if (old_slots[i].value) {
+      slot_place(shard, old_slots[i]);
+    }
+  }
+}
+
+
+// empty slot i by shifting the rest of its probe run back one slot.
+// the shift stops at an empty slot or an entry already at its home,
+// which for consecutive keys is the very next slot.
+static void
+slot_remove
+(
+ hashmap_uint64_shard_t *shard,
+ size_t i
+)
+{
+  size_t mask = shard->capacity - 1;
+
+  for (size_t j = (i + 1) & mask;
+       shard->slots[j].value && slot_displacement(shard, j) > 0;
+       i = j, j = (j + 1) & mask) {
+    shard->slots[i] = shard->slots[j];
+  }
+
+  shard->slots[i].value = NULL;
+}
+
+
+
+//*****************************************************************************
+// interface operations
+//*****************************************************************************
+
+void
+hashmap_uint64_init
+(
+ hashmap_uint64_t *map,
+ allocator_t *alloc
+)
+{
+  memset(map, 0, sizeof(*map));
+  map->alloc = alloc;
+
+  for (int i = 0; i < HASHMAP_UINT64_SHARDS; i++) {
+    spinlock_init(&map->shards[i].lock);
+  }
+}
+
+
+bool
+hashmap_uint64_insert
+(
+ hashmap_uint64_t *map,
+ uint64_t key,
+ void *value
+)
+{
+  hashmap_uint64_shard_t *shard = shard_get(map, key);
+  bool inserted = false;
+
+  spinlock_lock(&shard->lock);
+
+  if (shard->capacity == 0) {
+    shard_resize(map, shard, HASHMAP_UINT64_SHARD_CAPACITY);
+  } else if (2 * (shard->count + 1) > shard->capacity) {
+    shard_resize(map, shard, 2 * shard->capacity);
+  }
+
+  if (slot_find(shard, key) < 0) {
+    hashmap_uint64_slot_t entry = { .key = key, .value = value };
+    slot_place(shard, entry);
+    shard->count++;
+    inserted = true;
+  }
+
+  spinlock_unlock(&shard->lock);
+
+  return inserted;
+}
+
+
+void *
+hashmap_uint64_lookup
+(
+ hashmap_uint64_t *map,
+ uint64_t key
+)
+{
+  hashmap_uint64_shard_t *shard = shard_get(map, key);
+  void *value = NULL;
+
+  spinlock_lock(&shard->lock);
+
+  if (shard->count > 0) {
+    ssize_t i = slot_find(shard, key);
+    if (i >= 0) value = shard->slots[i].value;
+  }
+
+  spinlock_unlock(&shard->lock);
+
+  return value;
+}
+
+
+void *
+hashmap_uint64_delete
+(
+ hashmap_uint64_t *map,
+ uint64_t key
+)
+{
+  hashmap_uint64_shard_t *shard = shard_get(map, key);
+  void *value = NULL;
+
+  spinlock_lock(&shard->lock);
+
+  if (shard->count > 0) {
+    ssize_t i = slot_find(shard, key);
+    if (i >= 0) {
+      value = shard->slots[i].value;
+      slot_remove(shard, i);
+      shard->count--;
+    }
+  }
+
+  spinlock_unlock(&shard->lock);
+
+  return value;
+}
+
+
+uint64_t
+hashmap_uint64_count
+(
+ hashmap_uint64_t *map
+)
+{
+  uint64_t count = 0;
+
+  for (int i = 0; i < HASHMAP_UINT64_SHARDS; i++) {
+    count += map->shards[i].count;
+  }
+
+  return count;
+}
+
+
+
+//*****************************************************************************
+// unit test
+//*****************************************************************************
+
+// checks the map against a reference array under a random mix of
+// operations, then times the insert/lookup/delete pattern of
+// correlation ids against a splay tree. set UNIT_TEST to 1 and build with
+//   cc -O2 -I<src> hashmap-uint64.c splay-uint64.c
+// run as: a.out [ids] [ids in flight]
+
+#define UNIT_TEST 0
+#if UNIT_TEST
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "splay-uint64.h"
+
+#define KEYS 20000
+
+typedef struct {
+  splay_uint64_node_t node;
+} entry_t;
+
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static void
+check_random(void)
+{
+  static hashmap_uint64_t map = HASHMAP_UINT64_INITIALIZER(malloc);
+  static void *reference[KEYS];
+  uint64_t count = 0;
+
+  srandom(1);
+  for (long n = 0; n < 50 * KEYS; n++) {
+    // small keys collide; large keys exercise wraparound of homes
+    uint64_t key = (n & 1) ? random() % KEYS : (random() % 64) * 1031 % KEYS;
+    void *value = &reference[key];
+    switch (random() % 3) {
+    case 0:
+      assert(hashmap_uint64_insert(&map, key, value) == (reference[key] == NULL));
+      if (reference[key] == NULL) count++;
+      reference[key] = value;
+      break;
+    case 1:
+      assert(hashmap_uint64_lookup(&map, key) == reference[key]);
+      break;
+    case 2:
+      assert(hashmap_uint64_delete(&map, key) == reference[key]);
+      if (reference[key]) count--;
+      reference[key] = NULL;
+      break;
+    }
+  }
+  assert(hashmap_uint64_count(&map) == count);
+  for (uint64_t key = 0; key < KEYS; key++) {
+    assert(hashmap_uint64_lookup(&map, key) == reference[key]);
+  }
+  printf("random operations: ok (%lu live)\n", count);
+}
+
+
+int
+main(int argc, char **argv)
+{
+  long ids = argc > 1 ? atol(argv[1]) : 10000000;
+  long window = argc > 2 ? atol(argv[2]) : 1000;
+
+  check_random();
+
+  entry_t *entries = calloc(window, sizeof(entry_t));
+  volatile uintptr_t sink = 0;
+
+  // keep `window' ids in flight: retire id - window, then insert id.
+  // id reuses the entry of id - window, so it must be retired first.
+  double start = now();
+  hashmap_uint64_t map;
+  hashmap_uint64_init(&map, malloc);
+  for (long id = 1; id <= ids; id++) {
+    if (id > window) {
+      sink += (uintptr_t) hashmap_uint64_lookup(&map, id - window);
+      hashmap_uint64_delete(&map, id - window);
+    }
+    hashmap_uint64_insert(&map, id, &entries[id % window]);
+  }
+  double hash_time = now() - start;
+
+  start = now();
+  splay_uint64_node_t *root = NULL;
+  for (long id = 1; id <= ids; id++) {
+    if (id > window) {
+      sink += (uintptr_t) splay_uint64_lookup(&root, id - window);
+      splay_uint64_node_t *gone = splay_uint64_delete(&root, id - window);
+      assert(gone == &entries[id % window].node);
+      (void) gone;
+    }
+    entries[id % window].node.key = id;
+    bool added = splay_uint64_insert(&root, &entries[id % window].node);
+    assert(added);
+    (void) added;
+  }
+  double splay_time = now() - start;
+
+  printf("%ld ids, %ld in flight: hashmap %.1f ns/id, splay %.1f ns/id\n",
+	 ids, window, 1e9 * hash_time / ids, 1e9 * splay_time / ids);
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,190 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+
+//*****************************************************************************
+//
+// hashmap-uint64: a concurrent map from 64-bit keys to non-NULL
+// pointers, intended for keys that are issued in increasing order,
+// such as correlation ids, and that are looked up and deleted soon
+// after they are inserted.
+//
+// the map is split into shards by the low bits of the key; each shard
+// is an open-addressing table with linear probing, protected by its
+// own spinlock. within a shard, a key's home slot is the key itself
+// (with the shard bits removed) modulo the table size, so a window of
+// live, consecutive keys no larger than the table never collides.
+// collisions are resolved robin-hood style, keeping each probe run
+// ordered by home slot. deletion shifts the rest of a probe run back
+// rather than leaving a tombstone, so tables do not degrade as keys
+// are retired.
+//
+// a shard allocates its table on first insertion and doubles it when
+// it becomes half full. tables are obtained from
+// the allocator passed to hashmap_uint64_init; since hpcrun allocators
+// never free, a table that is outgrown is abandoned.
+//
+//*****************************************************************************
+
+#ifndef hashmap_uint64_h
+#define hashmap_uint64_h
+
+
+
+//*****************************************************************************
+// system includes
+//*****************************************************************************
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+
+
+//*****************************************************************************
+// local includes
+//*****************************************************************************
+
+#include "allocator.h"
+#include "spinlock.h"
+
+
+
+//*****************************************************************************
+// macros
+//*****************************************************************************
+
+#define HASHMAP_UINT64_SHARDS_LOG2 4
+#define HASHMAP_UINT64_SHARDS (1 << HASHMAP_UINT64_SHARDS_LOG2)
+
+// initial number of slots in each shard; must be a power of two
+#define HASHMAP_UINT64_SHARD_CAPACITY 256
+
+// static initializer, equivalent to calling hashmap_uint64_init
+#define HASHMAP_UINT64_INITIALIZER(allocator)			\
+  {								\
+    .alloc = allocator,						\
+    .shards = {							\
+      [0 ... HASHMAP_UINT64_SHARDS - 1] = {			\
+	.lock = SPINLOCK_UNLOCKED				\
+      }								\
+    }								\
+  }
+
+
+
+//*****************************************************************************
+// type declarations
+//*****************************************************************************
+
+typedef struct hashmap_uint64_slot_t {
+  uint64_t key;
+  void *value; // NULL marks an empty slot
+} hashmap_uint64_slot_t;
+
+
+typedef struct hashmap_uint64_shard_t {
+  spinlock_t lock;
+  size_t capacity;
+  size_t count;
+  hashmap_uint64_slot_t *slots;
+} __attribute__((aligned(128))) hashmap_uint64_shard_t;
+
+
+typedef struct hashmap_uint64_t {
+  allocator_t *alloc;
+  hashmap_uint64_shard_t shards[HASHMAP_UINT64_SHARDS];
+} hashmap_uint64_t;
+
+
+
+//*****************************************************************************
+// interface operations
+//*****************************************************************************
+
+void
+hashmap_uint64_init
+(
+ hashmap_uint64_t *map,
+ allocator_t *alloc
+);
+
+
+// returns false, leaving the map unchanged, if key is already present
+bool
+hashmap_uint64_insert
+(
+ hashmap_uint64_t *map,
+ uint64_t key,
+ void *value
+);
+
+
+// returns NULL if key is not present
+void *
+hashmap_uint64_lookup
+(
+ hashmap_uint64_t *map,
+ uint64_t key
+);
+
+
+// returns the value removed, or NULL if key is not present
+void *
+hashmap_uint64_delete
+(
+ hashmap_uint64_t *map,
+ uint64_t key
+);
+
+
+// number of entries; exact only when no updates are in progress
+uint64_t
+hashmap_uint64_count
+(
+ hashmap_uint64_t *map
+);
+
+
+
+#endif
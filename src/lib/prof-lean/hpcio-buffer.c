@@ -71,6 +71,15 @@
 //
 // Deserves further study: the best way to handle errors from write().
 //
+// With HPCIO_OUTBUF_ASYNC, the buffer is split into two halves.  When
+// the current half fills, it is queued for a background writer thread
+// with its file offset, and the client continues in the other half.
+// The queue push is lock-free and the writer is woken with sem_post(),
+// so both remain safe inside signal handlers.  The client never waits
+// for the writer: if the writer still holds the other half, or is not
+// running, the current half is written synchronously instead.  A half
+// the writer failed to write is kept and retried by the client.
+//
 //***************************************************************************
 
 //************************* System Include Files ****************************
@@ -79,7 +88,13 @@
 #include <sys/stat.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <sched.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdbool.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 
@@ -88,6 +103,7 @@
 #include "hpcfmt.h"
 #include "hpcio-buffer.h"
 #include "spinlock.h"
+#include "stdatomic.h"
 #include <include/min-max.h>
 
 #define HPCIO_OUTBUF_MAGIC  0x494F4246
@@ -98,6 +114,18 @@
 // type declarations
 //***************************************************************************
 
+// one half of an async buffer
+typedef struct hpcio_outbuf_block_s {
+  struct hpcio_outbuf_block_s *next;
+  struct hpcio_outbuf_s *outbuf;
+  void  *start;
+  size_t len;
+  off_t  offset;
+  bool   failed;  // set by the writer before it clears busy
+  _Atomic(bool) busy;
+} hpcio_outbuf_block_t;
+
+
 typedef struct hpcio_outbuf_s {
   struct hpcio_outbuf_s *next;
   uint32_t magic;
@@ -108,6 +136,12 @@ typedef struct hpcio_outbuf_s {
   int  flags;
   char use_lock;
   spinlock_t lock;
+
+  // async mode only
+  char use_async;
+  int  cur_block;
+  off_t offset;
+  hpcio_outbuf_block_t block[2];
 } hpcio_outbuf_t;
 
 
@@ -119,6 +153,10 @@ typedef struct hpcio_outbuf_s {
 static spinlock_t freelist_lock = SPINLOCK_UNLOCKED;
 static hpcio_outbuf_t *freelist = 0;
 
+static _Atomic(hpcio_outbuf_block_t *) async_queue;
+static _Atomic(bool) async_writer_running;
+static sem_t async_wakeup;
+
 
 
 //*************************** Private Functions *****************************
@@ -167,6 +205,161 @@ outbuf_free
 }
 
 
+// Write len bytes at offset with pwrite(), retrying short writes.
+//
+// Returns: HPCFMT_OK if everything was written, else HPCFMT_ERR.
+//
+static int
+block_write(int fd, void *start, size_t len, off_t offset)
+{
+  ssize_t ret;
+  size_t amt_done = 0;
+
+  while (amt_done < len) {
+    errno = 0;
+    ret = pwrite(fd, start + amt_done, len - amt_done, offset + amt_done);
+
+    // Check for short writes.  Note: EINTR is not failure.
+    if (ret > 0 || (ret == 0 && errno == EINTR)) {
+      amt_done += ret;
+    }
+    else {
+      return HPCFMT_ERR;
+    }
+  }
+
+  return HPCFMT_OK;
+}
+
+
+// Lock-free push onto the writer's queue.  The writer takes the
+// entire queue at once, so there is no ABA problem.
+static void
+async_enqueue(hpcio_outbuf_block_t *block)
+{
+  hpcio_outbuf_block_t *head = atomic_load(&async_queue);
+  do {
+    block->next = head;
+  } while (!atomic_compare_exchange_weak(&async_queue, &head, block));
+}
+
+
+static void
+block_await(hpcio_outbuf_block_t *block)
+{
+  while (atomic_load(&block->busy)) {
+    sched_yield();
+  }
+}
+
+
+// Rewrite a half that the writer failed to write.
+//
+// Returns: HPCFMT_OK if the half is free for reuse, else HPCFMT_ERR.
+//
+static int
+block_retry(hpcio_outbuf_block_t *block)
+{
+  if (block->failed) {
+    hpcio_outbuf_t *outbuf = block->outbuf;
+    if (block_write(outbuf->fd, block->start, block->len,
+		    block->offset) != HPCFMT_OK) {
+      return HPCFMT_ERR;
+    }
+    block->failed = false;
+  }
+  return HPCFMT_OK;
+}
+
+
+// Write the current half directly, in place of a handoff.
+//
+// Returns: HPCFMT_OK on success, else HPCFMT_ERR and the data stays
+// in the buffer.
+//
+static int
+outbuf_write_current(hpcio_outbuf_t *outbuf)
+{
+  if (outbuf->in_use > 0) {
+    if (block_write(outbuf->fd, outbuf->buf_start, outbuf->in_use,
+		    outbuf->offset) != HPCFMT_OK) {
+      return HPCFMT_ERR;
+    }
+    outbuf->offset += outbuf->in_use;
+    outbuf->in_use = 0;
+  }
+  return HPCFMT_OK;
+}
+
+
+// Hand the current half to the writer and switch to the other half.
+// If the writer is not running or still holds the other half, write
+// the current half here rather than wait.
+//
+// Returns: HPCFMT_OK if the current half is empty again, else
+// HPCFMT_ERR and no data is lost.
+//
+static int
+outbuf_handoff_buffer(hpcio_outbuf_t *outbuf)
+{
+  if (outbuf->in_use == 0) {
+    return HPCFMT_OK;
+  }
+
+  hpcio_outbuf_block_t *block = &outbuf->block[outbuf->cur_block];
+  hpcio_outbuf_block_t *other = &outbuf->block[outbuf->cur_block ^ 1];
+
+  if (!atomic_load(&async_writer_running) || atomic_load(&other->busy)) {
+    return outbuf_write_current(outbuf);
+  }
+  if (block_retry(other) != HPCFMT_OK) {
+    return outbuf_write_current(outbuf);
+  }
+
+  block->len = outbuf->in_use;
+  block->offset = outbuf->offset;
+  block->failed = false;
+  outbuf->offset += outbuf->in_use;
+
+  atomic_store(&block->busy, true);
+  async_enqueue(block);
+  sem_post(&async_wakeup);
+
+  outbuf->cur_block ^= 1;
+  outbuf->buf_start = other->start;
+  outbuf->in_use = 0;
+
+  return HPCFMT_OK;
+}
+
+
+// Wait for the writer to finish both halves, rewrite any half it
+// failed to write, then write the current half directly.  Used for
+// explicit flush and close.
+//
+// Returns: HPCFMT_OK on success, else HPCFMT_ERR.
+//
+static int
+outbuf_drain_buffer(hpcio_outbuf_t *outbuf)
+{
+  int ret = HPCFMT_OK;
+  int i;
+
+  for (i = 0; i < 2; i++) {
+    block_await(&outbuf->block[i]);
+    if (block_retry(&outbuf->block[i]) != HPCFMT_OK) {
+      ret = HPCFMT_ERR;
+    }
+  }
+
+  if (outbuf_write_current(outbuf) != HPCFMT_OK) {
+    ret = HPCFMT_ERR;
+  }
+
+  return ret;
+}
+
+
 // Try to write() the entire outbuf.
 //
 // Returns: HPCFMT_OK if the entire buffer was successfully written,
@@ -175,6 +368,10 @@ outbuf_free
 static int
 outbuf_flush_buffer(hpcio_outbuf_t *outbuf)
 {
+  if (outbuf->use_async) {
+    return outbuf_drain_buffer(outbuf);
+  }
+
   ssize_t amt_done, ret;
 
   amt_done = 0;
@@ -245,6 +442,27 @@ hpcio_outbuf_attach
   outbuf->use_lock = (flags & HPCIO_OUTBUF_LOCKED);
   spinlock_unlock(&outbuf->lock);
 
+  outbuf->use_async = (flags & HPCIO_OUTBUF_ASYNC) && buf_size >= 2;
+  if (outbuf->use_async) {
+    // async writes use pwrite(), starting at the current position
+    off_t offset = lseek(fd, 0, SEEK_CUR);
+    outbuf->offset = (offset < 0) ? 0 : offset;
+    outbuf->cur_block = 0;
+    outbuf->buf_size = buf_size / 2;
+
+    int i;
+    for (i = 0; i < 2; i++) {
+      hpcio_outbuf_block_t *block = &outbuf->block[i];
+      block->next = NULL;
+      block->outbuf = outbuf;
+      block->start = buf_start + i * outbuf->buf_size;
+      block->len = 0;
+      block->offset = 0;
+      block->failed = false;
+      atomic_store(&block->busy, false);
+    }
+  }
+
   *outbuf_ptr = outbuf;
 
   return HPCFMT_OK;
@@ -271,8 +489,9 @@ hpcio_outbuf_write(hpcio_outbuf_t *outbuf, const void *data, size_t size)
   while (amt_done < size) {
     // flush if needed
     if (size > outbuf->buf_size - outbuf->in_use) {
-      outbuf_flush_buffer(outbuf);
-      if (outbuf->in_use == outbuf->buf_size) {
+      int ret = outbuf->use_async ? outbuf_handoff_buffer(outbuf)
+	: outbuf_flush_buffer(outbuf);
+      if (ret != HPCFMT_OK && outbuf->in_use == outbuf->buf_size) {
 	// flush failed, no space
 	break;
       }
@@ -355,3 +574,216 @@ hpcio_outbuf_close(hpcio_outbuf_t **outbuf_ptr)
 
   return ret;
 }
+
+
+// Initialize the async writer queue.  Call before starting the writer
+// thread, and again in the child after fork().  Until the writer runs,
+// full halves are written synchronously.
+//
+// Returns: HPCFMT_OK on success, else HPCFMT_ERR.
+//
+int
+hpcio_outbuf_async_init(void)
+{
+  atomic_store(&async_queue, NULL);
+  atomic_store(&async_writer_running, false);
+  return (sem_init(&async_wakeup, 0, 0) == 0) ? HPCFMT_OK : HPCFMT_ERR;
+}
+
+
+// Thread body for the async writer.  Sleeps until a half is queued.
+// Never returns.
+//
+void *
+hpcio_outbuf_async_writer(void *arg)
+{
+  // the writer never takes samples
+  sigset_t mask;
+  sigfillset(&mask);
+  pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+  atomic_store(&async_writer_running, true);
+
+  for (;;) {
+    while (sem_wait(&async_wakeup) != 0 && errno == EINTR);
+
+    hpcio_outbuf_block_t *block = atomic_exchange(&async_queue, NULL);
+
+    // blocks carry their own offsets, so queue order does not matter
+    while (block != NULL) {
+      hpcio_outbuf_block_t *next = block->next;
+      hpcio_outbuf_t *outbuf = block->outbuf;
+
+      block->failed = (block_write(outbuf->fd, block->start, block->len,
+				   block->offset) != HPCFMT_OK);
+      atomic_store(&block->busy, false);
+
+      block = next;
+    }
+  }
+
+  return NULL;
+}
+
+
+//*************************** Unit Test *************************************
+
+// Latency of appending a 16-byte trace record from a timer signal
+// handler, as a sampled thread does, with and without the async
+// writer.  Set UNIT_TEST to 1, build with
+//   cc -I<src> hpcio-buffer.c -lpthread -lrt
+// and run as: a.out [directory] [samples] [ns between samples].
+
+#define UNIT_TEST 0
+
+#if UNIT_TEST
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/syscall.h>
+
+#define TEST_BUFFER_SIZE (4 * 1024 * 1024)
+
+static hpcio_outbuf_t *test_outbuf;
+static uint64_t *test_lat;
+static volatile long test_count;
+static long test_samples;
+
+static void *
+test_alloc(size_t size)
+{
+  return malloc(size);
+}
+
+
+static int
+test_cmp(const void *a, const void *b)
+{
+  uint64_t x = *(const uint64_t *) a;
+  uint64_t y = *(const uint64_t *) b;
+  return (x > y) - (x < y);
+}
+
+
+static uint64_t
+test_nanotime(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+
+static void
+test_handler(int sig, siginfo_t *info, void *context)
+{
+  long i = test_count;
+  if (i >= test_samples) return;
+
+  uint64_t datum[2] = { i, i };
+  uint64_t t0 = test_nanotime();
+  hpcio_outbuf_write(test_outbuf, datum, sizeof(datum));
+  test_lat[i] = test_nanotime() - t0;
+  test_count = i + 1;
+}
+
+
+static void
+test_run(const char *dir, long samples, long interval, int flags,
+	 const char *name)
+{
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/hpcio-buffer-test.%d", dir, getpid());
+
+  int fd = open(path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    perror(path);
+    exit(1);
+  }
+
+  void *buf = malloc(TEST_BUFFER_SIZE);
+  test_lat = malloc(samples * sizeof(uint64_t));
+  test_samples = samples;
+  test_count = 0;
+  hpcio_outbuf_attach(&test_outbuf, fd, buf, TEST_BUFFER_SIZE, flags,
+		      test_alloc);
+
+  struct sigaction sa;
+  memset(&sa, 0, sizeof(sa));
+  sa.sa_sigaction = test_handler;
+  sa.sa_flags = SA_SIGINFO | SA_RESTART;
+  sigaction(SIGPROF, &sa, NULL);
+
+  timer_t timer;
+  struct sigevent sev;
+  memset(&sev, 0, sizeof(sev));
+  sev.sigev_notify = SIGEV_THREAD_ID;
+  sev.sigev_signo = SIGPROF;
+  sev._sigev_un._tid = syscall(SYS_gettid);
+  timer_create(CLOCK_MONOTONIC, &sev, &timer);
+
+  struct itimerspec its;
+  its.it_interval.tv_sec = interval / 1000000000L;
+  its.it_interval.tv_nsec = interval % 1000000000L;
+  its.it_value = its.it_interval;
+  timer_settime(timer, 0, &its, NULL);
+
+  // the sampled thread computes while the handler appends
+  volatile uint64_t work = 0;
+  while (test_count < samples) {
+    work++;
+  }
+
+  timer_delete(timer);
+  int ret = hpcio_outbuf_close(&test_outbuf);
+
+  // every record is in place, in order
+  int fd2 = open(path, O_RDONLY);
+  long bad = 0, i;
+  uint64_t datum[2];
+  for (i = 0; i < samples; i++) {
+    if (read(fd2, datum, sizeof(datum)) != sizeof(datum)
+	|| datum[0] != i || datum[1] != i) {
+      bad++;
+    }
+  }
+  close(fd2);
+  unlink(path);
+
+  qsort(test_lat, samples, sizeof(uint64_t), test_cmp);
+  printf("%-10s %s: p50 %lu p99 %lu p99.9 %lu p99.99 %lu max %lu ns\n",
+	 name, (ret == HPCFMT_OK && bad == 0) ? "ok" : "FAILED",
+	 test_lat[samples / 2], test_lat[samples / 100 * 99],
+	 test_lat[samples / 1000 * 999], test_lat[samples / 10000 * 9999],
+	 test_lat[samples - 1]);
+
+  free(test_lat);
+  free(buf);
+}
+
+
+int
+main(int argc, char **argv)
+{
+  const char *dir = (argc > 1) ? argv[1] : "/tmp";
+  long samples = (argc > 2) ? atol(argv[2]) : 1000 * 1000;
+  long interval = (argc > 3) ? atol(argv[3]) : 20 * 1000;
+
+  hpcio_outbuf_async_init();
+
+  // no writer yet, so full halves are written by the handler
+  test_run(dir, samples, interval, HPCIO_OUTBUF_UNLOCKED | HPCIO_OUTBUF_ASYNC,
+	   "no-writer");
+
+  pthread_t writer;
+  pthread_create(&writer, NULL, hpcio_outbuf_async_writer, NULL);
+  while (!atomic_load(&async_writer_running));
+
+  test_run(dir, samples, interval, HPCIO_OUTBUF_UNLOCKED, "sync");
+  test_run(dir, samples, interval, HPCIO_OUTBUF_UNLOCKED | HPCIO_OUTBUF_ASYNC,
+	   "async");
+
+  return 0;
+}
+
+#endif
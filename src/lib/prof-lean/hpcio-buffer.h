@@ -64,6 +64,11 @@ typedef struct hpcio_outbuf_s hpcio_outbuf_t;
 #define HPCIO_OUTBUF_LOCKED    0x1
 #define HPCIO_OUTBUF_UNLOCKED  0x2
 
+// Split the buffer into two halves.  A full half is handed to the
+// background writer and the client continues in the other half, so
+// hpcio_outbuf_write() does not call write() itself.
+#define HPCIO_OUTBUF_ASYNC     0x4
+
 #if defined(__cplusplus)
 extern "C" {
 #endif
@@ -103,6 +108,24 @@ hpcio_outbuf_close
 );
 
 
+// Background writer for HPCIO_OUTBUF_ASYNC buffers.  The client
+// calls init once per process and runs the writer on a thread of its
+// own choosing.
+
+int
+hpcio_outbuf_async_init
+(
+  void
+);
+
+
+void *
+hpcio_outbuf_async_writer
+(
+  void *arg
+);
+
+
 #if defined(__cplusplus)
 }
 #endif
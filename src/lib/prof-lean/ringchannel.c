@@ -0,0 +1,333 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+
+
+//*****************************************************************************
+// system includes
+//*****************************************************************************
+
+#include <stdint.h>
+
+
+
+//*****************************************************************************
+// local includes
+//*****************************************************************************
+
+#include "ringchannel.h"
+
+
+
+//*****************************************************************************
+// macros
+//*****************************************************************************
+
+#define RINGCHANNEL_MASK (RINGCHANNEL_CAPACITY - 1)
+
+#define overflow(ch) \
+  (&(ch)->bichannel.bistacks[bichannel_direction_forward])
+
+
+
+//*****************************************************************************
+// interface operations 
+//*****************************************************************************
+
+void 
+ringchannel_init
+(
+ ringchannel_t *ch
+)
+{
+  bichannel_init(&ch->bichannel);
+
+  atomic_init(&ch->tail, 0);
+  ch->head = 0;
+
+  // slot i is free for the producer that claims position i
+  size_t i;
+  for (i = 0; i < RINGCHANNEL_CAPACITY; i++) {
+    atomic_init(&ch->slots[i].seq, i);
+    ch->slots[i].elem = 0;
+  }
+}
+
+
+void 
+ringchannel_push
+(
+ ringchannel_t *ch, 
+ s_element_t *e
+)
+{
+  size_t pos = atomic_load_explicit(&ch->tail, memory_order_relaxed);
+
+  for (;;) {
+    ringchannel_slot_t *slot = &ch->slots[pos & RINGCHANNEL_MASK];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    intptr_t diff = (intptr_t) seq - (intptr_t) pos;
+
+    if (diff == 0) {
+      // slot is free: claim position pos
+      if (atomic_compare_exchange_weak_explicit
+	  (&ch->tail, &pos, pos + 1, memory_order_relaxed, 
+	   memory_order_relaxed)) {
+	slot->elem = e;
+	atomic_store_explicit(&slot->seq, pos + 1, memory_order_release);
+	return;
+      }
+    } else if (diff < 0) {
+      // ring is full: spill
+      bistack_push(overflow(ch), e);
+      return;
+    } else {
+      // another producer claimed pos
+      pos = atomic_load_explicit(&ch->tail, memory_order_relaxed);
+    }
+  }
+}
+
+
+size_t
+ringchannel_pop_batch
+(
+ ringchannel_t *ch, 
+ s_element_t **batch,
+ size_t max
+)
+{
+  size_t n = 0;
+  size_t pos = ch->head;
+
+  // stop at the first slot whose producer has not yet published
+  while (n < max) {
+    ringchannel_slot_t *slot = &ch->slots[pos & RINGCHANNEL_MASK];
+    size_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (seq != pos + 1) break;
+
+    batch[n++] = slot->elem;
+    atomic_store_explicit(&slot->seq, pos + RINGCHANNEL_CAPACITY, 
+			  memory_order_release);
+    pos++;
+  }
+
+  ch->head = pos;
+
+  while (n < max) {
+    s_element_t *e = bistack_pop(overflow(ch));
+    if (!e) {
+      // private stack is empty; take the producers' overflow
+      bistack_steal(overflow(ch));
+      bistack_reverse(overflow(ch));
+      e = bistack_pop(overflow(ch));
+      if (!e) break;
+    }
+    batch[n++] = e;
+  }
+
+  return n;
+}
+
+
+void
+ringchannel_recycle
+(
+ ringchannel_t *ch, 
+ s_element_t *e
+)
+{
+  bichannel_push(&ch->bichannel, bichannel_direction_backward, e);
+}
+
+
+
+//*****************************************************************************
+// unit test
+//*****************************************************************************
+
+// contention benchmark: producer threads push into one channel while
+// a consumer drains it, using a ringchannel with batched pops and a
+// bichannel with steal/pop. set UNIT_TEST to 1 and build with
+//   cc -O2 -I<src> ringchannel.c bichannel.c bistack.c stacks.c -lpthread
+// run as: a.out [producers] [items per producer]
+
+#define UNIT_TEST 0
+#if UNIT_TEST
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define BATCH 256
+
+typedef struct {
+  s_element_ptr_t next;
+  long value;
+} int_element_t;
+
+static int_element_t *elements;
+static long items;
+static atomic_long producers_done;
+static ringchannel_t ring;
+static bichannel_t bi;
+
+
+static double
+now(void)
+{
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+
+static void *
+ring_produce(void *arg)
+{
+  long p = (long) arg;
+  long i;
+  for (i = 0; i < items; i++) {
+    ringchannel_push(&ring, (s_element_t *) &elements[p * items + i]);
+  }
+  atomic_fetch_add(&producers_done, 1);
+  return NULL;
+}
+
+
+static void *
+bi_produce(void *arg)
+{
+  long p = (long) arg;
+  long i;
+  for (i = 0; i < items; i++) {
+    bichannel_push(&bi, bichannel_direction_forward, 
+		   (s_element_t *) &elements[p * items + i]);
+  }
+  atomic_fetch_add(&producers_done, 1);
+  return NULL;
+}
+
+
+static long
+ring_consume(long nproducers)
+{
+  s_element_t *batch[BATCH];
+  long sum = 0;
+  for (;;) {
+    int done = atomic_load(&producers_done) == nproducers;
+    size_t n = ringchannel_pop_batch(&ring, batch, BATCH);
+    size_t i;
+    for (i = 0; i < n; i++) sum += ((int_element_t *) batch[i])->value;
+    if (n == 0 && done) break;
+  }
+  return sum;
+}
+
+
+static long
+bi_consume(long nproducers)
+{
+  long sum = 0;
+  for (;;) {
+    int done = atomic_load(&producers_done) == nproducers;
+    bichannel_steal(&bi, bichannel_direction_forward);
+    long n = 0;
+    s_element_t *e;
+    while ((e = bichannel_pop(&bi, bichannel_direction_forward))) {
+      sum += ((int_element_t *) e)->value;
+      n++;
+    }
+    if (n == 0 && done) break;
+  }
+  return sum;
+}
+
+
+static void
+run(const char *name, long nproducers, void *(*produce)(void *), 
+    long (*consume)(long))
+{
+  pthread_t *threads = malloc(nproducers * sizeof(pthread_t));
+  atomic_store(&producers_done, 0);
+
+  double start = now();
+  long p;
+  for (p = 0; p < nproducers; p++) {
+    pthread_create(&threads[p], NULL, produce, (void *) p);
+  }
+  long sum = consume(nproducers);
+  double elapsed = now() - start;
+  for (p = 0; p < nproducers; p++) {
+    pthread_join(threads[p], NULL);
+  }
+
+  long total = nproducers * items;
+  long expected = total * (total - 1) / 2;
+  printf("%-12s producers %3ld: %6.1f Mitems/s %s\n", name, nproducers,
+	 total / elapsed * 1e-6, sum == expected ? "ok" : "WRONG SUM");
+  free(threads);
+}
+
+
+int
+main(int argc, char **argv)
+{
+  long nproducers = (argc > 1) ? atol(argv[1]) : 8;
+  items = (argc > 2) ? atol(argv[2]) : 1000000;
+
+  elements = malloc(nproducers * items * sizeof(int_element_t));
+  long i;
+  for (i = 0; i < nproducers * items; i++) elements[i].value = i;
+
+  ringchannel_init(&ring);
+  bichannel_init(&bi);
+
+  run("ringchannel", nproducers, ring_produce, ring_consume);
+  run("bichannel", nproducers, bi_produce, bi_consume);
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,233 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+
+//*****************************************************************************
+//
+// ringchannel: a channel whose forward direction is a bounded
+// multi-producer, single-consumer ring of element pointers that the
+// consumer drains in batches. producers claim a slot with a single CAS
+// on the tail; the consumer releases slots without any atomic
+// read-modify-write. if the ring is full, producers spill elements
+// onto an overflow stack, so a push never waits for the consumer.
+// elements that overflow are not ordered with respect to the ring.
+//
+// a ringchannel begins with a bichannel, whose backward direction
+// returns consumed elements to producers. channel item allocators
+// written for bichannels work unchanged.
+//
+//*****************************************************************************
+
+#ifndef ringchannel_h
+#define ringchannel_h
+
+
+
+//*****************************************************************************
+// system includes
+//*****************************************************************************
+
+#include <stddef.h>
+
+
+
+//*****************************************************************************
+// local includes
+//*****************************************************************************
+
+#include "bichannel.h"
+#include "stdatomic.h"
+
+
+
+//*****************************************************************************
+// macros
+//*****************************************************************************
+
+#define RINGCHANNEL_CAPACITY 1024
+
+// bytes between the producers' and the consumer's fields. channels are
+// allocated with hpcrun_malloc_safe, which does not honor an alignment
+// attribute, so false sharing is avoided with padding instead: fields
+// this far apart never share a line or an adjacent-line prefetch pair.
+#define RINGCHANNEL_PAD 128
+
+#define ringchannel_macro_body_ignore(x) ;
+#define ringchannel_macro_body_show(x) x
+
+#define typed_ringchannel_declare(type) \
+  typed_ringchannel_functions(type, ringchannel_macro_body_ignore)
+
+#define typed_ringchannel_impl(type) \
+  typed_ringchannel_functions(type, ringchannel_macro_body_show)
+
+#define ringchannel_op(op) \
+  ringchannel_ ## op
+
+// synthesize the name of a typed channel
+
+#define typed_ringchannel(type) \
+  type ## _ringchannel_t
+
+// synthesize name for an operation on a typed channel
+
+#define typed_ringchannel_op(type, op) \
+  type ## _ringchannel_ ## op
+
+#define typed_ringchannel_init(type) \
+  typed_ringchannel_op(type, init)
+
+#define typed_ringchannel_push(type) \
+  typed_ringchannel_op(type, push)
+
+#define typed_ringchannel_pop_batch(type) \
+  typed_ringchannel_op(type, pop_batch)
+
+#define typed_ringchannel_recycle(type) \
+  typed_ringchannel_op(type, recycle)
+
+
+// define typed wrappers for a ringchannel type
+#define typed_ringchannel_functions(type, macro) \
+\
+  void \
+  typed_ringchannel_init(type) \
+  (typed_ringchannel(type) *c) \
+  macro({ \
+    ringchannel_op(init) ((ringchannel_t *) c); \
+  }) \
+\
+  void \
+  typed_ringchannel_push(type) \
+  (typed_ringchannel(type) *c, typed_stack_elem(type) *e) \
+  macro({ \
+    ringchannel_op(push) ((ringchannel_t *) c, (s_element_t *) e); \
+  }) \
+\
+  size_t \
+  typed_ringchannel_pop_batch(type) \
+  (typed_ringchannel(type) *c, typed_stack_elem(type) **batch, size_t max) \
+  macro({ \
+    return ringchannel_op(pop_batch) ((ringchannel_t *) c, \
+      (s_element_t **) batch, max); \
+  }) \
+\
+  void \
+  typed_ringchannel_recycle(type) \
+  (typed_ringchannel(type) *c, typed_stack_elem(type) *e) \
+  macro({ \
+    ringchannel_op(recycle) ((ringchannel_t *) c, (s_element_t *) e); \
+  })
+
+
+
+//*****************************************************************************
+// type declarations
+//*****************************************************************************
+
+typedef struct ringchannel_slot_t {
+  atomic_size_t seq;
+  s_element_t *elem;
+} ringchannel_slot_t;
+
+
+typedef struct ringchannel_t {
+  // forward: overflow stack; backward: recycled elements
+  bichannel_t bichannel;
+  char pad0[RINGCHANNEL_PAD];
+
+  // written by producers
+  atomic_size_t tail;
+  char pad1[RINGCHANNEL_PAD - sizeof(atomic_size_t)];
+
+  // private to the consumer
+  size_t head;
+  char pad2[RINGCHANNEL_PAD - sizeof(size_t)];
+
+  ringchannel_slot_t slots[RINGCHANNEL_CAPACITY];
+} ringchannel_t;
+
+
+
+//*****************************************************************************
+// interface operations
+//*****************************************************************************
+
+void 
+ringchannel_init
+(
+ ringchannel_t *ch
+);
+
+
+// multiple producers
+void
+ringchannel_push
+(
+ ringchannel_t *ch, 
+ s_element_t *e
+);
+
+
+// single consumer: move up to max elements into batch, ring first,
+// then overflow. returns the number of elements moved.
+size_t
+ringchannel_pop_batch
+(
+ ringchannel_t *ch, 
+ s_element_t **batch,
+ size_t max
+);
+
+
+// return a consumed element to the producers' side of the channel
+void
+ringchannel_recycle
+(
+ ringchannel_t *ch, 
+ s_element_t *e
+);
+
+
+
+#endif
@@ -71,6 +71,7 @@ using std::dec;
 using std::string;
 
 #include <map>
+#include <vector>
 #include <algorithm>
 #include <sstream>
 
@@ -1441,9 +1442,14 @@ Profile::fmt_epoch_fread(Profile* &prof, FILE* infs, uint rFlags,
 
   LoadMap loadmap(num_lm);
 
+  std::vector<string> lmNames(num_lm);
   for (uint i = 0; i < num_lm; ++i) {
-    string nm = loadmap_tbl.lst[i].name;
-    RealPathMgr::singleton().realpath(nm);
+    lmNames[i] = loadmap_tbl.lst[i].name;
+  }
+  RealPathMgr::singleton().realpath(lmNames);
+
+  for (uint i = 0; i < num_lm; ++i) {
+    const string& nm = lmNames[i];
 
     LoadMap::LM* lm = new LoadMap::LM(nm);
     loadmap.lm_insert(lm);
@@ -63,6 +63,7 @@
 //************************ System Include Files ******************************
 
 #include <string>
+#include <vector>
 
 //************************* User Include Files *******************************
 
@@ -97,6 +98,15 @@ public:
       return oldpath;
     }
   }
+
+  // realpath: Batched form of the above, converting 'paths' in place
+  virtual void
+  realpath(std::vector<std::string>& paths) const
+  {
+    if (m_realpathMgr) {
+      m_realpathMgr->realpath(paths);
+    }
+  }
   
 private:
   const RealPathMgr* m_realpathMgr;
@@ -60,6 +60,7 @@
 //************************ System Include Files ******************************
 
 #include <sys/types.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -73,6 +74,9 @@ using std::endl;
 #include <string>
 using std::string;
 
+#include <set>
+#include <vector>
+
 //************************* User Include Files *******************************
 
 #include "PGMReader.hpp"
@@ -133,6 +137,118 @@ xmlSanityCheck(const char *filenm, string & docType)
 }
 
 
+// Value of the attribute 'attr' (e.g., " n=\"") in the tag starting
+// at 'p' and ending before 'end', with the predefined entities
+// expanded.  Returns false if there is no such attribute or it holds
+// a character reference.
+static bool
+getTagAttr(const char* p, const char* end, const char* attr, string& val)
+{
+  size_t attrLen = strlen(attr);
+  const char* tagEnd = (const char*)memchr(p, '>', end - p);
+  if (!tagEnd) {
+    return false;
+  }
+
+  const char* a = p;
+  for (;;) {
+    a = (const char*)memchr(a, attr[0], tagEnd - a);
+    if (!a || (size_t)(tagEnd - a) < attrLen) {
+      return false;
+    }
+    if (strncmp(a, attr, attrLen) == 0) {
+      break;
+    }
+    a++;
+  }
+
+  const char* v = a + attrLen;
+  const char* vEnd = (const char*)memchr(v, '"', tagEnd - v);
+  if (!vEnd) {
+    return false;
+  }
+
+  val.clear();
+  while (v < vEnd) {
+    if (*v != '&') {
+      val += *v++;
+      continue;
+    }
+    static const char* ent[] = { "&amp;", "&lt;", "&gt;", "&quot;", "&apos;" };
+    static const char chr[] = { '&', '<', '>', '"', '\'' };
+    uint k;
+    for (k = 0; k < sizeof(chr); ++k) {
+      size_t len = strlen(ent[k]);
+      if ((size_t)(vEnd - v) >= len && strncmp(v, ent[k], len) == 0) {
+	val += chr[k];
+	v += len;
+	break;
+      }
+    }
+    if (k == sizeof(chr)) {
+      return false;
+    }
+  }
+  return true;
+}
+
+
+// Resolve the file names of structure file 'filenm' (load modules,
+// files, aliens and loops) in one batch before it is parsed, so that
+// the realpath() calls of the parser and of Struct::Tree hit the
+// RealPathMgr cache rather than the file system one at a time.  This
+// is only a prefetch: names it misses are resolved as before.
+static void
+prefetchFileNames(const char* filenm, DocHandlerArgs& docHandlerArgs)
+{
+  int fd = open(filenm, O_RDONLY);
+  if (fd < 0) {
+    return;
+  }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size == 0) {
+    close(fd);
+    return;
+  }
+  void* img = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (img == MAP_FAILED) {
+    return;
+  }
+
+  const char* beg = (const char*)img;
+  const char* end = beg + st.st_size;
+  std::set<string> nameSet;
+  string val;
+
+  for (const char* p = beg; (p = (const char*)memchr(p, '<', end - p)); p++) {
+    if (end - p < 4) {
+      break;
+    }
+    bool found = false;
+    if (p[1] == 'F' && p[2] == ' ') {
+      found = getTagAttr(p, end, " n=\"", val);
+    }
+    else if (p[1] == 'L' && p[2] == 'M' && p[3] == ' ') {
+      found = getTagAttr(p, end, " n=\"", val);
+    }
+    else if ((p[1] == 'A' || p[1] == 'L') && p[2] == ' ') {
+      found = getTagAttr(p, end, " f=\"", val);
+    }
+    if (found && !val.empty()) {
+      nameSet.insert(val);
+    }
+  }
+  munmap(img, st.st_size);
+
+  std::vector<string> nameVec(nameSet.begin(), nameSet.end());
+  docHandlerArgs.realpath(nameVec);
+
+  // Struct::Tree resolves the parser's (resolved) names once more
+  docHandlerArgs.realpath(nameVec);
+}
+
+
 void
 readStructure(Struct::Tree& structure, 
 	      const std::vector<string>& structureFiles,
@@ -170,6 +286,7 @@ read_PGM(Struct::Tree& structure,
     if (xmlSanityCheck(filenm, docType)) {
       return;
     }
+    prefetchFileNames(filenm, docHandlerArgs);
     try {
       SAX2XMLReader* parser = XMLReaderFactory::createXMLReader();
       
@@ -62,9 +62,13 @@
 #include <string>
 using std::string;
 
+#include <algorithm>
 #include <cstring>
+
 #include <sys/stat.h>
 #include <dirent.h>
+#include <pthread.h>
+#include <unistd.h>
 
 //*************************** User Include Files ****************************
 
@@ -98,6 +102,215 @@ bool try_slow_lookup_for_relative_paths(const char *path)
   return contains_relative;
 }
 
+
+#define PATHFIND_THREADS_MIN  4
+#define PATHFIND_THREADS_MAX 16
+
+typedef void (*ParallelFn)(size_t i, void* arg);
+
+struct ParallelFor {
+  ParallelFn fn;
+  void* arg;
+  size_t n;
+  volatile size_t next;
+};
+
+
+static void*
+parallelForWorker(void* vpf)
+{
+  ParallelFor* pf = (ParallelFor*)vpf;
+  size_t i;
+  while ((i = __sync_fetch_and_add(&pf->next, 1)) < pf->n) {
+    pf->fn(i, pf->arg);
+  }
+  return NULL;
+}
+
+
+// call fn(i, arg) for each 0 <= i < n, on up to numThreads() threads
+// (including the caller)
+static void
+parallelFor(size_t n, ParallelFn fn, void* arg)
+{
+  ParallelFor pf = { fn, arg, n, 0 };
+
+  size_t nthreads = std::min((size_t)PathFindMgr::numThreads(), n);
+  std::vector<pthread_t> tids;
+  for (size_t t = 1; t < nthreads; t++) {
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, parallelForWorker, &pf) == 0) {
+      tids.push_back(tid);
+    }
+  }
+  parallelForWorker(&pf);
+  for (size_t t = 0; t < tids.size(); t++) {
+    pthread_join(tids[t], NULL);
+  }
+}
+
+
+// List the regular files and subdirectories of 'path'.  Symlinks are
+// followed; a directory reached through a symlink is real-pathed.
+static void
+readDir(const std::string& path, std::vector<std::string>& files,
+	std::vector<std::string>& dirs)
+{
+  DIR* dir = opendir(path.c_str());
+  if (!dir) {
+    return;
+  }
+
+  struct dirent* x;
+  while ( (x = readdir(dir)) ) {
+    // skip "." and ".."
+    if (strcmp(x->d_name, ".") == 0 || strcmp(x->d_name, "..") == 0) {
+      continue;
+    }
+    
+    std::string x_fnm = path + "/" + x->d_name;
+
+    // --------------------------------------------------
+    // compute type of 'x_fnm'
+    // --------------------------------------------------
+    unsigned char x_type = DT_UNKNOWN;
+#if defined(_DIRENT_HAVE_D_TYPE)
+    x_type = x->d_type;
+#endif
+
+    // Even if 'd_type' is available, it may be bogus.  Try stat().
+    if (x_type == DT_UNKNOWN) {
+      struct stat statbuf;
+      int ret = lstat(x_fnm.c_str(), &statbuf); // do not follow symlinks!
+      if (ret != 0) {
+	continue; // error
+      }
+      
+      if (S_ISLNK(statbuf.st_mode)) {
+	x_type = DT_LNK; // S_IFLNK
+      }
+      else if (S_ISREG(statbuf.st_mode)) {
+	x_type = DT_REG; // S_IFREG
+      }
+      else if (S_ISDIR(statbuf.st_mode)) {
+	x_type = DT_DIR; // S_IFDIR
+      }
+    }
+
+    // --------------------------------------------------
+    // special case: resolve symlink to regular file or directory
+    // --------------------------------------------------
+    if (x_type == DT_LNK) {
+      struct stat statbuf;
+      int ret = stat(x_fnm.c_str(), &statbuf); // 'stat' resolves symlinks
+      if (ret != 0) {
+	continue; // error
+      }
+      
+      if (S_ISREG(statbuf.st_mode)) {
+	x_type = DT_REG;
+      }
+      else if (S_ISDIR(statbuf.st_mode)) {
+	x_type = DT_DIR;
+	x_fnm = RealPath(x_fnm.c_str());
+      }
+    }
+
+    if (x_type == DT_REG) {
+      files.push_back(x_fnm);
+    }
+    else if (x_type == DT_DIR) {
+      dirs.push_back(x_fnm);
+    }
+  }
+  closedir(dir);
+}
+
+
+// Shared state of the threads of PathFindMgr::crawl()
+struct CrawlState {
+  pthread_mutex_t lock;
+  pthread_cond_t  cond;
+
+  bool recursive;
+  uint64_t sizeMax;
+
+  std::vector<std::string> dirs;   // directories left to read
+  std::set<std::string> seenPaths; // directories ever queued
+  std::vector<std::string> files;  // regular files found
+  uint64_t size;                   // bytes of names in 'files'
+  int busy;                        // threads reading a directory
+};
+
+
+static void*
+crawlWorker(void* vst)
+{
+  CrawlState* st = (CrawlState*)vst;
+  std::vector<std::string> files, dirs;
+
+  pthread_mutex_lock(&st->lock);
+  for (;;) {
+    while (st->dirs.empty() && st->busy > 0) {
+      pthread_cond_wait(&st->cond, &st->lock);
+    }
+    if (st->dirs.empty() || st->size >= st->sizeMax) {
+      break;
+    }
+    std::string path = st->dirs.back();
+    st->dirs.pop_back();
+    st->busy++;
+    pthread_mutex_unlock(&st->lock);
+
+    files.clear();
+    dirs.clear();
+    readDir(path, files, dirs);
+
+    pthread_mutex_lock(&st->lock);
+    st->busy--;
+    for (uint i = 0; i < files.size(); ++i) {
+      st->size += files[i].size() + 1;
+      st->files.push_back(files[i]);
+    }
+    if (st->recursive) {
+      for (uint i = 0; i < dirs.size(); ++i) {
+	if (st->seenPaths.insert(dirs[i]).second) { // avoid cycles
+	  st->dirs.push_back(dirs[i]);
+	}
+      }
+    }
+    pthread_cond_broadcast(&st->cond);
+  }
+  pthread_cond_broadcast(&st->cond);
+  pthread_mutex_unlock(&st->lock);
+
+  return NULL;
+}
+
+
+// Arguments of PathFindMgr::pathfindCached()
+struct PathFindBatch {
+  PathFindMgr* mgr;
+  const std::vector<std::string>* names;
+  std::vector<std::string>* results;
+  std::vector<char>* slow;  // needs pathfind_slow()
+};
+
+
+// Arguments of realpathOne()
+struct RealPathBatch {
+  const std::vector<std::string>* names;
+  std::vector<std::string>* results;
+};
+
+
+static void
+realpathOne(size_t i, void* vbatch)
+{
+  RealPathBatch* batch = (RealPathBatch*)vbatch;
+  (*batch->results)[i] = RealPath((*batch->names)[i].c_str());
+}
+
 //***************************************************************************
 // PathFindMgr
 //***************************************************************************
@@ -130,22 +343,7 @@ PathFindMgr::pathfind(const char* pathList, const char* name, const char* mode)
   // -------------------------------------------------------
   // 0. Cache files found using 'pathList'
   // -------------------------------------------------------
-  if (!m_isPopulated) {
-    m_isPopulated = true;
-    std::vector<std::string> pathVec; // will contain all -I paths
-    StrUtil::tokenize_str(std::string(pathList), ":", pathVec);
-    
-    std::set<std::string> seenPaths;
-    std::vector<std::string> recursionStack;
-    while (!m_isFull && !pathVec.empty()) {
-      if (pathVec.back() != ".") { // do not cache within CWD
-	scan(pathVec.back(), seenPaths, &recursionStack);
-	seenPaths.clear();
-	recursionStack.clear();
-      }
-      pathVec.pop_back();
-    }
-  }
+  populate(pathList);
 
   // -------------------------------------------------------
   // 1. Resolve 'name' either by pathfind cache or by pathfind_slow
@@ -183,6 +381,73 @@ PathFindMgr::pathfind(const char* pathList, const char* name, const char* mode)
 }
 
 
+void
+PathFindMgr::pathfind(const char* pathList,
+		      const std::vector<std::string>& names,
+		      const char* mode, std::vector<std::string>& results)
+{
+  populate(pathList);
+
+  results.assign(names.size(), std::string());
+  std::vector<char> slow(names.size(), 0);
+
+  PathFindBatch batch = { this, &names, &results, &slow };
+  parallelFor(names.size(), pathfindCached, &batch);
+
+  for (uint i = 0; i < names.size(); ++i) {
+    if (slow[i]) {
+      const char* ans = pathfind(pathList, names[i].c_str(), mode);
+      if (ans) {
+	results[i] = ans;
+      }
+    }
+  }
+}
+
+
+// Step 1 and 2 of pathfind() for names the cache can answer.  Only
+// reads the cache.
+void
+PathFindMgr::pathfindCached(size_t i, void* vbatch)
+{
+  PathFindBatch* batch = (PathFindBatch*)vbatch;
+  const std::string& name = (*batch->names)[i];
+
+  std::string name_real = name;
+  bool found = batch->mgr->find(name_real);
+
+  if (!found && (batch->mgr->m_isFull
+		 || try_slow_lookup_for_relative_paths(name.c_str()))) {
+    (*batch->slow)[i] = 1;
+    return;
+  }
+
+  const char* ans = RealPath(name_real.c_str());
+  if (found || ans[0] == '/') {
+    (*batch->results)[i] = ans;
+  }
+}
+
+
+void
+PathFindMgr::realpath(const std::vector<std::string>& names,
+		      std::vector<std::string>& results)
+{
+  results.resize(names.size());
+  RealPathBatch batch = { &names, &results };
+  parallelFor(names.size(), realpathOne, &batch);
+}
+
+
+int
+PathFindMgr::numThreads()
+{
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  int n = (ncpu > 0) ? (int)ncpu : 1;
+  return std::max(PATHFIND_THREADS_MIN, std::min(n, PATHFIND_THREADS_MAX));
+}
+
+
 const char*
 PathFindMgr::pathfind_slow(const char* pathList, const char* name,
 			   const char* mode,
@@ -410,14 +675,83 @@ PathFindMgr::insert(const std::string& path)
 }
 
 
-std::string
-PathFindMgr::scan(std::string& path, std::set<std::string>& seenPaths,
-		  std::vector<std::string>* recursionStack)
+void
+PathFindMgr::populate(const char* pathList)
+{
+  if (m_isPopulated) {
+    return;
+  }
+  m_isPopulated = true;
+
+  std::vector<std::string> pathVec; // will contain all -I paths
+  StrUtil::tokenize_str(std::string(pathList), ":", pathVec);
+
+  while (!m_isFull && !pathVec.empty()) {
+    if (pathVec.back() != ".") { // do not cache within CWD
+      crawl(pathVec.back());
+    }
+    pathVec.pop_back();
+  }
+}
+
+
+void
+PathFindMgr::crawl(std::string path)
 {
-  bool doCacheFiles = (recursionStack != NULL);
+  bool isRecursive = isRecursivePath(path.c_str());
+  if (isRecursive) {
+    path = path.substr(0, path.length() - RecursivePathSfxLn);
+  }
+
+  if (path.empty()) {
+    return;
+  }
+
+  // ensure we are using a canonical path (cf. scan())
+  path = RealPath(path.c_str());
+
+  CrawlState st;
+  pthread_mutex_init(&st.lock, NULL);
+  pthread_cond_init(&st.cond, NULL);
+  st.recursive = isRecursive;
+  st.sizeMax = s_sizeMax;
+  st.dirs.push_back(path);
+  st.seenPaths.insert(path);
+  st.size = m_size;
+  st.busy = 0;
+
+  std::vector<pthread_t> tids;
+  for (int t = 1; t < numThreads(); t++) {
+    pthread_t tid;
+    if (pthread_create(&tid, NULL, crawlWorker, &st) == 0) {
+      tids.push_back(tid);
+    }
+  }
+  crawlWorker(&st);
+  for (uint t = 0; t < tids.size(); t++) {
+    pthread_join(tids[t], NULL);
+  }
+
+  pthread_cond_destroy(&st.cond);
+  pthread_mutex_destroy(&st.lock);
+
+  std::sort(st.files.begin(), st.files.end());
+  for (uint i = 0; i < st.files.size() && !m_isFull; ++i) {
+    insert(st.files[i]);
+  }
+
+  // directories left unread: the cache cannot be trusted to be complete
+  if (!st.dirs.empty()) {
+    DIAG_WMsgIf(!m_isFull, "PathFindMgr::crawl(): cache size limit reached");
+    m_isFull = true;
+  }
+}
 
-  bool doRecursiveScan = isRecursivePath(path.c_str());
-  if (doRecursiveScan) {
+
+std::string
+PathFindMgr::scan(std::string& path, std::set<std::string>& seenPaths)
+{
+  if (isRecursivePath(path.c_str())) {
     path = path.substr(0, path.length() - RecursivePathSfxLn);
   }
 
@@ -432,11 +766,8 @@ PathFindMgr::scan(std::string& path, std::set<std::string>& seenPaths,
   // -------------------------------------------------------
 
   // 0. ensure we are using a canonical path by realpath-ing (a) the
-  //    root path and (b) symlink directories (below)
-  if ((recursionStack && recursionStack->empty())
-      || !recursionStack) {
-    path = RealPath(path.c_str());
-  }
+  //    root path and (b) symlink directories (readDir())
+  path = RealPath(path.c_str());
 
   // 1. check for a past occurance
   std::set<std::string>::iterator it = seenPaths.find(path);
@@ -450,105 +781,17 @@ PathFindMgr::scan(std::string& path, std::set<std::string>& seenPaths,
   // -------------------------------------------------------
   // Scan 'path'
   // -------------------------------------------------------
-  DIR* dir = opendir(path.c_str());
-  if (!dir) {
-    return localPaths;
-  }
+  std::vector<std::string> files, dirs;
+  readDir(path, files, dirs);
 
-  bool isFirstDir = true;
-  struct dirent* x;
-  while ( (x = readdir(dir)) ) {
-    // skip "." and ".."
-    if (strcmp(x->d_name, ".") == 0 || strcmp(x->d_name, "..") == 0) {
-      continue;
+  for (uint i = 0; i < dirs.size(); ++i) {
+    if (seenPaths.find(dirs[i]) != seenPaths.end()) {
+      continue; // avoid cycles
     }
-    
-    std::string x_fnm = path + "/" + x->d_name;
-
-    // --------------------------------------------------
-    // compute type of 'x_fnm'
-    // --------------------------------------------------
-    unsigned char x_type = DT_UNKNOWN;
-#if defined(_DIRENT_HAVE_D_TYPE)
-    x_type = x->d_type;
-#endif
-
-    // Even if 'd_type' is available, it may be bogus.  Try stat().
-    if (x_type == DT_UNKNOWN) {
-      struct stat statbuf;
-      int ret = lstat(x_fnm.c_str(), &statbuf); // do not follow symlinks!
-      if (ret != 0) {
-	continue; // error
-      }
-      
-      if (S_ISLNK(statbuf.st_mode)) {
-	x_type = DT_LNK; // S_IFLNK
-      }
-      else if (S_ISREG(statbuf.st_mode)) {
-	x_type = DT_REG; // S_IFREG
-      }
-      else if (S_ISDIR(statbuf.st_mode)) {
-	x_type = DT_DIR; // S_IFDIR
-      }
+    if (!localPaths.empty()) {
+      localPaths += ":";
     }
-
-    // --------------------------------------------------
-    // special case: resolve symlink to regular file or directory
-    // --------------------------------------------------
-    if (x_type == DT_LNK) {
-      struct stat statbuf;
-      int ret = stat(x_fnm.c_str(), &statbuf); // 'stat' resolves symlinks
-      if (ret != 0) {
-	continue; // error
-      }
-      
-      if (S_ISREG(statbuf.st_mode)) {
-	x_type = DT_REG;
-      }
-      else if (S_ISDIR(statbuf.st_mode)) {
-	x_type = DT_DIR;
-	x_fnm = RealPath(x_fnm.c_str());
-	if (seenPaths.find(x_fnm) != seenPaths.end()) {
-	  continue; // avoid cycles
-	}
-      }
-    }
-
-    // --------------------------------------------------
-    // case 1: regular file
-    // --------------------------------------------------
-    if (x_type == DT_REG) {
-      if (doCacheFiles && !m_isFull) {
-	insert(x_fnm);
-      }
-    }
-
-    // --------------------------------------------------
-    // case 2: directory
-    // --------------------------------------------------
-    else if (x_type == DT_DIR) {
-      if (recursionStack) {
-	if (doRecursiveScan) {
-	  x_fnm += "/*";
-	  recursionStack->push_back(x_fnm);
-	}
-      }
-      else {
-	x_fnm += "/*";
-	if (!isFirstDir) {
-	  localPaths += ":";
-	}
-	localPaths += x_fnm;
-	isFirstDir = false;
-      }
-    }
-  }
-  closedir(dir);
-  
-  if (recursionStack && !recursionStack->empty()) {
-    std::string nextPath = recursionStack->back();
-    recursionStack->pop_back();
-    scan(nextPath, seenPaths, recursionStack);
+    localPaths += dirs[i] + "/*";
   }
 
   return localPaths;
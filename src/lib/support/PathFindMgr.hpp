@@ -127,6 +127,26 @@ public:
   // calls to this function, and must not be freed by the caller.
   const char*
   pathfind(const char* pathList, const char* name, const char* mode);
+
+  // pathfind: Batched form of the above: set 'results[i]' to the
+  // answer for 'names[i]', or to "" where the above returns NULL.
+  // Names answered by the cache are resolved in parallel; the others
+  // are searched for on disk one at a time.
+  void
+  pathfind(const char* pathList, const std::vector<std::string>& names,
+	   const char* mode, std::vector<std::string>& results);
+
+  // realpath: Set 'results[i]' to RealPath(names[i]) for each name,
+  // resolving the names in parallel.
+  static void
+  realpath(const std::vector<std::string>& names,
+	   std::vector<std::string>& results);
+
+  // Number of threads that read directories and resolve batches of
+  // paths.  The work waits on the file system rather than the CPU, so
+  // there are a few even on small nodes.
+  static int
+  numThreads();
   
   
   // Is this a valid recursive path of the form '.../path/\*' ?
@@ -206,33 +226,42 @@ private:
   insert(const std::string& path);
 
 
-  // Scans the directory designated by 'path' and does one of two
-  // things, depending on the value of 'recursionStack'.
-  // - If 'recursionStack' is non-NULL, cache all the files in 'path'
-  //   (until the cache is full).  If 'path' is recursive, scan
-  //   recursively.  (Use 'recursionStack' to implement recursion.)
-  // - Otherwise, ignore files and return a (non-recursive)
-  //   colon-separated list of all subdirectories within 'path'.  Each
-  //   path is suffixed with '*' (a recursive path).
-  //
-  // Assumes that path has been real-pathed.
+  // Caches the files of each path in 'pathList', once.  See crawl().
+  void
+  populate(const char* pathList);
+
+
+  // Caches all the files in the directory 'path' (until the cache is
+  // full) and, if 'path' is recursive, in all directories below it.
+  // Directories are read by numThreads() threads: on a parallel file
+  // system each read is a round trip to a metadata server.  The files
+  // found are cached in sorted order, so the cache does not depend on
+  // thread timing.
   //
-  // ** N.B.: This is a confusing conflation of two functions that are
-  // similar; there should have been more abstraction. **
+  // @param path: The path to the directory whose contents are to be
+  //              cached. If it is recursive, it ends with '/*'.
+  void
+  crawl(std::string path);
+
+
+  // Scans the directory designated by 'path' and returns a
+  // (non-recursive) colon-separated list of all subdirectories
+  // within 'path'.  Each path is suffixed with '*' (a recursive
+  // path).
   //
-  // @param path:          The path to the directory whose contents are to
-  //                       be cached. If it is recursive, a '*' will be
-  //                       appended at the end.
+  // @param path:          The directory to scan.  A trailing '/*' is
+  //                       ignored.  Replaced by its real path.
   //
   // @param seenPaths:     Set of paths already seen.  Used to avoid 
   //                       cycles caused by symlinks.
-  //
-  // @param resultpathVec: If non-NULL and 'path' is recursive, all
-  //                       sub-directories of 'path' will be added to
-  //                       this vector, which is used in a LIFO manner.
   std::string
-  scan(std::string& path, std::set<std::string>& seenPaths,
-       std::vector<std::string>* recursionStack = NULL);
+  scan(std::string& path, std::set<std::string>& seenPaths);
+
+
+  // Resolves names[i] of a batched pathfind() from the cache (a
+  // parallel loop body; 'batch' is a PathFindBatch).
+  static void
+  pathfindCached(size_t i, void* batch);
 
  
   // If the cache is full and a path cannot be found from the cache,
@@ -62,6 +62,9 @@
 #include <string>
 using std::string;
 
+#include <map>
+#include <sstream>
+
 
 //*************************** User Include Files ****************************
 
@@ -140,7 +143,7 @@ RealPathMgr::realpath(string& pathNm) const
   // -------------------------------------------------------
   if (it != m_cache.end()) {
     // use cached value
-    const string& pathNm_real = it->second;
+    const string& pathNm_real = *(it->second);
     if (pathNm_real[0] == '/') { // optimization: only copy if fully resolved
       pathNm = pathNm_real;
     }
@@ -151,24 +154,19 @@ RealPathMgr::realpath(string& pathNm) const
     // -------------------------------------------------------
     string pathNm_orig = pathNm;
 
-    if (m_pathReplaceMgr != NULL) {
-      pathNm = m_pathReplaceMgr->replace(pathNm);
-    }
-    else {
-      pathNm = PathReplacementMgr::singleton().replace(pathNm);
-    }
+    pathNm = replace(pathNm);
 
     it = m_cache.find(pathNm);
 
     if (it != m_cache.end()) {
       // use cached value
-      const string& pathNm_real = it->second;
+      const string& pathNm_real = *(it->second);
       if (pathNm_real[0] == '/') { // optimization: only copy if fully resolved
 	pathNm = pathNm_real;
       }
 
       // since 'pathNm_orig' was not in map, ensure it is
-      m_cache.insert(make_pair(pathNm_orig, pathNm_real));
+      m_cache.insert(make_pair(pathNm_orig, it->second));
     }
     else {
       // -------------------------------------------------------
@@ -196,13 +194,98 @@ RealPathMgr::realpath(string& pathNm) const
       }
 
       pathNm = pathNm_real;
-      m_cache.insert(make_pair(pathNm_orig, pathNm_real));
+      m_cache.insert(make_pair(pathNm_orig, intern(pathNm_real)));
     }
   }
   return (pathNm[0] == '/'); // fully resolved
 }
 
 
+void
+RealPathMgr::realpath(std::vector<string>& pathNms) const
+{
+  // -------------------------------------------------------
+  // 1. Convert the names the cache knows (cf. the above) and collect
+  //    the distinct path-replaced names of the others
+  // -------------------------------------------------------
+  std::vector<string> missVec;
+  std::unordered_map<string, size_t> missMap; // missVec index
+  std::vector<std::pair<size_t, size_t> > missOf; // (pathNms, missVec)
+
+  for (size_t i = 0; i < pathNms.size(); ++i) {
+    string& pathNm = pathNms[i];
+    if (pathNm.empty()) {
+      continue;
+    }
+
+    MyMap::iterator it = m_cache.find(pathNm);
+    if (it == m_cache.end()) {
+      string pathNm_rep = replace(pathNm);
+      it = m_cache.find(pathNm_rep);
+      if (it != m_cache.end()) {
+	m_cache.insert(make_pair(pathNm, it->second));
+	pathNm = pathNm_rep;
+      }
+      else {
+	std::pair<std::unordered_map<string, size_t>::iterator, bool> ret =
+	  missMap.insert(make_pair(pathNm_rep, missVec.size()));
+	if (ret.second) {
+	  missVec.push_back(pathNm_rep);
+	}
+	missOf.push_back(std::make_pair(i, ret.first->second));
+	continue;
+      }
+    }
+
+    const string& pathNm_real = *(it->second);
+    if (pathNm_real[0] == '/') { // optimization: only copy if fully resolved
+      pathNm = pathNm_real;
+    }
+  }
+
+  if (missVec.empty()) {
+    return;
+  }
+
+  // -------------------------------------------------------
+  // 2. Resolve the rest using PathFindMgr or realpath
+  // -------------------------------------------------------
+  std::vector<string> realVec;
+  if (m_searchPaths.empty()) {
+    PathFindMgr::realpath(missVec, realVec);
+  }
+  else {
+    PathFindMgr& mgr =
+      (m_pathFindMgr != NULL) ? *m_pathFindMgr : PathFindMgr::singleton();
+    mgr.pathfind(m_searchPaths.c_str(), missVec, "r", realVec);
+    for (size_t j = 0; j < realVec.size(); ++j) {
+      if (realVec[j].empty()) {
+	realVec[j] = missVec[j];
+      }
+    }
+  }
+
+  for (size_t k = 0; k < missOf.size(); ++k) {
+    string& pathNm = pathNms[missOf[k].first];
+    const string* pathNm_real = intern(realVec[missOf[k].second]);
+    m_cache.insert(make_pair(pathNm, pathNm_real));
+    pathNm = *pathNm_real;
+  }
+}
+
+
+string
+RealPathMgr::replace(const string& pathNm) const
+{
+  if (m_pathReplaceMgr != NULL) {
+    return m_pathReplaceMgr->replace(pathNm);
+  }
+  else {
+    return PathReplacementMgr::singleton().replace(pathNm);
+  }
+}
+
+
 void
 RealPathMgr::searchPaths(const string& pathsStr)
 {
@@ -244,10 +327,14 @@ std::ostream&
 RealPathMgr::dump(std::ostream& os, uint GCC_ATTR_UNUSED flags,
 		  const char* pfx) const
 {
+  // sorted, for a stable dump
+  std::map<string, const string*> sorted(m_cache.begin(), m_cache.end());
+
   os << pfx << "[ RealPathMgr:" << std::endl;
-  for (MyMap::const_iterator it = m_cache.begin(); it != m_cache.end(); ++it) {
+  for (std::map<string, const string*>::const_iterator it = sorted.begin();
+       it != sorted.end(); ++it) {
     const string& x = it->first;
-    const string& y = it->second;
+    const string& y = *(it->second);
     os << pfx << "  " << x << " => " << y << std::endl;
   }
   os << pfx << "]" << std::endl;
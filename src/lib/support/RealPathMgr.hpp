@@ -63,7 +63,9 @@
 //************************* System Include Files ****************************
 
 #include <string>
-#include <map>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
 #include <iostream>
 
 #include <cctype>
@@ -105,6 +107,12 @@ public:
   // return false.
   bool
   realpath(std::string& pathNm) const;
+
+  // realpath: Batched form of the above: convert each of 'pathNms'.
+  // The names missing from the cache are resolved together and in
+  // parallel (cf. PathFindMgr::pathfind()).
+  void
+  realpath(std::vector<std::string>& pathNms) const;
   
   
   const std::string&
@@ -140,12 +148,25 @@ public:
 
 
 private:
-  typedef std::map<std::string, std::string> MyMap;
+  // m_cache maps each name looked up to its real path, which is
+  // interned in m_realPaths: many names (relative, through symlinks,
+  // in different forms) share one real path.  Elements of unordered
+  // containers do not move, so the pointers stay valid.
+  typedef std::unordered_set<std::string> StringSet;
+  typedef std::unordered_map<std::string, const std::string*> MyMap;
+
+  const std::string*
+  intern(const std::string& pathNm_real) const
+  { return &*(m_realPaths.insert(pathNm_real).first); }
+
+  std::string
+  replace(const std::string& pathNm) const;
 
   PathFindMgr * m_pathFindMgr;
   PathReplacementMgr * m_pathReplaceMgr;
 
   std::string m_searchPaths;
+  mutable StringSet m_realPaths;
   mutable MyMap m_cache;
 };
 
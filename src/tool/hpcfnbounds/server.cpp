@@ -443,6 +443,12 @@ system_server(DiscoverFnTy fn_discovery, int fd1, int fd2)
       do_query(fn_discovery, &mesg);
     }
 
+    // batch queries are only supported by hpcfnbounds2, the client
+    // falls back to single queries
+    else if (mesg.type == SYSERV_QUERY_BATCH) {
+      write_mesg(SYSERV_ERR, 0);
+    }
+
     // unknown message
     else {
       err(1, "unknown mesg type from client: %d", mesg.type);
@@ -0,0 +1,181 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+// cache.c - write the function list of a load-object as an fnbounds cache file
+
+#include  <limits.h>
+#include  <sys/stat.h>
+
+#include  "fnbounds.h"
+#include  "syserv-mesg.h"
+
+char  *cache_dir = NULL;
+
+static char cbuf[PATH_MAX + 128];
+
+// read the GNU build-id note from the PT_NOTE segments of e as a hex string;
+// hpcrun reads it the same way from the file, so stripped section headers
+// do not matter
+static int
+cache_build_id(Elf *e, char *hex)
+{
+  static const char digits[] = "0123456789abcdef";
+  size_t nphdr, i, k;
+  GElf_Phdr phdr;
+
+  hex[0] = '\0';
+  if (elf_getphdrnum(e, &nphdr) != 0) {
+    return SC_SKIP;
+  }
+  for (i = 0; i < nphdr; i++) {
+    if (gelf_getphdr(e, i, &phdr) == NULL || phdr.p_type != PT_NOTE) {
+      continue;
+    }
+    Elf_Data *data = elf_getdata_rawchunk(e, phdr.p_offset, phdr.p_filesz, ELF_T_NHDR);
+    if (data == NULL) {
+      continue;
+    }
+
+    size_t off = 0, name_off, desc_off;
+    GElf_Nhdr nhdr;
+    while ((off = gelf_getnote(data, off, &nhdr, &name_off, &desc_off)) > 0) {
+      if (nhdr.n_type == NT_GNU_BUILD_ID && nhdr.n_namesz == 4
+          && memcmp((char *)data->d_buf + name_off, "GNU", 4) == 0
+          && nhdr.n_descsz > 0 && nhdr.n_descsz <= FNBOUNDS_CACHE_BUILD_ID_MAX) {
+        unsigned char *desc = (unsigned char *)data->d_buf + desc_off;
+        for (k = 0; k < nhdr.n_descsz; k++) {
+          hex[2*k] = digits[desc[k] >> 4];
+          hex[2*k + 1] = digits[desc[k] & 0xf];
+        }
+        hex[2*nhdr.n_descsz] = '\0';
+        return SC_DONE;
+      }
+    }
+  }
+  return SC_SKIP;
+}
+
+// write_cache_file -- write the sorted function list of xname to cache_dir,
+// in the same form send_funcs() sends it to hpcrun.  The file is written
+// under a temporary name and renamed into place, so hpcrun never maps a
+// partial file.  Returns NULL on success, or an error message.
+char *
+write_cache_file(Elf *e)
+{
+  char path[PATH_MAX];
+  char fname[PATH_MAX + 64];
+  char tname[PATH_MAX + 96];
+  struct syserv_fnbounds_cache hdr;
+  struct stat st;
+  uint64_t *addrs;
+  uint64_t lastaddr;
+  size_t i, np, pathlen;
+  FILE *fp;
+
+  if (realpath(xname, path) == NULL || stat(path, &st) != 0) {
+    sprintf(cbuf, "cannot cache %s -- %s", xname, strerror(errno));
+    return cbuf;
+  }
+
+  // the unique addresses, and a zero at the end
+  addrs = (uint64_t *)malloc((nfunc + 1) * sizeof(uint64_t));
+  if (addrs == NULL) {
+    sprintf(cbuf, "cannot allocate %ld addresses for cache file", nfunc + 1);
+    return cbuf;
+  }
+  np = 0;
+  lastaddr = (uint64_t) -1;
+  for (i = 0; i < nfunc; i++) {
+    if (farray[i].fadd != lastaddr) {
+      addrs[np++] = farray[i].fadd;
+      lastaddr = farray[i].fadd;
+    }
+  }
+  addrs[np++] = 0;
+
+  pathlen = strlen(path) + 1;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, FNBOUNDS_CACHE_MAGIC, sizeof(hdr.magic));
+  hdr.version = FNBOUNDS_CACHE_VERSION;
+  hdr.addr_size = sizeof(void *);
+  hdr.file_size = st.st_size;
+  hdr.mtime_sec = st.st_mtim.tv_sec;
+  hdr.mtime_nsec = st.st_mtim.tv_nsec;
+  (void)cache_build_id(e, hdr.build_id);
+  hdr.path_offset = sizeof(hdr);
+  hdr.addr_offset = (hdr.path_offset + pathlen + 7) & ~((uint64_t) 7);
+  hdr.num_addrs = np;
+  hdr.reference_offset = refOffset;
+  hdr.is_relocatable = is_dotso;
+
+  sprintf(fname, "%s/%016lx" FNBOUNDS_CACHE_SUFFIX, cache_dir, fnbounds_cache_hash(path));
+  sprintf(tname, "%s.%d.tmp", fname, (int)getpid());
+
+  fp = fopen(tname, "w");
+  if (fp == NULL) {
+    free(addrs);
+    sprintf(cbuf, "cannot create cache file %s -- %s", tname, strerror(errno));
+    return cbuf;
+  }
+  static const char pad[8] = {0};
+  size_t npad = hdr.addr_offset - hdr.path_offset - pathlen;
+  int ok = fwrite(&hdr, sizeof(hdr), 1, fp) == 1
+    && fwrite(path, pathlen, 1, fp) == 1
+    && (npad == 0 || fwrite(pad, npad, 1, fp) == 1)
+    && fwrite(addrs, np * sizeof(uint64_t), 1, fp) == 1;
+  ok = (fclose(fp) == 0) && ok;
+  free(addrs);
+
+  if (!ok || rename(tname, fname) != 0) {
+    sprintf(cbuf, "cannot write cache file %s -- %s", fname, strerror(errno));
+    unlink(tname);
+    return cbuf;
+  }
+
+  if (verbose) {
+    fprintf(stderr, "FNB2: wrote %ld addresses for %s to %s\n", np - 1, path, fname);
+  }
+  return NULL;
+}
@@ -0,0 +1,64 @@
+#!/bin/sh
+#
+# Time hpcfnbounds2 on one scan thread against several, and check that
+# both give the same function list.
+#
+# usage: fnbounds-bench.sh hpcfnbounds2 [-r reps] [-j threads] [file ...]
+#
+# Without files, the five largest shared libraries under /usr/lib are
+# used.  Each time is the best of reps runs (default 3).  The thread
+# count defaults to the number of online CPUs.
+#
+
+die() {
+    echo "fnbounds-bench: $*" 1>&2
+    exit 1
+}
+
+[ $# -ge 1 ] || die "usage: $0 hpcfnbounds2 [-r reps] [-j threads] [file ...]"
+fnb="$1"
+shift
+[ -x "$fnb" ] || die "not executable: $fnb"
+
+reps=3
+threads=`getconf _NPROCESSORS_ONLN 2>/dev/null || echo 1`
+while [ $# -gt 0 ]; do
+    case "$1" in
+	-r) reps="$2"; shift 2 ;;
+	-j) threads="$2"; shift 2 ;;
+	*)  break ;;
+    esac
+done
+
+if [ $# -eq 0 ]; then
+    set -- `find /usr/lib /usr/lib64 -name '*.so*' -type f -size +10M 2>/dev/null \
+	| xargs ls -S 2>/dev/null | head -5`
+fi
+[ $# -ge 1 ] || die "no files to scan"
+
+tmp=`mktemp -d` || die "mktemp failed"
+trap 'rm -rf "$tmp"' 0
+
+# best time in ms of reps runs of hpcfnbounds2 -j $1 on $2, output in $3
+best_ms() {
+    best=
+    i=0
+    while [ $i -lt $reps ]; do
+	start=`date +%s%N`
+	"$fnb" -j "$1" "$2" > "$3" 2>/dev/null
+	end=`date +%s%N`
+	ms=$(( (end - start) / 1000000 ))
+	if [ -z "$best" ] || [ $ms -lt $best ]; then best=$ms; fi
+	i=$((i + 1))
+    done
+    echo $best
+}
+
+printf '%-40s %10s %10s %8s  %s\n' file "-j 1 ms" "-j $threads ms" speedup output
+for file in "$@"; do
+    seq=`best_ms 1 "$file" "$tmp/seq"`
+    par=`best_ms "$threads" "$file" "$tmp/par"`
+    if cmp -s "$tmp/seq" "$tmp/par"; then same=same; else same=DIFFERENT; fi
+    speedup=`awk "BEGIN { printf \"%.2f\", $seq / ($par > 0 ? $par : 1) }"`
+    printf '%-40s %10s %10s %8s  %s\n' `basename "$file"` $seq $par $speedup $same
+done
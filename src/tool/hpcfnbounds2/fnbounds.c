@@ -49,12 +49,16 @@
 #include  "code-ranges.h"
 #include  "server.h"
 #include  "scan.h"
+#include  "funclist.h"
+
+#include <sys/stat.h>
 
 #include <include/hpctoolkit-version.h>
 
 int verbose = 0;
 int scan_code = 1;
 int no_dwarf = 0;
+int scan_threads = 0;   // 0: one per CPU
 int outputmode = OM_TEXT;
 
 size_t  maxfunc = 0;
@@ -141,6 +145,23 @@ main(int argc, char **argv, char **envp)
       p++;
       continue;
     }
+    if ( strcmp (*p, "-C") == 0 ) {
+      // write each load-object's function list to a cache file in the directory
+      if ((i+1) >= argc) {
+        fprintf (stderr, "FNB2: -C requires a directory\n" );
+        exit(1);
+      }
+      p++;
+      cache_dir = *p;
+      if (mkdir (cache_dir, 0755) != 0 && errno != EEXIST) {
+        fprintf (stderr, "FNB2: cannot create cache directory %s -- %s\n", cache_dir, strerror(errno) );
+        exit(1);
+      }
+      outputmode = OM_CACHE;
+      i++;
+      p++;
+      continue;
+    }
     if ( strcmp (*p, "-d") == 0 ) {
       // treat as an alias for "-n itfa"
       disable_sources ("itfa");
@@ -162,6 +183,18 @@ main(int argc, char **argv, char **envp)
       p++;
       continue;
     }
+    if ( strcmp (*p, "-j") == 0 ) {
+      // number of scanning threads
+      if ((i+1) >= argc) {
+        fprintf (stderr, "FNB2: -j requires a thread count\n" );
+        exit(1);
+      }
+      p++;
+      scan_threads = atoi (*p);
+      i++;
+      p++;
+      continue;
+    }
     if ( strcmp (*p, "-h") == 0 ) {
       usage();
       exit(0);
@@ -222,32 +255,14 @@ get_funclist(char *name)
 {
   int fd;
   char  *ret = NULL;
-  uint64_t k;
   Elf   *e;
   
   refOffset = 0;
 
-  // Make sure function list array is allocated
-  // And that initial values are set to something reasonable in case of early exit
+  // Functions are added to per-thread lists, and only gathered into
+  // farray once all sections are scanned
   //
-  if ( farray == NULL) {
-    farray = (Function_t*) valloc(MAX_FUNC * sizeof(Function_t) );  
-    maxfunc = MAX_FUNC;
-    nfunc = 0;
-    //
-    // This is a "safe" initialization.  If it causes extra memory to be
-    // mapped (i.e. memory usage increases markedly, it could be removed.
-    //
-    for (k = 0; k < maxfunc; k++) {
-      farray[k].fadd = 0ull;
-      farray[k].fnam = NULL;
-      farray[k].src = SC_FNTYPE_NONE;
-      farray[k].fr_fnam = FR_NO;
-    }
-    if ( verbose > 1) {
-      fprintf(stderr, "FNB2: Initial farray allocated for %ld functions\n", maxfunc);
-    }
-  }
+  fl_init();
   xname = name;
 
   // Special-case the name "[vdso]"
@@ -309,6 +324,7 @@ cleanup()
     farray = NULL;
     nfunc = 0;
  }
+  fl_cleanup();
 
   refOffset = 0;
 }
@@ -346,9 +362,9 @@ process_mapped_header(Elf *lelf)
   size_t j,jn;
   GElf_Phdr progHeader;
   ehRecord_t ehInfo;
-  uint64_t rf;
   uint32_t symTabPresent;
-  uint32_t dynSymIssue;
+  uint64_t symtabRf, dynsymRf;
+  SymSec_t symtabSec, dynsymSec;
   char elfclass;
 
   // verify the header is as it should be
@@ -433,11 +449,14 @@ process_mapped_header(Elf *lelf)
 
   section = NULL;
 
-  symTabPresent = FR_NO;
-  dynSymIssue = FR_NO;
+  // a missing symtab counts as unread, a missing dynsym as no issue
+  symtabRf = SC_SKIP;
+  dynsymRf = SC_DONE;
   //
   // This is the main loop for traversing the sections.
   // NB section numbering starts at 1, not 0.
+  // The symbol sections are only queued here, and read in parallel
+  // after the loop.
   //
   for(i=1; i < nsec; i++) {
     section = elf_nextscn(lelf, section);
@@ -467,19 +486,10 @@ process_mapped_header(Elf *lelf)
     }
       
     if (secHead.sh_type == SHT_SYMTAB) {
-      rf = symtabread(lelf, secHead);
-      // only skip eh_frame if symtabread was successful
-      if ((rf == SC_DONE) && (symtabread_f == SC_DONE) && (dynSymIssue == FR_NO)){
-        symTabPresent = FR_YES;
-      }
+      symtabRf = symtabread(lelf, secHead, &symtabSec);
     }
     else if (secHead.sh_type == SHT_DYNSYM) {
-      rf = dynsymread(lelf, secHead);
-      // force eh_frame read if something went wrong
-      if ((rf == SC_SKIP) && (dynsymread_f == SC_DONE)) {
-        dynSymIssue = FR_YES;
-        symTabPresent = FR_NO;
-      }
+      dynsymRf = dynsymread(lelf, secHead, &dynsymSec);
     }
 
     else if (secHead.sh_type == SHT_PROGBITS) {
@@ -516,6 +526,25 @@ process_mapped_header(Elf *lelf)
       }
     }
   }
+  // read the symbol sections
+  fl_run();
+  if (symtabRf == SC_DONE) {
+    symtabRf = symtabSec.rf;
+  }
+  if (dynsymRf == SC_DONE) {
+    dynsymRf = dynsymSec.rf;
+  }
+
+  // only skip eh_frame if symtabread was successful, and
+  // force eh_frame read if something went wrong with the dynsym
+  symTabPresent = FR_NO;
+  if ((symtabRf == SC_DONE) && (symtabread_f == SC_DONE)) {
+    symTabPresent = FR_YES;
+  }
+  if ((dynsymRf == SC_SKIP) && (dynsymread_f == SC_DONE)) {
+    symTabPresent = FR_NO;
+  }
+
   //
   // any eh_frame scans are done after traversing the sections,
   // because various of them may be needed for relative addressing
@@ -544,12 +573,15 @@ process_mapped_header(Elf *lelf)
 #endif
 
   // We have the complete function table, now sort it
-  qsort( (void *)farray, nfunc, sizeof(Function_t), &func_cmp );
+  fl_merge();
 
   // output the result
   if (server_mode != 0) {
     // send list to server
     send_funcs();
+  } else if (outputmode == OM_CACHE) {
+    // write list to a cache file for hpcrun
+    return write_cache_file(lelf);
   } else {
     // Print the function list
     print_funcs();
@@ -602,7 +634,7 @@ disable_sources(char *str)
 // Routines to read the elf sections
 
 uint64_t
-dynsymread(Elf *e, GElf_Shdr sechdr)
+dynsymread(Elf *e, GElf_Shdr sechdr, SymSec_t *symSec)
 {
   uint64_t rf;
 
@@ -610,14 +642,14 @@ dynsymread(Elf *e, GElf_Shdr sechdr)
     return SC_SKIP;
   }
 
-  rf = symsecread (e, sechdr, SC_FNTYPE_DYNSYM);
+  rf = symsecread (e, sechdr, SC_FNTYPE_DYNSYM, symSec);
 
   return rf;
 
 }
 
 uint64_t 
-symtabread(Elf *e, GElf_Shdr sechdr)
+symtabread(Elf *e, GElf_Shdr sechdr, SymSec_t *symSec)
 {
   uint64_t rf;
 
@@ -625,22 +657,22 @@ symtabread(Elf *e, GElf_Shdr sechdr)
       return SC_SKIP;
   }
 
-  rf = symsecread (e, sechdr, SC_FNTYPE_SYMTAB);
+  rf = symsecread (e, sechdr, SC_FNTYPE_SYMTAB, symSec);
 
   return rf;
 
 }
 
+// Queue the symbols of a section to be read in chunks.  The section and
+// string table data are fetched and translated here, and the tasks read
+// the symbols straight from those buffers, so no libelf call runs on a
+// worker thread.  symSec->rf becomes SC_SKIP if a task fails.
 uint64_t
-symsecread(Elf *e, GElf_Shdr secHead, char *src)
+symsecread(Elf *e, GElf_Shdr secHead, char *src, SymSec_t *symSec)
 {
-  Elf_Data *data;
-  char *symName;
+  Elf_Data *data, *strData;
+  Elf_Scn *section, *strSection;
   uint64_t count;
-  GElf_Sym curSym;
-  Elf_Scn *section;
-  uint64_t ii,symType;
-  // char *marmite;
 
   section = gelf_offscn(e,secHead.sh_offset);  // back read section from header offset
   if (section == NULL) {
@@ -652,34 +684,60 @@ symsecread(Elf *e, GElf_Shdr secHead, char *src)
     fprintf(stderr, "FNB2: %s %s\n", elfGenericErr, elf_errmsg(-1));
     return SC_SKIP;
   }
+  strSection = elf_getscn(e, secHead.sh_link);
+  strData = (strSection == NULL) ? NULL : elf_getdata(strSection, NULL);
+  if (strData == NULL || strData->d_buf == NULL) {
+    fprintf(stderr, "FNB2: %s %s\n", elfGenericErr, elf_errmsg(-1));
+    return SC_SKIP;
+  }
+  // get_funclist only accepts ELFCLASS64 files
+  if (data->d_type != ELF_T_SYM || data->d_buf == NULL) {
+    fprintf(stderr, "FNB2: %s unexpected symbol section data\n", elfGenericErr);
+    return SC_SKIP;
+  }
 
+  symSec->data = data;
+  symSec->strData = strData;
+  symSec->src = src;
+  symSec->rf = SC_DONE;
 
-  count = (secHead.sh_size)/(secHead.sh_entsize);
-  for (ii=0; ii<count; ii++) {
-    if (gelf_getsym(data, ii, &curSym) != &curSym) {
-      fprintf(stderr, "FNB2: %s %s\n", elfGenericErr, elf_errmsg(-1));
-      return SC_SKIP;
-    }
-    symName = elf_strptr(e, secHead.sh_link, curSym.st_name);
-    if (symName == NULL) {
-      fprintf(stderr, "FNB2: %s %s\n", elfGenericErr, elf_errmsg(-1));
-      return SC_SKIP;
-    }
-    symType = GELF_ST_TYPE(curSym.st_info);
-
-    if ( (symType == STT_FUNC) && (curSym.st_value != 0) ) {
-      add_function(curSym.st_value, symName, src, FR_NO);
-      // this hack in case the symName was going away with the
-      // closed elf *, but that doesn't seem to be happening.
-      // marmite = strdup(symName);
-      // add_function(curSym.st_value, marmite, src, FR_YES);
-    }
-  }
+  count = data->d_size / sizeof(Elf64_Sym);
+  fl_task(symsec_task, symSec, count, FL_SYM_CHUNK);
 
   return SC_DONE;
 
 }
 
+// Read symbols [lo, hi) of a section queued by symsecread
+void
+symsec_task(void *arg, uint64_t lo, uint64_t hi)
+{
+  SymSec_t *symSec = (SymSec_t *)arg;
+  char *strBuf = (char *)symSec->strData->d_buf;
+  size_t strSize = symSec->strData->d_size;
+  char *symName;
+  Elf64_Sym *curSym;
+  uint64_t ii,symType,stName;
+
+  for (ii=lo; ii<hi; ii++) {
+    curSym = (Elf64_Sym *)symSec->data->d_buf + ii;
+    stName = curSym->st_name;
+    symType = ELF64_ST_TYPE(curSym->st_info);
+    if ( (stName >= strSize) || (memchr(strBuf + stName, '\0', strSize - stName) == NULL) ) {
+      fprintf(stderr, "FNB2: %s symbol name at offset %ld not in the string table\n",
+          elfGenericErr, stName);
+      __atomic_store_n(&symSec->rf, SC_SKIP, __ATOMIC_RELAXED);
+      return;
+    }
+    symName = strBuf + stName;
+
+    if ( (symType == STT_FUNC) && (curSym->st_value != 0) ) {
+      // symName points into the elf string table, which libelf frees
+      add_function(curSym->st_value, symName, symSec->src, FR_NO);
+    }
+  }
+}
+
 void
 print_funcs()
 {
@@ -695,9 +753,10 @@ print_funcs()
 
   // Print the function list
   int np = 0;
+  char nameBuff[TB_SIZE];
   if (nfunc > 0) {
     // print the first entry, not beginning with new line
-    printf("0x%lx    %s(%s)", farray[0].fadd, farray[0].fnam, farray[0].src);
+    printf("0x%lx    %s(%s)", farray[0].fadd, func_name(&farray[0], nameBuff), farray[0].src);
     uint64_t lastaddr = farray[0].fadd;
     np ++;
 
@@ -705,10 +764,10 @@ print_funcs()
     for (i=1; i<nfunc; i ++) {
       if (farray[i].fadd == lastaddr) {
         // if at the last address, just add the alias string
-        printf(", %s(%s)", farray[i].fnam, farray[i].src);
+        printf(", %s(%s)", func_name(&farray[i], nameBuff), farray[i].src);
       } else {
         // terminate previous entry, and start new one
-        printf("\n0x%lx    %s(%s)", farray[i].fadd, farray[i].fnam, farray[i].src);
+        printf("\n0x%lx    %s(%s)", farray[i].fadd, func_name(&farray[i], nameBuff), farray[i].src);
         lastaddr = farray[i].fadd;
         np ++;
       }
@@ -724,13 +783,14 @@ write_cc_funcs()
   int i;
   // write the function address list
   int np = 0;
+  char nameBuff[TB_SIZE];
   if (nfunc > 0) {
     // print the header
     printf("unsigned long hpcrun_nm_addrs[] = {\n" );
 
     // print the first entry, not beginning with new line
     // printf("  0x%lx   /* %s(%s)", farray[0].fadd, farray[0].fnam, farray[0].src);
-    printf("  0x%lx  /* %s", farray[0].fadd, farray[0].fnam);
+    printf("  0x%lx  /* %s", farray[0].fadd, func_name(&farray[0], nameBuff));
     uint64_t lastaddr = farray[0].fadd;
     np ++;
 
@@ -739,11 +799,11 @@ write_cc_funcs()
       if (farray[i].fadd == lastaddr) {
         // if at the last address, just add the alias string
         // printf(", %s(%s)", farray[i].fnam, farray[i].src);
-        printf(", %s", farray[i].fnam);
+        printf(", %s", func_name(&farray[i], nameBuff));
       } else {
         // terminate previous entry, and start new one
         // printf(" */,\n  0x%lx  /*  %s(%s)", farray[i].fadd, farray[i].fnam, farray[i].src);
-        printf(" */,\n  0x%lx  /* %s", farray[i].fadd, farray[i].fnam);
+        printf(" */,\n  0x%lx  /* %s", farray[i].fadd, func_name(&farray[i], nameBuff));
         lastaddr = farray[i].fadd;
         np ++;
       }
@@ -760,65 +820,78 @@ write_cc_funcs()
 void
 add_function(uint64_t faddr, char *fname, char *src, uint8_t freeFlag)
 {
-  Function_t * of;
-  uint64_t k;
-
-  farray[nfunc].fadd = faddr;
-  farray[nfunc].fnam = fname;
-  farray[nfunc].src = src;
-  farray[nfunc].fr_fnam = freeFlag;
   //
   // on freeFlag: FR_YES means fname was malloc'd elsewhere and needs freeing
   // after we're done with the list.  FR_NO means it's a symbol *  from an elf *, so 
   // libelf will take care of it.
   //
 #if DEBUG
-  fprintf(stderr, "FNB2: Adding: #%6d --0x%08lx\t%s(%s)\n", nfunc, farray[nfunc].fadd,
-      farray[nfunc].fnam, farray[nfunc].src);
+  fprintf(stderr, "FNB2: Adding: 0x%08lx\t%s(%s)\n", faddr, fname, src);
 #endif
-  nfunc ++;
-  if (nfunc >= maxfunc) {
-    // current table is full; double its size
-    maxfunc = 2*maxfunc;
-    of = farray;
-    farray = (Function_t *)realloc(farray, maxfunc * sizeof(Function_t) );
-    if ( verbose > 1) {
-      fprintf(stderr, "FNB2: Increasing farray size to %ld functions %s\n",
-         maxfunc, (of == farray ? "(not moved)" : "(moved)") );
-    }
-    if (farray == NULL) {
-      fprintf(stderr, "FNB2: Fatal error: unable to increase function table to %ld functions; exiting", maxfunc);
-      exit(1);
-    }
-    //
-    // initialize the new part of the table.
-    //
-    for (k = nfunc; k < maxfunc; k++) {
-      farray[k].fadd = 0ull;
-      farray[k].fnam = NULL;
-      farray[k].src = SC_FNTYPE_NONE;
-      farray[k].fr_fnam = FR_NO;
-    }
+  fl_add(faddr, fname, src, freeFlag, FN_NAMED);
+}
+
+// Add a discovered function, whose name is formed from its address
+// by func_name() if it is ever printed
+void
+add_stripped_function(uint64_t faddr, uint8_t fnamFmt, char *src)
+{
+  fl_add(faddr, NULL, src, FR_NO, fnamFmt);
+}
+
+char *
+func_name(Function_t *f, char *buf)
+{
+  switch (f->fnam_fmt) {
+    case FN_STRIPPED:
+      sprintf(buf, "stripped_0x%lx", f->fadd);
+      return buf;
+    case FN_PERSONALITY:
+      sprintf(buf, "personality_0x%lx", f->fadd);
+      return buf;
+    case FN_LSDA:
+      sprintf(buf, "LSDA_0x%lx", f->fadd);
+      return buf;
+    default:
+      return f->fnam;
   }
 }
 
+// Only called to order entries with the same address, see fl_merge().
+// Generated names at one address differ only by their prefix, so most
+// comparisons are settled without formatting the name.
 int
 func_cmp(const void *a, const void *b)
 {
+  static const char *fmt_prefix[] = { NULL, "stripped_0x", "personality_0x", "LSDA_0x" };
   int ret;
+  char buf1[TB_SIZE], buf2[TB_SIZE];
 
-  Function_t fp1 = *((Function_t *) a); 
-  Function_t fp2 = *((Function_t *) b); 
-  if (fp1.fadd > fp2.fadd ) {
+  Function_t *fp1 = (Function_t *) a; 
+  Function_t *fp2 = (Function_t *) b; 
+  if (fp1->fadd > fp2->fadd ) {
     ret = 1;
-  } else if (fp1.fadd < fp2.fadd ) {
+  } else if (fp1->fadd < fp2->fadd ) {
     ret = -1;
+  } else if (fp1->fnam_fmt == FN_NAMED && fp2->fnam_fmt == FN_NAMED) {
+    ret = strcmp (fp1->fnam, fp2->fnam);
+  } else if (fp1->fnam_fmt == fp2->fnam_fmt) {
+    ret = 0;
+  } else if (fp1->fnam_fmt != FN_NAMED && fp2->fnam_fmt != FN_NAMED) {
+    ret = strcmp (fmt_prefix[fp1->fnam_fmt], fmt_prefix[fp2->fnam_fmt]);
   } else {
-    ret = strcmp (fp1.fnam, fp2.fnam);
+    const char *p1 = (fp1->fnam_fmt == FN_NAMED) ? fp1->fnam : fmt_prefix[fp1->fnam_fmt];
+    const char *p2 = (fp2->fnam_fmt == FN_NAMED) ? fp2->fnam : fmt_prefix[fp2->fnam_fmt];
+    size_t n = strlen ((fp1->fnam_fmt == FN_NAMED) ? p2 : p1);
+
+    ret = strncmp (p1, p2, n);
+    if (ret == 0) {
+      ret = strcmp (func_name(fp1, buf1), func_name(fp2, buf2));
+    }
   }
 #if 0
   fprintf(stderr, "FNB2: %d = compare (%s, 0x08lx) with (%s, 0x08lx)\n",
-      ret, fp1.fnam, fp1.fadd, fp2.fnam, fp2.fadd );
+      ret, fp1->fnam, fp1->fadd, fp2->fnam, fp2->fadd );
 #endif
   return ret;
 }
@@ -845,12 +918,14 @@ usage()
       "\t     also can be specified with environment variable HPCFNBOUNDS_NO_USE\n"
       "\t-d\tdon't perform function discovery on stripped code\n"
       "\t\t    eguivalent to -n itfa\n"
+      "\t-j <n>\tscan with up to <n> threads (default: one per CPU)\n"
       "\t-s fdin fdout\trun in server mode\n"
 #if 0
       "\t-D\tdon't attempt to process DWARF\n"
 #endif
       "\t-c\twrite output in C source code\n"
       "\t-t\twrite output in text format (default)\n"
+      "\t-C <dir>\twrite output as fnbounds cache files in <dir>, for hpcrun\n"
       "\t\tIf no format is specified, then text mode is used.\n"
       "\t-h\tprint this help message and exit\n"
       "\n"
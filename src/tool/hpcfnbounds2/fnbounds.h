@@ -70,24 +70,37 @@ typedef struct Function {
   char	*fnam;
   char	*src;
   uint8_t fr_fnam;
+  uint8_t fnam_fmt;
 } Function_t;
 
+// symbol section queued for reading by symsecread
+typedef struct SymSec {
+  Elf_Data	*data;
+  Elf_Data	*strData;
+  char	*src;
+  uint64_t	rf;	// written by the tasks with __atomic_store_n
+} SymSec_t;
+
 // prototypes
 char	*get_funclist(char *);
 char	*process_vdso();
 char	*process_mapped_header(Elf *e);
 void	print_funcs();
 void	write_cc_funcs();
+char	*write_cache_file(Elf *e);
 void	add_function(uint64_t, char *, char *, uint8_t);
+void	add_stripped_function(uint64_t, uint8_t, char *);
+char	*func_name(Function_t *, char *);
 int	func_cmp(const void *a, const void *b);
 void	usage();
 void	cleanup();
 
 // Methods for the various sources of functions
 void	disable_sources(char *);
-uint64_t	dynsymread(Elf *e, GElf_Shdr sh);
-uint64_t	symtabread(Elf *e, GElf_Shdr sh);
-uint64_t  symsecread(Elf *e, GElf_Shdr sechdr, char *src);
+uint64_t	dynsymread(Elf *e, GElf_Shdr sh, SymSec_t *symSec);
+uint64_t	symtabread(Elf *e, GElf_Shdr sh, SymSec_t *symSec);
+uint64_t  symsecread(Elf *e, GElf_Shdr sechdr, char *src, SymSec_t *symSec);
+void	symsec_task(void *arg, uint64_t lo, uint64_t hi);
 
 // Flags governing which sources are processed
 extern	int	dynsymread_f;
@@ -106,6 +119,7 @@ extern	int	server_mode;
 extern	int	verbose;
 extern	int	scan_code;
 extern	int	no_dwarf;;
+extern	int	scan_threads;
 extern	int	is_dotso;
 extern  uint64_t refOffset;
 extern	char	*xname;
@@ -113,6 +127,9 @@ extern	char	*xname;
 extern	int	outputmode;
 #define	OM_TEXT 0
 #define	OM_CC 1
+#define	OM_CACHE 2
+
+extern	char	*cache_dir;
 
 // unified string pointers to contain function types
 
@@ -142,8 +159,14 @@ extern const char __e_[];
 #define FR_YES	(1)
 #define FR_NO	(0)
 
+// for the fnam_fmt field, how to form a name that is not kept in fnam.
+// Names of discovered functions are only formatted when printed.
+#define FN_NAMED	(0)	// fnam is the name
+#define FN_STRIPPED	(1)	// stripped_0x<addr>
+#define FN_PERSONALITY	(2)	// personality_0x<addr>
+#define FN_LSDA	(3)	// LSDA_0x<addr>
+
 // Defines 
-#define MAX_FUNC          (65536)
 #define TB_SIZE		        (512)
 #define MAX_SYM_SIZE	    (TB_SIZE)
 #define SC_SKIP		        (0)
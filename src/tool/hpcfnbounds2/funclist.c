@@ -0,0 +1,323 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+// funclist.c - per-thread function lists, scan tasks, and the merged sort
+
+#include  <pthread.h>
+
+#include  "fnbounds.h"
+#include  "funclist.h"
+
+typedef struct FuncList {
+  Function_t	*farray;
+  size_t	nfunc;
+  size_t	maxfunc;
+} FuncList_t;
+
+typedef struct Task {
+  fl_task_fn_t	fn;
+  void	*arg;
+  uint64_t	lo;
+  uint64_t	hi;
+} Task_t;
+
+typedef struct MergeArg {
+  Function_t	*src;
+  Function_t	*dst;
+  size_t	*off;	// run k is [off[k], off[k+1])
+  size_t	nrun;
+} MergeArg_t;
+
+static FuncList_t lists[FL_MAX_THREADS];
+static __thread int self = 0;	// index of the list of this thread
+static int nthreads = 1;
+
+static Task_t *tasks = NULL;
+static size_t ntasks = 0;
+static size_t maxtasks = 0;
+static size_t nexttask = 0;
+
+void
+fl_init()
+{
+  int i;
+
+  nthreads = scan_threads;
+  if (nthreads <= 0) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    nthreads = (ncpu > 0) ? ncpu : 1;
+  }
+  if (nthreads > FL_MAX_THREADS) {
+    nthreads = FL_MAX_THREADS;
+  }
+  for (i = 0; i < FL_MAX_THREADS; i++) {
+    lists[i].nfunc = 0;
+  }
+  if (verbose > 1) {
+    fprintf(stderr, "FNB2: Scanning with up to %d threads\n", nthreads);
+  }
+}
+
+void
+fl_add(uint64_t faddr, char *fname, char *src, uint8_t freeFlag, uint8_t fnamFmt)
+{
+  FuncList_t *l = &lists[self];
+
+  if (l->nfunc >= l->maxfunc) {
+    // current table is full; double its size
+    l->maxfunc = (l->maxfunc == 0) ? FL_INIT_FUNC : 2*l->maxfunc;
+    l->farray = (Function_t *)realloc(l->farray, l->maxfunc * sizeof(Function_t) );
+    if (l->farray == NULL) {
+      fprintf(stderr, "FNB2: Fatal error: unable to increase function table to %ld functions; exiting", l->maxfunc);
+      exit(1);
+    }
+  }
+
+  Function_t *f = &l->farray[l->nfunc++];
+  f->fadd = faddr;
+  f->fnam = fname;
+  f->src = src;
+  f->fr_fnam = freeFlag;
+  f->fnam_fmt = fnamFmt;
+}
+
+// Queue fn over [0, count) in chunks of at most chunk items
+void
+fl_task(fl_task_fn_t fn, void *arg, uint64_t count, uint64_t chunk)
+{
+  uint64_t lo;
+
+  for (lo = 0; lo < count; lo += chunk) {
+    if (ntasks >= maxtasks) {
+      maxtasks = (maxtasks == 0) ? 64 : 2*maxtasks;
+      tasks = (Task_t *)realloc(tasks, maxtasks * sizeof(Task_t));
+      if (tasks == NULL) {
+        fprintf(stderr, "FNB2: Fatal error: unable to allocate %ld scan tasks; exiting", maxtasks);
+        exit(1);
+      }
+    }
+    tasks[ntasks].fn = fn;
+    tasks[ntasks].arg = arg;
+    tasks[ntasks].lo = lo;
+    tasks[ntasks].hi = (count - lo < chunk) ? count : lo + chunk;
+    ntasks++;
+  }
+}
+
+static void
+fl_work()
+{
+  for (;;) {
+    size_t k = __atomic_fetch_add(&nexttask, 1, __ATOMIC_RELAXED);
+    if (k >= ntasks) {
+      break;
+    }
+    tasks[k].fn(tasks[k].arg, tasks[k].lo, tasks[k].hi);
+  }
+}
+
+static void *
+fl_worker(void *arg)
+{
+  self = (int)(intptr_t)arg;
+  fl_work();
+  return NULL;
+}
+
+// Run the queued tasks; the calling thread works on them too
+void
+fl_run()
+{
+  pthread_t tid[FL_MAX_THREADS];
+  int i, nt;
+
+  nt = (ntasks < nthreads) ? ntasks : nthreads;
+  nexttask = 0;
+  for (i = 1; i < nt; i++) {
+    if (pthread_create(&tid[i], NULL, fl_worker, (void *)(intptr_t)i) != 0) {
+      break;
+    }
+  }
+  nt = i;
+  fl_work();
+  for (i = 1; i < nt; i++) {
+    pthread_join(tid[i], NULL);
+  }
+  ntasks = 0;
+}
+
+static int
+addr_cmp(const void *a, const void *b)
+{
+  uint64_t a1 = ((Function_t *) a)->fadd;
+  uint64_t a2 = ((Function_t *) b)->fadd;
+
+  return (a1 > a2) - (a1 < a2);
+}
+
+// sort run lo
+static void
+sort_task(void *arg, uint64_t lo, uint64_t hi)
+{
+  MergeArg_t *m = (MergeArg_t *)arg;
+
+  qsort(m->src + m->off[lo], m->off[lo+1] - m->off[lo], sizeof(Function_t), &addr_cmp);
+}
+
+// merge runs 2*lo and 2*lo+1 of src into dst
+static void
+merge_task(void *arg, uint64_t lo, uint64_t hi)
+{
+  MergeArg_t *m = (MergeArg_t *)arg;
+  size_t r = 2*lo;
+  size_t i = m->off[r];
+  size_t iend = m->off[r+1];
+  size_t j = iend;
+  size_t jend = (r+1 < m->nrun) ? m->off[r+2] : iend;
+  size_t k = i;
+
+  while (i < iend && j < jend) {
+    if (m->src[j].fadd < m->src[i].fadd) {
+      m->dst[k++] = m->src[j++];
+    } else {
+      m->dst[k++] = m->src[i++];
+    }
+  }
+  if (i < iend) {
+    memcpy(&m->dst[k], &m->src[i], (iend - i) * sizeof(Function_t));
+    k += iend - i;
+  }
+  if (j < jend) {
+    memcpy(&m->dst[k], &m->src[j], (jend - j) * sizeof(Function_t));
+  }
+}
+
+// Sort the per-thread lists by address in parallel, and merge them
+// into farray.  Only entries at the same address are ordered by name.
+void
+fl_merge()
+{
+  size_t off[FL_MAX_THREADS + 1];
+  MergeArg_t m;
+  size_t total, i, j, k;
+
+  total = 0;
+  for (i = 0; i < FL_MAX_THREADS; i++) {
+    total += lists[i].nfunc;
+  }
+
+  m.src = (Function_t *)malloc((total + 1) * sizeof(Function_t));
+  m.dst = (Function_t *)malloc((total + 1) * sizeof(Function_t));
+  if (m.src == NULL || m.dst == NULL) {
+    fprintf(stderr, "FNB2: Fatal error: unable to allocate function table of %ld functions; exiting", total);
+    exit(1);
+  }
+
+  // gather the lists as runs of one array
+  m.off = off;
+  m.nrun = 0;
+  off[0] = 0;
+  for (i = 0; i < FL_MAX_THREADS; i++) {
+    if (lists[i].nfunc == 0) {
+      continue;
+    }
+    memcpy(&m.src[off[m.nrun]], lists[i].farray, lists[i].nfunc * sizeof(Function_t));
+    off[m.nrun + 1] = off[m.nrun] + lists[i].nfunc;
+    m.nrun++;
+    lists[i].nfunc = 0;
+  }
+
+  fl_task(sort_task, &m, m.nrun, 1);
+  fl_run();
+
+  while (m.nrun > 1) {
+    fl_task(merge_task, &m, (m.nrun + 1)/2, 1);
+    fl_run();
+    for (k = 0; 2*k < m.nrun; k++) {
+      off[k] = off[2*k];
+    }
+    off[k] = total;
+    m.nrun = k;
+    Function_t *t = m.src;
+    m.src = m.dst;
+    m.dst = t;
+  }
+  free(m.dst);
+
+  // order aliases (entries at the same address) by name
+  for (i = 0; i < total; i = j) {
+    for (j = i + 1; j < total && m.src[j].fadd == m.src[i].fadd; j++) ;
+    if (j - i > 1) {
+      qsort(&m.src[i], j - i, sizeof(Function_t), &func_cmp);
+    }
+  }
+
+  farray = m.src;
+  nfunc = total;
+  maxfunc = total + 1;
+}
+
+// Free the lists, and the names of any functions not merged into farray
+void
+fl_cleanup()
+{
+  size_t i, k;
+
+  for (i = 0; i < FL_MAX_THREADS; i++) {
+    for (k = 0; k < lists[i].nfunc; k++) {
+      if (lists[i].farray[k].fr_fnam == FR_YES) {
+        free(lists[i].farray[k].fnam);
+      }
+    }
+    free(lists[i].farray);
+    lists[i].farray = NULL;
+    lists[i].nfunc = 0;
+    lists[i].maxfunc = 0;
+  }
+  free(tasks);
+  tasks = NULL;
+  ntasks = 0;
+  maxtasks = 0;
+}
@@ -0,0 +1,76 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+// funclist.h - per-thread function lists, scan tasks, and the merged sort
+//
+// The scanners add functions to a list owned by the calling thread, so
+// sections (and parts of large sections) can be scanned concurrently.
+// fl_merge() sorts the lists in parallel and merges them into farray.
+// A task is a function applied to a range [lo, hi) of items; fl_task()
+// splits a range into chunks and fl_run() runs all queued chunks on
+// scan_threads threads, the calling thread included.
+
+#ifndef _FNBOUNDS_FUNCLIST_H_
+#define _FNBOUNDS_FUNCLIST_H_
+
+#include  <stdint.h>
+
+typedef void (*fl_task_fn_t)(void *arg, uint64_t lo, uint64_t hi);
+
+// prototypes
+void	fl_init(void);
+void	fl_add(uint64_t faddr, char *fname, char *src, uint8_t freeFlag, uint8_t fnamFmt);
+void	fl_task(fl_task_fn_t fn, void *arg, uint64_t count, uint64_t chunk);
+void	fl_run(void);
+void	fl_merge(void);
+void	fl_cleanup(void);
+
+// Defines
+#define FL_MAX_THREADS	(16)
+#define FL_INIT_FUNC	(4096)
+#define FL_SYM_CHUNK	(16384)
+#define FL_FDE_CHUNK	(16384)
+
+#endif  // _FNBOUNDS_FUNCLIST_H_
@@ -47,6 +47,7 @@
 
 #include <fnbounds.h>
 #include <scan.h>
+#include "funclist.h"
 #include <endian.h>
 
 uint64_t 
@@ -375,8 +376,6 @@ pltscan(Elf *e, GElf_Shdr secHead)
 {
   uint64_t ii;
   uint64_t startAddr, endAddr, pltEntrySize;
-  char nameBuff[TB_SIZE];
-  char *vegamite;
 
   if (skipSectionScan(e, secHead, pltscan_f) == SC_SKIP) {
     return SC_SKIP;
@@ -394,9 +393,7 @@ pltscan(Elf *e, GElf_Shdr secHead)
   }
 
   for (ii = startAddr + pltEntrySize; ii < endAddr; ii += pltEntrySize) {
-    sprintf(nameBuff,"stripped_0x%lx",ii);
-    vegamite = strdup(nameBuff);
-    add_function(ii, vegamite, SC_FNTYPE_PLT, FR_YES);
+    add_stripped_function(ii, FN_STRIPPED, SC_FNTYPE_PLT);
   }
 
   return SC_DONE;
@@ -409,8 +406,6 @@ pltsecscan(Elf *e, GElf_Shdr secHead)
 {
   uint64_t ii;
   uint64_t startAddr, endAddr, pltEntrySize;
-  char nameBuff[TB_SIZE];
-  char *vegamite;
 
   if (skipSectionScan(e, secHead, pltsecscan_f) == SC_SKIP) {
     return SC_SKIP;
@@ -428,9 +423,7 @@ pltsecscan(Elf *e, GElf_Shdr secHead)
   }
 
   for (ii = startAddr + pltEntrySize; ii < endAddr; ii += pltEntrySize) {
-    sprintf(nameBuff,"stripped_0x%lx",ii);
-    vegamite = strdup(nameBuff);
-    add_function(ii, vegamite, SC_FNTYPE_PLTSEC, FR_YES);
+    add_stripped_function(ii, FN_STRIPPED, SC_FNTYPE_PLTSEC);
   }
 
   return SC_DONE;
@@ -510,13 +503,10 @@ ehframescan(Elf *e, ehRecord_t *ehRecord)
   GElf_Shdr ehSecHead,textSecHead,dataSecHead;
   Elf_Data *data;
   uint64_t recordOffset;
-  uint64_t calculatedAddr64, calculatedAddrRange;
   uint64_t extra;
   uint8_t *pb;
   uint32_t *pw;
-  uint32_t kc, kf, recType, recLen, cf, kk, curCIE;
-  char nameBuff[TB_SIZE];
-  char *promite;  // mmmm
+  uint32_t kc, kf, recType, recLen, cf, kk, kl, kh, curCIE;
   uint8_t cieVersion;
   char *augString;
   uint64_t codeAlign;
@@ -524,13 +514,15 @@ ehframescan(Elf *e, ehRecord_t *ehRecord)
   uint8_t retReg;
   uint8_t fdeEnc;
   uint64_t augDataLen;
-  uint64_t cieOffset, fdeOffset, a, b;
+  uint64_t cieOffset, a, b;
   uint64_t dataSize;
   uint64_t cieTableSize, cieAddress;
   ehCIERecord_t *cieTable;
   ehDecodeRecord_t decodeRecord;
-  ehCIERecord_t *fdeRefCIE;
-  uint64_t personalityFunctionAddr, landingFunctionAddr;
+  ehFDERecord_t *fdeTable;
+  uint64_t fdeTableSize, nfde;
+  ehScan_t ehScan;
+  uint64_t rv;
   static char elfFailMess[] = {"Error in eh_frame handling, aborting scan.  libelf failed with "};
 
 
@@ -596,6 +588,17 @@ ehframescan(Elf *e, ehRecord_t *ehRecord)
     return SC_SKIP;
   }
 
+  // allocate a fdeTable
+  fdeTableSize = EHF_INIT_FDE;
+  nfde = 0;
+  fdeTable = (ehFDERecord_t *) malloc (fdeTableSize * sizeof(ehFDERecord_t));
+  if (fdeTable == NULL) {
+    fprintf(stderr, "FNB2: Fatal error in eh_frame handler, cannot allocate fdeTable.  Aborting.\n");
+    free ( cieTable );
+    return SC_SKIP;
+  }
+
+  rv = SC_DONE;
   recordOffset = 0;
 
   pb = (uint8_t *)(data -> d_buf);
@@ -606,6 +609,8 @@ ehframescan(Elf *e, ehRecord_t *ehRecord)
   // read through the eh_frame until the terminating record is reached.
   // we assume each group of FDE reference the previous CIE; so only the
   // most recent fdeEnc is used.  there's at least 1 CIE required.
+  // CIEs are parsed as they are read, FDEs are only queued, and decoded
+  // in parallel once all CIEs are known.
   //
   do {
     pw = (uint32_t *)pb;  // convenience to read words, and get rid of endian issue
@@ -615,7 +620,8 @@ ehframescan(Elf *e, ehRecord_t *ehRecord)
     // support extended record lengths here if required
     if (recLen == EHF_CIE_EXTREC) {
       fprintf(stderr, "FNB2: Fatal error in eh_frame handling, extended records not supported, aborting\n");
-      return SC_SKIP;
+      rv = SC_SKIP;
+      break;
     }
 
     //
@@ -771,12 +777,15 @@ ehframescan(Elf *e, ehRecord_t *ehRecord)
       ++kc;
       if (kc >= cieTableSize) {
         cieTableSize += EHF_MAX_CIE;
-        cieTable = (ehCIERecord_t *) realloc ((void *)cieTable, cieTableSize * sizeof(ehCIERecord_t));
-        if (cieTable == NULL) {
+        ehCIERecord_t *newCieTable = (ehCIERecord_t *) realloc ((void *)cieTable, cieTableSize * sizeof(ehCIERecord_t));
+        if (newCieTable == NULL) {
           fprintf(stderr, "FNB2: Fatal error in eh_frame handler, cannot re-allocate cieTable at size %ld.  Aborting.\n",
               cieTableSize);
+          free ( fdeTable );
+          free ( cieTable );
           return SC_SKIP;
         }
+        cieTable = newCieTable;
       }
 
     }  // ! recType is a CIE
@@ -787,125 +796,59 @@ ehframescan(Elf *e, ehRecord_t *ehRecord)
 
       //
       // determine to which CIE this FDE belongs. recType contains the offset to the CIE address
-      // from that point in the stream.  Since we don't expect a huge amount of CIEs, just leaf
-      // through them to find the right one.  (In theory the actual CIE should be near the last 
-      // one used in the list, this would be a performance enhancement).
+      // from that point in the stream.  The cieTable is in stream order, so search it by
+      // bisection.
       //
       cieAddress = recordOffset + sizeof(recLen) - recType; 
 
-      for (kk = 0; kk < kc; kk++) {
-        if ( cieTable[kk].cieBaseAddress == cieAddress ) {
-          curCIE = kk;
-          break;
+      kl = 0;
+      kh = kc;
+      while (kl < kh) {
+        kk = (kl + kh) / 2;
+        if (cieTable[kk].cieBaseAddress < cieAddress) {
+          kl = kk + 1;
+        } else {
+          kh = kk;
         }
       }
 
       //
-      // Fatal error if the CIE wasn't found
+      // Fatal error if the CIE wasn't found; FDEs queued so far are still decoded
       //
-      if (kk == kc) {
+      if ((kl == kc) || (cieTable[kl].cieBaseAddress != cieAddress)) {
         fprintf(stderr, "FNB2: Fatal error in eh_frame handling, FDE without associated CIE in %s\n", xname);
-        return SC_SKIP;
+        rv = SC_SKIP;
+        break;
       }
-
-      fdeRefCIE = &cieTable[curCIE];
+      curCIE = kl;
 
       // 
       // verify that the CIE parsed correctly
       //
-      if ((fdeRefCIE -> cieSize) == 0) {
+      if ((cieTable[curCIE].cieSize) == 0) {
         fprintf(stderr, "FNB2: Warning in eh_frame handling, FDE references unparsed CIE 0x%lx in %s, skipping\n",
-            fdeRefCIE -> cieBaseAddress, xname);
+            cieTable[curCIE].cieBaseAddress, xname);
         goto nextRecord;
       }
 
-      fdeOffset = EHF_WO_FS*sizeof(*pw);
-
       //
-      // grab the personality function if there's a 'P'. This comes from the reference CIE and doesn't 
-      // change any of the FDE offsets
+      // queue the FDE; its addresses are decoded by ehframe_fde_task
       //
-      if ( (fdeRefCIE -> cieContainsType.P) == EHF_CIE_TRUE) {
-        decodeRecord.totalOffset = fdeRefCIE -> cieAugDataOffset;
-        decodeRecord.fdeEnc = fdeRefCIE -> cieFDEEncType.P;
-
-        personalityFunctionAddr = decodeDwarfAddress(fdeRefCIE->cieAugData, &decodeRecord, &a, 
-            "personality function");
-
-        //
-        // now add the personality function to the list
-        // note that since the personality address comes from the cie, 
-        // we don't increase fdeOffset
-        //
-        if (personalityFunctionAddr != EHF_DECDWRF_ERROR) {
-          sprintf(nameBuff,"personality_0x%lx", personalityFunctionAddr);
-          promite = strdup(nameBuff);
-          add_function(personalityFunctionAddr, promite, SC_FNTYPE_EH_FRAME, FR_YES);
+      if (nfde >= fdeTableSize) {
+        fdeTableSize = 2*fdeTableSize;
+        ehFDERecord_t *newFdeTable = (ehFDERecord_t *) realloc ((void *)fdeTable, fdeTableSize * sizeof(ehFDERecord_t));
+        if (newFdeTable == NULL) {
+          fprintf(stderr, "FNB2: Fatal error in eh_frame handler, cannot re-allocate fdeTable at size %ld.  Aborting.\n",
+              fdeTableSize);
+          free ( fdeTable );
+          free ( cieTable );
+          return SC_SKIP;
         }
-
+        fdeTable = newFdeTable;
       }
-
-      //
-      // pick off the actual function address, if there's an 'R'
-      //
-      if ( (fdeRefCIE -> cieContainsType.R) == EHF_CIE_TRUE) {
-        decodeRecord.fdeEnc = fdeRefCIE -> cieFDEEncType.R;
-        decodeRecord.totalOffset = recordOffset+fdeOffset;
-
-        calculatedAddr64 = decodeDwarfAddress(pb+fdeOffset, &decodeRecord, &a, "FDE function address");
-
-        //
-        // add the function address to the list
-        //
-        if (calculatedAddr64 != EHF_DECDWRF_ERROR) {
-          calculatedAddr64 += fdeRefCIE -> cieAddressOffset; // adjust pointer if S
-          sprintf(nameBuff,"stripped_0x%lx",calculatedAddr64);
-          promite = strdup(nameBuff);
-          add_function(calculatedAddr64, promite, SC_FNTYPE_EH_FRAME, FR_YES);
-        }
-        else {
-          goto nextRecord;
-        }
-        fdeOffset += a;
-
-        //
-        // we have to decode the function range, even though it's not used, to get the offset
-        // to the LDSA function, if one is present.  The fdeEnc is the same
-        //
-        decodeRecord.totalOffset = recordOffset+fdeOffset;
-
-        calculatedAddrRange = decodeDwarfAddress(pb+fdeOffset, &decodeRecord, &a, "FDE function range");
-        if (calculatedAddrRange == EHF_DECDWRF_ERROR) {
-          goto nextRecord;
-        }
-        fdeOffset += a;
-
-      } // !R
-
-      if ( (fdeRefCIE -> cieContainsType.L) == EHF_CIE_TRUE) {
-        augDataLen = decodeULEB128(pb+fdeOffset, &a);
-        if (augDataLen == EHF_ULEB128_ERROR) {
-          fprintf(stderr, "FNB2: Warning in eh_frame handling, cannot decode LSDA aug data len in %s\n", xname);
-          goto nextRecord;
-        }
-        fdeOffset += a;
-        fdeEnc = fdeRefCIE -> cieFDEEncType.L;
-        if (fdeEnc != DW_EH_PE_omit) {
-          decodeRecord.fdeEnc = fdeEnc;
-          decodeRecord.totalOffset = recordOffset+fdeOffset;
-          landingFunctionAddr = decodeDwarfAddress(pb+fdeOffset, &decodeRecord, &a, "LSDA function");
-          //
-          // add the lsda function
-          //
-          if (landingFunctionAddr != EHF_DECDWRF_ERROR) {
-            sprintf(nameBuff,"LSDA_0x%lx",landingFunctionAddr);
-            promite = strdup(nameBuff);
-            add_function(landingFunctionAddr, promite, SC_FNTYPE_EH_FRAME, FR_YES);
-          }
-          fdeOffset += a;
-
-        }
-      } // !L
+      fdeTable[nfde].fdeOffset = recordOffset;
+      fdeTable[nfde].fdeCIE = curCIE;
+      ++nfde;
 
     } // ! recType is an FDE
 
@@ -929,13 +872,132 @@ nextRecord:
 
   } while (cf == EHF_CF_CONT);  // ! traversal of eh_frame records
 
+  //
+  // decode the queued FDEs
+  //
+  ehScan.ehData = (uint8_t *)(data -> d_buf);
+  ehScan.cieTable = cieTable;
+  ehScan.fdeTable = fdeTable;
+  ehScan.decodeRecord = decodeRecord;
+  fl_task(ehframe_fde_task, &ehScan, nfde, FL_FDE_CHUNK);
+  fl_run();
+
+  free ( fdeTable );
   free ( cieTable );
 
   if(verbose> 1) {
     fprintf (stderr, "FNB2: scanning .eh_frame, found %d CIE and %d FDE records\n", kc, kf);
     }
   
-  return SC_DONE;
+  return rv;
+}
+
+// decode the FDEs [lo, hi) queued by ehframescan, and add the functions
+// they name
+void
+ehframe_fde_task(void *arg, uint64_t lo, uint64_t hi)
+{
+  ehScan_t *ehScan = (ehScan_t *)arg;
+  ehDecodeRecord_t decodeRecord;
+  ehCIERecord_t *fdeRefCIE;
+  uint64_t k, recordOffset, fdeOffset, a;
+  uint64_t calculatedAddr64, calculatedAddrRange;
+  uint64_t augDataLen;
+  uint64_t personalityFunctionAddr, landingFunctionAddr;
+  uint8_t fdeEnc;
+  uint8_t *pb;
+  uint32_t *pw;
+
+  // the section addresses; the rest is set before each decode
+  decodeRecord = ehScan->decodeRecord;
+
+  for (k = lo; k < hi; k++) {
+    recordOffset = ehScan->fdeTable[k].fdeOffset;
+    pb = ehScan->ehData + recordOffset;
+    fdeRefCIE = &ehScan->cieTable[ehScan->fdeTable[k].fdeCIE];
+
+    fdeOffset = EHF_WO_FS*sizeof(*pw);
+
+    //
+    // grab the personality function if there's a 'P'. This comes from the reference CIE and doesn't 
+    // change any of the FDE offsets
+    //
+    if ( (fdeRefCIE -> cieContainsType.P) == EHF_CIE_TRUE) {
+      decodeRecord.totalOffset = fdeRefCIE -> cieAugDataOffset;
+      decodeRecord.fdeEnc = fdeRefCIE -> cieFDEEncType.P;
+
+      personalityFunctionAddr = decodeDwarfAddress(fdeRefCIE->cieAugData, &decodeRecord, &a, 
+          "personality function");
+
+      //
+      // now add the personality function to the list
+      // note that since the personality address comes from the cie, 
+      // we don't increase fdeOffset
+      //
+      if (personalityFunctionAddr != EHF_DECDWRF_ERROR) {
+        add_stripped_function(personalityFunctionAddr, FN_PERSONALITY, SC_FNTYPE_EH_FRAME);
+      }
+
+    }
+
+    //
+    // pick off the actual function address, if there's an 'R'
+    //
+    if ( (fdeRefCIE -> cieContainsType.R) == EHF_CIE_TRUE) {
+      decodeRecord.fdeEnc = fdeRefCIE -> cieFDEEncType.R;
+      decodeRecord.totalOffset = recordOffset+fdeOffset;
+
+      calculatedAddr64 = decodeDwarfAddress(pb+fdeOffset, &decodeRecord, &a, "FDE function address");
+
+      //
+      // add the function address to the list
+      //
+      if (calculatedAddr64 != EHF_DECDWRF_ERROR) {
+        calculatedAddr64 += fdeRefCIE -> cieAddressOffset; // adjust pointer if S
+        add_stripped_function(calculatedAddr64, FN_STRIPPED, SC_FNTYPE_EH_FRAME);
+      }
+      else {
+        continue;
+      }
+      fdeOffset += a;
+
+      //
+      // we have to decode the function range, even though it's not used, to get the offset
+      // to the LDSA function, if one is present.  The fdeEnc is the same
+      //
+      decodeRecord.totalOffset = recordOffset+fdeOffset;
+
+      calculatedAddrRange = decodeDwarfAddress(pb+fdeOffset, &decodeRecord, &a, "FDE function range");
+      if (calculatedAddrRange == EHF_DECDWRF_ERROR) {
+        continue;
+      }
+      fdeOffset += a;
+
+    } // !R
+
+    if ( (fdeRefCIE -> cieContainsType.L) == EHF_CIE_TRUE) {
+      augDataLen = decodeULEB128(pb+fdeOffset, &a);
+      if (augDataLen == EHF_ULEB128_ERROR) {
+        fprintf(stderr, "FNB2: Warning in eh_frame handling, cannot decode LSDA aug data len in %s\n", xname);
+        continue;
+      }
+      fdeOffset += a;
+      fdeEnc = fdeRefCIE -> cieFDEEncType.L;
+      if (fdeEnc != DW_EH_PE_omit) {
+        decodeRecord.fdeEnc = fdeEnc;
+        decodeRecord.totalOffset = recordOffset+fdeOffset;
+        landingFunctionAddr = decodeDwarfAddress(pb+fdeOffset, &decodeRecord, &a, "LSDA function");
+        //
+        // add the lsda function
+        //
+        if (landingFunctionAddr != EHF_DECDWRF_ERROR) {
+          add_stripped_function(landingFunctionAddr, FN_LSDA, SC_FNTYPE_EH_FRAME);
+        }
+        fdeOffset += a;
+
+      }
+    } // !L
+  }
 }
 
 
@@ -91,6 +91,19 @@ typedef struct __ehDecodeRecord {
   uint8_t fdeEnc;
 } ehDecodeRecord_t;
 
+typedef struct __ehFDERecord {
+  uint64_t fdeOffset;  // record offset in the eh_frame
+  uint32_t fdeCIE;     // index into the cieTable
+} ehFDERecord_t;
+
+// state shared by the tasks decoding the FDEs of one eh_frame
+typedef struct __ehScan {
+  uint8_t *ehData;
+  ehCIERecord_t *cieTable;
+  ehFDERecord_t *fdeTable;
+  ehDecodeRecord_t decodeRecord;
+} ehScan_t;
+
 
 
 // prototypes
@@ -101,6 +114,7 @@ uint64_t	textscan(Elf *e, GElf_Shdr sh);
 uint64_t	finiscan(Elf *e, GElf_Shdr sh);
 uint64_t	altinstr_replacementscan(Elf *e, GElf_Shdr sh);
 uint64_t	ehframescan(Elf *e, ehRecord_t *ehRecord);
+void	ehframe_fde_task(void *arg, uint64_t lo, uint64_t hi);
 uint64_t 	skipSectionScan(Elf *e, GElf_Shdr secHead, int secFlag);
 uint64_t  decodeULEB128(uint8_t *input, uint64_t *sizeInBytes);
 int64_t   decodeSLEB128(uint8_t *input, uint64_t *sizeInBytes);
@@ -110,6 +124,7 @@ uint64_t  unalignedEndianRead(uint8_t *, size_t, uint64_t);
 
 // Defines 
 #define EHF_MAX_CIE       (64)
+#define EHF_INIT_FDE      (4096)
 #define EHF_CIE_TRUE      (1)
 #define EHF_CIE_FALSE     (0)
 #define EHF_CIE_EXTREC    (0xfffffffful)
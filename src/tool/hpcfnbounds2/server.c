@@ -68,13 +68,24 @@
 //
 // 4. The server runs outside of hpcrun and libmonitor.
 //
+// 5. A batch query (SYSERV_QUERY_BATCH) is processed by a pool of
+// forked workers, one load module per worker, since the analysis in
+// fnbounds.c keeps its state in globals.  Each worker writes the same
+// reply as for a single query into a pipe back to the server, and the
+// server gathers the address arrays into one shared-memory segment.
+//
 //***************************************************************************
 
 #include <sys/types.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <sys/time.h>
 #include <sys/resource.h>
+#include <sys/wait.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
 #include <setjmp.h>
 #include <signal.h>
 #include <stdint.h>
@@ -94,6 +105,9 @@
 #define ADDR_SIZE   (256 * 1024)
 #define INIT_INBUF_SIZE    2000
 
+#define MAX_BATCH_WORKERS  16
+#define WORKER_READ_SIZE   (64 * 1024)
+
 #define SUCCESS   0
 #define FAILURE  -1
 #define END_OF_FILE  -2
@@ -113,6 +127,20 @@ static struct syserv_fnbounds_info fnb_info;
 static int jmpbuf_ok = 0;
 static sigjmp_buf jmpbuf;
 
+// name of the last batch segment, unlinked in case the client didn't
+static char batch_shm_name[64];
+static int  batch_seq = 0;
+
+// one load module of a batch query, and the reply from its worker
+struct batch_item {
+  char   *name;
+  int     fd;
+  pid_t   pid;
+  char   *buf;
+  size_t  len;
+  size_t  size;
+};
+
 // 
 // Although init_server only returns 0 for now (errors don't interrupt)
 // we could return 1 in case of a problem
@@ -159,12 +187,22 @@ init_server (DiscoverFnTy fn_discovery, int fd1, int fd2)
       do_query(fn_discovery, &mesg);
     }
 
+    // batch query
+    else if (mesg.type == SYSERV_QUERY_BATCH) {
+      write_mesg(SYSERV_ACK, 0);
+      do_query_batch(fn_discovery, &mesg);
+    }
+
     // unknown message
     else {
       err(1, "unknown mesg type from client: %d", mesg.type);
     }
   }
 
+  if (batch_shm_name[0] != 0) {
+    shm_unlink(batch_shm_name);
+  }
+
   //
   // if we've finished, return
   //
@@ -177,12 +215,11 @@ init_server (DiscoverFnTy fn_discovery, int fd1, int fd2)
 // fnbounds server
 //*****************************************************************
 
-void
-do_query(DiscoverFnTy fn_discovery, struct syserv_mesg *mesg)
+// Read the payload of a query message into inbuf.
+static void
+read_query_names(struct syserv_mesg *mesg)
 {
-  char *ret;
-  int ret2;
-  // Make sure the buffer is big enough to hold the name string
+  // Make sure the buffer is big enough to hold the name strings
   if (mesg->len > inbuf_size) {
     inbuf_size += mesg->len;
     inbuf = (char *) realloc(inbuf, inbuf_size);
@@ -191,18 +228,26 @@ do_query(DiscoverFnTy fn_discovery, struct syserv_mesg *mesg)
     }
   }
 
-  // read the string following the message
-  ret2 = read_all(fdin, inbuf, mesg->len);
-  if (ret2 != SUCCESS) {
+  // read the strings following the message
+  if (read_all(fdin, inbuf, mesg->len) != SUCCESS) {
     err(1, "read from fdin failed");
   }
+}
+
+
+// Compute the function list for one load module and write the reply
+// (OK and the addresses, or ERR) to fdout.
+static void
+query_one(char *name)
+{
+  char *ret;
 
   if (verbose) {
-    fprintf(stderr, "FNB2: begin processing %s -- %s\n", strrchr(inbuf, '/'), inbuf );
+    fprintf(stderr, "FNB2: begin processing %s -- %s\n", strrchr(name, '/'), name );
   }
-  ret = get_funclist(inbuf);
+  ret = get_funclist(name);
   if ( ret != NULL) {
-    fprintf(stderr, "\nFNB2: Server failure processing %s: %s\n", inbuf, ret );
+    fprintf(stderr, "\nFNB2: Server failure processing %s: %s\n", name, ret );
 
     // send the error message to the server
     int rets = write_mesg(SYSERV_ERR, 0);
@@ -210,10 +255,304 @@ do_query(DiscoverFnTy fn_discovery, struct syserv_mesg *mesg)
       errx(1, "Server send error message failed");
     }  // if success, message has been written in send_funcs
   }
+}
+
+
+void
+do_query(DiscoverFnTy fn_discovery, struct syserv_mesg *mesg)
+{
+  read_query_names(mesg);
+  query_one(inbuf);
   return;
 }
 
 
+//*****************************************************************
+// batch queries
+//*****************************************************************
+
+static size_t
+page_align(size_t size)
+{
+  static size_t pagesize = 0;
+
+  if (pagesize == 0) {
+    long ans = sysconf(_SC_PAGESIZE);
+    pagesize = (ans > 0) ? ans : 4096;
+  }
+
+  return ((size + pagesize - 1)/pagesize) * pagesize;
+}
+
+
+// One worker per CPU, unless HPCFNBOUNDS_WORKERS says otherwise.
+static int
+num_batch_workers(int num_items)
+{
+  long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+  int workers = (ncpu > 0) ? ncpu : 1;
+
+  char *str = getenv("HPCFNBOUNDS_WORKERS");
+  if (str != NULL && atoi(str) > 0) {
+    workers = atoi(str);
+  }
+
+  if (workers > MAX_BATCH_WORKERS) {
+    workers = MAX_BATCH_WORKERS;
+  }
+  if (workers > num_items) {
+    workers = num_items;
+  }
+  return workers;
+}
+
+
+// Fork a worker that answers the query for one item into a pipe.
+// The workers split the CPUs for their scan threads, unless -j says
+// otherwise.
+static void
+batch_worker_start(struct batch_item *item, int workers)
+{
+  int fds[2];
+
+  if (pipe(fds) != 0) {
+    err(1, "pipe for batch worker failed");
+  }
+
+  pid_t pid = fork();
+  if (pid < 0) {
+    err(1, "fork for batch worker failed");
+  }
+
+  if (pid == 0) {
+    close(fds[0]);
+    fdout = fds[1];
+    if (scan_threads <= 0) {
+      long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+      scan_threads = (ncpu > workers) ? ncpu / workers : 1;
+    }
+    query_one(item->name);
+    _exit(0);
+  }
+
+  close(fds[1]);
+  item->fd = fds[0];
+  item->pid = pid;
+}
+
+
+// Read what is available from a worker's pipe.
+// Returns: 1 when the worker has finished, else 0.
+static int
+batch_worker_read(struct batch_item *item)
+{
+  if (item->size - item->len < WORKER_READ_SIZE) {
+    item->size = 2 * item->size + WORKER_READ_SIZE;
+    item->buf = (char *) realloc(item->buf, item->size);
+    if (item->buf == NULL) {
+      err(1, "realloc for batch reply failed");
+    }
+  }
+
+  ssize_t ret = read(item->fd, item->buf + item->len, item->size - item->len);
+  if (ret < 0 && errno == EINTR) {
+    return 0;
+  }
+  if (ret > 0) {
+    item->len += ret;
+    return 0;
+  }
+
+  close(item->fd);
+  item->fd = -1;
+  waitpid(item->pid, NULL, 0);
+  return 1;
+}
+
+
+// Decode a worker's reply.  A worker that failed or died leaves an
+// entry with status ERR.
+static void
+batch_entry_decode(struct batch_item *item, struct syserv_batch_entry *entry)
+{
+  struct syserv_mesg mesg;
+
+  memset(entry, 0, sizeof(*entry));
+  entry->info.magic = FNBOUNDS_MAGIC;
+  entry->info.status = SYSERV_ERR;
+
+  if (item->len < sizeof(mesg)) {
+    return;
+  }
+  memcpy(&mesg, item->buf, sizeof(mesg));
+  if (mesg.magic != SYSERV_MAGIC || mesg.type != SYSERV_OK) {
+    return;
+  }
+
+  size_t num_bytes = mesg.len * sizeof(uint64_t);
+  if (item->len != sizeof(mesg) + num_bytes + sizeof(entry->info)) {
+    return;
+  }
+  memcpy(&entry->info, item->buf + sizeof(mesg) + num_bytes, sizeof(entry->info));
+  entry->num_addrs = mesg.len;
+}
+
+
+// Run the workers, keeping up to 'workers' of them busy.
+static void
+batch_run(struct batch_item *items, int num_items, int workers)
+{
+  struct pollfd pfd[MAX_BATCH_WORKERS];
+  int running[MAX_BATCH_WORKERS];
+  int next = 0;
+  int done = 0;
+  int k;
+
+  for (k = 0; k < workers; k++) {
+    running[k] = -1;
+  }
+
+  while (done < num_items) {
+    for (k = 0; k < workers; k++) {
+      if (running[k] < 0 && next < num_items) {
+        batch_worker_start(&items[next], workers);
+        running[k] = next++;
+      }
+      pfd[k].fd = (running[k] < 0) ? -1 : items[running[k]].fd;
+      pfd[k].events = POLLIN;
+      pfd[k].revents = 0;
+    }
+
+    if (poll(pfd, workers, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      err(1, "poll on batch workers failed");
+    }
+
+    for (k = 0; k < workers; k++) {
+      if (running[k] >= 0 && pfd[k].revents != 0
+          && batch_worker_read(&items[running[k]])) {
+        running[k] = -1;
+        done++;
+      }
+    }
+  }
+}
+
+
+// Copy the address arrays into a new shared-memory segment.
+// Returns: SUCCESS or FAILURE.
+static int
+batch_segment_write(struct batch_item *items, struct syserv_batch_entry *entries,
+                    int num_items)
+{
+  size_t total = 0;
+  int i;
+
+  for (i = 0; i < num_items; i++) {
+    entries[i].offset = total;
+    total += page_align(entries[i].num_addrs * sizeof(uint64_t));
+  }
+  if (total == 0) {
+    total = page_align(1);
+  }
+
+  if (batch_shm_name[0] != 0) {
+    shm_unlink(batch_shm_name);
+  }
+  snprintf(batch_shm_name, sizeof(batch_shm_name), "/hpcfnbounds.%d.%d",
+           (int) getpid(), batch_seq++);
+
+  int fd = shm_open(batch_shm_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+  if (fd < 0) {
+    warn("shm_open %s failed", batch_shm_name);
+    batch_shm_name[0] = 0;
+    return FAILURE;
+  }
+  if (ftruncate(fd, total) != 0) {
+    warn("ftruncate of %s failed", batch_shm_name);
+    close(fd);
+    return FAILURE;
+  }
+  char *seg = (char *) mmap(NULL, total, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+  if (seg == MAP_FAILED) {
+    warn("mmap of %s failed", batch_shm_name);
+    return FAILURE;
+  }
+
+  for (i = 0; i < num_items; i++) {
+    memcpy(seg + entries[i].offset, items[i].buf + sizeof(struct syserv_mesg),
+           entries[i].num_addrs * sizeof(uint64_t));
+  }
+  munmap(seg, total);
+
+  return SUCCESS;
+}
+
+
+void
+do_query_batch(DiscoverFnTy fn_discovery, struct syserv_mesg *mesg)
+{
+  int num_items = 0;
+  int i;
+  char *p;
+
+  read_query_names(mesg);
+
+  for (p = inbuf; p < inbuf + mesg->len; p += strlen(p) + 1) {
+    num_items++;
+  }
+
+  struct batch_item *items = (struct batch_item *) calloc(num_items, sizeof(*items));
+  struct syserv_batch_entry *entries =
+    (struct syserv_batch_entry *) calloc(num_items, sizeof(*entries));
+  if (num_items > 0 && (items == NULL || entries == NULL)) {
+    err(1, "malloc for batch query failed");
+  }
+
+  for (i = 0, p = inbuf; i < num_items; i++, p += strlen(p) + 1) {
+    items[i].name = p;
+    items[i].fd = -1;
+  }
+
+  int workers = num_batch_workers(num_items);
+  if (verbose) {
+    fprintf(stderr, "FNB2: begin batch of %d load modules, %d workers\n",
+            num_items, workers);
+  }
+  batch_run(items, num_items, workers);
+
+  for (i = 0; i < num_items; i++) {
+    batch_entry_decode(&items[i], &entries[i]);
+  }
+
+  int ret;
+  if (batch_segment_write(items, entries, num_items) == SUCCESS) {
+    size_t len = strlen(batch_shm_name) + 1;
+    ret = write_mesg(SYSERV_OK, len);
+    if (ret == SUCCESS) {
+      ret = write_all(fdout, batch_shm_name, len);
+    }
+    if (ret == SUCCESS) {
+      ret = write_all(fdout, entries, num_items * sizeof(*entries));
+    }
+  } else {
+    ret = write_mesg(SYSERV_ERR, 0);
+  }
+  if (ret != SUCCESS) {
+    errx(1, "Server write of batch reply failed");
+  }
+
+  for (i = 0; i < num_items; i++) {
+    free(items[i].buf);
+  }
+  free(items);
+  free(entries);
+}
+
+
 
 // Send the list of functions to the client
 void
@@ -232,7 +571,7 @@ send_funcs ()
     }
   }
   if (verbose) {
-    fprintf(stderr, "FNB2: %s = %d (%ld) -- %s\n", strrchr(inbuf, '/'), np, (uint64_t)nfunc, inbuf );
+    fprintf(stderr, "FNB2: %s = %d (%ld) -- %s\n", strrchr(xname, '/'), np, (uint64_t)nfunc, xname );
   }
 
   // send the OK mesg with the count of addresses
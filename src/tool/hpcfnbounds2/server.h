@@ -53,6 +53,7 @@
 
 uint64_t	init_server(DiscoverFnTy, int, int);
 void	do_query(DiscoverFnTy , struct syserv_mesg *);
+void	do_query_batch(DiscoverFnTy , struct syserv_mesg *);
 void  send_funcs();
 
 void	signal_handler_init();
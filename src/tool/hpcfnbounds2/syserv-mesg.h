@@ -67,7 +67,8 @@ enum {
   SYSERV_QUERY,
   SYSERV_EXIT,
   SYSERV_OK,
-  SYSERV_ERR
+  SYSERV_ERR,
+  SYSERV_QUERY_BATCH
 };
 
 struct syserv_mesg {
@@ -88,4 +89,67 @@ struct syserv_fnbounds_info {
   int       is_relocatable;
 };
 
+// A batch query sends SYSERV_QUERY_BATCH with len = number of bytes
+// of file names, each terminated by \0.  The server answers ACK (or
+// ERR if it does not support batches) before the names are sent.
+// When the batch is done, the server answers OK with len = length of
+// the name (including \0) of a POSIX shared-memory segment, then the
+// name, then one syserv_batch_entry per file, in query order.  The
+// address array for each file is at a page-aligned offset in the
+// segment.  The client unlinks the segment after mapping it.
+//
+struct syserv_batch_entry {
+  int64_t  offset;
+  int64_t  num_addrs;   // including the trailing 0
+
+  // info.status is SYSERV_ERR if the query failed
+  struct syserv_fnbounds_info info;
+};
+
+// An fnbounds cache file holds the answer for one load module, written
+// ahead of time by `hpcfnbounds2 -C <dir>`, so that hpcrun can map it
+// instead of querying the server.  The file is <dir>/<hash>.fnb, where
+// <hash> is fnbounds_cache_hash() of the module's real path in hex.
+// The file holds the header, the path (including \0) at path_offset,
+// and the addresses (including the trailing 0) at addr_offset.  It is
+// only used if the path, size, mtime and build-id of the module still
+// match the header.
+//
+// Unlike the messages above, cache files outlive the process that
+// wrote them, so the header records the word size and a version.
+//
+#define FNBOUNDS_CACHE_MAGIC         "HPCFNB\0\0"
+#define FNBOUNDS_CACHE_VERSION       1
+#define FNBOUNDS_CACHE_SUFFIX        ".fnb"
+#define FNBOUNDS_CACHE_BUILD_ID_MAX  64   // bytes; GNU build-ids are 20
+
+struct syserv_fnbounds_cache {
+  char      magic[8];
+  uint32_t  version;
+  uint32_t  addr_size;     // sizeof(void *)
+  uint64_t  file_size;     // of the load module
+  int64_t   mtime_sec;
+  int64_t   mtime_nsec;
+  char      build_id[2 * FNBOUNDS_CACHE_BUILD_ID_MAX + 1];  // hex, or ""
+
+  uint64_t  path_offset;
+  uint64_t  addr_offset;
+  uint64_t  num_addrs;     // including the trailing 0
+  uint64_t  reference_offset;
+  int64_t   is_relocatable;
+};
+
+// 64-bit FNV-1a hash of a path
+static inline uint64_t
+fnbounds_cache_hash(const char *path)
+{
+  uint64_t hash = 0xcbf29ce484222325ULL;
+
+  for (; *path != '\0'; path++) {
+    hash ^= (unsigned char) *path;
+    hash *= 0x100000001b3ULL;
+  }
+  return hash;
+}
+
 #endif  // _SYSERV_MESG_H_
@@ -209,7 +209,10 @@ realmain(int argc, char* const* argv)
   bool printProgress = true;
 
   // Static instruction overlay should be down before stmt coalesce 
-  //Analysis::CallPath::overlayGPUInstructionsMain(*prof, args.instructionFiles);
+  if (args.gpuAdvisorThreads > 0) {
+    Analysis::CallPath::overlayGPUInstructionsMain(*prof, args.instructionFiles,
+      args.gpuAdvisorThreads);
+  }
 
   Analysis::CallPath::overlayStaticStructureMain(*prof, args.agent,
 						 args.doNormalizeTy, printProgress);
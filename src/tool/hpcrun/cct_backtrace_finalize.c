@@ -65,3 +65,9 @@ cct_cursor_finalize(
   else return cursor;
 }
 
+
+bool
+cct_backtrace_finalize_active(void)
+{
+  return finalizers != NULL || cursor_finalize != NULL;
+}
@@ -59,4 +59,9 @@ extern cct_node_t *cct_cursor_finalize(
   cct_node_t *cursor
 );
 
+
+// true if any finalizer is registered, i.e., backtraces must be
+// finalized in the context of the sample
+extern bool cct_backtrace_finalize_active(void);
+
 #endif
@@ -64,6 +64,7 @@
 #include <utilities/ip-normalized.h>
 #include "frame.h"
 #include <unwind/common/backtrace_info.h>
+#include <unwind/common/bt_memo.h>
 #include <unwind/common/fence_enum.h>
 #include <ompt/ompt-defer.h>
 #include <ompt/ompt-callstack.h>
@@ -97,9 +98,16 @@ hpcrun_kernel_callpath_register(hpcrun_kernel_callpath_t kcp)
 	hpcrun_kernel_callpath = kcp;
 }
 
+//
+// if 'nodes' is not NULL, record in nodes[f - path_end] the cct node
+// reached after inserting frame f.  if 'path_resume' is not NULL, the
+// frames outer to it were inserted by an earlier call with the same
+// 'nodes', and insertion resumes at path_resume.
+//
 static cct_node_t*
 cct_insert_raw_backtrace(cct_node_t* cct,
-                            frame_t* path_beg, frame_t* path_end)
+                            frame_t* path_beg, frame_t* path_end,
+                            frame_t* path_resume, cct_node_t** nodes)
 {
   TMSG(BT_INSERT, "%s : start", __func__);
   if (!cct) return NULL; // nowhere to insert
@@ -113,6 +121,13 @@ cct_insert_raw_backtrace(cct_node_t* cct,
   // FIXME: POGLEDAJ KOLIKO ON PUTA KROZ OVO PRODJE
 
   ip_normalized_t parent_routine = ip_normalized_NULL;
+  if (path_resume) {
+    if (path_resume < path_beg) {
+      cct = nodes[(path_resume + 1) - path_end];
+      parent_routine = (path_resume + 1)->the_function;
+    }
+    path_beg = path_resume;
+  }
   for(; path_beg >= path_end; path_beg--){
     if ( (! retain_recursion) &&
 	 (path_beg >= path_end + 1) && 
@@ -129,6 +144,7 @@ cct_insert_raw_backtrace(cct_node_t* cct,
       cct = hpcrun_cct_insert_addr(cct, &tmp);
     }
     parent_routine = path_beg->the_function;
+    if (nodes) nodes[path_beg - path_end] = cct;
   }
   hpcrun_cct_terminate_path(cct);
   // FIXME: vi3 consider this function
@@ -156,9 +172,10 @@ hpcrun_get_retain_recursion_mode()
   return retain_recursion;
 }
 
-// See usage in header.
-cct_node_t*
-hpcrun_cct_insert_backtrace(cct_node_t* treenode, frame_t* path_beg, frame_t* path_end)
+static cct_node_t*
+cct_insert_backtrace_resume(cct_node_t* treenode,
+			    frame_t* path_beg, frame_t* path_end,
+			    frame_t* path_resume, cct_node_t** nodes)
 {
   TMSG(FENCE, "insert backtrace into treenode %p", treenode);
   TMSG(FENCE, "backtrace below");
@@ -167,7 +184,8 @@ hpcrun_cct_insert_backtrace(cct_node_t* treenode, frame_t* path_beg, frame_t* pa
     ENABLE(BT_INSERT);
   }
 
-  cct_node_t* path = cct_insert_raw_backtrace(treenode, path_beg, path_end);
+  cct_node_t* path = cct_insert_raw_backtrace(treenode, path_beg, path_end,
+					      path_resume, nodes);
   if (! bt_ins) DISABLE(BT_INSERT);
 
   // Put lush as_info class correction here
@@ -191,12 +209,20 @@ hpcrun_cct_insert_backtrace(cct_node_t* treenode, frame_t* path_beg, frame_t* pa
 
 // See usage in header.
 cct_node_t*
-hpcrun_cct_insert_backtrace_w_metric(cct_node_t* treenode,
+hpcrun_cct_insert_backtrace(cct_node_t* treenode, frame_t* path_beg, frame_t* path_end)
+{
+  return cct_insert_backtrace_resume(treenode, path_beg, path_end, NULL, NULL);
+}
+
+static cct_node_t*
+cct_insert_backtrace_w_metric_resume(cct_node_t* treenode,
 				     int metric_id,
 				     frame_t* path_beg, frame_t* path_end,
+				     frame_t* path_resume, cct_node_t** nodes,
 				     cct_metric_data_t datum, void *data_aux)
 {
-  cct_node_t* path = hpcrun_cct_insert_backtrace(treenode, path_beg, path_end);
+  cct_node_t* path = cct_insert_backtrace_resume(treenode, path_beg, path_end,
+						 path_resume, nodes);
 
   if (hpcrun_kernel_callpath) {
     path = hpcrun_kernel_callpath(path, data_aux);
@@ -214,6 +240,18 @@ hpcrun_cct_insert_backtrace_w_metric(cct_node_t* treenode,
   return path;
 }
 
+// See usage in header.
+cct_node_t*
+hpcrun_cct_insert_backtrace_w_metric(cct_node_t* treenode,
+				     int metric_id,
+				     frame_t* path_beg, frame_t* path_end,
+				     cct_metric_data_t datum, void *data_aux)
+{
+  return cct_insert_backtrace_w_metric_resume(treenode, metric_id,
+					      path_beg, path_end, NULL, NULL,
+					      datum, data_aux);
+}
+
 //
 // Insert new backtrace in cct
 //
@@ -373,10 +411,30 @@ hpcrun_cct_record_backtrace_w_metric(cct_bundle_t* cct, bool partial,
   TMSG(FENCE, "further sanity check: bt->last frame = (%d, %p)", 
        bt->last->ip_norm.lm_id, bt->last->ip_norm.lm_ip);
 
-  return hpcrun_cct_insert_backtrace_w_metric(cct_cursor, metricId,
-					      bt->last, bt->begin, 
-					      (cct_metric_data_t) metricIncr, data);
+  if (! bt->memoized) {
+    return hpcrun_cct_insert_backtrace_w_metric(cct_cursor, metricId,
+						bt->last, bt->begin, 
+						(cct_metric_data_t) metricIncr, data);
+  }
+
+  // the frames outer to bt->memo_frame were inserted at the same cursor
+  // by the previous sample; resume insertion below them
+  bt_memo_t* memo = &td->bt_memo;
+  frame_t* resume = bt->memo_frame;
+  if (resume && (memo->root != cct_cursor || resume < bt->begin)) {
+    resume = NULL;
+  }
+
+  cct_node_t* path =
+    cct_insert_backtrace_w_metric_resume(cct_cursor, metricId,
+					 bt->last, bt->begin, resume,
+					 hpcrun_bt_memo_nodes(memo, bt->begin),
+					 (cct_metric_data_t) metricIncr, data);
+
+  hpcrun_bt_memo_commit(memo, bt->begin, cct_cursor, bt->fence);
+  if (resume) hpcrun_stats_frames_memo_inc((long) (bt->last - resume + 1));
 
+  return path;
 }
 
 
@@ -416,8 +474,20 @@ help_hpcrun_backtrace2cct(cct_bundle_t* bundle, ucontext_t* context,
     }
   }
 
+  frame_t* bt_begin = bt.begin;
+  frame_t* bt_last = bt.last;
+  ip_normalized_t bt_last_ip = bt.last->ip_norm;
+
   cct_backtrace_finalize(&bt, isSync);
 
+  if (bt.memoized &&
+      (bt.partial_unwind || bt.begin != bt_begin || bt.last != bt_last || bt.collapsed ||
+       ! ip_normalized_eq(&bt_last_ip, &bt.last->ip_norm))) {
+    // the frames were edited for this sample; don't memoize them
+    bt.memoized = false;
+    bt.memo_frame = NULL;
+  }
+
   if (bt.partial_unwind) {
     if (ENABLED(NO_PARTIAL_UNW)){
       return NULL;
@@ -19,7 +19,8 @@
   macro(HPCRUN_SANITIZER_TORCH_ANALYSIS_ONGPU)  \
   macro(HPCRUN_SANITIZER_GPU_ANALYSIS_BLOCKS)  \
   macro(HPCRUN_CUDA_DEVICE_BUFFER_SIZE)  \
-  macro(HPCRUN_CUDA_DEVICE_SEMAPHORE_SIZE)
+  macro(HPCRUN_CUDA_DEVICE_SEMAPHORE_SIZE)  \
+  macro(HPCRUN_GPU_TRACE_WORKERS)
 
 typedef enum {
 #define DEFINE_ENUM_KNOBS(knob_name)  \
@@ -49,6 +49,13 @@ const char* HPCRUN_OPT_LUSH_AGENTS = "HPCRUN_OPT_LUSH_AGENTS";
 
 const char* HPCRUN_OUT_PATH        = "HPCRUN_OUT_PATH";
 const char* HPCRUN_TRACE           = "HPCRUN_TRACE";
+const char* HPCRUN_TRACE_ASYNC     = "HPCRUN_TRACE_ASYNC";
+
+const char* HPCRUN_UNWIND_CACHE    = "HPCRUN_UNWIND_CACHE";
+const char* HPCRUN_BT_MEMO         = "HPCRUN_BT_MEMO";
+const char* HPCRUN_UNWIND_PREFETCH = "HPCRUN_UNWIND_PREFETCH";
+const char* HPCRUN_FNBOUNDS_CACHE  = "HPCRUN_FNBOUNDS_CACHE";
+const char* HPCRUN_PERF_USER_STACK = "HPCRUN_PERF_USER_STACK";
 
 const char* PAPI_EVENT_LIST        = "PAPI_EVENT_LIST";
 
@@ -58,6 +58,7 @@
 #include "hpcrun_return_codes.h"
 #include "monitor.h"
 #include <trampoline/common/trampoline.h>
+#include <unwind/common/bt_memo.h>
 #include <messages/messages.h>
 #include <cct/cct_bundle.h>
 
@@ -120,6 +121,7 @@ hpcrun_check_for_new_loadmap(epoch_t* epoch)
     hpcrun_cct_bundle_init(&(epoch->csdata), (epoch->csdata).ctxt);
 
     hpcrun_trampoline_remove();
+    hpcrun_bt_memo_invalidate();
 
     newepoch->loadmap = current;
     newepoch->next  = epoch;
@@ -154,6 +156,7 @@ hpcrun_epoch_reset(void)
   memcpy(newepoch, epoch, sizeof(epoch_t));
   TMSG(EPOCH_RESET, "check new loadmap = old loadmap = %d", newepoch->loadmap == epoch->loadmap);
   hpcrun_cct_bundle_init(&(newepoch->csdata), newepoch->csdata_ctxt); // reset cct
+  hpcrun_bt_memo_invalidate();
   hpcrun_reset_epoch(newepoch);
   TMSG(EPOCH_RESET," ==> no new epoch for next sample = %d", newepoch->loadmap == hpcrun_getLoadmap());
 }
@@ -9,4 +9,8 @@ void hpcrun_syserv_fini(void);
 
 void *hpcrun_syserv_query(const char *fname, struct fnbounds_file_header *fh);
 
+void hpcrun_syserv_batch_add(const char *fname);
+
+void hpcrun_syserv_batch_query(void);
+
 #endif  // _FNBOUNDS_CLIENT_H_
@@ -0,0 +1,242 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+// Map precomputed fnbounds tables from the cache directories in
+// HPCRUN_FNBOUNDS_CACHE.  A cache file holds the same array of
+// addresses that the server sends over the pipe, so the mapped file is
+// used in place as the dso table and is never unmapped, the same as an
+// answer from the server.
+//
+// A cache file is only used if the module still has the path, size,
+// mtime and build-id recorded in the file.  The build-id is read last,
+// since it is the only check that reads the module itself.
+
+//***************************************************************************
+// system includes
+//***************************************************************************
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+//***************************************************************************
+// local includes
+//***************************************************************************
+
+#include <hpcfnbounds/syserv-mesg.h>
+#include <env.h>
+#include <messages/messages.h>
+
+#include "fnbounds_cache.h"
+#include "fnbounds_interface.h"
+
+//***************************************************************************
+// macros
+//***************************************************************************
+
+#define MAX_CACHE_DIRS  16
+
+//***************************************************************************
+// local data
+//***************************************************************************
+
+static char  cache_dirs_buf[PATH_MAX];
+static char *cache_dirs[MAX_CACHE_DIRS];
+static int   num_cache_dirs = 0;
+
+//***************************************************************************
+// private operations
+//***************************************************************************
+
+// Open the cache file of fname and check it against the module.
+// Returns: the file descriptor, with the header in *hdr and the size of
+// the cache file in *size, or else -1.
+//
+static int
+cache_file_open(const char *fname, struct syserv_fnbounds_cache *hdr,
+		size_t *size)
+{
+  char path[PATH_MAX];
+  char cache_path[PATH_MAX];
+  char build_id[2 * FNBOUNDS_BUILD_ID_MAX + 1];
+  struct stat st, cst;
+  int k;
+
+  if (num_cache_dirs == 0 || fname == NULL || stat(fname, &st) != 0) {
+    return -1;
+  }
+
+  size_t len = strlen(fname) + 1;
+  uint64_t hash = fnbounds_cache_hash(fname);
+
+  for (k = 0; k < num_cache_dirs; k++) {
+    snprintf(cache_path, sizeof(cache_path), "%s/%016lx" FNBOUNDS_CACHE_SUFFIX,
+	     cache_dirs[k], (unsigned long) hash);
+
+    int fd = open(cache_path, O_RDONLY);
+    if (fd < 0) {
+      continue;
+    }
+
+    if (fstat(fd, &cst) == 0
+	&& pread(fd, hdr, sizeof(*hdr), 0) == sizeof(*hdr)
+	&& memcmp(hdr->magic, FNBOUNDS_CACHE_MAGIC, sizeof(hdr->magic)) == 0
+	&& hdr->version == FNBOUNDS_CACHE_VERSION
+	&& hdr->addr_size == sizeof(void *)
+	&& hdr->file_size == (uint64_t) st.st_size
+	&& hdr->mtime_sec == (int64_t) st.st_mtim.tv_sec
+	&& hdr->mtime_nsec == (int64_t) st.st_mtim.tv_nsec
+	&& hdr->num_addrs >= 1
+	&& hdr->addr_offset % sizeof(void *) == 0
+	&& hdr->addr_offset + hdr->num_addrs * sizeof(void *) <= (uint64_t) cst.st_size
+	&& hdr->path_offset + len <= hdr->addr_offset
+	&& pread(fd, path, len, hdr->path_offset) == (ssize_t) len
+	&& memcmp(path, fname, len) == 0)
+    {
+      // a module without a build-id matches an empty one
+      hdr->build_id[sizeof(hdr->build_id) - 1] = '\0';
+      if (! fnbounds_build_id(fname, build_id)) {
+	build_id[0] = '\0';
+      }
+      if (strcmp(hdr->build_id, build_id) == 0) {
+	*size = cst.st_size;
+	return fd;
+      }
+      TMSG(FNBOUNDS_CLIENT, "cache: stale build-id: %s", cache_path);
+    }
+    else {
+      TMSG(FNBOUNDS_CLIENT, "cache: stale file: %s", cache_path);
+    }
+    close(fd);
+  }
+
+  return -1;
+}
+
+//***************************************************************************
+// interface operations
+//***************************************************************************
+
+void
+fnbounds_cache_init(void)
+{
+  char *save = NULL;
+  char *dir;
+
+  num_cache_dirs = 0;
+
+  const char *str = getenv(HPCRUN_FNBOUNDS_CACHE);
+  if (str == NULL || str[0] == '\0') {
+    return;
+  }
+  if (strlen(str) >= sizeof(cache_dirs_buf)) {
+    EMSG("fnbounds cache: directory list too long: %s", str);
+    return;
+  }
+  strcpy(cache_dirs_buf, str);
+
+  for (dir = strtok_r(cache_dirs_buf, ":", &save);
+       dir != NULL && num_cache_dirs < MAX_CACHE_DIRS;
+       dir = strtok_r(NULL, ":", &save)) {
+    cache_dirs[num_cache_dirs++] = dir;
+  }
+  TMSG(FNBOUNDS_CLIENT, "cache: %d directories: %s", num_cache_dirs, str);
+}
+
+
+void *
+fnbounds_cache_lookup(const char *fname, struct fnbounds_file_header *fh)
+{
+  struct syserv_fnbounds_cache hdr;
+  size_t size;
+
+  int fd = cache_file_open(fname, &hdr, &size);
+  if (fd < 0) {
+    return NULL;
+  }
+
+  char *base = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (base == MAP_FAILED) {
+    EMSG("fnbounds cache: mmap failed for %s: %s", fname, strerror(errno));
+    return NULL;
+  }
+
+  fh->num_entries = hdr.num_addrs - 1;
+  fh->reference_offset = hdr.reference_offset;
+  fh->is_relocatable = hdr.is_relocatable;
+  fh->mmap_size = size;
+
+  TMSG(FNBOUNDS_CLIENT, "cache: %s, symbols: %ld, offset: 0x%lx, reloc: %d",
+       fname, (long) fh->num_entries, (long) fh->reference_offset,
+       (int) fh->is_relocatable);
+
+  return base + hdr.addr_offset;
+}
+
+
+bool
+fnbounds_cache_probe(const char *fname)
+{
+  struct syserv_fnbounds_cache hdr;
+  size_t size;
+
+  int fd = cache_file_open(fname, &hdr, &size);
+  if (fd < 0) {
+    return false;
+  }
+  close(fd);
+  return true;
+}
@@ -0,0 +1,74 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+// Precomputed fnbounds tables.
+//
+// `hpcfnbounds2 -C <dir> <files>` writes the answer for each load
+// module to a cache file in <dir> (see syserv-mesg.h).
+// HPCRUN_FNBOUNDS_CACHE is a colon-separated list of such directories.
+// A module whose file is found there, with the same path, size, mtime
+// and build-id, is mapped from the file instead of being sent to the
+// fnbounds server.
+
+#ifndef _FNBOUNDS_CACHE_H_
+#define _FNBOUNDS_CACHE_H_
+
+#include <stdbool.h>
+
+#include "fnbounds_file_header.h"
+
+// read HPCRUN_FNBOUNDS_CACHE; the cache stays disabled if it is not set
+void fnbounds_cache_init(void);
+
+// Returns: pointer to the array of addresses mapped from the cache file
+// of 'fname' and fills in the file header, or else NULL.
+void *fnbounds_cache_lookup(const char *fname, struct fnbounds_file_header *fh);
+
+// true if fnbounds_cache_lookup() would find 'fname'
+bool fnbounds_cache_probe(const char *fname);
+
+#endif  // _FNBOUNDS_CACHE_H_
@@ -75,6 +75,13 @@
 // 6. The bottom of this file has code for an interactive, stand-alone
 // client for testing hpcfnbounds in server mode.
 //
+// 7. Load modules can be queued with hpcrun_syserv_batch_add() and
+// sent in one batch query.  The server answers with a shared-memory
+// segment holding all of the address arrays, which we map privately
+// and hand out, one page-aligned piece per module, as
+// hpcrun_syserv_query() is called for each name.  A server that does
+// not support batches answers ERR and we stop asking.
+//
 // Todo:
 //
 
@@ -125,6 +132,7 @@ char	*outfile;
 #include <err.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <sched.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -170,6 +178,31 @@ static int fdin = -1;
 static pid_t my_pid;
 static pid_t server_pid = 0;
 
+// names queued for the next batch query
+static char  *batch_names = NULL;
+static size_t batch_names_len = 0;
+static size_t batch_names_size = 0;
+static int    batch_count = 0;
+static bool   batch_unsupported = false;
+
+// answers from the last batch query, waiting to be claimed by
+// hpcrun_syserv_query()
+struct batch_answer {
+  const char *name;
+  void *addr;
+  struct fnbounds_file_header fh;
+  bool ok;
+  bool claimed;
+};
+
+static char *answer_names = NULL;
+static size_t answer_names_size = 0;
+static struct syserv_batch_entry *answer_entries = NULL;
+static struct batch_answer *answers = NULL;
+static size_t answers_size = 0;
+static int num_answers = 0;
+static int next_answer = 0;
+
 #if 0
 // Limit on memory use at which we restart the server in Meg.
 #define SERVER_MEM_LIMIT  140
@@ -584,6 +617,237 @@ hpcrun_syserv_fini(void)
 }
 
 
+//*****************************************************************
+// Batch Queries
+//*****************************************************************
+
+// Release the answers from the last batch, including the address
+// arrays that nobody claimed.
+//
+static void
+batch_answers_clear(void)
+{
+  int k;
+
+  for (k = 0; k < num_answers; k++) {
+    if (answers[k].ok && !answers[k].claimed) {
+      munmap(answers[k].addr, answers[k].fh.mmap_size);
+    }
+  }
+  if (answers != NULL) {
+    munmap(answers, answers_size);
+    munmap(answer_entries, page_align(num_answers * sizeof(struct syserv_batch_entry)));
+    munmap(answer_names, answer_names_size);
+  }
+  answers = NULL;
+  answer_entries = NULL;
+  answer_names = NULL;
+  num_answers = 0;
+  next_answer = 0;
+}
+
+
+// Returns: true if 'fname' was answered by the last batch, and fills
+// in its address array (or NULL if its query failed) and file header.
+//
+static bool
+batch_answer_claim(const char *fname, void **addr, struct fnbounds_file_header *fh)
+{
+  int n;
+
+  // queries usually come in the same order as the batch, so start
+  // looking just past the last answer claimed
+  for (n = 0; n < num_answers; n++) {
+    struct batch_answer *ans = &answers[(next_answer + n) % num_answers];
+    if (!ans->claimed && strcmp(ans->name, fname) == 0) {
+      ans->claimed = true;
+      next_answer = (next_answer + n + 1) % num_answers;
+      *addr = ans->addr;
+      *fh = ans->fh;
+      return true;
+    }
+  }
+
+  return false;
+}
+
+
+// Queue 'fname' for the next batch query.
+//
+void
+hpcrun_syserv_batch_add(const char *fname)
+{
+  size_t len = strlen(fname) + 1;
+
+  if (batch_unsupported) {
+    return;
+  }
+
+  if (batch_names_len + len > batch_names_size) {
+    size_t size = page_align(2 * (batch_names_len + len));
+    char *names = mmap_anon(size);
+    if (names == MAP_FAILED) {
+      return;
+    }
+    if (batch_names != NULL) {
+      memcpy(names, batch_names, batch_names_len);
+      munmap(batch_names, batch_names_size);
+    }
+    batch_names = names;
+    batch_names_size = size;
+  }
+
+  memcpy(batch_names + batch_names_len, fname, len);
+  batch_names_len += len;
+  batch_count++;
+}
+
+
+// Send the queued names to the server in one query and keep the
+// answers for hpcrun_syserv_query().  On any failure, the queries are
+// simply left to be made one at a time.
+//
+void
+hpcrun_syserv_batch_query(void)
+{
+  struct timeval start, now;
+  struct syserv_mesg mesg;
+  struct stat st;
+  char shm_name[PATH_MAX];
+  char *base;
+  int k, fd;
+
+  batch_answers_clear();
+
+  int count = batch_count;
+  size_t names_len = batch_names_len;
+  batch_count = 0;
+  batch_names_len = 0;
+
+  if (count == 0 || batch_unsupported) {
+    return;
+  }
+
+  if (client_status != SYSERV_ACTIVE || my_pid != getpid()) {
+    launch_server();
+  }
+
+  TMSG(FNBOUNDS_CLIENT, "batch query: %d load modules", count);
+
+  if (ENABLED(FNBOUNDS_CLIENT)) {
+    gettimeofday(&start, NULL);
+  }
+
+  if (write_mesg(SYSERV_QUERY_BATCH, names_len) != SUCCESS
+      || read_mesg(&mesg) != SUCCESS) {
+    shutdown_server();
+    return;
+  }
+  if (mesg.type != SYSERV_ACK) {
+    TMSG(FNBOUNDS_CLIENT, "batch queries not supported by server");
+    batch_unsupported = true;
+    return;
+  }
+
+  if (write_all(fdout, batch_names, names_len) != SUCCESS
+      || read_mesg(&mesg) != SUCCESS) {
+    EMSG("FNBOUNDS_CLIENT ERROR: lost contact with server");
+    shutdown_server();
+    return;
+  }
+  if (mesg.type != SYSERV_OK) {
+    EMSG("FNBOUNDS_CLIENT ERROR: batch query failed");
+    return;
+  }
+
+  // Read the segment name and the table of entries.
+  size_t entries_size = page_align(count * sizeof(struct syserv_batch_entry));
+  answer_entries = mmap_anon(entries_size);
+  if (mesg.len > sizeof(shm_name) || answer_entries == MAP_FAILED
+      || read_all(fdin, shm_name, mesg.len) != SUCCESS
+      || read_all(fdin, answer_entries, count * sizeof(struct syserv_batch_entry)) != SUCCESS) {
+    EMSG("FNBOUNDS_CLIENT ERROR: lost contact with server");
+    if (answer_entries != MAP_FAILED) {
+      munmap(answer_entries, entries_size);
+    }
+    answer_entries = NULL;
+    shutdown_server();
+    return;
+  }
+
+  // Map the segment privately, then unlink it.  Each module's piece
+  // can later be unmapped on its own.
+  fd = shm_open(shm_name, O_RDONLY, 0);
+  if (fd < 0) {
+    EMSG("FNBOUNDS_CLIENT ERROR: unable to open batch segment %s", shm_name);
+    munmap(answer_entries, entries_size);
+    answer_entries = NULL;
+    return;
+  }
+  shm_unlink(shm_name);
+  base = MAP_FAILED;
+  if (fstat(fd, &st) == 0) {
+    base = mmap(NULL, st.st_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  }
+  close(fd);
+  if (base == MAP_FAILED) {
+    EMSG("FNBOUNDS_CLIENT ERROR: unable to map batch segment");
+    munmap(answer_entries, entries_size);
+    answer_entries = NULL;
+    return;
+  }
+
+  // Keep the names with the answers: the queue may be refilled
+  // before they are claimed.
+  answers_size = page_align(count * sizeof(struct batch_answer));
+  answers = mmap_anon(answers_size);
+  if (answers == MAP_FAILED) {
+    EMSG("FNBOUNDS_CLIENT ERROR: mmap failed");
+    munmap(base, st.st_size);
+    munmap(answer_entries, entries_size);
+    answers = NULL;
+    answer_entries = NULL;
+    return;
+  }
+  answer_names = batch_names;
+  answer_names_size = batch_names_size;
+  batch_names = NULL;
+  batch_names_size = 0;
+
+  const char *name = answer_names;
+  for (k = 0; k < count; k++, name += strlen(name) + 1) {
+    struct syserv_batch_entry *ent = &answer_entries[k];
+    struct batch_answer *ans = &answers[k];
+
+    ans->name = name;
+    ans->ok = (ent->info.magic == FNBOUNDS_MAGIC && ent->info.status == SYSERV_OK);
+    if (ans->ok) {
+      ans->addr = base + ent->offset;
+      ans->fh.num_entries = ent->info.num_entries;
+      ans->fh.reference_offset = ent->info.reference_offset;
+      ans->fh.is_relocatable = ent->info.is_relocatable;
+      ans->fh.mmap_size = page_align(ent->num_addrs * sizeof(void *));
+    } else {
+      ans->addr = NULL;
+    }
+  }
+  num_answers = count;
+
+  // the server pads a segment with no addresses to one page
+  struct syserv_batch_entry *last = &answer_entries[count - 1];
+  size_t end = last->offset + page_align(last->num_addrs * sizeof(void *));
+  if (end < st.st_size) {
+    munmap(base + end, st.st_size - end);
+  }
+
+  if (ENABLED(FNBOUNDS_CLIENT)) {
+    gettimeofday(&now, NULL);
+  }
+  TMSG(FNBOUNDS_CLIENT, "batch query: %d load modules, time: %ld usec",
+       count, tdiff(start, now));
+}
+
+
 //*****************************************************************
 // Query the System Server
 //*****************************************************************
@@ -603,6 +867,14 @@ hpcrun_syserv_query(const char *fname, struct fnbounds_file_header *fh)
     return NULL;
   }
 
+  if (batch_answer_claim(fname, &addr, fh)) {
+    TMSG(FNBOUNDS_CLIENT, "query: %s (from batch)", fname);
+    if (addr == NULL) {
+      EMSG("FNBOUNDS_CLIENT ERROR: query failed: %s", fname);
+    }
+    return addr;
+  }
+
   if (client_status != SYSERV_ACTIVE || my_pid != getpid()) {
     launch_server();
   }
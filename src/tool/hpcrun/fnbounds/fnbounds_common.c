@@ -44,8 +44,16 @@
 //
 // ******************************************************* EndRiceCopyright *
 
+#include <elf.h>
+#include <fcntl.h>
+#include <link.h>
+#include <string.h>
+#include <unistd.h>
+
 #include "fnbounds_interface.h"
 
+#define FNBOUNDS_NOTE_BUF_MAX 2048
+
 int
 fnbounds_table_lookup(void **table, int length, void *ip, 
 		      void **start, void **end)
@@ -73,3 +81,62 @@ fnbounds_table_lookup(void **table, int length, void *ip,
   *end   = table[lo+1];
   return 0;
 }
+
+
+// Uses only system calls, since modules can be mapped from a signal
+// handler.
+bool
+fnbounds_build_id(const char *path, char *hex)
+{
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return false;
+
+  bool found = false;
+  ElfW(Ehdr) ehdr;
+  if (pread(fd, &ehdr, sizeof(ehdr), 0) != sizeof(ehdr)
+      || memcmp(ehdr.e_ident, ELFMAG, SELFMAG) != 0
+      || ehdr.e_phentsize != sizeof(ElfW(Phdr))) {
+    close(fd);
+    return false;
+  }
+
+  for (int i = 0; i < ehdr.e_phnum && !found; i++) {
+    ElfW(Phdr) phdr;
+    off_t off = ehdr.e_phoff + i * sizeof(phdr);
+    if (pread(fd, &phdr, sizeof(phdr), off) != sizeof(phdr)) break;
+    if (phdr.p_type != PT_NOTE) continue;
+
+    char buf[FNBOUNDS_NOTE_BUF_MAX] __attribute__((aligned(8)));
+    size_t len = phdr.p_filesz < sizeof(buf) ? phdr.p_filesz : sizeof(buf);
+    ssize_t got = pread(fd, buf, len, phdr.p_offset);
+    if (got <= 0) continue;
+
+    size_t pos = 0;
+    size_t align = phdr.p_align > 4 ? phdr.p_align : 4;
+    while (pos + sizeof(ElfW(Nhdr)) <= (size_t) got) {
+      ElfW(Nhdr) *note = (ElfW(Nhdr) *) (buf + pos);
+      size_t name_pos = pos + sizeof(*note);
+      size_t desc_pos = name_pos + ((note->n_namesz + align - 1) & ~(align - 1));
+      size_t next = desc_pos + ((note->n_descsz + align - 1) & ~(align - 1));
+      if (desc_pos + note->n_descsz > (size_t) got) break;
+
+      if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4
+	  && memcmp(buf + name_pos, "GNU", 4) == 0
+	  && note->n_descsz > 0 && note->n_descsz <= FNBOUNDS_BUILD_ID_MAX) {
+	static const char digits[] = "0123456789abcdef";
+	unsigned char *desc = (unsigned char *) (buf + desc_pos);
+	for (size_t k = 0; k < note->n_descsz; k++) {
+	  hex[2 * k]     = digits[desc[k] >> 4];
+	  hex[2 * k + 1] = digits[desc[k] & 0xf];
+	}
+	hex[2 * note->n_descsz] = '\0';
+	found = true;
+	break;
+      }
+      pos = next;
+    }
+  }
+
+  close(fd);
+  return found;
+}
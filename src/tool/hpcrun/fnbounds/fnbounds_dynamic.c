@@ -92,6 +92,7 @@
 #include "fnbounds_interface.h"
 #include "fnbounds_file_header.h"
 #include "client.h"
+#include "fnbounds_cache.h"
 #include "dylib.h"
 
 #include <hpcrun/main.h>
@@ -181,6 +182,7 @@ fnbounds_init()
 {
   if (hpcrun_get_disabled()) return 0;
 
+  fnbounds_cache_init();
   hpcrun_syserv_init();
   fnbounds_map_executable();
   fnbounds_map_open_dsos();
@@ -291,7 +293,10 @@ fnbounds_dso_exec(void)
 
   TMSG(MAP_EXEC, "Entry");
   realpath("/proc/self/exe", filename);
-  void** nm_table = (void**) hpcrun_syserv_query(filename, &fh);
+  void** nm_table = (void**) fnbounds_cache_lookup(filename, &fh);
+  if (! nm_table) {
+    nm_table = (void**) hpcrun_syserv_query(filename, &fh);
+  }
   if (! nm_table) {
     EMSG("No nm_table for executable %s", filename);
     dylib_find_executable_bounds(&start, &end);
@@ -357,6 +362,32 @@ fnbounds_ensure_mapped_dso(const char *module_name, void *start, void *end, stru
 }
 
 
+void
+fnbounds_batch_add(const char *module_name, void *start, void *end)
+{
+  char filename[PATH_MAX];
+
+  // the executable and virtual files are queried one at a time
+  if (module_name == NULL || module_name[0] == '\0'
+      || strncmp(module_name, "linux-gate.so", 13) == 0) {
+    return;
+  }
+
+  if (hpcrun_loadmap_findByAddr(start, end) == NULL
+      && realpath(module_name, filename) != NULL
+      && ! fnbounds_cache_probe(filename)) {
+    hpcrun_syserv_batch_add(filename);
+  }
+}
+
+
+void
+fnbounds_batch_query(void)
+{
+  hpcrun_syserv_batch_query();
+}
+
+
 //---------------------------------------------------------------------
 // Function: fnbounds_unmap_closed_dsos
 // Purpose:  
@@ -465,7 +496,11 @@ fnbounds_compute(const char* incoming_filename, void* start, void* end)
     pathname_for_query = filename;
   }
 
-  nm_table = (void**) hpcrun_syserv_query(pathname_for_query, &fh);
+  // a precomputed table, if there is one, saves the server a scan
+  nm_table = (void**) fnbounds_cache_lookup(pathname_for_query, &fh);
+  if (nm_table == NULL) {
+    nm_table = (void**) hpcrun_syserv_query(pathname_for_query, &fh);
+  }
   if (nm_table == NULL) {
     return hpcrun_dso_make(filename, NULL, NULL, start, end, 0);
   }
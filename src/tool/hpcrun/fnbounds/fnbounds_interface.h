@@ -72,6 +72,15 @@ fnbounds_unmap_closed_dsos();
 bool
 fnbounds_ensure_mapped_dso(const char *module_name, void *start, void *end, struct dl_phdr_info*);
 
+// queue a load module that is not yet mapped for a batch query to the
+// fnbounds server; fnbounds_batch_query sends the queued names at once
+// so that fnbounds_ensure_mapped_dso finds their answers waiting
+void
+fnbounds_batch_add(const char *module_name, void *start, void *end);
+
+void
+fnbounds_batch_query(void);
+
 void
 fnbounds_fini();
 
@@ -87,4 +96,13 @@ fnbounds_table_lookup(void **table, int length, void *ip,
 		      void **start, void **end);
 
 
+#define FNBOUNDS_BUILD_ID_MAX 64   // bytes; GNU build-ids are 20
+
+// fnbounds_build_id(): read the GNU build-id note of the ELF file
+// 'path' into 'hex' as a string of up to 2 * FNBOUNDS_BUILD_ID_MAX hex
+// digits.  Returns false if the file has no build-id.
+bool
+fnbounds_build_id(const char *path, char *hex);
+
+
 #include "fnbounds_table_interface.h"
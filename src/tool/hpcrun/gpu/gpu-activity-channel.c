@@ -45,6 +45,8 @@
 // local includes
 //******************************************************************************
 
+#include <lib/prof-lean/ringchannel.h>
+
 #include <hpcrun/memory/hpcrun-malloc.h>
 
 #include "gpu-activity.h"
@@ -56,24 +58,23 @@
 // macros
 //******************************************************************************
 
-#undef typed_bichannel
+#define CHANNEL_BATCH_SIZE 64
+
+#undef typed_ringchannel
 #undef typed_stack_elem
 
-#define typed_bichannel(x) gpu_activity_channel_t
+#define typed_ringchannel(x) gpu_activity_channel_t
 #define typed_stack_elem(x) gpu_activity_t
 
 // define macros that simplify use of activity channel API 
 #define channel_init  \
-  typed_bichannel_init(gpu_activity_t)
+  typed_ringchannel_init(gpu_activity_t)
 
-#define channel_pop   \
-  typed_bichannel_pop(gpu_activity_t)
+#define channel_pop_batch   \
+  typed_ringchannel_pop_batch(gpu_activity_t)
 
 #define channel_push  \
-  typed_bichannel_push(gpu_activity_t)
-
-#define channel_steal \
-  typed_bichannel_steal(gpu_activity_t)
+  typed_ringchannel_push(gpu_activity_t)
 
 #define gpu_activity_alloc(channel)		\
   channel_item_alloc(channel, gpu_activity_t)
@@ -87,7 +88,7 @@
 //******************************************************************************
 
 typedef struct gpu_activity_channel_t {
-  bistack_t bistacks[2];
+  ringchannel_t ring;
 } gpu_activity_channel_t;
 
 
@@ -104,8 +105,8 @@ static __thread gpu_activity_channel_t *gpu_activity_channel = NULL;
 // private functions
 //******************************************************************************
 
-// implement bidirectional channels for activities
-typed_bichannel_impl(gpu_activity_t)
+// implement ring channels for activities
+typed_ringchannel_impl(gpu_activity_t)
 
 
 static gpu_activity_channel_t *
@@ -154,7 +155,7 @@ gpu_activity_channel_produce
 
   gpu_context_activity_dump(channel_activity, "PRODUCE");
 
-  channel_push(channel, bichannel_direction_forward, channel_activity);
+  channel_push(channel, channel_activity);
 }
 
 
@@ -166,14 +167,18 @@ gpu_activity_channel_consume
 {
   gpu_activity_channel_t *channel = gpu_activity_channel_get();
 
-  // steal elements previously enqueued by the producer
-  channel_steal(channel, bichannel_direction_forward);
+  gpu_activity_t *batch[CHANNEL_BATCH_SIZE];
 
-  // consume all elements enqueued before this function was called
+  // consume elements in batches until the channel is drained
   for (;;) {
-    gpu_activity_t *a = channel_pop(channel, bichannel_direction_forward);
-    if (!a) break;
-    gpu_activity_consume(a, aa_fn);
-    gpu_activity_free(channel, a);
+    size_t n = channel_pop_batch(channel, batch, CHANNEL_BATCH_SIZE);
+
+    size_t i;
+    for (i = 0; i < n; i++) {
+      gpu_activity_consume(batch[i], aa_fn);
+      gpu_activity_free(channel, batch[i]);
+    }
+
+    if (n < CHANNEL_BATCH_SIZE) break;
   }
 }
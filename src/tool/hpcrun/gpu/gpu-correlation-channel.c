@@ -50,7 +50,7 @@
 //******************************************************************************
 
 
-#include <lib/prof-lean/bichannel.h>
+#include <lib/prof-lean/ringchannel.h>
 
 #include <hpcrun/memory/hpcrun-malloc.h>
 
@@ -65,24 +65,23 @@
 // macros
 //******************************************************************************
 
-#undef typed_bichannel
+#define CHANNEL_BATCH_SIZE 64
+
+#undef typed_ringchannel
 #undef typed_stack_elem
 
-#define typed_bichannel(x) gpu_correlation_channel_t
+#define typed_ringchannel(x) gpu_correlation_channel_t
 #define typed_stack_elem(x) gpu_correlation_t
 
 // define macros that simplify use of correlation channel API 
 #define channel_init  \
-  typed_bichannel_init(gpu_correlation_t)
+  typed_ringchannel_init(gpu_correlation_t)
 
-#define channel_pop   \
-  typed_bichannel_pop(gpu_correlation_t)
+#define channel_pop_batch   \
+  typed_ringchannel_pop_batch(gpu_correlation_t)
 
 #define channel_push  \
-  typed_bichannel_push(gpu_correlation_t)
-
-#define channel_steal \
-  typed_bichannel_steal(gpu_correlation_t)
+  typed_ringchannel_push(gpu_correlation_t)
 
 
 
@@ -91,7 +90,7 @@
 //******************************************************************************
 
 typedef struct gpu_correlation_channel_t {
-  bistack_t bistacks[2];
+  ringchannel_t ring;
 } gpu_correlation_channel_t;
 
 
@@ -108,8 +107,8 @@ static __thread gpu_correlation_channel_t *gpu_correlation_channel = NULL;
 // private functions
 //******************************************************************************
 
-// implement bidirectional channels for correlations
-typed_bichannel_impl(gpu_correlation_t)
+// implement ring channels for correlations
+typed_ringchannel_impl(gpu_correlation_t)
 
 
 static gpu_correlation_channel_t *
@@ -164,7 +163,7 @@ gpu_correlation_channel_produce
   gpu_correlation_produce(c, host_correlation_id, gpu_op_ccts, cpu_submit_time,
 			  activity_channel);
 
-  channel_push(corr_channel, bichannel_direction_forward, c);
+  channel_push(corr_channel, c);
 }
 
 
@@ -174,15 +173,19 @@ gpu_correlation_channel_consume
  gpu_correlation_channel_t *channel
 )
 {
-  // steal elements previously enqueued by the producer
-  channel_steal(channel, bichannel_direction_forward);
+  gpu_correlation_t *batch[CHANNEL_BATCH_SIZE];
 
-  // consume all elements enqueued before this function was called
+  // consume elements in batches until the channel is drained
   for (;;) {
-    gpu_correlation_t *c = channel_pop(channel, bichannel_direction_forward);
-    if (!c) break;
-    gpu_correlation_consume(c);
-    gpu_correlation_free(channel, c);
+    size_t n = channel_pop_batch(channel, batch, CHANNEL_BATCH_SIZE);
+
+    size_t i;
+    for (i = 0; i < n; i++) {
+      gpu_correlation_consume(batch[i]);
+      gpu_correlation_free(channel, batch[i]);
+    }
+
+    if (n < CHANNEL_BATCH_SIZE) break;
   }
 }
 
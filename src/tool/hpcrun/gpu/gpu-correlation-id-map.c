@@ -54,8 +54,11 @@
 // local includes
 //*****************************************************************************
 
+#include <lib/prof-lean/hashmap-uint64.h>
 #include <lib/prof-lean/splay-uint64.h>
 
+#include <hpcrun/memory/hpcrun-malloc.h>
+
 #include "gpu-correlation-id-map.h"
 #include "gpu-splay-allocator.h"
 
@@ -70,6 +73,11 @@
 #include "gpu-print.h"
 
 
+// correlation ids are issued in increasing order and retired soon
+// after, which suits a hash map better than a splay tree
+#define USE_HASHMAP 1
+
+
 #define st_insert				\
   typed_splay_insert(correlation_id)
 
@@ -119,8 +127,33 @@ typedef struct typed_splay_node(correlation_id) {
 // local data
 //******************************************************************************
 
+#if USE_HASHMAP
+
+static hashmap_uint64_t map = HASHMAP_UINT64_INITIALIZER(hpcrun_malloc_safe);
+
+#define map_lookup(id) \
+  ((gpu_correlation_id_map_entry_t *) hashmap_uint64_lookup(&map, id))
+
+#define map_insert(entry) \
+  hashmap_uint64_insert(&map, entry->gpu_correlation_id, entry)
+
+#define map_delete(id) \
+  ((gpu_correlation_id_map_entry_t *) hashmap_uint64_delete(&map, id))
+
+#define map_count() \
+  hashmap_uint64_count(&map)
+
+#else
+
 static gpu_correlation_id_map_entry_t *map_root = NULL;
 
+#define map_lookup(id) st_lookup(&map_root, id)
+#define map_insert(entry) st_insert(&map_root, entry)
+#define map_delete(id) st_delete(&map_root, id)
+#define map_count() st_count(map_root)
+
+#endif
+
 static gpu_correlation_id_map_entry_t *free_list = NULL;
 
 
@@ -129,7 +162,9 @@ static gpu_correlation_id_map_entry_t *free_list = NULL;
 // private operations
 //*****************************************************************************
 
+#if !USE_HASHMAP
 typed_splay_impl(correlation_id)
+#endif
 
 
 static gpu_correlation_id_map_entry_t *
@@ -169,7 +204,7 @@ gpu_correlation_id_map_lookup
 )
 {
   uint64_t correlation_id = gpu_correlation_id;
-  gpu_correlation_id_map_entry_t *result = st_lookup(&map_root, correlation_id);
+  gpu_correlation_id_map_entry_t *result = map_lookup(correlation_id);
 
   PRINT("correlation_id map lookup: id=0x%lx (record %p)\n", 
        correlation_id, result);
@@ -185,7 +220,7 @@ gpu_correlation_id_map_insert
  uint64_t host_correlation_id
 )
 {
-  if (st_lookup(&map_root, gpu_correlation_id)) { 
+  if (map_lookup(gpu_correlation_id)) { 
     // fatal error: correlation_id already present; a
     // correlation should be inserted only once.
     assert(0);
@@ -193,7 +228,7 @@ gpu_correlation_id_map_insert
     gpu_correlation_id_map_entry_t *entry = 
       gpu_correlation_id_map_entry_new(gpu_correlation_id, host_correlation_id);
 
-    st_insert(&map_root, entry);
+    map_insert(entry);
 
     PRINT("correlation_id_map insert: correlation_id=0x%lx external_id=%ld (entry=%p)\n", 
 	  gpu_correlation_id, host_correlation_id, entry);
@@ -211,7 +246,7 @@ gpu_correlation_id_map_external_id_replace
 {
   PRINT("correlation_id map replace: id=0x%x\n", gpu_correlation_id);
 
-  gpu_correlation_id_map_entry_t *entry = st_lookup(&map_root, gpu_correlation_id);
+  gpu_correlation_id_map_entry_t *entry = map_lookup(gpu_correlation_id);
   if (entry) {
     entry->host_correlation_id = host_correlation_id;
   }
@@ -224,7 +259,7 @@ gpu_correlation_id_map_delete
  uint32_t gpu_correlation_id
 )
 {
-  gpu_correlation_id_map_entry_t *node = st_delete(&map_root, gpu_correlation_id);
+  gpu_correlation_id_map_entry_t *node = map_delete(gpu_correlation_id);
   st_free(&free_list, node);
 }
 
@@ -241,7 +276,7 @@ gpu_correlation_id_map_kernel_update
   uint64_t correlation_id = gpu_correlation_id;
   PRINT("correlation_id map replace: id=0x%lx\n", correlation_id);
 
-  gpu_correlation_id_map_entry_t *entry = st_lookup(&map_root, correlation_id);
+  gpu_correlation_id_map_entry_t *entry = map_lookup(correlation_id);
   if (entry) {
     entry->device_id = device_id;
     entry->start = start;
@@ -301,5 +336,5 @@ gpu_correlation_id_map_count
  void
 )
 {
-  return st_count(map_root);
+  return map_count();
 }
@@ -54,8 +54,11 @@
 // local includes
 //******************************************************************************
 
+#include <lib/prof-lean/hashmap-uint64.h>
 #include <lib/prof-lean/splay-uint64.h>
 
+#include <hpcrun/memory/hpcrun-malloc.h>
+
 #include <hpcrun/cct/cct.h>
 
 #include "gpu-host-correlation-map.h"
@@ -73,6 +76,11 @@
 #include "gpu-print.h"
 
 
+// correlation ids are issued in increasing order and retired soon
+// after, which suits a hash map better than a splay tree
+#define USE_HASHMAP 1
+
+
 #define st_insert				\
   typed_splay_insert(host_correlation)
 
@@ -125,8 +133,33 @@ typedef struct typed_splay_node(host_correlation) {
 // local data
 //******************************************************************************
 
+#if USE_HASHMAP
+
+static hashmap_uint64_t map = HASHMAP_UINT64_INITIALIZER(hpcrun_malloc_safe);
+
+#define map_lookup(id) \
+  ((gpu_host_correlation_map_entry_t *) hashmap_uint64_lookup(&map, id))
+
+#define map_insert(entry) \
+  hashmap_uint64_insert(&map, entry->host_correlation_id, entry)
+
+#define map_delete(id) \
+  ((gpu_host_correlation_map_entry_t *) hashmap_uint64_delete(&map, id))
+
+#define map_count() \
+  hashmap_uint64_count(&map)
+
+#else
+
 static gpu_host_correlation_map_entry_t *map_root = NULL;
 
+#define map_lookup(id) st_lookup(&map_root, id)
+#define map_insert(entry) st_insert(&map_root, entry)
+#define map_delete(id) st_delete(&map_root, id)
+#define map_count() st_count(map_root)
+
+#endif
+
 static gpu_host_correlation_map_entry_t *free_list = NULL;
 
 
@@ -135,7 +168,9 @@ static gpu_host_correlation_map_entry_t *free_list = NULL;
 // private operations
 //******************************************************************************
 
+#if !USE_HASHMAP
 typed_splay_impl(host_correlation)
+#endif
 
 
 static gpu_host_correlation_map_entry_t *
@@ -198,7 +233,7 @@ gpu_host_correlation_map_lookup
  uint64_t host_correlation_id
 )
 {
-  gpu_host_correlation_map_entry_t *result = st_lookup(&map_root, host_correlation_id);
+  gpu_host_correlation_map_entry_t *result = map_lookup(host_correlation_id);
 
   PRINT("host_correlation_map lookup: id=0x%lx (entry %p)", host_correlation_id, result);
 
@@ -215,7 +250,7 @@ gpu_host_correlation_map_insert
  gpu_activity_channel_t *activity_channel
 )
 {
-  if (st_lookup(&map_root, host_correlation_id)) { 
+  if (map_lookup(host_correlation_id)) { 
     // fatal error: host_correlation id already present; a
     // correlation should be inserted only once.
     assert(0);
@@ -224,7 +259,7 @@ gpu_host_correlation_map_insert
       gpu_host_correlation_map_entry_new(host_correlation_id, gpu_op_ccts, 
 					 cpu_submit_time, activity_channel);
 
-    st_insert(&map_root, entry);
+    map_insert(entry);
 
     PRINT("host_correlation_map insert: correlation_id=0x%lx "
 	 "activity_channel=%p (entry=%p)", 
@@ -245,7 +280,7 @@ gpu_host_correlation_map_samples_increase
   PRINT("correlation_map samples update: correlation_id=0x%lx (update %d)", 
 	host_correlation_id, val);
 
-  gpu_host_correlation_map_entry_t *entry = st_lookup(&map_root, host_correlation_id);
+  gpu_host_correlation_map_entry_t *entry = map_lookup(host_correlation_id);
 
   if (entry) {
     entry->samples += val;
@@ -268,7 +303,7 @@ gpu_host_correlation_map_total_samples_update
   PRINT("correlation_map total samples update: correlation_id=0x%lx (update %d)",
        host_correlation_id, val);
 
-  gpu_host_correlation_map_entry_t *entry = st_lookup(&map_root, host_correlation_id);
+  gpu_host_correlation_map_entry_t *entry = map_lookup(host_correlation_id);
 
   if (entry) {
     entry->total_samples = val;
@@ -285,7 +320,7 @@ gpu_host_correlation_map_delete
  uint64_t host_correlation_id
 )
 {
-  gpu_host_correlation_map_entry_t *node = st_delete(&map_root, host_correlation_id);
+  gpu_host_correlation_map_entry_t *node = map_delete(host_correlation_id);
   st_free(&free_list, node);
 }
 
@@ -342,5 +377,5 @@ gpu_host_correlation_map_count
  void
 )
 {
-  return st_count(map_root);
+  return map_count();
 }
@@ -111,6 +111,12 @@ typedef struct gpu_trace_channel_t {
   pthread_mutex_t mutex;
   pthread_cond_t cond;
   uint64_t count;
+
+  // condition signaled when items are ready. by default, this is the
+  // channel's own condition; a consumer that serves several channels
+  // binds them all to a condition of its own.
+  pthread_mutex_t *wait_mutex;
+  pthread_cond_t *wait_cond;
 } gpu_trace_channel_t;
 
 
@@ -156,10 +162,26 @@ gpu_trace_channel_alloc
   pthread_mutex_init(&channel->mutex, NULL);
   pthread_cond_init(&channel->cond, NULL);
 
+  channel->wait_mutex = &channel->mutex;
+  channel->wait_cond = &channel->cond;
+
   return channel;
 }
 
 
+void
+gpu_trace_channel_bind
+(
+ gpu_trace_channel_t *channel,
+ pthread_mutex_t *mutex,
+ pthread_cond_t *cond
+)
+{
+  channel->wait_mutex = mutex;
+  channel->wait_cond = cond;
+}
+
+
 void
 gpu_trace_channel_produce
 (
@@ -177,7 +199,7 @@ gpu_trace_channel_produce
 }
 
 
-void
+uint64_t
 gpu_trace_channel_consume
 (
  gpu_trace_channel_t *channel,
@@ -185,6 +207,8 @@ gpu_trace_channel_consume
  gpu_trace_item_consume_fn_t trace_item_consume
 )
 {
+  uint64_t count = 0;
+
   // steal elements previously pushed by the producer
   channel_steal(channel, bichannel_direction_forward);
 
@@ -197,7 +221,10 @@ gpu_trace_channel_consume
     if (!ti) break;
     gpu_trace_item_consume(trace_item_consume, td, ti);
     gpu_trace_item_free(channel, ti);
+    count++;
   }
+
+  return count;
 }
 
 
@@ -213,7 +240,9 @@ gpu_trace_channel_await
 
   // wait for a signal or for a few seconds. periodically waking
   // up avoids missing a signal.
-  pthread_cond_timedwait(&channel->cond, &channel->mutex, &time); 
+  pthread_mutex_lock(channel->wait_mutex);
+  pthread_cond_timedwait(channel->wait_cond, channel->wait_mutex, &time); 
+  pthread_mutex_unlock(channel->wait_mutex);
 }
 
 
@@ -223,6 +252,6 @@ gpu_trace_channel_signal_consumer
  gpu_trace_channel_t *trace_channel
 )
 {
-  pthread_cond_signal(&trace_channel->cond);
+  pthread_cond_signal(trace_channel->wait_cond);
 }
 
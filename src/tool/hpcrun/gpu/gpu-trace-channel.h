@@ -46,6 +46,15 @@
 
 
 
+//******************************************************************************
+// system includes
+//******************************************************************************
+
+#include <pthread.h>
+#include <stdint.h>
+
+
+
 //******************************************************************************
 // local includes
 //******************************************************************************
@@ -73,6 +82,16 @@ gpu_trace_channel_alloc
 );
 
 
+// redirect consumer wakeups for this channel to a shared condition
+void
+gpu_trace_channel_bind
+(
+ gpu_trace_channel_t *channel,
+ pthread_mutex_t *mutex,
+ pthread_cond_t *cond
+);
+
+
 void
 gpu_trace_channel_produce
 (
@@ -81,7 +100,8 @@ gpu_trace_channel_produce
 );
 
 
-void
+// returns the number of trace items consumed
+uint64_t
 gpu_trace_channel_consume
 (
  gpu_trace_channel_t *channel,
@@ -0,0 +1,550 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+//******************************************************************************
+// system includes
+//******************************************************************************
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+
+
+//******************************************************************************
+// libmonitor 
+//******************************************************************************
+
+#include <monitor.h>
+
+
+
+//******************************************************************************
+// local includes
+//******************************************************************************
+
+#include <lib/prof-lean/spinlock.h>
+#include <lib/prof-lean/stdatomic.h>
+
+#include <hpcrun/memory/hpcrun-malloc.h>
+
+#include "gpu-trace-channel.h"
+#include "gpu-trace-pool.h"
+
+
+
+//******************************************************************************
+// macros
+//******************************************************************************
+
+#define UNIT_TEST 0
+
+#define DEBUG 0
+
+#include "gpu-print.h"
+
+#define SECONDS_UNTIL_WAKEUP 2
+
+
+
+//******************************************************************************
+// type declarations
+//******************************************************************************
+
+typedef struct gpu_trace_pool_stream_t {
+  struct gpu_trace_pool_stream_t *next;
+  gpu_trace_t *trace;
+  _Atomic(bool) busy;
+  bool finished;
+} gpu_trace_pool_stream_t;
+
+
+typedef struct gpu_trace_worker_t {
+  pthread_t thread;
+  pthread_mutex_t mutex;
+  pthread_cond_t cond;
+  _Atomic(gpu_trace_pool_stream_t *) streams;
+} gpu_trace_worker_t;
+
+
+typedef void *(*pthread_start_routine_t)(void *);
+
+
+
+//******************************************************************************
+// local variables
+//******************************************************************************
+
+static int pool_num_workers;
+
+static gpu_trace_pool_drain_fn_t pool_drain_fn;
+
+static gpu_trace_pool_finish_fn_t pool_finish_fn;
+
+static gpu_trace_worker_t *pool_workers;
+
+static _Atomic(bool) pool_started;
+
+static _Atomic(bool) pool_stop_flag;
+
+static atomic_ullong pool_next_worker;
+
+static spinlock_t pool_lock = SPINLOCK_UNLOCKED;
+
+
+
+//******************************************************************************
+// private operations
+//******************************************************************************
+
+static bool
+gpu_trace_pool_stream_try_acquire
+(
+ gpu_trace_pool_stream_t *stream
+)
+{
+  bool idle = false;
+  return atomic_compare_exchange_strong(&stream->busy, &idle, true);
+}
+
+
+static void
+gpu_trace_pool_stream_release
+(
+ gpu_trace_pool_stream_t *stream
+)
+{
+  atomic_store(&stream->busy, false);
+}
+
+
+// drain every stream on a worker's list that no other worker is
+// currently draining. returns the number of records consumed.
+static uint64_t
+gpu_trace_pool_worker_drain
+(
+ gpu_trace_worker_t *worker
+)
+{
+  uint64_t count = 0;
+
+  gpu_trace_pool_stream_t *stream = atomic_load(&worker->streams);
+  for (; stream; stream = stream->next) {
+    if (gpu_trace_pool_stream_try_acquire(stream)) {
+      if (!stream->finished) {
+        count += pool_drain_fn(stream->trace);
+      }
+      gpu_trace_pool_stream_release(stream);
+    }
+  }
+
+  return count;
+}
+
+
+// an idle worker visits the other workers' streams
+static uint64_t
+gpu_trace_pool_worker_steal
+(
+ int self
+)
+{
+  uint64_t count = 0;
+
+  int i;
+  for (i = 1; i < pool_num_workers; i++) {
+    gpu_trace_worker_t *victim = &pool_workers[(self + i) % pool_num_workers];
+    count += gpu_trace_pool_worker_drain(victim);
+  }
+
+  return count;
+}
+
+
+static void
+gpu_trace_pool_worker_await
+(
+ gpu_trace_worker_t *worker
+)
+{
+  struct timespec time;
+  clock_gettime(CLOCK_REALTIME, &time);
+  time.tv_sec += SECONDS_UNTIL_WAKEUP;
+
+  // wait for a signal or for a few seconds. periodically waking
+  // up avoids missing a signal.
+  pthread_mutex_lock(&worker->mutex);
+  if (!atomic_load(&pool_stop_flag)) {
+    pthread_cond_timedwait(&worker->cond, &worker->mutex, &time);
+  }
+  pthread_mutex_unlock(&worker->mutex);
+}
+
+
+static void
+gpu_trace_pool_worker_finish
+(
+ gpu_trace_worker_t *worker
+)
+{
+  gpu_trace_pool_stream_t *stream = atomic_load(&worker->streams);
+  for (; stream; stream = stream->next) {
+    // wait for a thief to release the stream
+    while (!gpu_trace_pool_stream_try_acquire(stream));
+    pool_finish_fn(stream->trace);
+    stream->finished = true;
+    gpu_trace_pool_stream_release(stream);
+  }
+}
+
+
+static void *
+gpu_trace_pool_worker
+(
+ void *arg
+)
+{
+  int self = (int) (intptr_t) arg;
+  gpu_trace_worker_t *worker = &pool_workers[self];
+
+  PRINT("gpu trace worker %d started\n", self);
+
+  while (!atomic_load(&pool_stop_flag)) {
+    uint64_t count = gpu_trace_pool_worker_drain(worker);
+    if (count == 0) {
+      count = gpu_trace_pool_worker_steal(self);
+    }
+    if (count == 0) {
+      gpu_trace_pool_worker_await(worker);
+    }
+  }
+
+  gpu_trace_pool_worker_finish(worker);
+
+  return NULL;
+}
+
+
+static void
+gpu_trace_pool_start
+(
+ void
+)
+{
+  spinlock_lock(&pool_lock);
+
+  if (!atomic_load(&pool_started)) {
+    pool_workers = (gpu_trace_worker_t *)
+      hpcrun_malloc_safe(pool_num_workers * sizeof(gpu_trace_worker_t));
+    memset(pool_workers, 0, pool_num_workers * sizeof(gpu_trace_worker_t));
+
+    // Create worker threads without libmonitor watching
+    monitor_disable_new_threads();
+
+    int i;
+    for (i = 0; i < pool_num_workers; i++) {
+      gpu_trace_worker_t *worker = &pool_workers[i];
+      pthread_mutex_init(&worker->mutex, NULL);
+      pthread_cond_init(&worker->cond, NULL);
+      atomic_store(&worker->streams, NULL);
+      pthread_create(&worker->thread, NULL, 
+		     (pthread_start_routine_t) gpu_trace_pool_worker, 
+		     (void *) (intptr_t) i);
+    }
+
+    monitor_enable_new_threads();
+
+    atomic_store(&pool_started, true);
+  }
+
+  spinlock_unlock(&pool_lock);
+}
+
+
+
+//******************************************************************************
+// interface operations
+//******************************************************************************
+
+void
+gpu_trace_pool_init
+(
+ int num_workers,
+ gpu_trace_pool_drain_fn_t drain_fn,
+ gpu_trace_pool_finish_fn_t finish_fn
+)
+{
+  // workers are started lazily; reconfiguring a running pool is a no-op
+  if (atomic_load(&pool_started)) return;
+
+  pool_num_workers = num_workers;
+  pool_drain_fn = drain_fn;
+  pool_finish_fn = finish_fn;
+
+  atomic_store(&pool_stop_flag, false);
+  atomic_store(&pool_next_worker, 0);
+}
+
+
+void
+gpu_trace_pool_stream_add
+(
+ gpu_trace_t *trace,
+ gpu_trace_channel_t *channel
+)
+{
+  if (!atomic_load(&pool_started)) {
+    gpu_trace_pool_start();
+  }
+
+  gpu_trace_pool_stream_t *stream = (gpu_trace_pool_stream_t *)
+    hpcrun_malloc_safe(sizeof(gpu_trace_pool_stream_t));
+
+  stream->trace = trace;
+  stream->finished = false;
+  atomic_store(&stream->busy, false);
+
+  // assign streams to workers round robin
+  int owner = atomic_fetch_add(&pool_next_worker, 1) % pool_num_workers;
+  gpu_trace_worker_t *worker = &pool_workers[owner];
+
+  gpu_trace_channel_bind(channel, &worker->mutex, &worker->cond);
+
+  // streams are never removed, so a lock-free push suffices
+  gpu_trace_pool_stream_t *head = atomic_load(&worker->streams);
+  do {
+    stream->next = head;
+  } while (!atomic_compare_exchange_weak(&worker->streams, &head, stream));
+
+  PRINT("gpu trace stream %p assigned to worker %d\n", trace, owner);
+}
+
+
+void
+gpu_trace_pool_fini
+(
+ void
+)
+{
+  if (!atomic_load(&pool_started)) return;
+
+  atomic_store(&pool_stop_flag, true);
+
+  int i;
+  for (i = 0; i < pool_num_workers; i++) {
+    gpu_trace_worker_t *worker = &pool_workers[i];
+    pthread_mutex_lock(&worker->mutex);
+    pthread_cond_signal(&worker->cond);
+    pthread_mutex_unlock(&worker->mutex);
+  }
+
+  for (i = 0; i < pool_num_workers; i++) {
+    pthread_join(pool_workers[i].thread, NULL);
+  }
+}
+
+
+
+//******************************************************************************
+// unit test
+//******************************************************************************
+
+#if UNIT_TEST
+
+// set UNIT_TEST to 1 and build with the trace channel and its allocator:
+//   cc ... gpu-trace-pool.c gpu-trace-channel.c gpu-trace-item.c
+//     gpu-channel-item-allocator.c lib/prof-lean/{bichannel,bistack,stacks}.c
+//
+// producers feed synthetic trace items into many streams; the pool
+// checks that every stream consumes all of its items in order.
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define NUM_STREAMS 256
+#define NUM_ITEMS 10000
+#define NUM_WORKERS 4
+#define NUM_PRODUCERS 8
+
+typedef struct gpu_trace_t {
+  gpu_trace_channel_t *channel;
+  uint64_t last_start;
+  uint64_t count;
+} gpu_trace_t;
+
+static gpu_trace_t streams[NUM_STREAMS];
+
+static __thread gpu_trace_t *current;
+
+
+void *
+hpcrun_malloc_safe
+(
+ size_t s
+)
+{
+  return malloc(s);
+}
+
+
+void
+monitor_disable_new_threads
+(
+ void
+)
+{
+}
+
+
+void
+monitor_enable_new_threads
+(
+ void
+)
+{
+}
+
+
+static void
+test_consume
+(
+ thread_data_t *td,
+ cct_node_t *call_path,
+ uint64_t start_time,
+ uint64_t end_time
+)
+{
+  assert(start_time == current->last_start + 1);
+  current->last_start = start_time;
+  current->count++;
+}
+
+
+static uint64_t
+test_drain
+(
+ gpu_trace_t *trace
+)
+{
+  current = trace;
+  return gpu_trace_channel_consume(trace->channel, NULL, test_consume);
+}
+
+
+static void
+test_finish
+(
+ gpu_trace_t *trace
+)
+{
+  test_drain(trace);
+}
+
+
+static void *
+test_produce
+(
+ void *arg
+)
+{
+  int p = (int) (intptr_t) arg;
+
+  // each stream has a single producer, as for a GPU stream
+  int s;
+  for (s = p; s < NUM_STREAMS; s += NUM_PRODUCERS) {
+    uint64_t i;
+    for (i = 1; i <= NUM_ITEMS; i++) {
+      gpu_trace_item_t ti;
+      gpu_trace_item_produce(&ti, i, i, i + 1, NULL);
+      gpu_trace_channel_produce(streams[s].channel, &ti);
+    }
+    gpu_trace_channel_signal_consumer(streams[s].channel);
+  }
+
+  return NULL;
+}
+
+
+int
+main
+(
+ int argc,
+ char **argv
+)
+{
+  gpu_trace_pool_init(NUM_WORKERS, test_drain, test_finish);
+
+  int i;
+  for (i = 0; i < NUM_STREAMS; i++) {
+    streams[i].channel = gpu_trace_channel_alloc();
+    gpu_trace_pool_stream_add(&streams[i], streams[i].channel);
+  }
+
+  pthread_t producers[NUM_PRODUCERS];
+  for (i = 0; i < NUM_PRODUCERS; i++) {
+    pthread_create(&producers[i], NULL, test_produce, (void *) (intptr_t) i);
+  }
+  for (i = 0; i < NUM_PRODUCERS; i++) {
+    pthread_join(producers[i], NULL);
+  }
+
+  gpu_trace_pool_fini();
+
+  for (i = 0; i < NUM_STREAMS; i++) {
+    if (streams[i].count != NUM_ITEMS) {
+      printf("stream %d: consumed %lu of %d items\n", i, 
+	     streams[i].count, NUM_ITEMS);
+      return 1;
+    }
+  }
+
+  printf("%d streams, %d items each, consumed in order by %d workers\n",
+	 NUM_STREAMS, NUM_ITEMS, NUM_WORKERS);
+
+  return 0;
+}
+
+#endif
@@ -0,0 +1,128 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+//******************************************************************************
+//
+// gpu-trace-pool: a fixed set of worker threads that drain the trace
+// channels of all GPU streams. each stream is owned by one worker, which
+// is woken when the stream's channel fills; an idle worker steals
+// streams from the others. a stream is drained by at most one worker at
+// a time, so the records of each stream are still appended in order.
+//
+//******************************************************************************
+
+#ifndef gpu_trace_pool_h
+#define gpu_trace_pool_h
+
+
+
+//******************************************************************************
+// system includes
+//******************************************************************************
+
+#include <stdint.h>
+
+
+
+//******************************************************************************
+// forward declarations
+//******************************************************************************
+
+typedef struct gpu_trace_t gpu_trace_t;
+
+typedef struct gpu_trace_channel_t gpu_trace_channel_t;
+
+
+
+//******************************************************************************
+// type declarations
+//******************************************************************************
+
+// consume pending records of a stream; returns the number consumed
+typedef uint64_t (*gpu_trace_pool_drain_fn_t)
+(
+ gpu_trace_t *trace
+);
+
+
+// consume the remaining records of a stream and release it 
+typedef void (*gpu_trace_pool_finish_fn_t)
+(
+ gpu_trace_t *trace
+);
+
+
+
+//******************************************************************************
+// interface operations
+//******************************************************************************
+
+void
+gpu_trace_pool_init
+(
+ int num_workers,
+ gpu_trace_pool_drain_fn_t drain_fn,
+ gpu_trace_pool_finish_fn_t finish_fn
+);
+
+
+// assign a stream to a worker; workers are started by the first call
+void
+gpu_trace_pool_stream_add
+(
+ gpu_trace_t *trace,
+ gpu_trace_channel_t *channel
+);
+
+
+// finish all streams and join the workers
+void
+gpu_trace_pool_fini
+(
+ void
+);
+
+
+
+#endif
@@ -64,6 +64,7 @@
 #include <lib/prof-lean/stdatomic.h>
 
 #include <hpcrun/cct/cct.h>
+#include <hpcrun/control-knob.h>
 #include <hpcrun/thread_data.h>
 #include <hpcrun/threadmgr.h>
 #include <hpcrun/trace.h>
@@ -73,6 +74,7 @@
 #include "gpu-trace.h"
 #include "gpu-trace-channel.h"
 #include "gpu-trace-item.h"
+#include "gpu-trace-pool.h"
 
 
 
@@ -84,6 +86,8 @@
 
 #include "gpu-print.h"
 
+#define DEFAULT_GPU_TRACE_WORKERS 4
+
 
 
 //******************************************************************************
@@ -93,6 +97,12 @@
 typedef struct gpu_trace_t {
   pthread_t thread;
   gpu_trace_channel_t *trace_channel;
+
+  // per-stream state, which may be drained by any pool worker
+  thread_data_t *td;
+  uint64_t stream_start;
+  uint64_t last_end;
+  bool first;
 } gpu_trace_t;
 
 typedef void *(*pthread_start_routine_t)(void *);
@@ -109,7 +119,12 @@ static atomic_ullong stream_counter;
 
 static atomic_ullong stream_id;
 
-static __thread uint64_t stream_start = 0;
+// streams are drained by the pool only once gpu_trace_init has set it
+// up; backends that do not call it keep one thread per stream
+static int gpu_trace_workers = 0;
+
+// the stream being drained by this thread
+static __thread gpu_trace_t *current_trace = NULL;
 
 
 
@@ -123,7 +138,7 @@ stream_start_set
  uint64_t start_time
 )
 {
-  if (!stream_start) stream_start = start_time;
+  if (!current_trace->stream_start) current_trace->stream_start = start_time;
 }
 
 
@@ -133,7 +148,7 @@ stream_start_get
  void
 )
 {
-  return stream_start;
+  return current_trace->stream_start;
 }
 
 
@@ -145,6 +160,10 @@ gpu_trace_alloc
 {
   gpu_trace_t *trace = hpcrun_malloc_safe(sizeof(gpu_trace_t));
   trace->trace_channel = gpu_trace_channel_alloc();
+  trace->td = NULL;
+  trace->stream_start = 0;
+  trace->last_end = 0;
+  trace->first = true;
   return trace;
 }
 
@@ -220,10 +239,8 @@ gpu_trace_first
  uint64_t start
 )
 {
-  static __thread bool first = true;
-
-  if (first) {
-    first = false;
+  if (current_trace->first) {
+    current_trace->first = false;
     gpu_trace_stream_append(td, no_activity, start - 1);
   }
 }
@@ -236,15 +253,13 @@ gpu_trace_start_adjust
  uint64_t end
 )
 {
-  static __thread uint64_t last_end = 0;
-
-  if (start < last_end) {
+  if (start < current_trace->last_end) {
     // If we have a hardware measurement error (Power9),
     // set the offset as the end of the last activity
-    start = last_end + 1;
+    start = current_trace->last_end + 1;
   }
 
-  last_end = end;
+  current_trace->last_end = end;
 
   return start;
 }
@@ -279,7 +294,7 @@ consume_one_trace_item
     uint64_t cur_start = start_time;
     uint64_t cur_end = end_time;
     uint64_t intervals = (cur_start - stream_start_get() - 1) / frequency + 1;
-    uint64_t pivot = intervals * frequency + stream_start;
+    uint64_t pivot = intervals * frequency + stream_start_get();
 
     if (pivot <= cur_end && pivot >= cur_start) {
       // only trace when the pivot is within the range
@@ -304,15 +319,15 @@ consume_one_trace_item
 }
 
 
-static void
+static uint64_t
 gpu_trace_activities_process
 (
  thread_data_t *td,
  gpu_trace_t *thread_args
 )
 {
-  gpu_trace_channel_consume(thread_args->trace_channel, td, 
-			    consume_one_trace_item);
+  return gpu_trace_channel_consume(thread_args->trace_channel, td, 
+				   consume_one_trace_item);
 }
 
 
@@ -372,6 +387,49 @@ gpu_trace_stream_release
 }
 
 
+// switch the calling pool worker to a stream; the stream's thread data
+// is created by the first worker that drains it
+static thread_data_t *
+gpu_trace_stream_switch
+(
+ gpu_trace_t *trace
+)
+{
+  current_trace = trace;
+
+  if (trace->td == NULL) {
+    trace->td = gpu_trace_stream_acquire();
+  } else {
+    hpcrun_set_thread_data(trace->td);
+  }
+
+  return trace->td;
+}
+
+
+static uint64_t
+gpu_trace_pool_drain
+(
+ gpu_trace_t *trace
+)
+{
+  thread_data_t *td = gpu_trace_stream_switch(trace);
+  return gpu_trace_activities_process(td, trace);
+}
+
+
+static void
+gpu_trace_pool_finish
+(
+ gpu_trace_t *trace
+)
+{
+  thread_data_t *td = gpu_trace_stream_switch(trace);
+  gpu_trace_activities_process(td, trace);
+  gpu_trace_stream_release(td);
+}
+
+
 
 //******************************************************************************
 // interface operations
@@ -386,6 +444,15 @@ gpu_trace_init
   atomic_store(&stop_trace_flag, false);
   atomic_store(&stream_counter, 0);
   atomic_store(&stream_id, 0);
+
+  // A negative value restores one trace thread per stream
+  int workers = control_knob_value_get_int(HPCRUN_GPU_TRACE_WORKERS);
+  gpu_trace_workers = workers != 0 ? workers : DEFAULT_GPU_TRACE_WORKERS;
+
+  if (gpu_trace_workers > 0) {
+    gpu_trace_pool_init(gpu_trace_workers, gpu_trace_pool_drain,
+			gpu_trace_pool_finish);
+  }
 }
 
 
@@ -395,6 +462,8 @@ gpu_trace_record
  gpu_trace_t *thread_args
 )
 {
+  current_trace = thread_args;
+
   thread_data_t* td = gpu_trace_stream_acquire();
 
   while (!atomic_load(&stop_trace_flag)) {
@@ -422,6 +491,10 @@ gpu_trace_fini
 
   gpu_context_stream_map_signal_all();
 
+  if (gpu_trace_workers > 0) {
+    gpu_trace_pool_fini();
+  }
+
   while (atomic_load(&stream_counter));
 }
 
@@ -435,11 +508,17 @@ gpu_trace_create
   // Init variables
   gpu_trace_t *trace = gpu_trace_alloc();
 
+  atomic_fetch_add(&stream_counter, 1);
+
+  if (gpu_trace_workers > 0) {
+    // Multiplex the stream onto the trace worker pool
+    gpu_trace_pool_stream_add(trace, trace->trace_channel);
+    return trace;
+  }
+
   // Create a new thread for the stream without libmonitor watching
   monitor_disable_new_threads();
 
-  atomic_fetch_add(&stream_counter, 1);
-
   pthread_create(&trace->thread, NULL, (pthread_start_routine_t) gpu_trace_record, 
 		 trace);
 
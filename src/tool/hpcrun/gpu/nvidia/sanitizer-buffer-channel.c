@@ -50,7 +50,7 @@
 //******************************************************************************
 
 
-#include <lib/prof-lean/bichannel.h>
+#include <lib/prof-lean/ringchannel.h>
 
 #include <hpcrun/memory/hpcrun-malloc.h>
 
@@ -62,34 +62,30 @@
 // macros
 //******************************************************************************
 
-#undef typed_bichannel
+#define CHANNEL_BATCH_SIZE 64
+
+#undef typed_ringchannel
 #undef typed_stack_elem
 
-#define typed_bichannel(x) sanitizer_buffer_channel_t
+#define typed_ringchannel(x) sanitizer_buffer_channel_t
 #define typed_stack_elem(x) sanitizer_buffer_t
 
 // define macros that simplify use of buffer channel API 
 #define channel_init  \
-  typed_bichannel_init(sanitizer_buffer_t)
+  typed_ringchannel_init(sanitizer_buffer_t)
 
-#define channel_pop   \
-  typed_bichannel_pop(sanitizer_buffer_t)
+#define channel_pop_batch   \
+  typed_ringchannel_pop_batch(sanitizer_buffer_t)
 
 #define channel_push  \
-  typed_bichannel_push(sanitizer_buffer_t)
-
-#define channel_reverse \
-  typed_bichannel_reverse(sanitizer_buffer_t)
-
-#define channel_steal \
-  typed_bichannel_steal(sanitizer_buffer_t)
+  typed_ringchannel_push(sanitizer_buffer_t)
 
 //******************************************************************************
 // type declarations
 //******************************************************************************
 
 typedef struct sanitizer_buffer_channel_t {
-  bistack_t bistacks[2];
+  ringchannel_t ring;
   atomic_bool flush;
   atomic_bool finish;
   atomic_uint balance;
@@ -105,8 +101,8 @@ static __thread sanitizer_buffer_channel_t *sanitizer_buffer_channel[GPU_PATCH_T
 // private functions
 //******************************************************************************
 
-// implement bidirectional channels for buffers
-typed_bichannel_impl(sanitizer_buffer_t)
+// implement ring channels for buffers
+typed_ringchannel_impl(sanitizer_buffer_t)
 
 static sanitizer_buffer_channel_t *
 sanitizer_buffer_channel_alloc
@@ -180,7 +176,7 @@ sanitizer_buffer_channel_push
 {
   sanitizer_buffer_channel_t *buf_channel = sanitizer_buffer_channel_get(type);
 
-  channel_push(buf_channel, bichannel_direction_forward, b);
+  channel_push(buf_channel, b);
 }
 
 
@@ -211,21 +207,21 @@ sanitizer_buffer_channel_consume
 )
 {
   bool do_flush = false;
+  sanitizer_buffer_t *batch[CHANNEL_BATCH_SIZE];
 
 FLUSH:
-  // steal elements previously enqueued by the producer
-  channel_steal(channel, bichannel_direction_forward);
+  // consume buffers in FIFO batches until the channel is drained
+  for (;;) {
+    size_t n = channel_pop_batch(channel, batch, CHANNEL_BATCH_SIZE);
 
-  // reverse them so that they are in FIFO order
-  channel_reverse(channel, bichannel_direction_forward);
+    size_t i;
+    for (i = 0; i < n; i++) {
+      sanitizer_buffer_process(batch[i]);
+      // Restore balance
+      sanitizer_buffer_free(channel, batch[i], &channel->balance);
+    }
 
-  // consume all elements enqueued before this function was called
-  for (;;) {
-    sanitizer_buffer_t *b = channel_pop(channel, bichannel_direction_forward);
-    if (!b) break;
-    sanitizer_buffer_process(b);
-    // Restore balance
-    sanitizer_buffer_free(channel, b, &channel->balance);
+    if (n < CHANNEL_BATCH_SIZE) break;
   }
 
   if (atomic_load(&channel->flush)) {
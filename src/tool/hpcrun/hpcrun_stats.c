@@ -78,6 +78,18 @@ static atomic_long num_unwind_intervals_suspicious = ATOMIC_VAR_INIT(0);
 static atomic_long trolled = ATOMIC_VAR_INIT(0);
 static atomic_long frames_total = ATOMIC_VAR_INIT(0);
 static atomic_long trolled_frames = ATOMIC_VAR_INIT(0);
+static atomic_long memo_frames = ATOMIC_VAR_INIT(0);
+static atomic_long recipe_hash_hit = ATOMIC_VAR_INIT(0);
+static atomic_long recipe_map_hit = ATOMIC_VAR_INIT(0);
+static atomic_long recipe_miss = ATOMIC_VAR_INIT(0);
+static atomic_long recipe_prefetch = ATOMIC_VAR_INIT(0);
+
+static atomic_long ompt_region_registered = ATOMIC_VAR_INIT(0);
+static atomic_long ompt_region_resolved_sample = ATOMIC_VAR_INIT(0);
+static atomic_long ompt_region_resolved_end = ATOMIC_VAR_INIT(0);
+static atomic_long ompt_region_resolved_fini = ATOMIC_VAR_INIT(0);
+static atomic_long ompt_region_unresolved = ATOMIC_VAR_INIT(0);
+static atomic_long ompt_region_pending = ATOMIC_VAR_INIT(0);
 static atomic_long frames_libfail_total = ATOMIC_VAR_INIT(0);
 
 static atomic_long acc_trace_records = ATOMIC_VAR_INIT(0);
@@ -104,6 +116,17 @@ hpcrun_stats_reinit(void)
   atomic_store_explicit(&trolled, 0, memory_order_relaxed);
   atomic_store_explicit(&frames_total, 0, memory_order_relaxed);
   atomic_store_explicit(&trolled_frames, 0, memory_order_relaxed);
+  atomic_store_explicit(&memo_frames, 0, memory_order_relaxed);
+  atomic_store_explicit(&recipe_hash_hit, 0, memory_order_relaxed);
+  atomic_store_explicit(&recipe_map_hit, 0, memory_order_relaxed);
+  atomic_store_explicit(&recipe_miss, 0, memory_order_relaxed);
+  atomic_store_explicit(&recipe_prefetch, 0, memory_order_relaxed);
+  atomic_store_explicit(&ompt_region_registered, 0, memory_order_relaxed);
+  atomic_store_explicit(&ompt_region_resolved_sample, 0, memory_order_relaxed);
+  atomic_store_explicit(&ompt_region_resolved_end, 0, memory_order_relaxed);
+  atomic_store_explicit(&ompt_region_resolved_fini, 0, memory_order_relaxed);
+  atomic_store_explicit(&ompt_region_unresolved, 0, memory_order_relaxed);
+  atomic_store_explicit(&ompt_region_pending, 0, memory_order_relaxed);
   atomic_store_explicit(&frames_libfail_total, 0, memory_order_relaxed);
 
   atomic_store_explicit(&acc_trace_records, 0, memory_order_relaxed);
@@ -418,6 +441,155 @@ hpcrun_stats_trolled_frames(void)
   return atomic_load_explicit(&trolled_frames, memory_order_relaxed);
 }
 
+//---------------------------------------------------------------------
+// total number of (unwind) frames in sample set reused from the
+// backtrace memo
+//---------------------------------------------------------------------
+
+void
+hpcrun_stats_frames_memo_inc(long amt)
+{
+  atomic_fetch_add_explicit(&memo_frames, amt, memory_order_relaxed);
+}
+
+long
+hpcrun_stats_frames_memo(void)
+{
+  return atomic_load_explicit(&memo_frames, memory_order_relaxed);
+}
+
+//---------------------------------------------------------------------
+// unwind recipe lookups
+//---------------------------------------------------------------------
+
+void
+hpcrun_stats_recipe_hash_hit_inc(void)
+{
+  atomic_fetch_add_explicit(&recipe_hash_hit, 1L, memory_order_relaxed);
+}
+
+long
+hpcrun_stats_recipe_hash_hit(void)
+{
+  return atomic_load_explicit(&recipe_hash_hit, memory_order_relaxed);
+}
+
+void
+hpcrun_stats_recipe_map_hit_inc(void)
+{
+  atomic_fetch_add_explicit(&recipe_map_hit, 1L, memory_order_relaxed);
+}
+
+long
+hpcrun_stats_recipe_map_hit(void)
+{
+  return atomic_load_explicit(&recipe_map_hit, memory_order_relaxed);
+}
+
+void
+hpcrun_stats_recipe_miss_inc(void)
+{
+  atomic_fetch_add_explicit(&recipe_miss, 1L, memory_order_relaxed);
+}
+
+long
+hpcrun_stats_recipe_miss(void)
+{
+  return atomic_load_explicit(&recipe_miss, memory_order_relaxed);
+}
+
+void
+hpcrun_stats_recipe_prefetch_inc(long amt)
+{
+  atomic_fetch_add_explicit(&recipe_prefetch, amt, memory_order_relaxed);
+}
+
+long
+hpcrun_stats_recipe_prefetch(void)
+{
+  return atomic_load_explicit(&recipe_prefetch, memory_order_relaxed);
+}
+
+//---------------------------------------------------------------------
+// deferred OpenMP region contexts
+//---------------------------------------------------------------------
+
+void
+hpcrun_stats_ompt_region_registered_inc(void)
+{
+  atomic_fetch_add_explicit(&ompt_region_registered, 1L, memory_order_relaxed);
+}
+
+long
+hpcrun_stats_ompt_region_registered(void)
+{
+  return atomic_load_explicit(&ompt_region_registered, memory_order_relaxed);
+}
+
+void
+hpcrun_stats_ompt_region_resolved_sample_inc(long amt)
+{
+  atomic_fetch_add_explicit(&ompt_region_resolved_sample, amt, memory_order_relaxed);
+}
+
+long
+hpcrun_stats_ompt_region_resolved_sample(void)
+{
+  return atomic_load_explicit(&ompt_region_resolved_sample, memory_order_relaxed);
+}
+
+void
+hpcrun_stats_ompt_region_resolved_end_inc(long amt)
+{
+  atomic_fetch_add_explicit(&ompt_region_resolved_end, amt, memory_order_relaxed);
+}
+
+long
+hpcrun_stats_ompt_region_resolved_end(void)
+{
+  return atomic_load_explicit(&ompt_region_resolved_end, memory_order_relaxed);
+}
+
+void
+hpcrun_stats_ompt_region_resolved_fini_inc(long amt)
+{
+  atomic_fetch_add_explicit(&ompt_region_resolved_fini, amt, memory_order_relaxed);
+}
+
+long
+hpcrun_stats_ompt_region_resolved_fini(void)
+{
+  return atomic_load_explicit(&ompt_region_resolved_fini, memory_order_relaxed);
+}
+
+void
+hpcrun_stats_ompt_region_unresolved_inc(long amt)
+{
+  atomic_fetch_add_explicit(&ompt_region_unresolved, amt, memory_order_relaxed);
+}
+
+long
+hpcrun_stats_ompt_region_unresolved(void)
+{
+  return atomic_load_explicit(&ompt_region_unresolved, memory_order_relaxed);
+}
+
+void
+hpcrun_stats_ompt_region_pending_max(long pending)
+{
+  long cur = atomic_load_explicit(&ompt_region_pending, memory_order_relaxed);
+  while (pending > cur &&
+         !atomic_compare_exchange_weak_explicit(&ompt_region_pending, &cur, pending,
+                                                memory_order_relaxed,
+                                                memory_order_relaxed));
+}
+
+long
+hpcrun_stats_ompt_region_pending(void)
+{
+  return atomic_load_explicit(&ompt_region_pending, memory_order_relaxed);
+}
+
 //----------------------------
 // samples yielded due to deadlock prevention
 //----------------------------
@@ -455,11 +627,24 @@ hpcrun_stats_print_summary(void)
 
   long cpu_frames = atomic_load_explicit(&frames_total, memory_order_relaxed);
   long cpu_frames_trolled = atomic_load_explicit(&trolled_frames, memory_order_relaxed);
+  long cpu_frames_memo = atomic_load_explicit(&memo_frames, memory_order_relaxed);
   long cpu_frames_libfail_total = atomic_load_explicit(&frames_libfail_total, memory_order_relaxed);
 
   long cpu_intervals_total = atomic_load_explicit(&num_unwind_intervals_total, memory_order_relaxed);
   long cpu_intervals_susp = atomic_load_explicit(&num_unwind_intervals_suspicious, memory_order_relaxed);
 
+  long cpu_recipe_hash = atomic_load_explicit(&recipe_hash_hit, memory_order_relaxed);
+  long cpu_recipe_map = atomic_load_explicit(&recipe_map_hit, memory_order_relaxed);
+  long cpu_recipe_miss = atomic_load_explicit(&recipe_miss, memory_order_relaxed);
+  long cpu_recipe_prefetch = atomic_load_explicit(&recipe_prefetch, memory_order_relaxed);
+
+  long omp_registered = atomic_load_explicit(&ompt_region_registered, memory_order_relaxed);
+  long omp_sample = atomic_load_explicit(&ompt_region_resolved_sample, memory_order_relaxed);
+  long omp_end = atomic_load_explicit(&ompt_region_resolved_end, memory_order_relaxed);
+  long omp_fini = atomic_load_explicit(&ompt_region_resolved_fini, memory_order_relaxed);
+  long omp_unresolved = atomic_load_explicit(&ompt_region_unresolved, memory_order_relaxed);
+  long omp_pending = atomic_load_explicit(&ompt_region_pending, memory_order_relaxed);
+
   long acc_samp = atomic_load_explicit(&acc_samples, memory_order_relaxed);
   long acc_samp_dropped = atomic_load_explicit(&acc_samples_dropped, memory_order_relaxed);
 
@@ -484,13 +669,22 @@ hpcrun_stats_print_summary(void)
        cpu_dropped, cpu_segv, cpu_dropped - cpu_segv);
 
   AMSG("SUMMARY: samples: %ld (recorded: %ld, blocked: %ld, errant: %ld, trolled: %ld, yielded: %ld),\n"
-       "         frames: %ld (trolled: %ld)\n"
-       "         intervals: %ld (suspicious: %ld)",
+       "         frames: %ld (trolled: %ld, memo: %ld)\n"
+       "         intervals: %ld (suspicious: %ld)\n"
+       "         recipe lookups: %ld (hash: %ld, map: %ld, miss: %ld, prefetched fcns: %ld)",
        cpu_total, cpu_valid, cpu_blocked, cpu_dropped, cpu_trolled, cpu_yielded,
-       cpu_frames, cpu_frames_trolled,
-       cpu_intervals_total, cpu_intervals_susp
+       cpu_frames, cpu_frames_trolled, cpu_frames_memo,
+       cpu_intervals_total, cpu_intervals_susp,
+       cpu_recipe_hash + cpu_recipe_map + cpu_recipe_miss,
+       cpu_recipe_hash, cpu_recipe_map, cpu_recipe_miss, cpu_recipe_prefetch
        );
 
+  if (omp_registered > 0) {
+    AMSG("OMPT DEFERRED CONTEXTS: %ld (resolved in samples: %ld, at region end: %ld, "
+         "at thread exit: %ld, unresolved: %ld), most pending: %ld",
+         omp_registered, omp_sample, omp_end, omp_fini, omp_unresolved, omp_pending);
+  }
+
   if (hpcrun_get_disabled()) {
     AMSG("SAMPLING HAS BEEN DISABLED");
   }
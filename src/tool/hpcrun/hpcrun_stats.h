@@ -195,6 +195,57 @@ long hpcrun_stats_frames_libfail_total(void);
 void hpcrun_stats_trolled_frames_inc(long amt);
 long hpcrun_stats_trolled_frames(void);
 
+//---------------------------------------------------------------------
+// total number of (unwind) frames in sample set reused from the
+// backtrace memo
+//---------------------------------------------------------------------
+
+void hpcrun_stats_frames_memo_inc(long amt);
+long hpcrun_stats_frames_memo(void);
+
+//---------------------------------------------------------------------
+// unwind recipe lookups: found in the thread's hash table, found
+// ready in the shared map, or missed and built (or waited for) in the
+// sample handler; functions whose recipes were built by the prefetch
+// thread
+//---------------------------------------------------------------------
+
+void hpcrun_stats_recipe_hash_hit_inc(void);
+long hpcrun_stats_recipe_hash_hit(void);
+
+void hpcrun_stats_recipe_map_hit_inc(void);
+long hpcrun_stats_recipe_map_hit(void);
+
+void hpcrun_stats_recipe_miss_inc(void);
+long hpcrun_stats_recipe_miss(void);
+
+void hpcrun_stats_recipe_prefetch_inc(long amt);
+long hpcrun_stats_recipe_prefetch(void);
+
+//---------------------------------------------------------------------
+// OpenMP regions whose calling contexts were deferred: registered by
+// worker threads, resolved in samples, at the end of a region or at
+// thread exit, or left unresolved; and the most any thread had pending
+//---------------------------------------------------------------------
+
+void hpcrun_stats_ompt_region_registered_inc(void);
+long hpcrun_stats_ompt_region_registered(void);
+
+void hpcrun_stats_ompt_region_resolved_sample_inc(long amt);
+long hpcrun_stats_ompt_region_resolved_sample(void);
+
+void hpcrun_stats_ompt_region_resolved_end_inc(long amt);
+long hpcrun_stats_ompt_region_resolved_end(void);
+
+void hpcrun_stats_ompt_region_resolved_fini_inc(long amt);
+long hpcrun_stats_ompt_region_resolved_fini(void);
+
+void hpcrun_stats_ompt_region_unresolved_inc(long amt);
+long hpcrun_stats_ompt_region_unresolved(void);
+
+void hpcrun_stats_ompt_region_pending_max(long pending);
+long hpcrun_stats_ompt_region_pending(void);
+
 //-----------------------------
 // print summary
 //-----------------------------
@@ -133,6 +133,9 @@
 
 #include <unwind/common/backtrace.h>
 #include <unwind/common/unwind.h>
+#include <unwind/common/uw_recipe_cache.h>
+#include <unwind/common/uw_recipe_prefetch.h>
+#include <unwind/common/bt_memo.h>
 
 #include <utilities/arch/context-pc.h>
 
@@ -505,6 +508,9 @@ hpcrun_init_internal(bool is_child)
   // first instance of recursive call
   hpcrun_set_retain_recursion_mode(getenv("HPCRUN_RETAIN_RECURSION") != NULL);
 
+  // Reuse the outer frames of the previous backtrace when they are unchanged
+  hpcrun_bt_memo_set_enabled(getenv(HPCRUN_BT_MEMO) != NULL);
+
   // Initialize logical unwinding agents (LUSH)
   if (opts.lush_agent_paths[0] != '\0') {
     epoch_t* epoch = TD_GET(core_profile_trace_data.epoch);
@@ -739,6 +745,8 @@ hpcrun_fini_internal()
     // write all threads' profile data and close trace file
     hpcrun_threadMgr_data_fini(hpcrun_get_thread_data());
 
+    uw_recipe_prefetch_fini();
+    uw_recipe_cache_fini();
     fnbounds_fini();
     hpcrun_stats_print_summary();
     messages_fini();
@@ -1180,6 +1188,7 @@ monitor_thread_post_create(void* data)
   hpcrun_safe_enter();
 
   TMSG(THREAD,"post create");
+  uw_recipe_prefetch_notify_threaded();
   TMSG(THREAD,"done post create");
 
   hpcrun_safe_exit();
@@ -265,6 +265,9 @@ hpcrun_reclaim_freeable_mem(void)
   mi->mi_low = mi->mi_start;
   TD_GET(mem_low) = 0;
   num_reclaims++;
+
+  // the memo refers to cct nodes in the reclaimed memory
+  hpcrun_bt_memo_invalidate();
   TMSG(MALLOC, "%s: %d", __func__, num_reclaims);
 }
 
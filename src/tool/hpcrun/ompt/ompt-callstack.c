@@ -749,6 +749,10 @@ ompt_backtrace_finalize
   if(!isSync && !ompt_eager_context_p() && !bt->collapsed){
     register_to_all_regions();
   }
+
+  if (!isSync && !ompt_eager_context_p()) {
+    ompt_resolve_region_contexts_sample();
+  }
 }
 
 
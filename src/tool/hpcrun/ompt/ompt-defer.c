@@ -49,6 +49,7 @@
 //*****************************************************************************
 
 #include <assert.h>
+#include <stdlib.h>
 
 
 
@@ -68,6 +69,7 @@
 #include "ompt-parallel-region-map.h"
 #endif
 
+#include <hpcrun/hpcrun_stats.h>
 #include <hpcrun/unresolved.h>
 #include <hpcrun/utilities/timer.h>
 
@@ -87,6 +89,24 @@
 
 #define DEFER_DEBUGGING 0
 
+// notifications a sample may resolve, unless HPCRUN_OMPT_RESOLVE_BUDGET
+// says otherwise.  the rest wait for the end of a region or idleness.
+#define RESOLVE_SAMPLE_BUDGET 4
+
+#define RESOLVE_UNBOUNDED -1
+
+
+
+//*****************************************************************************
+// private data
+//*****************************************************************************
+
+static int resolve_sample_budget = RESOLVE_SAMPLE_BUDGET;
+
+// set while a thread resolves region contexts. a sample that interrupts
+// it must leave the notification queues alone.
+static __thread int resolving = 0;
+
 
 
 //*****************************************************************************
@@ -577,6 +597,8 @@ register_to_region
 
   // increment the number of unresolved regions
   unresolved_cnt++;
+  hpcrun_stats_ompt_region_registered_inc();
+  hpcrun_stats_ompt_region_pending_max(unresolved_cnt);
 }
 
 ompt_notification_t*
@@ -807,6 +829,43 @@ mark_remaining_unresolved_regions
 }
 
 
+// resolve at most budget pending notifications, or all of them if
+// budget is RESOLVE_UNBOUNDED. returns the number resolved.
+static int
+resolve_region_contexts_bounded
+(
+ int budget
+)
+{
+  int n = 0;
+
+  resolving = 1;
+  while ((budget == RESOLVE_UNBOUNDED || n < budget) &&
+         try_resolve_one_region_context()) {
+    n++;
+  }
+  resolving = 0;
+
+  return n;
+}
+
+
+void
+ompt_defer_init
+(
+ void
+)
+{
+  char *budget_str = getenv("HPCRUN_OMPT_RESOLVE_BUDGET");
+  if (budget_str) {
+    int budget = atoi(budget_str);
+    resolve_sample_budget = (budget >= 0) ? budget : RESOLVE_SAMPLE_BUDGET;
+  }
+  TMSG(DEFER_CTXT, "resolve at most %d region contexts per sample",
+       resolve_sample_budget);
+}
+
+
 void 
 ompt_resolve_region_contexts
 (
@@ -816,8 +875,11 @@ ompt_resolve_region_contexts
   struct timespec start_time;
 
   size_t i = 0;
+  long resolved = 0;
   timer_start(&start_time);
 
+  resolving = 1;
+
   // attempt to resolve all remaining regions
   for(;;i++) {
 
@@ -825,7 +887,7 @@ ompt_resolve_region_contexts
     if (unresolved_cnt == 0) break; 
 
     // poll for a notification to resolve a region context
-    try_resolve_one_region_context();
+    resolved += try_resolve_one_region_context();
 
     // infrequently check for a timeout
     if (i % 1000) {
@@ -839,6 +901,11 @@ ompt_resolve_region_contexts
     }
   }
 
+  resolving = 0;
+
+  hpcrun_stats_ompt_region_resolved_fini_inc(resolved);
+  hpcrun_stats_ompt_region_unresolved_inc(unresolved_cnt);
+
 #if 0
   if (unresolved_cnt != 0) {
     mark_remaining_unresolved_regions();
@@ -864,14 +931,30 @@ ompt_resolve_region_contexts_poll
 )
 {
   // if there are any unresolved contexts
-  if (unresolved_cnt) {
+  if (unresolved_cnt && !resolving) {
     // attempt to resolve contexts by consuming any notifications that
     // are currently pending.
-    while (try_resolve_one_region_context());
+    int n = resolve_region_contexts_bounded(RESOLVE_UNBOUNDED);
+    hpcrun_stats_ompt_region_resolved_end_inc(n);
   };
 }
 
 
+void
+ompt_resolve_region_contexts_sample
+(
+ void
+)
+{
+  // resolve a few pending contexts, so that a thread that stays inside
+  // a region does not collect a long backlog for the end of the region
+  if (unresolved_cnt && !resolving && resolve_sample_budget > 0) {
+    int n = resolve_region_contexts_bounded(resolve_sample_budget);
+    hpcrun_stats_ompt_region_resolved_sample_inc(n);
+  }
+}
+
+
 #if 1
 cct_node_t *
 top_cct
@@ -1426,3 +1509,454 @@ tmp_end_region_resolve
     hpcrun_cct_delete_self(unresolved_cct);
   }
 }
+
+
+#define UNIT_TEST 0
+#if UNIT_TEST
+
+// a synthetic driver of the OMPT events that defer region contexts,
+// for testing without an OpenMP runtime. set UNIT_TEST to 1 and build
+// with the hpcrun include paths:
+//   cc -O2 -I... ompt-defer.c ompt-queues.c ompt-thread.c -lpthread
+// run as: a.out [workers] [regions] [sample budget] [regions between polls]
+//
+// a master thread forks regions. workers take samples in each region,
+// which registers them for its context, and leave it without polling
+// except every few regions, so notifications pile up. samples resolve
+// at most the budget each. when a region ends, the master provides
+// its call path and notifies the first registered worker. at exit,
+// every sample must sit under its region's call path, no unresolved
+// placeholder may remain, and every region must have been released.
+//
+// the CCT is replaced by a small tree that counts samples per node.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+
+#define TEST_MAX_SAMPLES 3
+#define TEST_NUM_SITES   7
+
+struct cct_node_t {
+  cct_addr_t addr;
+  struct cct_node_t *parent;
+  struct cct_node_t *children;  // first child
+  struct cct_node_t *next;      // next sibling
+  long samples;
+};
+
+static int num_workers = 4;
+static int num_regions = 2000;
+static int poll_every = 8;
+
+static pthread_barrier_t region_begin;
+static pthread_barrier_t region_end;
+static ompt_region_data_t *current_region;
+
+static atomic_long regions_released = ATOMIC_VAR_INIT(0);
+static atomic_long samples_taken = ATOMIC_VAR_INIT(0);
+static atomic_long most_per_sample = ATOMIC_VAR_INIT(0);
+static atomic_long errors = ATOMIC_VAR_INIT(0);
+
+static atomic_long st_registered = ATOMIC_VAR_INIT(0);
+static atomic_long st_sample = ATOMIC_VAR_INIT(0);
+static atomic_long st_end = ATOMIC_VAR_INIT(0);
+static atomic_long st_fini = ATOMIC_VAR_INIT(0);
+static atomic_long st_unresolved = ATOMIC_VAR_INIT(0);
+static atomic_long st_pending = ATOMIC_VAR_INIT(0);
+
+static __thread thread_data_t *test_td;
+static __thread ompt_region_data_t *test_region;
+
+
+//-----------------------------------------------------------------------------
+// the fake CCT
+//-----------------------------------------------------------------------------
+
+static int
+test_addr_eq(cct_addr_t *a, cct_addr_t *b)
+{
+  return a->ip_norm.lm_id == b->ip_norm.lm_id &&
+    a->ip_norm.lm_ip == b->ip_norm.lm_ip;
+}
+
+static cct_node_t *
+test_node_new(cct_addr_t *addr, cct_node_t *parent)
+{
+  cct_node_t *n = calloc(1, sizeof(cct_node_t));
+  n->addr = *addr;
+  n->parent = parent;
+  if (parent) {
+    n->next = parent->children;
+    parent->children = n;
+  }
+  return n;
+}
+
+cct_node_t *
+hpcrun_cct_parent(cct_node_t *n)
+{
+  return n ? n->parent : NULL;
+}
+
+cct_addr_t *
+hpcrun_cct_addr(cct_node_t *n)
+{
+  return &n->addr;
+}
+
+cct_node_t *
+hpcrun_cct_insert_addr(cct_node_t *node, cct_addr_t *frm)
+{
+  cct_node_t *c;
+  for (c = node->children; c; c = c->next) {
+    if (test_addr_eq(&c->addr, frm)) return c;
+  }
+  return test_node_new(frm, node);
+}
+
+cct_node_t *
+hpcrun_cct_insert_path_return_leaf(cct_node_t *root, cct_node_t *path)
+{
+  if (!path || !path->parent) return root;
+  root = hpcrun_cct_insert_path_return_leaf(root, path->parent);
+  return hpcrun_cct_insert_addr(root, &path->addr);
+}
+
+void
+hpcrun_cct_delete_self(cct_node_t *cct)
+{
+  cct_node_t **link;
+  for (link = &cct->parent->children; *link; link = &(*link)->next) {
+    if (*link == cct) {
+      *link = cct->next;
+      break;
+    }
+  }
+  cct->parent = NULL;
+  cct->next = NULL;
+}
+
+void
+hpcrun_cct_walkset(cct_node_t *cct, cct_op_t fn, cct_op_arg_t arg)
+{
+  cct_node_t *c, *next;
+  for (c = cct->children; c; c = next) {
+    next = c->next;
+    fn(c, arg, 0);
+  }
+}
+
+void
+hpcrun_cct_merge(cct_node_t *a, cct_node_t *b, merge_op_t merge,
+                 merge_op_arg_t arg)
+{
+  a->samples += b->samples;
+  b->samples = 0;
+
+  cct_node_t *c, *next;
+  for (c = b->children; c; c = next) {
+    next = c->next;
+    cct_node_t *same;
+    for (same = a->children; same; same = same->next) {
+      if (test_addr_eq(&same->addr, &c->addr)) break;
+    }
+    if (same) {
+      hpcrun_cct_merge(same, c, merge, arg);
+    } else {
+      c->parent = a;
+      c->next = a->children;
+      a->children = c;
+    }
+  }
+  b->children = NULL;
+}
+
+cct_node_t *
+hpcrun_cct_copy_just_addr(cct_node_t *cct)
+{
+  return cct ? test_node_new(&cct->addr, NULL) : NULL;
+}
+
+void
+hpcrun_cct_set_children(cct_node_t *cct, cct_node_t *children)
+{
+  if (cct) cct->children = children;
+}
+
+void
+hpcrun_cct_set_parent(cct_node_t *cct, cct_node_t *parent)
+{
+  if (cct) cct->parent = parent;
+}
+
+
+//-----------------------------------------------------------------------------
+// the rest of hpcrun and the OpenMP runtime
+//-----------------------------------------------------------------------------
+
+static thread_data_t *
+test_get_thread_data(void)
+{
+  return test_td;
+}
+
+thread_data_t *(*hpcrun_get_thread_data)(void) = test_get_thread_data;
+
+ompt_placeholders_t ompt_placeholders;
+
+int debug_flag_get(dbg_category flag) { return 0; }
+void hpcrun_pmsg(const char *tag, const char *fmt, ...) { }
+void monitor_real_exit(int status) { exit(status); }
+
+metric_data_list_t *hpcrun_get_metric_data_list(cct_node_id_t cct_id) { return NULL; }
+int hpcrun_get_num_kind_metrics(void) { return 0; }
+metric_desc_t *hpcrun_id2metric(int id) { return NULL; }
+cct_metric_data_t *hpcrun_metric_set_loc(metric_data_list_t *rv, int id) { return NULL; }
+
+cct_node_t *ompt_region_root(cct_node_t *node) { return node; }
+ompt_frame_t *hpcrun_ompt_get_task_frame(int level) { return NULL; }
+uint64_t hpcrun_ompt_get_parallel_info_id(int level) { return 0; }
+
+ompt_region_data_t *
+hpcrun_ompt_get_region_data(int level)
+{
+  return level == 0 ? test_region : NULL;
+}
+
+ompt_notification_t *
+hpcrun_ompt_notification_alloc(void)
+{
+  return calloc(1, sizeof(ompt_notification_t));
+}
+
+// notifications stay allocated: the test checks the queues, not reuse
+void hpcrun_ompt_notification_free(ompt_notification_t *notification) { }
+
+void
+hpcrun_ompt_region_free(ompt_region_data_t *region_data)
+{
+  atomic_fetch_add(&regions_released, 1);
+}
+
+#if REGION_DEBUG
+void ompt_region_debug_notify_needed(ompt_notification_t *n) { }
+void ompt_region_debug_notify_received(ompt_notification_t *n) { }
+int hpcrun_ompt_region_check(void) { return 0; }
+#endif
+
+void
+timer_start(struct timespec *start_time)
+{
+  clock_gettime(CLOCK_MONOTONIC, start_time);
+}
+
+double
+timer_elapsed(struct timespec *start_time)
+{
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (now.tv_sec - start_time->tv_sec) +
+    1e-9 * (now.tv_nsec - start_time->tv_nsec);
+}
+
+void hpcrun_stats_ompt_region_registered_inc(void) { atomic_fetch_add(&st_registered, 1); }
+void hpcrun_stats_ompt_region_resolved_sample_inc(long amt) { atomic_fetch_add(&st_sample, amt); }
+void hpcrun_stats_ompt_region_resolved_end_inc(long amt) { atomic_fetch_add(&st_end, amt); }
+void hpcrun_stats_ompt_region_resolved_fini_inc(long amt) { atomic_fetch_add(&st_fini, amt); }
+void hpcrun_stats_ompt_region_unresolved_inc(long amt) { atomic_fetch_add(&st_unresolved, amt); }
+
+void
+hpcrun_stats_ompt_region_pending_max(long pending)
+{
+  long cur = atomic_load(&st_pending);
+  while (pending > cur && !atomic_compare_exchange_weak(&st_pending, &cur, pending));
+}
+
+
+//-----------------------------------------------------------------------------
+// the driver
+//-----------------------------------------------------------------------------
+
+static void
+test_error(const char *msg)
+{
+  if (atomic_fetch_add(&errors, 1) < 10) printf("FAIL: %s\n", msg);
+}
+
+// a sample taken by a worker inside the current region
+static void
+test_sample(int site)
+{
+  register_to_all_regions();
+
+  cct_node_t *leaf =
+    hpcrun_cct_insert_addr(cct_not_master_region, &ADDR2(1, 1000 + site));
+  leaf->samples++;
+  atomic_fetch_add(&samples_taken, 1);
+
+  long before = atomic_load(&st_sample);
+  ompt_resolve_region_contexts_sample();
+  long n = atomic_load(&st_sample) - before;  // may count other threads
+  long cur = atomic_load(&most_per_sample);
+  while (n > cur && !atomic_compare_exchange_weak(&most_per_sample, &cur, n));
+}
+
+// samples must hang under thread root -> main -> site
+static long
+test_check_tree(cct_node_t *node, int depth)
+{
+  long samples = node->samples;
+  if (node->addr.ip_norm.lm_id == (uint16_t) UNRESOLVED) {
+    test_error("unresolved placeholder left in the tree");
+  }
+  if (samples && depth != 3) {
+    test_error("samples outside their region's call path");
+  }
+  cct_node_t *c;
+  for (c = node->children; c; c = c->next) {
+    samples += test_check_tree(c, depth + 1);
+  }
+  return samples;
+}
+
+static void *
+test_worker(void *arg)
+{
+  int id = (int)(uintptr_t) arg;
+  cct_addr_t root_addr = ADDR2(0, 0);
+
+  test_td = calloc(1, sizeof(thread_data_t));
+  test_td->core_profile_trace_data.epoch = calloc(1, sizeof(epoch_t));
+  cct_node_t *thread_root = test_node_new(&root_addr, NULL);
+  hpcrun_get_thread_epoch()->csdata.thread_root = thread_root;
+  wfq_init(&threads_queue);
+
+  long my_samples = 0;
+  int r;
+  for (r = 0; ; r++) {
+    pthread_barrier_wait(&region_begin);
+    ompt_region_data_t *region = current_region;
+    if (region == NULL) break;
+
+    // implicit task begin
+    test_region = region;
+    add_region_and_ancestors_to_stack(region, false);
+    not_master_region = region;
+
+    int s, num_samples = (r + id) % (TEST_MAX_SAMPLES + 1);
+    for (s = 0; s < num_samples; s++) {
+      test_sample(s);
+      my_samples++;
+    }
+
+    // implicit task end
+    pop_region_stack();
+    test_region = NULL;
+    if (r % poll_every == poll_every - 1) {
+      ompt_resolve_region_contexts_poll();
+    }
+
+    pthread_barrier_wait(&region_end);
+  }
+
+  // thread finalizer
+  ompt_resolve_region_contexts(0);
+
+  if (unresolved_cnt != 0) test_error("worker exited with unresolved regions");
+  if (test_check_tree(thread_root, 0) != my_samples) {
+    test_error("samples lost while resolving");
+  }
+  return NULL;
+}
+
+// the call path of a region, as the master provides it at its end
+static cct_node_t *
+test_call_path(int r)
+{
+  cct_addr_t root_addr = ADDR2(0, 0);
+  cct_addr_t main_addr = ADDR2(1, 1);
+  cct_addr_t site_addr = ADDR2(1, 100 + r % TEST_NUM_SITES);
+
+  cct_node_t *root = test_node_new(&root_addr, NULL);
+  return test_node_new(&site_addr, test_node_new(&main_addr, root));
+}
+
+int
+main(int argc, char **argv)
+{
+  if (argc > 1) num_workers = atoi(argv[1]);
+  if (argc > 2) num_regions = atoi(argv[2]);
+  if (argc > 3) setenv("HPCRUN_OMPT_RESOLVE_BUDGET", argv[3], 1);
+  if (argc > 4) poll_every = atoi(argv[4]);
+
+  ompt_defer_init();
+
+  pthread_barrier_init(&region_begin, NULL, num_workers + 1);
+  pthread_barrier_init(&region_end, NULL, num_workers + 1);
+
+  pthread_t workers[num_workers];
+  int i, r;
+  for (i = 0; i < num_workers; i++) {
+    pthread_create(&workers[i], NULL, test_worker, (void *)(uintptr_t) i);
+  }
+
+  struct timespec start;
+  timer_start(&start);
+
+  for (r = 0; r < num_regions; r++) {
+    // parallel begin
+    ompt_region_data_t *region = calloc(1, sizeof(ompt_region_data_t));
+    region->region_id = r + 1;
+    wfq_init(&region->queue);
+    current_region = region;
+
+    pthread_barrier_wait(&region_begin);
+    pthread_barrier_wait(&region_end);
+
+    // parallel end
+    region->call_path = test_call_path(r);
+    ompt_notification_t *to_notify =
+      (ompt_notification_t *) wfq_dequeue_public(&region->queue);
+    if (to_notify) {
+      wfq_enqueue(OMPT_BASE_T_STAR(to_notify), to_notify->threads_queue);
+    } else {
+      hpcrun_ompt_region_free(region);
+    }
+  }
+
+  current_region = NULL;
+  pthread_barrier_wait(&region_begin);
+  for (i = 0; i < num_workers; i++) {
+    pthread_join(workers[i], NULL);
+  }
+  double secs = timer_elapsed(&start);
+
+  long registered = atomic_load(&st_registered);
+  long resolved = atomic_load(&st_sample) + atomic_load(&st_end) +
+    atomic_load(&st_fini);
+
+  printf("%d workers, %d regions, budget %d, poll every %d: %.2f s\n",
+         num_workers, num_regions, resolve_sample_budget, poll_every, secs);
+  printf("samples %ld, regions registered %ld (in samples %ld, at region end %ld, "
+         "at exit %ld, unresolved %ld), most pending %ld, most per sample %ld\n",
+         atomic_load(&samples_taken), registered, atomic_load(&st_sample),
+         atomic_load(&st_end), atomic_load(&st_fini),
+         atomic_load(&st_unresolved), atomic_load(&st_pending),
+         atomic_load(&most_per_sample));
+
+  if (resolved != registered || atomic_load(&st_unresolved) != 0) {
+    test_error("registered regions were not all resolved");
+  }
+  if (atomic_load(&regions_released) != num_regions) {
+    test_error("regions not released");
+  }
+  if (num_workers == 1 && atomic_load(&most_per_sample) > resolve_sample_budget) {
+    test_error("a sample resolved more than its budget");
+  }
+
+  printf("%s\n", atomic_load(&errors) ? "FAIL" : "PASS");
+  return atomic_load(&errors) != 0;
+}
+
+#endif
@@ -175,6 +175,15 @@ resolve_one_region_context
 );
 
 
+// read the per-sample resolution budget from the environment
+void
+ompt_defer_init
+(
+ void
+);
+
+
+// resolve every pending region context; used at the end of a region
 void 
 ompt_resolve_region_contexts_poll
 (
@@ -182,6 +191,14 @@ ompt_resolve_region_contexts_poll
 );
 
 
+// resolve a bounded number of pending region contexts; used in samples
+void
+ompt_resolve_region_contexts_sample
+(
+ void
+);
+
+
 void 
 ompt_resolve_region_contexts
 (
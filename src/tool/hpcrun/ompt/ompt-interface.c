@@ -420,7 +420,7 @@ ompt_idle_begin
 {
   undirected_blame_idle_begin(&omp_idle_blame_info);
   if (!ompt_eager_context_p()) {
-    while(try_resolve_one_region_context());
+    ompt_resolve_region_contexts_poll();
   }
 }
 
@@ -649,6 +649,7 @@ ompt_initialize
 
   prepare_device();
   init_tasks();
+  ompt_defer_init();
 
 #if DEBUG_TASK
   printf("Task full context: %s\n", ompt_task_full_context ? "yes" : "no");
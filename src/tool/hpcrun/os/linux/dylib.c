@@ -113,6 +113,10 @@ struct dylib_fmbn_s {
 // forward declarations
 //*****************************************************************************
 
+static int 
+dylib_batch_add_callback(struct dl_phdr_info *info, 
+			 size_t size, void *);
+
 static int 
 dylib_map_open_dsos_callback(struct dl_phdr_info *info, 
 			     size_t size, void *);
@@ -139,6 +143,11 @@ void
 dylib_map_open_dsos()
 {
   char *vdso_start = (char *) vdso_segment_addr();
+
+  // ask the fnbounds server about all new modules in one round trip
+  dl_iterate_phdr(dylib_batch_add_callback, (void *) vdso_start);
+  fnbounds_batch_query();
+
   dl_iterate_phdr(dylib_map_open_dsos_callback, (void *) vdso_start);
   if (vdso_start) {
     char *vdso_end = vdso_start + vdso_segment_len();
@@ -318,6 +327,21 @@ dylib_get_segment_bounds(struct dl_phdr_info *info,
 }
 
 
+static int
+dylib_batch_add_callback(struct dl_phdr_info *info, size_t size, 
+			 void *vdso_start)
+{
+  struct dylib_seg_bounds_s bounds;
+  dylib_get_segment_bounds(info, &bounds);
+
+  if (bounds.start != vdso_start) {
+    fnbounds_batch_add(info->dlpi_name, bounds.start, bounds.end);
+  }
+
+  return 0;
+}
+
+
 static int
 dylib_map_open_dsos_callback(struct dl_phdr_info *info, size_t size, 
 			     void *vdso_start)
@@ -47,12 +47,28 @@
 //
 // directed blame shifting for locks, critical sections, ...
 //
+// The map is split into shards by the high bits of a hash of the
+// object.  Each shard is a list of open addressing tables, newest
+// first, each twice the size of the one before it.  A slot is claimed
+// for an object by a CAS on its key and is never released; its blame
+// is only ever added to or exchanged with 0.  New objects go into the
+// newest table, and the thread that fills it to 3/4 pushes a larger
+// one; a thread that finds the newest table full pushes one itself
+// rather than wait.  Tables are never moved or freed, so no lock is
+// needed.
+//
+// When a table is pushed while another thread is inserting the same
+// object, the object may get a slot in two tables.  Adding blame uses
+// the first slot found, and taking blame drains all of them, so blame
+// is never lost.
+//
 
 /******************************************************************************
  * system includes
  *****************************************************************************/
 
-#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 
 
@@ -70,29 +86,13 @@
  * macros
  *****************************************************************************/
 
-#define N (128*1024)
-#define INDEX_MASK ((N)-1)
+#define SHARD_BITS 6
+#define NUM_SHARDS (1 << SHARD_BITS)
 
-#define LOSSLESS_BLAME
+// 64 shards of 2048 slots take 2MB, like 128K 8-byte entries did
+#define INIT_SLOTS 2048
 
-#ifdef BLAME_MAP_LOCKING
-
-#define do_lock() \
-{ \
-  for(;;) { \
-    if (fetch_and_store_i64(&thelock, 1) == 0) break; \
-    while (thelock == 1); \
-  } \
-}
-
-#define do_unlock() thelock = 0
-
-#else
-
-#define do_lock() 
-#define do_unlock()
-
-#endif
+#define CACHE_LINE 64
 
 
 
@@ -100,28 +100,30 @@
  * data type
  *****************************************************************************/
 
-typedef struct {
-  uint32_t obj_id;
-  uint32_t blame;
-} blame_parts_t;
-
-typedef union {
-  uint_fast64_t combined;
-  blame_parts_t parts;
-} blame_all_t;
+typedef struct blame_slot_s {
+  atomic_uint_fast64_t obj;    // 0 if free
+  atomic_uint_fast64_t blame;
+} blame_slot_t;
 
 
-union blame_entry_t {
-  atomic_uint_fast64_t value;
-};
+typedef struct blame_table_s {
+  struct blame_table_s *older;
+  uint64_t mask;               // number of slots - 1
+  uint64_t grow_at;            // number of used slots that triggers growth
+  atomic_uint_fast64_t used;
+  blame_slot_t slots[];
+} blame_table_t;
 
 
+typedef struct blame_shard_s {
+  _Atomic(blame_table_t *) newest;
+  char pad[CACHE_LINE - sizeof(blame_table_t *)];
+} blame_shard_t;
 
-/***************************************************************************
- * private data  
- ***************************************************************************/
 
-static uint64_t volatile thelock;
+struct blame_map_s {
+  blame_shard_t shards[NUM_SHARDS];
+};
 
 
 
@@ -129,44 +131,97 @@ static uint64_t volatile thelock;
  * private operations
  ***************************************************************************/
 
-uint32_t 
-blame_entry_obj_id(uint_fast64_t value)
+static uint64_t
+blame_map_hash(uint64_t obj)
 {
-  blame_all_t entry;
-  entry.combined = value;
-  return entry.parts.obj_id;
+  // the finalizer of splitmix64; objects are often aligned, so all
+  // bits need to be mixed
+  obj ^= obj >> 30;
+  obj *= 0xbf58476d1ce4e5b9ULL;
+  obj ^= obj >> 27;
+  obj *= 0x94d049bb133111ebULL;
+  obj ^= obj >> 31;
+  return obj;
 }
 
 
-uint32_t 
-blame_entry_blame(uint_fast64_t value)
+static blame_shard_t *
+blame_map_shard(blame_map_t *map, uint64_t hash)
 {
-  blame_all_t entry;
-  entry.combined = value;
-  return entry.parts.blame;
+  return &map->shards[hash >> (64 - SHARD_BITS)];
 }
 
-uint32_t 
-blame_map_obj_id(uint64_t obj)
+
+static blame_table_t *
+blame_table_new(uint64_t nslots, blame_table_t *older)
 {
-  return ((uint32_t) ((uint64_t)obj) >> 2);
+  blame_table_t *t =
+    hpcrun_malloc(sizeof(blame_table_t) + nslots * sizeof(blame_slot_t));
+  if (t == NULL) return NULL;
+
+  t->older = older;
+  t->mask = nslots - 1;
+  t->grow_at = nslots - nslots / 4;
+  atomic_init(&t->used, 0);
+
+  uint64_t i;
+  for (i = 0; i < nslots; i++) {
+    atomic_init(&t->slots[i].obj, 0);
+    atomic_init(&t->slots[i].blame, 0);
+  }
+  return t;
 }
 
 
-uint32_t 
-blame_map_hash(uint64_t obj) 
+// return the slot of obj in table t, or NULL.  with insert, claim a
+// slot if obj has none; *claimed tells whether this call claimed it.
+static blame_slot_t *
+blame_table_find(blame_table_t *t, uint64_t obj, uint64_t hash,
+                 bool insert, bool *claimed)
 {
-  return ((uint32_t)((blame_map_obj_id(obj)) & INDEX_MASK));
+  uint64_t i = hash & t->mask;
+  uint64_t n;
+
+  for (n = 0; n <= t->mask; n++, i = (i + 1) & t->mask) {
+    blame_slot_t *slot = &t->slots[i];
+    uint_fast64_t cur = atomic_load_explicit(&slot->obj, memory_order_acquire);
+
+    if (cur == obj) return slot;
+
+    if (cur == 0) {
+      if (!insert) return NULL;
+      if (atomic_compare_exchange_strong_explicit(&slot->obj, &cur, obj,
+                                                  memory_order_acq_rel,
+                                                  memory_order_acquire)) {
+        *claimed = true;
+        return slot;
+      }
+      // another thread claimed the slot; it may have claimed it for obj
+      if (cur == obj) return slot;
+    }
+  }
+  return NULL;
 }
 
 
-uint_fast64_t 
-blame_map_entry(uint64_t obj, uint32_t metric_value)
+// push a table twice the size of t, unless a newer table was pushed
+// already.  a thread that loses the race leaves its table unused.
+static void
+blame_shard_grow(blame_shard_t *shard, blame_table_t *t)
 {
-  blame_all_t be;
-  be.parts.obj_id = blame_map_obj_id(obj);
-  be.parts.blame = metric_value;
-  return be.combined;
+  if (atomic_load(&shard->newest) != t) return;
+
+  blame_table_t *bigger = blame_table_new(2 * (t->mask + 1), t);
+  if (bigger == NULL) {
+    EMSG("blame map: unable to grow a table of %ld slots", t->mask + 1);
+    return;
+  }
+
+  blame_table_t *expected = t;
+  if (!atomic_compare_exchange_strong(&shard->newest, &expected, bigger)) {
+    TMSG(LOCKWAIT, "blame map: lost race to grow a table of %ld slots",
+         t->mask + 1);
+  }
 }
 
 
@@ -175,106 +230,276 @@ blame_map_entry(uint64_t obj, uint32_t metric_value)
  * interface operations
  ***************************************************************************/
 
-blame_entry_t*
+blame_map_t*
 blame_map_new(void)
 {
-  blame_entry_t* rv = hpcrun_malloc(N * sizeof(blame_entry_t));
-  blame_map_init(rv);
-  return rv;
+  blame_map_t* map = hpcrun_malloc(sizeof(blame_map_t));
+  if (map != NULL) blame_map_init(map);
+  return map;
 }
 
+
 void 
-blame_map_init(blame_entry_t table[])
+blame_map_init(blame_map_t* map)
 {
   int i;
-  for(i = 0; i < N; i++) {
-    atomic_store(&table[i].value, 0);
+  for (i = 0; i < NUM_SHARDS; i++) {
+    atomic_init(&map->shards[i].newest, blame_table_new(INIT_SLOTS, NULL));
   }
 }
 
 
 void
-blame_map_add_blame(blame_entry_t table[],
-		    uint64_t obj, uint32_t metric_value)
+blame_map_add_blame(blame_map_t* map, uint64_t obj, uint64_t metric_value)
 {
-  uint32_t obj_id = blame_map_obj_id(obj);
-  uint32_t index = blame_map_hash(obj);
-
-  assert(index >= 0 && index < N);
-
-  do_lock();
-  uint_fast64_t oldval = atomic_load(&table[index].value);
-
-  for(;;) {
-    blame_all_t newval;
-    newval.combined = oldval;
-    newval.parts.blame += metric_value;
-
-    uint32_t obj_at_index = newval.parts.obj_id;
-    if(obj_at_index == obj_id) {
-#ifdef LOSSLESS_BLAME
-      if (atomic_compare_exchange_strong_explicit(&table[index].value, &oldval, newval.combined,
-						  memory_order_relaxed, memory_order_relaxed)) 
-        break;
-#else
-      // the atomicity is not needed here, but it is the easiest way to write this
-      atomic_store(&table[index].value, newval.combined);
-      break;
-#endif
-    } else {
-      if(newval.parts.obj_id == 0) {
-	newval.combined = blame_map_entry(obj, metric_value);
-#ifdef LOSSLESS_BLAME
-	if ((atomic_compare_exchange_strong_explicit(&table[index].value, &oldval, newval.combined,
-						     memory_order_relaxed, memory_order_relaxed)))  
-          break;
-	// otherwise, try again
-#else
-        // the atomicity is not needed here, but it is the easiest way to write this
-        atomic_store(&table[index].value, newval.combined);
-	break;
-#endif
-      }
-      else {
-	EMSG("leaked blame %d\n", metric_value);
-	// entry in use for another object's blame
-	// in this case, since it isn't easy to shift 
-	// our blame efficiently, we simply drop it.
-	break;
+  if (obj == 0 || metric_value == 0) return;
+
+  uint64_t hash = blame_map_hash(obj);
+  blame_shard_t *shard = blame_map_shard(map, hash);
+
+  for (;;) {
+    blame_table_t *newest = atomic_load_explicit(&shard->newest, memory_order_acquire);
+    blame_table_t *t;
+    blame_slot_t *slot = NULL;
+    bool claimed = false;
+
+    // an existing slot of obj, in any table
+    for (t = newest; t != NULL && slot == NULL; t = t->older) {
+      slot = blame_table_find(t, obj, hash, false, &claimed);
+    }
+
+    // or a new one in the newest table
+    if (slot == NULL && newest != NULL) {
+      slot = blame_table_find(newest, obj, hash, true, &claimed);
+      if (claimed &&
+          atomic_fetch_add(&newest->used, 1) + 1 == newest->grow_at) {
+        blame_shard_grow(shard, newest);
       }
     }
+
+    if (slot != NULL) {
+      atomic_fetch_add_explicit(&slot->blame, metric_value, memory_order_relaxed);
+      return;
+    }
+
+    if (newest == NULL) {
+      EMSG("leaked blame %ld\n", metric_value);
+      return;
+    }
+
+    // the newest table filled up before the thread growing it pushed
+    // a larger one.  push one here rather than wait, since the thread
+    // growing it may be the one this handler interrupted.
+    blame_shard_grow(shard, newest);
+    if (atomic_load(&shard->newest) == newest) {
+      EMSG("leaked blame %ld\n", metric_value);
+      return;
+    }
   }
-  do_unlock();
 }
 
 
 uint64_t 
-blame_map_get_blame(blame_entry_t table[], uint64_t obj)
+blame_map_get_blame(blame_map_t* map, uint64_t obj)
 {
-  static uint64_t zero = 0;
+  if (obj == 0) return 0;
+
+  uint64_t hash = blame_map_hash(obj);
+  blame_shard_t *shard = blame_map_shard(map, hash);
   uint64_t val = 0;
-  uint32_t obj_id = blame_map_obj_id(obj);
-  uint32_t index = blame_map_hash(obj);
-
-  assert(index >= 0 && index < N);
-
-  do_lock();
-  for(;;) {
-    uint_fast64_t oldval = atomic_load(&table[index].value);
-    uint32_t entry_obj_id = blame_entry_obj_id(oldval);
-    if(entry_obj_id == obj_id) {
-#ifdef LOSSLESS_BLAME
-      if (!atomic_compare_exchange_strong_explicit(&table[index].value, &oldval, zero,
-						  memory_order_relaxed, memory_order_relaxed)) 
-        continue; // try again on failure
-#else
-      table[index].all = 0;
-#endif
-      val = (uint64_t) blame_entry_blame(oldval);
+  blame_table_t *t;
+
+  for (t = atomic_load_explicit(&shard->newest, memory_order_acquire);
+       t != NULL; t = t->older) {
+    bool claimed;
+    blame_slot_t *slot = blame_table_find(t, obj, hash, false, &claimed);
+    if (slot != NULL && atomic_load_explicit(&slot->blame, memory_order_relaxed) != 0) {
+      val += atomic_exchange_explicit(&slot->blame, 0, memory_order_relaxed);
     }
-    break;
   }
-  do_unlock();
 
   return val;
 }
+
+
+#define UNIT_TEST 0
+#if UNIT_TEST
+
+// set UNIT_TEST to 1 and build with the hpcrun include paths:
+//   cc -O2 -I... blame-map.c -lpthread
+// run as: a.out [adders] [getters] [objects] [adds per adder]
+//
+// adders add random blame to random objects while getters take the
+// blame of random objects.  then the rest of the blame is taken, and
+// the blame taken must equal the blame added.  the objects outnumber
+// the initial slots, so the tables must grow while in use.
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+int
+debug_flag_get(dbg_category flag)
+{
+  return 0;
+}
+
+void
+hpcrun_pmsg(const char* tag, const char* fmt, ...)
+{
+}
+
+static atomic_uint_fast64_t emsgs = ATOMIC_VAR_INIT(0);
+
+void
+hpcrun_emsg(const char* fmt, ...)
+{
+  atomic_fetch_add(&emsgs, 1);
+}
+
+void*
+hpcrun_malloc(size_t size)
+{
+  return malloc(size);
+}
+
+static blame_map_t *map;
+static uint64_t num_objs;
+static uint64_t num_adds;
+
+static atomic_uint_fast64_t added = ATOMIC_VAR_INIT(0);
+static atomic_uint_fast64_t taken = ATOMIC_VAR_INIT(0);
+static atomic_int adders_running = ATOMIC_VAR_INIT(0);
+
+static uint64_t
+next_random(uint64_t *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+// aligned like the lock addresses used as objects
+static uint64_t
+test_obj(uint64_t i)
+{
+  return 0x7f0000000000ULL + 64 * (i + 1);
+}
+
+static void *
+adder(void *arg)
+{
+  uint64_t state = 0x9e3779b97f4a7c15ULL * ((uintptr_t) arg + 1);
+  uint64_t sum = 0;
+  uint64_t i;
+  for (i = 0; i < num_adds; i++) {
+    uint64_t r = next_random(&state);
+    uint64_t value = 1 + (r >> 54);
+    blame_map_add_blame(map, test_obj(r % num_objs), value);
+    sum += value;
+  }
+  atomic_fetch_add(&added, sum);
+  atomic_fetch_sub(&adders_running, 1);
+  return NULL;
+}
+
+static void *
+getter(void *arg)
+{
+  uint64_t state = 0xd1b54a32d192ed03ULL * ((uintptr_t) arg + 1);
+  uint64_t sum = 0;
+  while (atomic_load(&adders_running) > 0) {
+    sum += blame_map_get_blame(map, test_obj(next_random(&state) % num_objs));
+  }
+  atomic_fetch_add(&taken, sum);
+  return NULL;
+}
+
+static uint64_t
+num_slots(void)
+{
+  uint64_t n = 0;
+  int i;
+  for (i = 0; i < NUM_SHARDS; i++) {
+    blame_table_t *t;
+    for (t = atomic_load(&map->shards[i].newest); t; t = t->older) {
+      n += t->mask + 1;
+    }
+  }
+  return n;
+}
+
+int
+main(int argc, char **argv)
+{
+  int num_adders = (argc > 1) ? atoi(argv[1]) : 4;
+  int num_getters = (argc > 2) ? atoi(argv[2]) : 2;
+  num_objs = (argc > 3) ? strtoull(argv[3], NULL, 10) : 1000000;
+  num_adds = (argc > 4) ? strtoull(argv[4], NULL, 10) : 2000000;
+
+  int errors = 0;
+  map = blame_map_new();
+
+  // blame of one object beyond 32 bits
+  uint64_t big = 3ULL << 31;
+  blame_map_add_blame(map, 0x1000, big);
+  blame_map_add_blame(map, 0x1000, big);
+  if (blame_map_get_blame(map, 0x1000) != 2 * big) {
+    printf("FAIL: 64-bit blame not preserved\n");
+    errors++;
+  }
+  if (blame_map_get_blame(map, 0x1000) != 0) {
+    printf("FAIL: blame not reset after get\n");
+    errors++;
+  }
+
+  pthread_t threads[num_adders + num_getters];
+  struct timespec t0, t1;
+  int i;
+
+  atomic_store(&adders_running, num_adders);
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (i = 0; i < num_adders; i++) {
+    pthread_create(&threads[i], NULL, adder, (void *)(uintptr_t) i);
+  }
+  for (i = 0; i < num_getters; i++) {
+    pthread_create(&threads[num_adders + i], NULL, getter,
+                   (void *)(uintptr_t) i);
+  }
+  for (i = 0; i < num_adders + num_getters; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  uint64_t rest = 0;
+  uint64_t k;
+  for (k = 0; k < num_objs; k++) {
+    rest += blame_map_get_blame(map, test_obj(k));
+  }
+
+  uint64_t total_added = atomic_load(&added);
+  uint64_t total_taken = atomic_load(&taken) + rest;
+  double secs = (t1.tv_sec - t0.tv_sec) + 1e-9 * (t1.tv_nsec - t0.tv_nsec);
+
+  printf("%d adders, %d getters, %lu objects: %.1f ns/add, %lu slots\n",
+         num_adders, num_getters, num_objs,
+         1e9 * secs / (num_adders * num_adds), num_slots());
+  printf("added %lu, taken %lu (%lu while adding)\n",
+         total_added, total_taken, atomic_load(&taken));
+
+  if (total_added != total_taken) {
+    printf("FAIL: blame not conserved\n");
+    errors++;
+  }
+  if (atomic_load(&emsgs) != 0) {
+    printf("FAIL: %lu errors reported\n", atomic_load(&emsgs));
+    errors++;
+  }
+
+  printf("%s\n", errors ? "FAIL" : "PASS");
+  return errors != 0;
+}
+
+#endif
@@ -63,16 +63,18 @@
 //
 // (abstract) data type definition
 //
-typedef union blame_entry_t blame_entry_t;
+typedef struct blame_map_s blame_map_t;
 
 /***************************************************************************
  * interface operations
  ***************************************************************************/
 
-blame_entry_t* blame_map_new(void);
-void blame_map_init(blame_entry_t* table);
-void blame_map_add_blame(blame_entry_t* table,
-			 uint64_t obj, uint32_t metric_value);
-uint64_t blame_map_get_blame(blame_entry_t* table, uint64_t obj);
+blame_map_t* blame_map_new(void);
+void blame_map_init(blame_map_t* map);
+void blame_map_add_blame(blame_map_t* map,
+			 uint64_t obj, uint64_t metric_value);
+
+// returns the blame accumulated for obj and resets it to 0
+uint64_t blame_map_get_blame(blame_map_t* map, uint64_t obj);
 
 #endif // _hpctoolkit_blame_map_h_
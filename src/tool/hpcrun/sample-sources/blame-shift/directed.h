@@ -14,7 +14,7 @@ typedef uint64_t (*directed_blame_target_fn)(void);
 
 typedef struct directed_blame_info_t {
   directed_blame_target_fn get_blame_target;
-  blame_entry_t* blame_table;
+  blame_map_t* blame_table;
 
   int wait_metric_id;
   int blame_metric_id;
@@ -52,6 +52,11 @@
 // Override functions:
 // posix_memalign, memalign, valloc
 // malloc, calloc, free, realloc
+//
+// By default, a sampled block carries a leakinfo header, or a footer
+// found through a splay tree at free.  With HPCRUN_MEMLEAK_TABLE set,
+// blocks are not changed and sampled blocks are recorded in per-thread
+// tables instead (see memleak-table.c).
 
 /******************************************************************************
  * standard include files
@@ -89,6 +94,7 @@
  *****************************************************************************/
 
 #include <sample-sources/memleak.h>
+#include <sample-sources/memleak-table.h>
 #include <messages/messages.h>
 #include <safe-sampling.h>
 #include <sample_event.h>
@@ -141,6 +147,7 @@ typedef void *realloc_fcn(void *, size_t);
 #define MEMLEAK_DEFAULT_PAGESIZE  4096
 
 #define HPCRUN_MEMLEAK_PROB  "HPCRUN_MEMLEAK_PROB"
+#define HPCRUN_MEMLEAK_TABLE "HPCRUN_MEMLEAK_TABLE"
 #define DEFAULT_PROB  0.1
 
 #ifdef HPCRUN_STATIC_LINK
@@ -172,6 +179,7 @@ extern realloc_fcn        real_realloc;
 static int leak_detection_enabled = 0; // default is off
 static int leak_detection_init = 0;    // default is uninitialized
 static int use_memleak_prob = 0;
+static int use_memleak_table = 0;
 static float memleak_prob = 0.0;
 
 static struct leakinfo_s *memleak_tree_root = NULL;
@@ -276,6 +284,9 @@ splay_delete(void *memblock)
  * private operations
  *****************************************************************************/
 
+static void memleak_table_reclaim(void *ptr, cct_node_t *context, size_t bytes);
+
+
 // Accept 0.ddd as floating point or x/y as fraction.
 static float
 string_to_prob(char *str)
@@ -335,6 +346,11 @@ memleak_initialize(void)
     srandom(seed);
   }
 
+  if (getenv(HPCRUN_MEMLEAK_TABLE) != NULL) {
+    use_memleak_table = 1;
+    memleak_table_init(memleak_table_reclaim);
+  }
+
   // unconditionally enable leak detection for now
   leak_detection_enabled = 1;
   leak_detection_init = 1;
@@ -477,6 +493,61 @@ memleak_add_leakinfo(const char *name, void *sys_ptr, void *appl_ptr,
 }
 
 
+// Returns: 1 if this allocation should be tracked, else 0 and the
+// reason in inactive_mesg.
+//
+static int
+memleak_sample_active(char **inactive_mesg)
+{
+  // note: we can't track malloc inside dlopen, that would lead to
+  // deadlock.
+  if (! (leak_detection_enabled && hpcrun_memleak_active())) {
+    return 0;
+  }
+  if (TD_GET(inside_dlfcn)) {
+    *inactive_mesg = "unable to monitor: inside dlfcn";
+    return 0;
+  }
+  if (use_memleak_prob && (random()/(float)RAND_MAX > memleak_prob)) {
+    *inactive_mesg = "not sampled";
+    return 0;
+  }
+  return 1;
+}
+
+
+// Table mode: record a sampled block in the thread's table.
+//
+static void
+memleak_table_add(const char *name, void *ptr, size_t bytes, ucontext_t *uc)
+{
+  sample_val_t smpl =
+    hpcrun_sample_callpath(uc, hpcrun_memleak_alloc_id(),
+      (hpcrun_metricVal_t) {.i=bytes},
+      0, 1, NULL);
+  memleak_table_insert(ptr, smpl.sample_node, bytes);
+
+  TMSG(MEMLEAK, "%s: bytes: %ld appl: %p cct: %p (table)",
+       name, bytes, ptr, smpl.sample_node);
+}
+
+
+// Table mode: add metric for a block that was freed and release it.
+// Frees by other threads than the malloc are reconciled in batches,
+// so this may run some time after the free.
+//
+static void
+memleak_table_reclaim(void *ptr, cct_node_t *context, size_t bytes)
+{
+  if (context != NULL && hpcrun_memleak_active()) {
+    hpcrun_free_inc(context, bytes);
+    TMSG(MEMLEAK, "free: bytes: %ld appl: %p cct: %p (table)",
+	 bytes, ptr, context);
+  }
+  real_free(ptr);
+}
+
+
 // Unified function for all of the mallocs, aligned and unaligned.
 // Do the malloc, add the leakinfo struct and print TMSG.
 //
@@ -497,19 +568,9 @@ memleak_malloc_helper(const char *name, size_t bytes, size_t align,
 
   TMSG(MEMLEAK, "%s: bytes: %ld", name, bytes);
 
-  // do the real malloc, aligned or not.  note: we can't track malloc
-  // inside dlopen, that would lead to deadlock.
-  active = 1;
-  if (! (leak_detection_enabled && hpcrun_memleak_active())) {
-    active = 0;
-  } else if (TD_GET(inside_dlfcn)) {
-    active = 0;
-    inactive_mesg = "unable to monitor: inside dlfcn";
-  } else if (use_memleak_prob && (random()/(float)RAND_MAX > memleak_prob)) {
-    active = 0;
-    inactive_mesg = "not sampled";
-  }
-  size = bytes + (active ? leakinfo_size : 0);
+  // do the real malloc, aligned or not.
+  active = memleak_sample_active(&inactive_mesg);
+  size = bytes + ((active && ! use_memleak_table) ? leakinfo_size : 0);
   if (align != 0) {
     // there is no __libc_posix_memalign(), so we use __libc_memalign()
     // instead, or else use dlsym().
@@ -536,6 +597,11 @@ memleak_malloc_helper(const char *name, size_t bytes, size_t align,
     return sys_ptr;
   }
 
+  if (use_memleak_table) {
+    memleak_table_add(name, sys_ptr, bytes, uc);
+    return sys_ptr;
+  }
+
   loc = memleak_get_malloc_loc(sys_ptr, bytes, align, &appl_ptr, &info_ptr);
   memleak_add_leakinfo(name, sys_ptr, appl_ptr, info_ptr, bytes, uc, loc);
 
@@ -755,6 +821,11 @@ MONITOR_EXT_WRAP_NAME(free)(void *ptr)
     goto finish;
   }
 
+  if (use_memleak_table) {
+    memleak_table_free(ptr);
+    goto finish;
+  }
+
   loc = memleak_get_free_loc(ptr, &sys_ptr, &info_ptr);
   memleak_free_helper("free", sys_ptr, ptr, info_ptr, loc);
   real_free(sys_ptr);
@@ -799,6 +870,29 @@ MONITOR_EXT_WRAP_NAME(realloc)(void *ptr, size_t bytes)
     goto finish;
   }
 
+  if (use_memleak_table) {
+    cct_node_t *context;
+    size_t old_bytes;
+
+    // no batching here: the block may move, so its old address must
+    // leave the tables now
+    if (memleak_table_take(ptr, &context, &old_bytes)
+	&& context != NULL && hpcrun_memleak_active()) {
+      hpcrun_free_inc(context, old_bytes);
+    }
+    if (bytes == 0) {
+      real_free(ptr);
+      appl_ptr = NULL;
+      goto finish;
+    }
+    active = memleak_sample_active(&inactive_mesg);
+    appl_ptr = real_realloc(ptr, bytes);
+    if (active && appl_ptr != NULL) {
+      memleak_table_add("realloc/malloc", appl_ptr, bytes, &uc);
+    }
+    goto finish;
+  }
+
   // for memleak metric, treat realloc as a free of the old bytes
   loc = memleak_get_free_loc(ptr, &sys_ptr, &info_ptr);
   memleak_free_helper("realloc/free", sys_ptr, ptr, info_ptr, loc);
@@ -812,17 +906,7 @@ MONITOR_EXT_WRAP_NAME(realloc)(void *ptr, size_t bytes)
 
   // if inactive, then do real_realloc() and return.
   // but if there used to be a header, then must slide user data.
-  // again, can't track malloc inside dlopen.
-  active = 1;
-  if (! (leak_detection_enabled && hpcrun_memleak_active())) {
-    active = 0;
-  } else if (TD_GET(inside_dlfcn)) {
-    active = 0;
-    inactive_mesg = "unable to monitor: inside dlfcn";
-  } else if (use_memleak_prob && (random()/(float)RAND_MAX > memleak_prob)) {
-    active = 0;
-    inactive_mesg = "not sampled";
-  }
+  active = memleak_sample_active(&inactive_mesg);
   if (! active) {
     if (loc == MEMLEAK_LOC_HEAD) {
       // slide left
@@ -0,0 +1,628 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+// Per-thread allocation tables for MEMLEAK.
+//
+// Each thread records its sampled allocations in its own open
+// addressing table keyed by the application pointer, so malloc and a
+// free by the same thread touch no shared data besides a counting
+// filter.  A slot is written only by its owner while free or deleted;
+// a live slot is deleted by a CAS of its key to TOMB, by the owner or
+// by another thread.
+//
+// A thread that frees a block not in its own table cannot tell which
+// table has it, so it collects such blocks and looks them up in all
+// tables, a batch at a time.  The blocks are released only after the
+// lookup, so their addresses cannot be reused while they are still in
+// a table.  Other threads search a table only while holding its lock,
+// which the owner takes only to rehash.
+//
+// The filter counts sampled blocks per hash of the pointer.  A free
+// whose count is 0 was not sampled and is released at once, which is
+// the common case when sampling with a low probability.
+//
+
+/******************************************************************************
+ * system includes
+ *****************************************************************************/
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+
+
+/******************************************************************************
+ * local includes
+ *****************************************************************************/
+
+#include "memleak-table.h"
+
+#include <memory/mmap.h>
+#include <messages/messages.h>
+#include <lib/prof-lean/spinlock.h>
+#include <lib/prof-lean/stdatomic.h>
+
+
+
+/******************************************************************************
+ * macros
+ *****************************************************************************/
+
+#define KEY_EMPTY  ((uintptr_t) 0)
+#define KEY_TOMB   ((uintptr_t) 1)
+
+#define TABLE_INIT_SLOTS  1024
+#define FREE_BATCH        64
+
+#define FILTER_BITS  16
+#define FILTER_SIZE  (1 << FILTER_BITS)
+
+
+
+/******************************************************************************
+ * type definitions
+ *****************************************************************************/
+
+typedef struct memleak_slot_s {
+  atomic_uintptr_t key;
+  cct_node_t *context;
+  size_t bytes;
+} memleak_slot_t;
+
+
+typedef struct memleak_table_s {
+  struct memleak_table_s *next;   // all tables
+  atomic_bool in_use;
+
+  // held by other threads while searching, and by the owner to rehash
+  spinlock_t lock;
+  memleak_slot_t *slots;
+  size_t mask;
+  size_t used;                    // live and deleted slots (owner only)
+  atomic_long live;
+
+  // frees of blocks that are not in this table
+  int num_pending;
+  void *pending[FREE_BATCH];
+} memleak_table_t;
+
+
+
+/******************************************************************************
+ * private data
+ *****************************************************************************/
+
+static memleak_table_free_fn *free_fn = NULL;
+
+static _Atomic(memleak_table_t *) all_tables = ATOMIC_VAR_INIT(NULL);
+
+static atomic_uint *filter = NULL;
+
+static pthread_once_t key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t table_key;
+
+static __thread memleak_table_t *my_table = NULL;
+
+
+
+/******************************************************************************
+ * private operations
+ *****************************************************************************/
+
+static inline uint64_t
+ptr_hash(void *ptr)
+{
+  return ((uintptr_t) ptr >> 4) * 0x9e3779b97f4a7c15ULL;
+}
+
+
+static inline atomic_uint *
+filter_count(void *ptr)
+{
+  return &filter[ptr_hash(ptr) >> (64 - FILTER_BITS)];
+}
+
+
+static memleak_slot_t *
+slots_new(size_t nslots)
+{
+  // mmap memory is zero: every key is KEY_EMPTY
+  return hpcrun_mmap_anon(nslots * sizeof(memleak_slot_t));
+}
+
+
+static void
+slots_delete(memleak_slot_t *slots, size_t nslots)
+{
+  munmap(slots, nslots * sizeof(memleak_slot_t));
+}
+
+
+// the live slot of ptr in table t, or NULL
+static memleak_slot_t *
+table_find(memleak_table_t *t, void *ptr)
+{
+  uintptr_t key = (uintptr_t) ptr;
+  size_t i = ptr_hash(ptr) & t->mask;
+  size_t n;
+
+  for (n = 0; n <= t->mask; n++, i = (i + 1) & t->mask) {
+    uintptr_t k = atomic_load_explicit(&t->slots[i].key, memory_order_acquire);
+    if (k == key) return &t->slots[i];
+    if (k == KEY_EMPTY) break;
+  }
+  return NULL;
+}
+
+
+// delete the slot of ptr; false if another thread deleted it first
+static bool
+slot_claim(memleak_table_t *t, memleak_slot_t *slot, void *ptr,
+           cct_node_t **context, size_t *bytes)
+{
+  uintptr_t key = (uintptr_t) ptr;
+
+  // read before the CAS: once the slot is deleted the owner may reuse it
+  *context = slot->context;
+  *bytes = slot->bytes;
+  if (!atomic_compare_exchange_strong(&slot->key, &key, KEY_TOMB)) {
+    *context = NULL;
+    *bytes = 0;
+    return false;
+  }
+  atomic_fetch_sub_explicit(&t->live, 1, memory_order_relaxed);
+  atomic_fetch_sub_explicit(filter_count(ptr), 1, memory_order_relaxed);
+  return true;
+}
+
+
+// rebuild the owner's table without deleted slots, with room to grow
+static void
+table_rehash(memleak_table_t *t)
+{
+  size_t live = atomic_load(&t->live);
+  size_t nslots = TABLE_INIT_SLOTS;
+  while (nslots < 4 * live) nslots *= 2;
+
+  memleak_slot_t *slots = slots_new(nslots);
+  if (slots == NULL) return;
+
+  spinlock_lock(&t->lock);
+
+  memleak_slot_t *old = t->slots;
+  size_t old_nslots = t->mask + 1;
+  size_t used = 0;
+  size_t i;
+  for (i = 0; i < old_nslots; i++) {
+    uintptr_t k = atomic_load(&old[i].key);
+    if (k == KEY_EMPTY || k == KEY_TOMB) continue;
+
+    size_t j = ptr_hash((void *) k) & (nslots - 1);
+    while (atomic_load_explicit(&slots[j].key, memory_order_relaxed) != KEY_EMPTY) {
+      j = (j + 1) & (nslots - 1);
+    }
+    slots[j].context = old[i].context;
+    slots[j].bytes = old[i].bytes;
+    atomic_store_explicit(&slots[j].key, k, memory_order_relaxed);
+    used++;
+  }
+  t->slots = slots;
+  t->mask = nslots - 1;
+  t->used = used;
+
+  spinlock_unlock(&t->lock);
+
+  slots_delete(old, old_nslots);
+}
+
+
+static void
+table_release(void *arg)
+{
+  memleak_table_t *t = (memleak_table_t *) arg;
+
+  memleak_table_flush();
+  my_table = NULL;
+  atomic_store_explicit(&t->in_use, false, memory_order_release);
+}
+
+
+static void
+table_key_init(void)
+{
+  pthread_key_create(&table_key, table_release);
+}
+
+
+// the calling thread's table. a table released by an exited thread is
+// reused, along with the blocks it still holds.
+static memleak_table_t *
+table_get(void)
+{
+  if (my_table != NULL) return my_table;
+
+  memleak_table_t *t;
+  for (t = atomic_load(&all_tables); t != NULL; t = t->next) {
+    int expected = false;  // atomic_bool holds an int
+    if (atomic_compare_exchange_strong(&t->in_use, &expected, true)) break;
+  }
+
+  if (t == NULL) {
+    t = hpcrun_mmap_anon(sizeof(memleak_table_t));
+    if (t == NULL) return NULL;
+    t->slots = slots_new(TABLE_INIT_SLOTS);
+    if (t->slots == NULL) return NULL;
+    t->mask = TABLE_INIT_SLOTS - 1;
+    spinlock_init(&t->lock);
+    atomic_init(&t->in_use, true);
+    atomic_init(&t->live, 0);
+
+    t->next = atomic_load(&all_tables);
+    while (!atomic_compare_exchange_weak(&all_tables, &t->next, t));
+  }
+
+  my_table = t;
+  pthread_once(&key_once, table_key_init);
+  pthread_setspecific(table_key, t);
+  return t;
+}
+
+
+
+/******************************************************************************
+ * interface operations
+ *****************************************************************************/
+
+void
+memleak_table_init(memleak_table_free_fn *fn)
+{
+  free_fn = fn;
+  filter = hpcrun_mmap_anon(FILTER_SIZE * sizeof(atomic_uint));
+  TMSG(MEMLEAK, "per-thread allocation tables %s", filter ? "on" : "failed");
+}
+
+
+void
+memleak_table_insert(void *ptr, cct_node_t *context, size_t bytes)
+{
+  memleak_table_t *t = table_get();
+  if (t == NULL || filter == NULL) return;
+
+  size_t i = ptr_hash(ptr) & t->mask;
+  for (;;) {
+    uintptr_t k = atomic_load_explicit(&t->slots[i].key, memory_order_relaxed);
+    if (k == KEY_EMPTY || k == KEY_TOMB) {
+      if (k == KEY_EMPTY) t->used++;
+      break;
+    }
+    i = (i + 1) & t->mask;
+  }
+
+  atomic_fetch_add_explicit(filter_count(ptr), 1, memory_order_relaxed);
+  atomic_fetch_add_explicit(&t->live, 1, memory_order_relaxed);
+
+  // free or deleted slots are never written by other threads
+  t->slots[i].context = context;
+  t->slots[i].bytes = bytes;
+  atomic_store_explicit(&t->slots[i].key, (uintptr_t) ptr, memory_order_release);
+
+  if (4 * t->used > 3 * (t->mask + 1)) {
+    table_rehash(t);
+  }
+}
+
+
+void
+memleak_table_free(void *ptr)
+{
+  if (filter == NULL ||
+      atomic_load_explicit(filter_count(ptr), memory_order_relaxed) == 0) {
+    free_fn(ptr, NULL, 0);
+    return;
+  }
+
+  memleak_table_t *t = table_get();
+  if (t == NULL) {
+    free_fn(ptr, NULL, 0);
+    return;
+  }
+
+  memleak_slot_t *slot = table_find(t, ptr);
+  cct_node_t *context;
+  size_t bytes;
+  if (slot != NULL && slot_claim(t, slot, ptr, &context, &bytes)) {
+    free_fn(ptr, context, bytes);
+    return;
+  }
+
+  t->pending[t->num_pending++] = ptr;
+  if (t->num_pending == FREE_BATCH) {
+    memleak_table_flush();
+  }
+}
+
+
+bool
+memleak_table_take(void *ptr, cct_node_t **context, size_t *bytes)
+{
+  if (filter == NULL ||
+      atomic_load_explicit(filter_count(ptr), memory_order_relaxed) == 0) {
+    return false;
+  }
+
+  memleak_table_t *mine = table_get();
+  memleak_table_t *t;
+  for (t = atomic_load(&all_tables); t != NULL; t = t->next) {
+    if (t != mine) spinlock_lock(&t->lock);
+    memleak_slot_t *slot = table_find(t, ptr);
+    bool found = (slot != NULL && slot_claim(t, slot, ptr, context, bytes));
+    if (t != mine) spinlock_unlock(&t->lock);
+    if (found) return true;
+  }
+  return false;
+}
+
+
+void
+memleak_table_flush(void)
+{
+  memleak_table_t *mine = my_table;
+  if (mine == NULL || mine->num_pending == 0) return;
+
+  int n = mine->num_pending;
+  cct_node_t *context[FREE_BATCH];
+  size_t bytes[FREE_BATCH];
+  bool matched[FREE_BATCH];
+  int i, unmatched = n;
+
+  for (i = 0; i < n; i++) {
+    context[i] = NULL;
+    bytes[i] = 0;
+    matched[i] = false;
+  }
+
+  memleak_table_t *t;
+  for (t = atomic_load(&all_tables); t != NULL && unmatched > 0; t = t->next) {
+    if (t == mine || atomic_load_explicit(&t->live, memory_order_relaxed) == 0) {
+      continue;
+    }
+    spinlock_lock(&t->lock);
+    for (i = 0; i < n; i++) {
+      if (matched[i]) continue;
+      memleak_slot_t *slot = table_find(t, mine->pending[i]);
+      if (slot != NULL &&
+          slot_claim(t, slot, mine->pending[i], &context[i], &bytes[i])) {
+        matched[i] = true;
+        unmatched--;
+      }
+    }
+    spinlock_unlock(&t->lock);
+  }
+
+  // release only after the lookups: until then no address in the
+  // batch can be handed out and sampled again
+  mine->num_pending = 0;
+  for (i = 0; i < n; i++) {
+    free_fn(mine->pending[i], context[i], bytes[i]);
+  }
+}
+
+
+#define UNIT_TEST 0
+#if UNIT_TEST
+
+// allocation rate microbenchmark.  set UNIT_TEST to 1 and build with
+// the hpcrun include paths:
+//   cc -O2 -I... memleak-table.c -lpthread
+// run as: a.out [threads] [pairs per thread]
+//
+// each thread mallocs and frees blocks in rounds of 64, sampling each
+// block with a given probability as the overrides do, first freeing
+// its own blocks, then the blocks of the next thread.  reports the
+// time per malloc/free pair above plain malloc and free, and checks
+// that every sampled byte comes back exactly once.  the unwind of a
+// sampled malloc is not included.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define ROUND 64
+
+static int num_threads = 4;
+static long num_pairs = 1000000;
+static double prob;
+static int cross;
+
+static pthread_barrier_t barrier;
+static void **blocks;
+
+static cct_node_t *test_context = (cct_node_t *) &num_threads;
+
+static atomic_long bytes_sampled = ATOMIC_VAR_INIT(0);
+static atomic_long bytes_reclaimed = ATOMIC_VAR_INIT(0);
+static atomic_long bad_reclaims = ATOMIC_VAR_INIT(0);
+
+int
+debug_flag_get(dbg_category flag)
+{
+  return 0;
+}
+
+void
+hpcrun_pmsg(const char* tag, const char* fmt, ...)
+{
+}
+
+void*
+hpcrun_mmap_anon(size_t size)
+{
+  void *addr = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  return addr == MAP_FAILED ? NULL : addr;
+}
+
+static void
+test_reclaim(void *ptr, cct_node_t *context, size_t bytes)
+{
+  if (context != NULL) {
+    if (context != test_context || bytes != *(size_t *) ptr) {
+      atomic_fetch_add(&bad_reclaims, 1);
+    }
+    atomic_fetch_add(&bytes_reclaimed, bytes);
+  }
+  free(ptr);
+}
+
+static void
+test_round(void **round, unsigned *seed, int tracked)
+{
+  int i;
+  long sampled = 0;
+  for (i = 0; i < ROUND; i++) {
+    size_t bytes = 16 + 8 * (rand_r(seed) % 64);
+    round[i] = malloc(bytes);
+    *(size_t *) round[i] = bytes;
+    if (tracked && rand_r(seed) < prob * RAND_MAX) {
+      memleak_table_insert(round[i], test_context, bytes);
+      sampled += bytes;
+    }
+  }
+  atomic_fetch_add(&bytes_sampled, sampled);
+}
+
+static void *
+test_thread(void *arg)
+{
+  int id = (int)(uintptr_t) arg;
+  int tracked = (prob >= 0);
+  unsigned seed = id + 1;
+  long r, i;
+  void **mine = &blocks[id * ROUND];
+  void **other = &blocks[((id + 1) % num_threads) * ROUND];
+
+  for (r = 0; r < num_pairs / ROUND; r++) {
+    test_round(mine, &seed, tracked);
+    if (cross) pthread_barrier_wait(&barrier);
+    void **victims = cross ? other : mine;
+    for (i = 0; i < ROUND; i++) {
+      if (tracked) memleak_table_free(victims[i]);
+      else free(victims[i]);
+    }
+    if (cross) pthread_barrier_wait(&barrier);
+  }
+  if (tracked) memleak_table_flush();
+  return NULL;
+}
+
+static double
+test_run(double p, int c)
+{
+  prob = p;
+  cross = c;
+  pthread_t threads[num_threads];
+  struct timespec t0, t1;
+  int i;
+
+  clock_gettime(CLOCK_MONOTONIC, &t0);
+  for (i = 0; i < num_threads; i++) {
+    pthread_create(&threads[i], NULL, test_thread, (void *)(uintptr_t) i);
+  }
+  for (i = 0; i < num_threads; i++) {
+    pthread_join(threads[i], NULL);
+  }
+  clock_gettime(CLOCK_MONOTONIC, &t1);
+
+  double secs = (t1.tv_sec - t0.tv_sec) + 1e-9 * (t1.tv_nsec - t0.tv_nsec);
+  return 1e9 * secs / ((num_pairs / ROUND) * ROUND * num_threads);
+}
+
+int
+main(int argc, char **argv)
+{
+  if (argc > 1) num_threads = atoi(argv[1]);
+  if (argc > 2) num_pairs = atol(argv[2]);
+
+  static const double probs[] = { 0.0, 0.01, 0.1, 1.0 };
+  int errors = 0;
+  int c, j;
+
+  memleak_table_init(test_reclaim);
+  blocks = malloc(num_threads * ROUND * sizeof(void *));
+  pthread_barrier_init(&barrier, NULL, num_threads);
+
+  printf("%d threads, %ld malloc/free pairs each\n", num_threads, num_pairs);
+  for (c = 0; c <= 1; c++) {
+    double base = test_run(-1, c);
+    printf("%s frees: plain malloc/free %.1f ns/pair\n",
+           c ? "cross-thread" : "same-thread", base);
+    for (j = 0; j < sizeof(probs) / sizeof(probs[0]); j++) {
+      double ns = test_run(probs[j], c);
+      printf("  prob %-5g  %6.1f ns/pair  (+%.1f)\n", probs[j], ns, ns - base);
+    }
+  }
+
+  printf("sampled %ld bytes, reclaimed %ld bytes\n",
+         atomic_load(&bytes_sampled), atomic_load(&bytes_reclaimed));
+  if (atomic_load(&bytes_sampled) != atomic_load(&bytes_reclaimed)) {
+    printf("FAIL: sampled bytes not reclaimed exactly once\n");
+    errors++;
+  }
+  if (atomic_load(&bad_reclaims) != 0) {
+    printf("FAIL: %ld blocks reclaimed with the wrong size\n",
+           atomic_load(&bad_reclaims));
+    errors++;
+  }
+
+  printf("%s\n", errors ? "FAIL" : "PASS");
+  return errors != 0;
+}
+
+#endif
@@ -0,0 +1,84 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+//
+// Per-thread tables of sampled allocations for MEMLEAK, keyed by the
+// pointer given to the application.  Used instead of headers and the
+// footer splay tree when HPCRUN_MEMLEAK_TABLE is set.
+//
+
+#ifndef __MEMLEAK_TABLE_H__
+#define __MEMLEAK_TABLE_H__
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <cct/cct.h>
+
+
+// called once a freed block is reconciled: context and bytes are
+// those recorded at malloc, or NULL and 0 if the block was not
+// sampled.  must release the block.
+typedef void memleak_table_free_fn(void *ptr, cct_node_t *context, size_t bytes);
+
+void memleak_table_init(memleak_table_free_fn *fn);
+
+// record a sampled allocation in the calling thread's table
+void memleak_table_insert(void *ptr, cct_node_t *context, size_t bytes);
+
+// free a block: blocks of the calling thread's table are reconciled
+// at once, blocks that may be in another thread's table are batched
+void memleak_table_free(void *ptr);
+
+// remove a block from whichever table holds it, without batching.
+// returns false if the block was not sampled.
+bool memleak_table_take(void *ptr, cct_node_t **context, size_t *bytes);
+
+// reconcile the calling thread's batch of frees
+void memleak_table_flush(void);
+
+#endif
@@ -117,6 +117,7 @@
 #include "perf_mmap.h"        // api for parsing mmapped buffer
 #include "perf_skid.h"
 #include "perf_event_open.h"
+#include "perf_ustack.h"      // deferred unwinding of user stacks
 
 #include "event_custom.h"     // api for pre-defined events
 
@@ -177,6 +178,12 @@ struct event_threshold_s {
   enum threshold_e threshold_type;
 };
 
+// state for perf_record_handler while draining a buffer
+typedef struct perf_record_arg_s {
+  event_thread_t *current;
+  void           *context;
+} perf_record_arg_t;
+
 //******************************************************************************
 // forward declarations 
 //******************************************************************************
@@ -548,6 +555,15 @@ record_sample(event_thread_t *current, perf_mmap_data_t *mmap_data,
   const double delta    = counter - info_aux->threshold_mean;
   info_aux->threshold_mean += delta / info_aux->num_samples;
 
+  // ----------------------------------------------------------------------------
+  // leave the unwind to the helper thread if we have a copy of the stack.
+  // predefined events may need the cct node right away.
+  // ----------------------------------------------------------------------------
+  if (current->event->metric_custom == NULL &&
+      perf_ustack_defer(mmap_data, current->event->hpcrun_metric_id, counter)) {
+    return sv;
+  }
+
   // ----------------------------------------------------------------------------
   // update the cct and add callchain if necessary
   // ----------------------------------------------------------------------------
@@ -563,6 +579,22 @@ record_sample(event_thread_t *current, perf_mmap_data_t *mmap_data,
   return sv;
 }
 
+
+// called for each record drained from the mmapped buffer
+static void
+perf_record_handler(perf_mmap_data_t *mmap_data, void *arg)
+{
+  perf_record_arg_t *record_arg = (perf_record_arg_t *) arg;
+
+  sample_val_t sv;
+  memset(&sv, 0, sizeof(sample_val_t));
+
+  if (mmap_data->header_type == PERF_RECORD_SAMPLE)
+    record_sample(record_arg->current, mmap_data, record_arg->context, &sv);
+
+  kernel_block_handler(record_arg->current, sv, mmap_data);
+}
+
 /***
  * (1) ensure that the default rate for frequency-based sampling is below the maximum.
  * (2) if the environment variable HPCRUN_PERF_COUNT is set, use it to set the threshold
@@ -691,6 +723,9 @@ METHOD_FN(thread_fini_action)
 
   perf_thread_fini(nevents, event_thread);
 
+  // record the samples still waiting for their unwind
+  perf_ustack_thread_fini();
+
   self->state = UNINIT;
 
   TMSG(LINUX_PERF, "%d: unregister thread OK", self->sel_idx);
@@ -744,6 +779,10 @@ METHOD_FN(shutdown)
 
   perf_thread_fini(nevents, event_thread);
 
+  // record the samples still waiting for their unwind
+  perf_ustack_thread_fini();
+  perf_ustack_fini();
+
   self->state = UNINIT;
 
   TMSG(LINUX_PERF, "shutdown OK");
@@ -821,6 +860,8 @@ METHOD_FN(process_event_list, int lush_metrics)
 
   set_default_threshold();
 
+  perf_ustack_init();
+
   // ----------------------------------------------------------------------
   // for each perf's event, create the metric descriptor which will be used later
   // during thread initialization for perf event creation
@@ -866,6 +907,7 @@ METHOD_FN(process_event_list, int lush_metrics)
     // all threads and file descriptor will reuse the same attributes.
     // ------------------------------------------------------------
     perf_util_attr_init(event, event_attr, is_period, threshold, 0);
+    perf_ustack_attr_init(event_attr);
 
     // ------------------------------------------------------------
     // initialize the property of the metric
@@ -963,6 +1005,8 @@ METHOD_FN(gen_event_set, int lush_metrics)
     }
   }
 
+  perf_ustack_thread_init();
+
   TMSG(LINUX_PERF, "gen_event_set OK");
 }
 
@@ -1151,23 +1195,15 @@ perf_event_handler(
   event_info_t *event_info     = (event_info_t *) current->event;
   struct perf_event_attr *attr = &event_info->attr;
 
-  int more_data = 0;
-  do {
-    perf_mmap_data_t mmap_data;
-    memset(&mmap_data, 0, sizeof(perf_mmap_data_t));
-
-    // reading info from mmapped buffer
-    more_data = read_perf_buffer(current->mmap, attr, &mmap_data);
-
-    sample_val_t sv;
-    memset(&sv, 0, sizeof(sample_val_t));
-
-    if (mmap_data.header_type == PERF_RECORD_SAMPLE)
-      record_sample(current, &mmap_data, context, &sv);
+  perf_mmap_data_t mmap_data;
+  perf_record_arg_t record_arg = { .current = current, .context = context };
 
-    kernel_block_handler(current, sv, &mmap_data);
+  // drain all the records of the mmapped buffer at once
+  read_perf_buffer_batch(current->mmap, attr, &mmap_data,
+                         perf_record_handler, &record_arg);
 
-  } while (more_data);
+  // record the samples the helper thread has unwound since the last time
+  perf_ustack_drain();
 
   perf_start_all(nevents, event_thread);
 
@@ -51,6 +51,8 @@
 
 #include <assert.h>
 #include <errno.h>
+#include <limits.h>
+#include <stddef.h>
 #include <sys/mman.h>
 #include <string.h>
 #include <unistd.h>
@@ -68,6 +70,7 @@
  *****************************************************************************/
 
 #include <hpcrun/messages/messages.h>
+#include <hpcrun/memory/hpcrun-malloc.h>
 
 /******************************************************************************
  * local include
@@ -81,6 +84,8 @@
  * Constants
  *****************************************************************************/
 
+#define UNIT_TEST 0
+
 #define MMAP_OFFSET_0            0
 
 #define PERF_DATA_PAGE_EXP        1      // use 2^PERF_DATA_PAGE_EXP pages
@@ -101,6 +106,19 @@
 
 
 
+/******************************************************************************
+ * types
+ *****************************************************************************/
+
+// a record being parsed.  the record is contiguous in memory: either in
+// place in the ring buffer, or copied out of it if it wraps around the
+// end of the buffer.  p is the next byte to parse.
+typedef struct perf_record_s {
+  const char *p;
+  const char *end;
+} perf_record_t;
+
+
 /******************************************************************************
  * local variables
  *****************************************************************************/
@@ -108,129 +126,105 @@
 static int pagesize      = 0;
 static size_t tail_mask  = 0;
 
+// records that wrap around the end of a ring buffer are copied here
+static __thread char *wrap_buffer = NULL;
+
 
 /******************************************************************************
  * local methods
  *****************************************************************************/
 
+//----------------------------------------------------------
+// copy bytes from the ring buffer starting at offset,
+// wrapping around the end of the buffer if necessary
+//----------------------------------------------------------
+static inline void
+ring_copy(const char *data, size_t offset, void *buf, size_t bytes)
+{
+  size_t right = BUFFER_SIZE - offset;
 
+  if (bytes <= right) {
+    memcpy(buf, data + offset, bytes);
+  } else {
+    memcpy(buf, data + offset, right);
+    memcpy((char *) buf + right, data, bytes - right);
+  }
+}
 
 
 //----------------------------------------------------------
-// read from perf_events mmap'ed buffer
-// to avoid too many memory fences, the routine requires the current
-//  head and tail position. Based on this info, it estimates whether
-//  the reading has enough bytes to read or not.
-//
-// If there is no enough bytes, it returns -1
-// otherwise it returns 0
+// read from a record.  reads past the end of the record fail
+// and return -1, otherwise return 0
 //----------------------------------------------------------
-static int
-perf_read(u64 data_head, u64 *data_tail,
-          pe_mmap_t *current_perf_mmap,
-          void *buf,
-          size_t bytes_wanted
-)
+static inline int
+record_read(perf_record_t *rec, void *buf, size_t bytes)
 {
-  if (current_perf_mmap == NULL)
+  if (bytes > rec->end - rec->p) {
+    rec->p = rec->end;
     return -1;
-
-  u64 tail_position = *data_tail;
-  size_t bytes_available = data_head - tail_position;
-
-  if (bytes_wanted > bytes_available) return -1;
-
-  // compute offset of tail in the circular buffer
-  unsigned long tail = BUFFER_OFFSET(tail_position);
-
-  long bytes_at_right = BUFFER_SIZE - tail;
-
-  // bytes to copy to the right of tail
-  size_t right = bytes_at_right < bytes_wanted ? bytes_at_right : bytes_wanted;
-
-  // front of the circular data buffer
-  char *data = BUFFER_FRONT(current_perf_mmap);
-
-  // copy bytes from tail position
-  memcpy(buf, data + tail, right);
-
-  // if necessary, wrap and continue copy from left edge of buffer
-  if (bytes_wanted > right) {
-    size_t left = bytes_wanted - right;
-    memcpy(buf + right, data, left);
   }
-  *data_tail = tail_position + bytes_wanted;
-
+  memcpy(buf, rec->p, bytes);
+  rec->p += bytes;
   return 0;
 }
 
 
 static inline int
-perf_read_header(u64 data_head, u64 *data_tail,
-  pe_mmap_t *current_perf_mmap,
-  pe_header_t *hdr
-)
+record_read_u32(perf_record_t *rec, u32 *val)
 {
-  return perf_read(data_head, data_tail, current_perf_mmap, hdr, sizeof(pe_header_t));
+  return record_read(rec, val, sizeof(u32));
 }
 
 
 static inline int
-perf_read_u32(u64 data_head, u64 *data_tail,
-  pe_mmap_t *current_perf_mmap,
-  u32 *val
-)
+record_read_u64(perf_record_t *rec, u64 *val)
 {
-  return perf_read(data_head, data_tail, current_perf_mmap, val, sizeof(u32));
+  return record_read(rec, val, sizeof(u64));
 }
 
 
-static inline int
-perf_read_u64(u64 data_head, u64 *data_tail,
-  pe_mmap_t *current_perf_mmap,
-  u64 *val
-)
+static inline void
+record_skip(perf_record_t *rec, size_t bytes)
 {
-  return perf_read(data_head, data_tail, current_perf_mmap, val, sizeof(u64));
+  rec->p = (bytes > rec->end - rec->p) ? rec->end : rec->p + bytes;
 }
 
 
 //----------------------------------------------------------
-// special mmap buffer reading for PERF_SAMPLE_READ
+// special record parsing for PERF_SAMPLE_READ
+// the values are not used, so they are only skipped
 //----------------------------------------------------------
 static void
-handle_struct_read_format(u64 data_head, u64 *data_tail, pe_mmap_t *perf_mmap, int read_format)
+handle_struct_read_format(perf_record_t *rec, int read_format)
 {
-  u64 value, id, nr, time_enabled, time_running;
+  u64 nr = 1;
+  size_t bytes = 0;
 
   if (read_format & PERF_FORMAT_GROUP) {
-    perf_read_u64(data_head, data_tail, perf_mmap, &nr);
+    record_read_u64(rec, &nr);
   } else {
-    perf_read_u64(data_head, data_tail, perf_mmap, &value);
+    bytes += sizeof(u64);    // value
   }
 
   if (read_format & PERF_FORMAT_TOTAL_TIME_ENABLED) {
-    perf_read_u64(data_head, data_tail, perf_mmap, &time_enabled);
+    bytes += sizeof(u64);
   }
   if (read_format & PERF_FORMAT_TOTAL_TIME_RUNNING) {
-    perf_read_u64(data_head, data_tail, perf_mmap, &time_running);
+    bytes += sizeof(u64);
   }
 
   if (read_format & PERF_FORMAT_GROUP) {
-    int i;
-    for(i=0;i<nr;i++) {
-      perf_read_u64(data_head, data_tail, perf_mmap, &value);
-
-      if (read_format & PERF_FORMAT_ID) {
-        perf_read_u64(data_head, data_tail, perf_mmap, &id);
-      }
+    size_t entry = (read_format & PERF_FORMAT_ID) ? 2 * sizeof(u64) : sizeof(u64);
+    if (nr > (rec->end - rec->p) / entry) {
+      nr = (rec->end - rec->p) / entry;
     }
+    bytes += nr * entry;
   }
-  else {
-    if (read_format & PERF_FORMAT_ID) {
-      perf_read_u64(data_head, data_tail, perf_mmap, &id);
-    }
+  else if (read_format & PERF_FORMAT_ID) {
+    bytes += sizeof(u64);
   }
+
+  record_skip(rec, bytes);
 }
 
 
@@ -240,26 +234,26 @@ handle_struct_read_format(u64 data_head, u64 *data_tail, pe_mmap_t *perf_mmap, i
 //----------------------------------------------------------
 
 static int
-perf_sample_callchain(u64 data_head, u64 *data_tail,
-                      pe_mmap_t *current_perf_mmap, perf_mmap_data_t* mmap_data)
+perf_sample_callchain(perf_record_t *rec, perf_mmap_data_t* mmap_data)
 {
   mmap_data->nr = 0;     // initialze the number of records to be 0
   u64 num_records = 0;
 
   // determine how many frames in the call chain
-  if (perf_read_u64(data_head, data_tail, current_perf_mmap, &num_records) == 0) {
+  if (record_read_u64(rec, &num_records) == 0) {
     if (num_records > 0) {
 
       // warning: if the number of frames is bigger than the storage (MAX_CALLCHAIN_FRAMES)
       // we have to truncate them. This is not a good practice, but so far it's the only
       // simplest solution I can come up.
-      mmap_data->nr = (num_records < MAX_CALLCHAIN_FRAMES ? num_records : MAX_CALLCHAIN_FRAMES);
+      u64 nr = (num_records < MAX_CALLCHAIN_FRAMES ? num_records : MAX_CALLCHAIN_FRAMES);
 
-      // read the IPs for the frames
-      if (perf_read(data_head, data_tail,
-                    current_perf_mmap, mmap_data->ips, num_records * sizeof(u64)) != 0) {
+      // read the IPs for the frames, and skip the ones that do not fit
+      if (record_read(rec, mmap_data->ips, nr * sizeof(u64)) == 0) {
+        mmap_data->nr = nr;
+        record_skip(rec, (num_records - nr) * sizeof(u64));
+      } else {
         // the data seems invalid
-        mmap_data->nr = 0;
         TMSG(LINUX_PERF, "unable to read all %d frames", num_records);
       }
     }
@@ -271,13 +265,12 @@ perf_sample_callchain(u64 data_head, u64 *data_tail,
 
 
 /**
- * parse mmapped buffer and copy the values into perf_mmap_data_t mmap_info.
+ * parse a sample record and copy the values into perf_mmap_data_t mmap_info.
  * we assume mmap_info is already initialized.
  * returns the number of read event attributes
  */
 static int
-parse_record_buffer(u64 data_head, u64 *data_tail,
-                    pe_mmap_t *current_perf_mmap,
+parse_record_buffer(perf_record_t *rec,
                     struct perf_event_attr *attr,
                     perf_mmap_data_t *mmap_info )
 {
@@ -286,62 +279,65 @@ parse_record_buffer(u64 data_head, u64 *data_tail,
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,12,0)
 	if (sample_type & PERF_SAMPLE_IDENTIFIER) {
-	  perf_read_u64(data_head, data_tail, current_perf_mmap, &mmap_info->sample_id);
+	  record_read_u64(rec, &mmap_info->sample_id);
 	  data_read++;
 	}
 #endif
 	if (sample_type & PERF_SAMPLE_IP) {
 	  // to be used by datacentric event
-	  perf_read_u64(data_head, data_tail, current_perf_mmap, &mmap_info->ip);
+	  record_read_u64(rec, &mmap_info->ip);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_TID) {
-	  perf_read_u32(data_head, data_tail, current_perf_mmap, &mmap_info->pid);
-	  perf_read_u32(data_head, data_tail, current_perf_mmap, &mmap_info->tid);
+	  record_read_u32(rec, &mmap_info->pid);
+	  record_read_u32(rec, &mmap_info->tid);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_TIME) {
-	  perf_read_u64(data_head, data_tail, current_perf_mmap, &mmap_info->time);
+	  record_read_u64(rec, &mmap_info->time);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_ADDR) {
 	  // to be used by datacentric event
-	  perf_read_u64(data_head, data_tail, current_perf_mmap, &mmap_info->addr);
+	  record_read_u64(rec, &mmap_info->addr);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_ID) {
-	  perf_read_u64(data_head, data_tail, current_perf_mmap, &mmap_info->id);
+	  record_read_u64(rec, &mmap_info->id);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_STREAM_ID) {
-	  perf_read_u64(data_head, data_tail, current_perf_mmap, &mmap_info->stream_id);
+	  record_read_u64(rec, &mmap_info->stream_id);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_CPU) {
-	  perf_read_u32(data_head, data_tail, current_perf_mmap, &mmap_info->cpu);
-	  perf_read_u32(data_head, data_tail, current_perf_mmap, &mmap_info->res);
+	  record_read_u32(rec, &mmap_info->cpu);
+	  record_read_u32(rec, &mmap_info->res);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_PERIOD) {
-	  perf_read_u64(data_head, data_tail, current_perf_mmap, &mmap_info->period);
+	  record_read_u64(rec, &mmap_info->period);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_READ) {
 	  // to be used by datacentric event
-	  handle_struct_read_format(data_head, data_tail, current_perf_mmap,
-	      attr->read_format);
+	  handle_struct_read_format(rec, attr->read_format);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_CALLCHAIN) {
 	  // add call chain from the kernel
-	  perf_sample_callchain(data_head, data_tail, current_perf_mmap, mmap_info);
+	  perf_sample_callchain(rec, mmap_info);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_RAW) {
 	  // not supported at the moment
-	  perf_read_u32(data_head, data_tail, current_perf_mmap, &mmap_info->size);
-	  mmap_info->data = alloca( sizeof(char) * mmap_info->size );
-	  perf_read( data_head, data_tail, current_perf_mmap, mmap_info->data, mmap_info->size) ;
+	  // the data is left in the record, see read_perf_buffer_batch
+	  record_read_u32(rec, &mmap_info->size);
+	  if (mmap_info->size > rec->end - rec->p) {
+	    mmap_info->size = rec->end - rec->p;
+	  }
+	  mmap_info->data = (char *) rec->p;
+	  record_skip(rec, mmap_info->size);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_BRANCH_STACK) {
@@ -349,19 +345,41 @@ parse_record_buffer(u64 data_head, u64 *data_tail,
 	}
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,7,0)
 	if (sample_type & PERF_SAMPLE_REGS_USER) {
+	  // the registers are left in the record, like RAW data
+	  record_read_u64(rec, &mmap_info->abi);
+	  if (mmap_info->abi != PERF_SAMPLE_REGS_ABI_NONE) {
+	    size_t size = __builtin_popcountll(attr->sample_regs_user) * sizeof(u64);
+	    if (size <= rec->end - rec->p) {
+	      mmap_info->regs = (u64 *) rec->p;
+	    }
+	    record_skip(rec, size);
+	  }
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_STACK_USER) {
+	  // so is the copy of the stack
+	  record_read_u64(rec, &mmap_info->stack_size);
+	  if (mmap_info->stack_size > 0) {
+	    if (mmap_info->stack_size <= rec->end - rec->p) {
+	      mmap_info->stack_data = (char *) rec->p;
+	    }
+	    record_skip(rec, mmap_info->stack_size);
+	    record_read_u64(rec, &mmap_info->stack_dyn_size);
+	    if (mmap_info->stack_data == NULL ||
+	        mmap_info->stack_dyn_size > mmap_info->stack_size) {
+	      mmap_info->stack_dyn_size = 0;
+	    }
+	  }
 	  data_read++;
 	}
 #endif
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(3,10,0)
 	if (sample_type & PERF_SAMPLE_WEIGHT) {
-	  perf_read_u64(data_head, data_tail, current_perf_mmap, &mmap_info->weight);
+	  record_read_u64(rec, &mmap_info->weight);
 	  data_read++;
 	}
 	if (sample_type & PERF_SAMPLE_DATA_SRC) {
-	  perf_read_u64(data_head, data_tail, current_perf_mmap, &mmap_info->data_src);
+	  record_read_u64(rec, &mmap_info->data_src);
 	  data_read++;
 	}
 #endif
@@ -385,8 +403,7 @@ parse_record_buffer(u64 data_head, u64 *data_tail,
 // any event that used sample_id_all or perf_record_misc_switch
 // needs to be parsed here
 static int
-parse_sample_id_buffer(u64 data_head, u64 *data_tail,
-                        pe_mmap_t *current_perf_mmap,
+parse_sample_id_buffer(perf_record_t *rec,
                         struct perf_event_attr *attr,
                         perf_mmap_data_t *mmap_info )
 {
@@ -394,30 +411,29 @@ parse_sample_id_buffer(u64 data_head, u64 *data_tail,
   int sample_type = attr->sample_type;
 
   if (sample_type & PERF_SAMPLE_TID) {
-    perf_read_u32(data_head, data_tail, current_perf_mmap, &mmap_info->pid);
-    perf_read_u32(data_head, data_tail, current_perf_mmap, &mmap_info->tid);
+    record_read_u32(rec, &mmap_info->pid);
+    record_read_u32(rec, &mmap_info->tid);
     data_read++;
   }
   if (sample_type & PERF_SAMPLE_TIME) {
-    perf_read_u64(data_head, data_tail, current_perf_mmap, &mmap_info->time);
+    record_read_u64(rec, &mmap_info->time);
     data_read++;
   }
-  if (sample_type & PERF_SAMPLE_TID) {
-    perf_read_u32(data_head, data_tail, current_perf_mmap, &mmap_info->pid);
-    perf_read_u32(data_head, data_tail, current_perf_mmap, &mmap_info->tid);
+  if (sample_type & PERF_SAMPLE_ID) {
+    record_read_u64(rec, &mmap_info->id);
     data_read++;
   }
   if (sample_type & PERF_SAMPLE_STREAM_ID) {
-    perf_read_u64(data_head, data_tail, current_perf_mmap, &mmap_info->stream_id);
+    record_read_u64(rec, &mmap_info->stream_id);
     data_read++;
   }
   if (sample_type & PERF_SAMPLE_CPU) {
-    perf_read_u32(data_head, data_tail, current_perf_mmap, &mmap_info->cpu);
-    perf_read_u32(data_head, data_tail, current_perf_mmap, &mmap_info->res);
+    record_read_u32(rec, &mmap_info->cpu);
+    record_read_u32(rec, &mmap_info->res);
     data_read++;
   }
   if (sample_type & PERF_SAMPLE_IDENTIFIER) {
-    perf_read_u64(data_head, data_tail, current_perf_mmap, &mmap_info->sample_id);
+    record_read_u64(rec, &mmap_info->sample_id);
     data_read++;
   }
 
@@ -426,54 +442,38 @@ parse_sample_id_buffer(u64 data_head, u64 *data_tail,
 #endif
 
 
-//----------------------------------------------------------------------
-// Public Interfaces
-//----------------------------------------------------------------------
-
-
 //----------------------------------------------------------
-// reading mmap buffer from the kernel
-// in/out: mmapped data of type perf_mmap_data_t.
-// return true if there are more data to be read,
-//        false otherwise
+// parse one record, of any type, into mmap_info
 //----------------------------------------------------------
-int
-read_perf_buffer(pe_mmap_t *current_perf_mmap,
-                 struct perf_event_attr *attr,
-                 perf_mmap_data_t *mmap_info)
+static void
+parse_record(perf_record_t *rec, pe_header_t *hdr,
+             struct perf_event_attr *attr,
+             perf_mmap_data_t *mmap_info)
 {
-  pe_header_t hdr;
-  u64 data_tail = current_perf_mmap->data_tail;
-  u64 data_head = current_perf_mmap->data_head;
-
-  rmb();  // memory fence after reading the data head
-
-  int read_successfully = perf_read_header(data_head, &data_tail, current_perf_mmap, &hdr);
-  if (read_successfully != 0 || hdr.size <= 0) {
-    return 0;
-  }
+  // the callchain is only valid up to mmap_info->nr, so it is not cleared
+  memset(mmap_info, 0, offsetof(perf_mmap_data_t, ips));
+  memset(&mmap_info->size, 0, sizeof(*mmap_info) - offsetof(perf_mmap_data_t, size));
 
-  mmap_info->header_type = hdr.type;
-  mmap_info->header_misc = hdr.misc;
+  mmap_info->header_type = hdr->type;
+  mmap_info->header_misc = hdr->misc;
 
-  if (hdr.type == PERF_RECORD_SAMPLE) {
-      parse_record_buffer(data_head, &data_tail, current_perf_mmap, attr, mmap_info);
+  if (hdr->type == PERF_RECORD_SAMPLE) {
+      parse_record_buffer(rec, attr, mmap_info);
 
 #if LINUX_VERSION_CODE >= KERNEL_VERSION(4,3,0)
-  } else if (hdr.type == PERF_RECORD_SWITCH) {
+  } else if (hdr->type == PERF_RECORD_SWITCH) {
       // only available since kernel 4.3
 
-    parse_sample_id_buffer(data_head, &data_tail, current_perf_mmap, attr, mmap_info);
+    parse_sample_id_buffer(rec, attr, mmap_info);
 
-    TMSG(LINUX_PERF, "%d context switch %d, time: %u", attr->config, hdr.misc, mmap_info->time);
+    TMSG(LINUX_PERF, "%d context switch %d, time: %u", attr->config, hdr->misc, mmap_info->time);
 
 #elif LINUX_VERSION_CODE >= KERNEL_VERSION(4,2,0)
-  } else if (hdr.type == PERF_RECORD_LOST_SAMPLES) {
-     u64 lost_samples;
-     perf_read_u64(current_perf_mmap, &lost_samples);
-     TMSG(LINUX_PERF, "[%d] lost samples %d",
-    		 current->fd, lost_samples);
-     skip_perf_data(current_perf_mmap, hdr.size-sizeof(lost_samples))
+  } else if (hdr->type == PERF_RECORD_LOST_SAMPLES) {
+     u64 lost_samples = 0;
+     record_read_u64(rec, &lost_samples);
+     TMSG(LINUX_PERF, "%d lost samples %d",
+    		 attr->config, lost_samples);
 #endif
 
   } else {
@@ -481,14 +481,91 @@ read_perf_buffer(pe_mmap_t *current_perf_mmap,
       // skip it
       TMSG(LINUX_PERF, "[%d] skip header %d  %d : %d bytes",
     		  attr->config,
-    		  hdr.type, hdr.misc, hdr.size);
+    		  hdr->type, hdr->misc, hdr->size);
+  }
+}
+
+
+//----------------------------------------------------------
+// consume up to max_records records between data_tail and
+// data_head, calling fn (if not NULL) for each one.  the
+// data head is read and data_tail is written once, with one
+// memory fence each.  returns the number of records read.
+//----------------------------------------------------------
+static int
+perf_drain(pe_mmap_t *current_perf_mmap,
+           struct perf_event_attr *attr,
+           perf_mmap_data_t *mmap_info,
+           perf_record_fn_t fn, void *arg,
+           int max_records)
+{
+  u64 data_head = current_perf_mmap->data_head;
+  rmb();  // memory fence after reading the data head
+
+  u64 data_tail = current_perf_mmap->data_tail;
+  char *data = BUFFER_FRONT(current_perf_mmap);
+  int num_records = 0;
+
+  while (num_records < max_records
+         && data_head - data_tail >= sizeof(pe_header_t)) {
+    pe_header_t hdr;
+    size_t offset = BUFFER_OFFSET(data_tail);
+
+    ring_copy(data, offset, &hdr, sizeof(hdr));
+    if (hdr.size < sizeof(hdr) || hdr.size > data_head - data_tail) {
+      break;
+    }
+
+    perf_record_t rec;
+    if (offset + hdr.size <= BUFFER_SIZE) {
+      // the common case: parse the record in place
+      rec.p = data + offset;
+    } else {
+      // the record wraps around the end of the buffer
+      if (wrap_buffer == NULL) {
+        wrap_buffer = hpcrun_malloc(BUFFER_SIZE);
+        if (wrap_buffer == NULL) break;
+      }
+      ring_copy(data, offset, wrap_buffer, hdr.size);
+      rec.p = wrap_buffer;
+    }
+    rec.end = rec.p + hdr.size;
+    rec.p += sizeof(hdr);
+
+    parse_record(&rec, &hdr, attr, mmap_info);
+    if (fn != NULL) {
+      fn(mmap_info, arg);
+    }
+
+    data_tail += hdr.size;
+    num_records++;
   }
 
-  // update tail after consuming a record
+  // update tail after consuming the records
   rmb();  // memory fence before writing data_tail
-  current_perf_mmap->data_tail += hdr.size;
+  current_perf_mmap->data_tail = data_tail;
 
-  return (data_tail-current_perf_mmap->data_tail);
+  return num_records;
+}
+
+
+//----------------------------------------------------------------------
+// Public Interfaces
+//----------------------------------------------------------------------
+
+
+//----------------------------------------------------------
+// read all the records in the mmap buffer, and call fn for
+// each one with its data in mmap_info.
+// returns the number of records read
+//----------------------------------------------------------
+int
+read_perf_buffer_batch(pe_mmap_t *current_perf_mmap,
+                       struct perf_event_attr *attr,
+                       perf_mmap_data_t *mmap_info,
+                       perf_record_fn_t fn, void *arg)
+{
+  return perf_drain(current_perf_mmap, attr, mmap_info, fn, arg, INT_MAX);
 }
 
 //----------------------------------------------------------
@@ -540,3 +617,243 @@ perf_mmap_init()
   tail_mask = PERF_TAIL_MASK(pagesize);
 }
 
+
+#if UNIT_TEST
+
+// set UNIT_TEST to 1 and build with the hpcrun include paths:
+//   cc -O2 -D_GNU_SOURCE -I... perf_mmap.c
+//
+// a synthetic producer writes perf records into a ring buffer the way
+// the kernel does: 8-byte aligned records, wrapping around the end of
+// the buffer, with data_head advanced after the data is written.  the
+// records are drained both one per data_tail update and in batches
+// with read_perf_buffer_batch, and every parsed record must match the
+// one that was written.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NUM_RECORDS    2000000
+#define MAX_RAW        200
+#define MAX_FRAMES     (MAX_CALLCHAIN_FRAMES + 8)
+
+#define TEST_SAMPLE_TYPE  (PERF_SAMPLE_IP | PERF_SAMPLE_TID | PERF_SAMPLE_TIME \
+                           | PERF_SAMPLE_PERIOD | PERF_SAMPLE_CALLCHAIN | PERF_SAMPLE_RAW)
+
+int
+debug_flag_get(dbg_category flag)
+{
+  return 0;
+}
+
+void
+hpcrun_pmsg(const char* tag, const char* fmt, ...)
+{
+}
+
+void
+hpcrun_emsg(const char* fmt, ...)
+{
+}
+
+void*
+hpcrun_malloc(size_t size)
+{
+  return malloc(size);
+}
+
+static pe_mmap_t *ring;
+static struct perf_event_attr attr;
+
+static u64 produced;      // records written
+static u64 consumed;      // records checked
+static u64 errors;
+
+static u64
+next_random(u64 *state)
+{
+  *state ^= *state << 13;
+  *state ^= *state >> 7;
+  *state ^= *state << 17;
+  return *state;
+}
+
+// the contents of record n are a function of n, so the consumer can
+// check them without keeping a copy
+static u32
+record_frames(u64 n)
+{
+  return (n * 7) % MAX_FRAMES;
+}
+
+static u32
+record_raw_size(u64 n)
+{
+  return (n * 13) % MAX_RAW;
+}
+
+static int
+record_is_switch(u64 n)
+{
+  return n % 5 == 3;
+}
+
+static size_t
+record_size(u64 n)
+{
+  size_t size = sizeof(pe_header_t);
+
+  if (record_is_switch(n)) {
+    // sample_id: tid and time
+    return size + 2 * sizeof(u32) + sizeof(u64);
+  }
+  size += 4 * sizeof(u64) + 2 * sizeof(u32);        // ip, tid, time, period, nr
+  size += record_frames(n) * sizeof(u64);
+  size += sizeof(u32) + record_raw_size(n);
+  return (size + 7) & ~((size_t) 7);
+}
+
+static void
+ring_put(u64 *head, const void *buf, size_t bytes)
+{
+  char *data = BUFFER_FRONT(ring);
+  size_t offset = BUFFER_OFFSET(*head);
+  size_t right = BUFFER_SIZE - offset;
+
+  if (bytes <= right) {
+    memcpy(data + offset, buf, bytes);
+  } else {
+    memcpy(data + offset, buf, right);
+    memcpy(data, (const char *) buf + right, bytes - right);
+  }
+  *head += bytes;
+}
+
+// write record n if it fits in the free space of the ring
+static int
+produce(u64 n)
+{
+  size_t size = record_size(n);
+  u64 head = ring->data_head;
+
+  if (head + size - ring->data_tail > BUFFER_SIZE) return 0;
+
+  pe_header_t hdr = { .misc = n & 0xff, .size = size };
+  u64 start = head;
+  u32 tid[2] = { n, n + 1 };
+  u64 time = n * 3;
+
+  if (record_is_switch(n)) {
+    hdr.type = PERF_RECORD_SWITCH;
+    ring_put(&head, &hdr, sizeof(hdr));
+    ring_put(&head, tid, sizeof(tid));
+    ring_put(&head, &time, sizeof(time));
+  } else {
+    hdr.type = PERF_RECORD_SAMPLE;
+    u64 ip = 0x400000 + n;
+    u64 period = n + 100;
+    u64 nr = record_frames(n);
+    u32 raw = record_raw_size(n);
+    char bytes[MAX_RAW];
+
+    ring_put(&head, &hdr, sizeof(hdr));
+    ring_put(&head, &ip, sizeof(ip));
+    ring_put(&head, tid, sizeof(tid));
+    ring_put(&head, &time, sizeof(time));
+    ring_put(&head, &period, sizeof(period));
+    ring_put(&head, &nr, sizeof(nr));
+    for (u64 k = 0; k < nr; k++) {
+      u64 frame = n + k;
+      ring_put(&head, &frame, sizeof(frame));
+    }
+    ring_put(&head, &raw, sizeof(raw));
+    memset(bytes, n & 0xff, raw);
+    ring_put(&head, bytes, raw);
+  }
+  head = start + size;
+
+  __atomic_store_n(&ring->data_head, head, __ATOMIC_RELEASE);
+  return 1;
+}
+
+static void
+check(perf_mmap_data_t *d, void *arg)
+{
+  u64 n = consumed++;
+  int bad = (d->header_misc != (n & 0xff)) || d->tid != n + 1 || d->time != n * 3;
+
+  if (record_is_switch(n)) {
+    bad |= d->header_type != PERF_RECORD_SWITCH;
+  } else {
+    u64 nr = record_frames(n);
+    if (nr > MAX_CALLCHAIN_FRAMES) nr = MAX_CALLCHAIN_FRAMES;
+
+    bad |= d->header_type != PERF_RECORD_SAMPLE || d->ip != 0x400000 + n
+      || d->period != n + 100 || d->nr != nr || d->size != record_raw_size(n);
+    for (u64 k = 0; k < d->nr; k++) {
+      bad |= d->ips[k] != n + k;
+    }
+    for (u32 k = 0; k < d->size; k++) {
+      bad |= (unsigned char) d->data[k] != (n & 0xff);
+    }
+  }
+  if (bad && errors++ < 10) {
+    fprintf(stderr, "record %lu: parsed incorrectly\n", (unsigned long) n);
+  }
+}
+
+static double
+run(int batch)
+{
+  perf_mmap_data_t mmap_data;
+  u64 state = 88172645463325252ULL;
+  struct timespec t0, t1;
+  double drain = 0;
+
+  ring->data_head = ring->data_tail = 0;
+  produced = consumed = 0;
+
+  while (consumed < NUM_RECORDS) {
+    // fill a random part of the free space, then drain
+    u64 burst = 1 + next_random(&state) % 64;
+    while (burst-- > 0 && produced < NUM_RECORDS && produce(produced)) {
+      produced++;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    if (batch) {
+      read_perf_buffer_batch(ring, &attr, &mmap_data, check, NULL);
+    } else {
+      while (ring->data_head != ring->data_tail) {
+        perf_drain(ring, &attr, &mmap_data, check, NULL, 1);
+      }
+    }
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    drain += (t1.tv_sec - t0.tv_sec) + 1e-9 * (t1.tv_nsec - t0.tv_nsec);
+  }
+  return drain;
+}
+
+int
+main(int argc, char **argv)
+{
+  perf_mmap_init();
+  ring = aligned_alloc(pagesize, PERF_MMAP_SIZE(pagesize));
+  memset(ring, 0, PERF_MMAP_SIZE(pagesize));
+
+  attr.sample_type = TEST_SAMPLE_TYPE;
+  attr.sample_id_all = 1;
+
+  double single = run(0);
+  double batch = run(1);
+
+  printf("%d records, ring of %ld bytes\n", NUM_RECORDS, (long) BUFFER_SIZE);
+  printf("one at a time: %.1f ns/record\n", 1e9 * single / NUM_RECORDS);
+  printf("batch:         %.1f ns/record\n", 1e9 * batch / NUM_RECORDS);
+  printf("%s: %lu errors\n", errors ? "FAIL" : "PASS", (unsigned long) errors);
+
+  return errors != 0;
+}
+
+#endif
@@ -64,6 +64,11 @@
 
 typedef struct perf_event_header pe_header_t;
 
+// called by read_perf_buffer_batch for each record.  pointers in
+// mmap_info into the record (the PERF_SAMPLE_RAW data, user registers
+// and user stack) are only valid until fn returns.
+typedef void (*perf_record_fn_t)(perf_mmap_data_t *mmap_info, void *arg);
+
 
 /******************************************************************************
  *  interfaces
@@ -74,9 +79,11 @@ void perf_mmap_init();
 pe_mmap_t* set_mmap(int perf_fd);
 void perf_unmmap(pe_mmap_t *mmap);
 
+// consume all the records in the buffer with one pair of memory fences
 int
-read_perf_buffer(pe_mmap_t *current_perf_mmap,
-    struct perf_event_attr *attr, perf_mmap_data_t *mmap_info);
+read_perf_buffer_batch(pe_mmap_t *current_perf_mmap,
+    struct perf_event_attr *attr, perf_mmap_data_t *mmap_info,
+    perf_record_fn_t fn, void *arg);
 
 
 #endif
@@ -0,0 +1,650 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+//
+// Deferred unwinding of perf samples from a copy of the user stack.
+//
+// Each sampled thread owns a queue of slots.  A slot moves from FREE
+// to CAPTURED in the owner's sample handler, from CAPTURED to BUSY and
+// then DONE in the helper thread, and from DONE back to FREE when the
+// owner records the call path in its CCT.  The owner captures and
+// records slots in order; the helper takes any CAPTURED slot.  When a
+// thread ends, it unwinds the slots the helper has not taken yet
+// itself.
+//
+// As for the unwind recipe prefetch thread, the helper is started
+// without libmonitor and only once the process is threaded, since it
+// needs thread data of its own.  Until then, and whenever a queue is
+// full, samples are unwound in the handler as usual.
+//
+// Unwinding and recording run with the handling sample flag set and a
+// jump buffer in place, so a fault in them drops the sample instead of
+// reaching the application.  The unwind of a slot may read any module,
+// so it also holds off unmaps until it is done.
+//
+// Deferral is off when the call path must be completed in the context
+// of the sample: with traces, trampolines, LUSH, or backtrace
+// finalizers such as OMPT's.
+//
+
+//******************************************************************************
+// system includes
+//******************************************************************************
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <setjmp.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+//******************************************************************************
+// local includes
+//******************************************************************************
+
+#include <include/hpctoolkit-config.h>
+
+#include <hpcrun/cct_backtrace_finalize.h>
+#include <hpcrun/cct_insert_backtrace.h>
+#include <hpcrun/env.h>
+#include <hpcrun/epoch.h>
+#include <hpcrun/frame.h>
+#include <hpcrun/handling_sample.h>
+#include <hpcrun/hpcrun_stats.h>
+#include <hpcrun/hpctoolkit.h>
+#include <hpcrun/sample_event.h>
+#include <hpcrun/sample_sources_all.h>
+#include <hpcrun/thread_data.h>
+#include <hpcrun/thread_use.h>
+#include <hpcrun/trace.h>
+#include <hpcrun/fnbounds/fnbounds_interface.h>
+#include <hpcrun/lush/lush-backtrace.h>
+#include <hpcrun/memory/mmap.h>
+#include <hpcrun/messages/messages.h>
+#include <hpcrun/sample-sources/blame-shift/blame-shift.h>
+#include <hpcrun/unwind/common/backtrace_info.h>
+#include <hpcrun/unwind/common/fence_enum.h>
+#include <hpcrun/unwind/common/unwind.h>
+#include <hpcrun/unwind/common/uw_recipe_map.h>
+#include <lib/prof-lean/stdatomic.h>
+
+#include "perf_ustack.h"
+
+// libmonitor functions
+#include <monitor.h>
+
+
+#if defined(HOST_CPU_x86_64)
+
+#include <asm/perf_regs.h>
+
+//******************************************************************************
+// macros
+//******************************************************************************
+
+#define USTACK_SLOTS      32
+#define USTACK_MAX_FRAMES 256
+
+// the kernel copies at most 64KB - 8 of the stack
+#define USTACK_MAX_SIZE   65528
+
+// registers sampled, in the order perf writes them
+#define USTACK_REGS ((1ULL << PERF_REG_X86_BP) | \
+                     (1ULL << PERF_REG_X86_SP) | \
+                     (1ULL << PERF_REG_X86_IP))
+#define USTACK_REG_BP 0
+#define USTACK_REG_SP 1
+#define USTACK_REG_IP 2
+
+// the helper is not a monitor thread and has no thread id of its own
+#define USTACK_THREAD_ID (-1)
+
+//******************************************************************************
+// types
+//******************************************************************************
+
+enum {
+  SLOT_FREE, SLOT_CAPTURED, SLOT_BUSY, SLOT_DONE
+};
+
+typedef struct ustack_slot_s {
+  atomic_int state;
+
+  int    metric_id;
+  double metric_incr;
+
+  hpcrun_unw_snapshot_t snap;
+
+  // kernel part of the call path
+  u64    nr;
+  u64    ips[MAX_CALLCHAIN_FRAMES];
+
+  // result of the unwind
+  int    fence;
+  int    nframes;
+  hpcrun_unw_snapshot_frame_t frames[USTACK_MAX_FRAMES];
+} ustack_slot_t;
+
+typedef struct ustack_queue_s {
+  struct ustack_queue_s *next;  // every queue ever allocated
+  atomic_bool in_use;
+
+  // owned by the sampled thread
+  unsigned int head;            // next slot to capture
+  unsigned int tail;            // next slot to record
+
+  ustack_slot_t slots[USTACK_SLOTS];
+} ustack_queue_t;
+
+//******************************************************************************
+// private data
+//******************************************************************************
+
+static size_t stack_size = 0;
+
+static _Atomic(ustack_queue_t *) queues = ATOMIC_VAR_INIT(NULL);
+
+static atomic_bool stop = ATOMIC_VAR_INIT(false);
+static atomic_bool started = ATOMIC_VAR_INIT(false);
+static atomic_bool running = ATOMIC_VAR_INIT(false);
+
+static sem_t work;
+
+static __thread ustack_queue_t *my_queue = NULL;
+
+//******************************************************************************
+// private operations
+//******************************************************************************
+
+// can a sample of this thread be completed outside its handler?
+static bool
+ustack_deferrable(void)
+{
+  return atomic_load_explicit(&running, memory_order_acquire)
+    && ! hpcrun_trace_isactive()
+    && ! hpcrun_isLogicalUnwind()
+    && ! ENABLED(USE_TRAMP)
+    && ! cct_backtrace_finalize_active();
+}
+
+
+// after a longjmp out of an unwind or record, as in sample_event.c
+static void
+ustack_fault_cleanup(thread_data_t *td)
+{
+  memset((void *) td->bad_unwind.jb, '\0', sizeof(td->bad_unwind.jb));
+  if (TD_GET(fnbounds_lock)) {
+    fnbounds_release_lock();
+  }
+}
+
+
+// runs on the helper or, at thread end, on the owner of the slot.  a
+// slot that faults is left with no frames and is dropped when recorded.
+static void
+ustack_unwind(ustack_slot_t *slot)
+{
+  thread_data_t *td = hpcrun_get_thread_data();
+  sigjmp_buf_t *it  = &td->bad_unwind;
+  sigjmp_buf_t *old = td->current_jmp_buf;
+
+  uw_recipe_map_detached_begin();
+
+  td->current_jmp_buf = it;
+  hpcrun_set_handling_sample(td);
+
+  if (sigsetjmp(it->jb, 1) == 0) {
+    slot->nframes = hpcrun_unw_snapshot(&slot->snap, slot->frames,
+					USTACK_MAX_FRAMES, &slot->fence);
+  } else {
+    TMSG(LINUX_PERF, "fault in user stack unwind, dropping sample");
+    ustack_fault_cleanup(td);
+    slot->nframes = 0;
+  }
+
+  hpcrun_clear_handling_sample(td);
+  td->current_jmp_buf = old;
+
+  uw_recipe_map_detached_end();
+}
+
+
+// take a captured slot and unwind it
+static bool
+ustack_try_unwind(ustack_slot_t *slot)
+{
+  int expected = SLOT_CAPTURED;
+  if (!atomic_compare_exchange_strong(&slot->state, &expected, SLOT_BUSY)) {
+    return false;
+  }
+  ustack_unwind(slot);
+  atomic_store_explicit(&slot->state, SLOT_DONE, memory_order_release);
+  return true;
+}
+
+
+// insert the call path of an unwound slot into the CCT of this thread
+static void
+ustack_record(ustack_slot_t *slot)
+{
+  thread_data_t *td = hpcrun_get_thread_data();
+  epoch_t *epoch = td->core_profile_trace_data.epoch;
+
+  if (epoch == NULL || slot->nframes == 0) {
+    hpcrun_stats_num_samples_dropped_inc();
+    return;
+  }
+
+  backtrace_info_t bt;
+  memset(&bt, 0, sizeof(bt));
+  bt.fence = slot->fence;
+  bt.partial_unwind = (slot->fence == FENCE_BAD);
+
+  if (bt.partial_unwind) {
+    if (ENABLED(NO_PARTIAL_UNW)) return;
+    hpcrun_stats_num_samples_partial_inc();
+  }
+
+  // called from the perf handler outside hpcrun_sample_callpath, so
+  // install a jump buffer of our own for a fault in the CCT insertion
+  sigjmp_buf_t *it  = &td->bad_unwind;
+  sigjmp_buf_t *old = td->current_jmp_buf;
+  td->current_jmp_buf = it;
+
+  hpcrun_set_handling_sample(td);
+
+  if (sigsetjmp(it->jb, 1) != 0) {
+    TMSG(LINUX_PERF, "fault recording a user stack sample, dropping it");
+    ustack_fault_cleanup(td);
+    hpcrun_stats_num_samples_dropped_inc();
+    hpcrun_clear_handling_sample(td);
+    td->current_jmp_buf = old;
+    return;
+  }
+
+  epoch = hpcrun_check_for_new_loadmap(epoch);
+
+  td->btbuf_cur = td->btbuf_beg;
+  for (int i = 0; i < slot->nframes; i++) {
+    hpcrun_ensure_btbuf_avail();
+    frame_t *frame = td->btbuf_cur++;
+    frame->as_info      = lush_assoc_info_NULL;
+    frame->ip_norm      = slot->frames[i].ip_norm;
+    frame->the_function = slot->frames[i].the_function;
+    frame->ra_loc       = NULL;
+    frame->lip          = NULL;
+  }
+  bt.begin = td->btbuf_beg;
+  bt.last  = td->btbuf_cur - 1;
+
+  // only the kernel call chain is read by perf_add_kernel_callchain
+  perf_mmap_data_t kernel_data;
+  kernel_data.nr = slot->nr;
+  memcpy(kernel_data.ips, slot->ips, slot->nr * sizeof(u64));
+
+  cct_node_t *node =
+    hpcrun_cct_record_backtrace_w_metric(&epoch->csdata, bt.partial_unwind,
+					 &bt, false, slot->metric_id,
+					 (hpcrun_metricVal_t) {.r = slot->metric_incr},
+					 &kernel_data);
+  hpcrun_stats_frames_total_inc(slot->nframes);
+
+  memset((void *) it->jb, '\0', sizeof(it->jb));
+  hpcrun_clear_handling_sample(td);
+  td->current_jmp_buf = old;
+
+  blame_shift_apply(slot->metric_id, node, slot->metric_incr);
+}
+
+
+static void
+ustack_unwind_pending(void)
+{
+  bool found;
+  do {
+    found = false;
+    ustack_queue_t *q;
+    for (q = atomic_load(&queues); q; q = q->next) {
+      for (int i = 0; i < USTACK_SLOTS; i++) {
+	if (atomic_load_explicit(&stop, memory_order_acquire)) return;
+	found |= ustack_try_unwind(&q->slots[i]);
+      }
+    }
+  } while (found);
+}
+
+
+static void *
+ustack_thread(void *arg)
+{
+  // the helper never takes samples.  faults stay unblocked so that the
+  // segv handler can drop a slot whose unwind faults.
+  sigset_t mask;
+  sigfillset(&mask);
+  sigdelset(&mask, SIGSEGV);
+  sigdelset(&mask, SIGBUS);
+  sigdelset(&mask, SIGILL);
+  sigdelset(&mask, SIGFPE);
+  monitor_real_pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+  thread_data_t *td = hpcrun_allocate_thread_data(USTACK_THREAD_ID);
+  hpcrun_set_thread_data(td);
+  hpcrun_thread_data_init(USTACK_THREAD_ID, NULL, 0,
+			  hpcrun_get_num_sample_sources());
+
+  TMSG(LINUX_PERF, "user stack unwind thread started");
+
+  while (!atomic_load_explicit(&stop, memory_order_acquire)) {
+    while (sem_wait(&work) != 0 && errno == EINTR);
+    ustack_unwind_pending();
+  }
+  atomic_store(&running, false);
+
+  return NULL;
+}
+
+
+// called outside a sample handler, with the process threaded
+static void
+ustack_thread_start(void)
+{
+  int expected = false;  // atomic_bool holds an int
+  if (!atomic_compare_exchange_strong(&started, &expected, true)) return;
+
+  pthread_t helper;
+
+  // Create the helper without libmonitor watching
+  monitor_disable_new_threads();
+  int ret = pthread_create(&helper, NULL, ustack_thread, NULL);
+  monitor_enable_new_threads();
+
+  if (ret == 0) {
+    pthread_detach(helper);
+    atomic_store_explicit(&running, true, memory_order_release);
+  } else {
+    EMSG("unable to start user stack unwind thread");
+  }
+}
+
+
+static ustack_queue_t *
+ustack_queue_acquire(void)
+{
+  ustack_queue_t *q;
+  for (q = atomic_load(&queues); q; q = q->next) {
+    int expected = false;  // atomic_bool holds an int
+    if (atomic_compare_exchange_strong(&q->in_use, &expected, true)) return q;
+  }
+
+  size_t size = sizeof(ustack_queue_t) + USTACK_SLOTS * stack_size;
+  q = hpcrun_mmap_anon(size);
+  if (q == NULL) return NULL;
+
+  char *stacks = (char *) (q + 1);
+  for (int i = 0; i < USTACK_SLOTS; i++) {
+    atomic_init(&q->slots[i].state, SLOT_FREE);
+    q->slots[i].snap.stack = stacks + i * stack_size;
+  }
+  q->head = q->tail = 0;
+  atomic_init(&q->in_use, true);
+
+  q->next = atomic_load(&queues);
+  while (!atomic_compare_exchange_weak(&queues, &q->next, q));
+
+  return q;
+}
+
+//******************************************************************************
+// interface operations
+//******************************************************************************
+
+bool
+perf_ustack_init(void)
+{
+  const char *env = getenv(HPCRUN_PERF_USER_STACK);
+  stack_size = 0;
+
+  if (env == NULL || *env == '\0') return false;
+
+  long size = strtol(env, NULL, 10);
+  if (size <= 0) return false;
+
+  // the kernel wants a multiple of 8
+  if (size > USTACK_MAX_SIZE) size = USTACK_MAX_SIZE;
+  stack_size = (size + 7) & ~7L;
+
+  sem_init(&work, 0, 0);
+  TMSG(LINUX_PERF, "deferred unwinding with %ld bytes of user stack", stack_size);
+
+  return true;
+}
+
+
+void
+perf_ustack_attr_init(struct perf_event_attr *attr)
+{
+  if (stack_size == 0) return;
+
+  attr->sample_type      |= PERF_SAMPLE_REGS_USER | PERF_SAMPLE_STACK_USER;
+  attr->sample_regs_user  = USTACK_REGS;
+  attr->sample_stack_user = stack_size;
+}
+
+
+void
+perf_ustack_thread_init(void)
+{
+  if (stack_size == 0) return;
+
+  if (my_queue == NULL) {
+    my_queue = ustack_queue_acquire();
+  }
+  if (hpcrun_using_threads_p()) {
+    ustack_thread_start();
+  }
+}
+
+
+bool
+perf_ustack_defer(perf_mmap_data_t *mmap_data, int metric_id,
+		  double metric_incr)
+{
+  ustack_queue_t *q = my_queue;
+
+  if (q == NULL ||
+      mmap_data->abi != PERF_SAMPLE_REGS_ABI_64 ||
+      mmap_data->regs == NULL ||
+      mmap_data->stack_dyn_size == 0) {
+    return false;
+  }
+
+  // let hpcrun_sample_callpath handle suspended sampling
+  if (! hpctoolkit_sampling_is_active() || hpcrun_is_sampling_disabled() ||
+      ! ustack_deferrable()) {
+    return false;
+  }
+
+  ustack_slot_t *slot = &q->slots[q->head % USTACK_SLOTS];
+  if (atomic_load_explicit(&slot->state, memory_order_acquire) != SLOT_FREE) {
+    return false;
+  }
+
+  size_t size = mmap_data->stack_dyn_size;
+  if (size > stack_size) size = stack_size;
+
+  slot->snap.pc = (void *) mmap_data->regs[USTACK_REG_IP];
+  slot->snap.sp = (void *) mmap_data->regs[USTACK_REG_SP];
+  slot->snap.bp = (void *) mmap_data->regs[USTACK_REG_BP];
+  slot->snap.stack_size = size;
+  memcpy((char *) slot->snap.stack, mmap_data->stack_data, size);
+
+  slot->nr = mmap_data->nr;
+  memcpy(slot->ips, mmap_data->ips, mmap_data->nr * sizeof(u64));
+
+  slot->metric_id   = metric_id;
+  slot->metric_incr = metric_incr;
+
+  atomic_store_explicit(&slot->state, SLOT_CAPTURED, memory_order_release);
+  q->head++;
+
+  hpcrun_stats_num_samples_total_inc();
+  hpcrun_stats_num_samples_attempted_inc();
+
+  sem_post(&work);
+
+  return true;
+}
+
+
+void
+perf_ustack_drain(void)
+{
+  ustack_queue_t *q = my_queue;
+  if (q == NULL) return;
+
+  while (q->tail != q->head) {
+    ustack_slot_t *slot = &q->slots[q->tail % USTACK_SLOTS];
+    if (atomic_load_explicit(&slot->state, memory_order_acquire) != SLOT_DONE) {
+      break;
+    }
+    ustack_record(slot);
+    atomic_store_explicit(&slot->state, SLOT_FREE, memory_order_release);
+    q->tail++;
+  }
+}
+
+
+void
+perf_ustack_thread_fini(void)
+{
+  ustack_queue_t *q = my_queue;
+  if (q == NULL) return;
+
+  unsigned int i;
+  for (i = q->tail; i != q->head; i++) {
+    ustack_slot_t *slot = &q->slots[i % USTACK_SLOTS];
+    ustack_try_unwind(slot);
+
+    // wait for the helper if it has the slot
+    while (atomic_load_explicit(&slot->state, memory_order_acquire) != SLOT_DONE);
+  }
+  perf_ustack_drain();
+
+  my_queue = NULL;
+  atomic_store(&q->in_use, false);
+}
+
+
+void
+perf_ustack_fini(void)
+{
+  if (stack_size == 0) return;
+
+  atomic_store(&stop, true);
+  if (atomic_exchange(&running, false)) {
+    sem_post(&work);
+  }
+}
+
+#else
+
+//******************************************************************************
+// interface operations: the unwind recipes for copies of the stack
+// exist only on x86-64
+//******************************************************************************
+
+bool
+perf_ustack_init(void)
+{
+  const char *env = getenv(HPCRUN_PERF_USER_STACK);
+  if (env != NULL && atol(env) > 0) {
+    EMSG("HPCRUN_PERF_USER_STACK is not supported on this architecture");
+  }
+  return false;
+}
+
+
+void
+perf_ustack_attr_init(struct perf_event_attr *attr)
+{
+}
+
+
+void
+perf_ustack_thread_init(void)
+{
+}
+
+
+void
+perf_ustack_thread_fini(void)
+{
+}
+
+
+void
+perf_ustack_fini(void)
+{
+}
+
+
+bool
+perf_ustack_defer(perf_mmap_data_t *mmap_data, int metric_id,
+		  double metric_incr)
+{
+  return false;
+}
+
+
+void
+perf_ustack_drain(void)
+{
+}
+
+#endif
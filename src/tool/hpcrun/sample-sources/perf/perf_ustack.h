@@ -0,0 +1,89 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+#ifndef __PERF_USTACK_H__
+#define __PERF_USTACK_H__
+
+//
+// Deferred unwinding of perf samples from a copy of the user stack.
+//
+// With HPCRUN_PERF_USER_STACK set to a number of bytes, perf events
+// also sample the user registers and that many bytes of the user
+// stack.  The signal handler only copies them into a per-thread queue,
+// and a helper thread unwinds the copies.  The sampled thread inserts
+// the unwound call paths into its own CCT on its next sample, so that
+// the CCT keeps a single writer.
+//
+
+#include <stdbool.h>
+#include <linux/perf_event.h>
+
+#include "perf-util.h"    // u64, u32 and perf_mmap_data_t
+
+// process initialization; returns true if deferred unwinding is enabled
+bool perf_ustack_init(void);
+
+// ask an event for the user registers and stack
+void perf_ustack_attr_init(struct perf_event_attr *attr);
+
+// thread initialization and finalization, outside a sample handler.
+// finalization records all the samples of the thread.
+void perf_ustack_thread_init(void);
+void perf_ustack_thread_fini(void);
+
+// stop the helper thread at process end
+void perf_ustack_fini(void);
+
+// in the sample handler: queue a sample for deferred unwinding.  if it
+// returns false, the caller must record the sample itself.
+bool perf_ustack_defer(perf_mmap_data_t *mmap_data, int metric_id,
+		       double metric_incr);
+
+// in the sample handler: record the samples that have been unwound
+void perf_ustack_drain(void);
+
+#endif
@@ -357,6 +357,8 @@ hpcrun_thread_data_init(int id, cct_ctxt_t* thr_ctxt, int is_child, size_t n_sou
 
   td->uw_hash_table = uw_hash_new(1023, hpcrun_malloc);
 
+  hpcrun_bt_memo_init(&td->bt_memo);
+
   // ----------------------------------------
   // trampoline
   // ----------------------------------------
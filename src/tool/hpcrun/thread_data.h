@@ -68,6 +68,7 @@
 #include <lush/lush-pthread.i>
 #include <unwind/common/backtrace.h>
 #include <unwind/common/uw_hash.h>
+#include <unwind/common/bt_memo.h>
 
 #include <lib/prof-lean/hpcio.h>
 #include <lib/prof-lean/hpcio-buffer.h>
@@ -228,6 +229,8 @@ typedef struct thread_data_t {
   backtrace_t bt;     // backtrace used for unwinding
   uw_hash_table_t *uw_hash_table;
 
+  bt_memo_t bt_memo;  // last complete backtrace, for reuse by the next one
+
   // ----------------------------------------
   // trampoline
   // ----------------------------------------
@@ -48,6 +48,7 @@
 // global includes 
 //*********************************************************************
 
+#include <pthread.h>
 #include <stdio.h>
 #include <sys/time.h>
 #include <assert.h>
@@ -90,6 +91,8 @@
 //*********************************************************************
 
 static void hpcrun_trace_file_validate(int valid, char *op);
+static hpctrace_hdr_flags_t hpcrun_trace_hdr_flags(void);
+static void hpcrun_trace_async_start(void);
 static inline void hpcrun_trace_append_with_time_real(core_profile_trace_data_t *cptd, unsigned int call_path_id, uint metric_id, uint32_t dLCA, uint64_t nanotime);
 
 
@@ -99,6 +102,11 @@ static inline void hpcrun_trace_append_with_time_real(core_profile_trace_data_t
 
 static int tracing = 0;
 
+static int trace_async = 0;
+
+// header flags are fixed at build time; compute them once
+static hpctrace_hdr_flags_t trace_flags;
+
 //*********************************************************************
 // interface operations
 //*********************************************************************
@@ -117,6 +125,13 @@ hpcrun_trace_init()
       tracing = 1;
       TMSG(TRACE, "Tracing is ON");
   }
+
+  trace_flags = hpcrun_trace_hdr_flags();
+
+  if (tracing && getenv(HPCRUN_TRACE_ASYNC)) {
+    // in a forked child, this starts a new writer for the child
+    hpcrun_trace_async_start();
+  }
 }
 
 
@@ -142,26 +157,16 @@ hpcrun_trace_open(core_profile_trace_data_t * cptd)
     fd = hpcrun_open_trace_file(cptd->id);
     hpcrun_trace_file_validate(fd >= 0, "open");
     cptd->trace_buffer = hpcrun_malloc(HPCRUN_TraceBufferSz);
+    int flags = HPCIO_OUTBUF_UNLOCKED | (trace_async ? HPCIO_OUTBUF_ASYNC : 0);
     ret = hpcio_outbuf_attach(&cptd->trace_outbuf, fd, cptd->trace_buffer,
-			      HPCRUN_TraceBufferSz, HPCIO_OUTBUF_UNLOCKED,
-                              hpcrun_malloc);
+			      HPCRUN_TraceBufferSz, flags, hpcrun_malloc);
     hpcrun_trace_file_validate(ret == HPCFMT_OK, "open");
 
-    hpctrace_hdr_flags_t flags = hpctrace_hdr_flags_NULL;
-#ifdef DATACENTRIC_TRACE
-    HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_DATA_CENTRIC_BIT_POS, true);
-#else
-    HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_DATA_CENTRIC_BIT_POS, false);
-#endif
-
 #if defined(LCA_TRACE) && (defined (HOST_CPU_x86_64) || defined (HOST_CPU_PPC))
-    HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_LCA_RECORDED_BIT_POS, true);
     ENABLE(USE_TRAMP);
-#else
-    HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_LCA_RECORDED_BIT_POS, false);
 #endif
     
-    ret = hpctrace_fmt_hdr_outbuf(flags, cptd->trace_outbuf);
+    ret = hpctrace_fmt_hdr_outbuf(trace_flags, cptd->trace_outbuf);
     hpcrun_trace_file_validate(ret == HPCFMT_OK, "write header to");
   }
   TMSG(TRACE, "Trace open done");
@@ -263,21 +268,55 @@ static inline void hpcrun_trace_append_with_time_real(core_profile_trace_data_t
     trace_datum.comp = nanotime;
 #endif
     
-    hpctrace_hdr_flags_t flags = hpctrace_hdr_flags_NULL;
+    int ret = hpctrace_fmt_datum_outbuf(&trace_datum, trace_flags, 
+					cptd->trace_outbuf);
+    hpcrun_trace_file_validate(ret == HPCFMT_OK, "append");
+}
+
+
+static hpctrace_hdr_flags_t
+hpcrun_trace_hdr_flags(void)
+{
+  hpctrace_hdr_flags_t flags = hpctrace_hdr_flags_NULL;
 #ifdef DATACENTRIC_TRACE
-    HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_DATA_CENTRIC_BIT_POS, true);
+  HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_DATA_CENTRIC_BIT_POS, true);
 #else
-    HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_DATA_CENTRIC_BIT_POS, false);
+  HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_DATA_CENTRIC_BIT_POS, false);
 #endif
-    
+
 #if defined(LCA_TRACE) && (defined (HOST_CPU_x86_64) || defined (HOST_CPU_PPC))
-    HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_LCA_RECORDED_BIT_POS, true);
+  HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_LCA_RECORDED_BIT_POS, true);
 #else
-    HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_LCA_RECORDED_BIT_POS, false);
+  HPCTRACE_HDR_FLAGS_SET_BIT(flags, HPCTRACE_HDR_FLAGS_LCA_RECORDED_BIT_POS, false);
 #endif
-    
-    int ret = hpctrace_fmt_datum_outbuf(&trace_datum, flags, cptd->trace_outbuf);
-    hpcrun_trace_file_validate(ret == HPCFMT_OK, "append");
+
+  return flags;
+}
+
+
+// start the thread that writes full trace buffers, so that sampled
+// threads hand off buffers instead of calling write() in the handler.
+static void
+hpcrun_trace_async_start(void)
+{
+  pthread_t writer;
+  int ret = -1;
+
+  if (hpcio_outbuf_async_init() == HPCFMT_OK) {
+    // Create the writer without libmonitor watching
+    monitor_disable_new_threads();
+    ret = pthread_create(&writer, NULL, hpcio_outbuf_async_writer, NULL);
+    monitor_enable_new_threads();
+  }
+
+  if (ret == 0) {
+    pthread_detach(writer);
+    trace_async = 1;
+    TMSG(TRACE, "Asynchronous trace writer started");
+  } else {
+    trace_async = 0;
+    EMSG("unable to start asynchronous trace writer, using synchronous writes");
+  }
 }
 
 
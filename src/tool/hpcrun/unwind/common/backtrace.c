@@ -71,6 +71,7 @@
 #include <trampoline/common/trampoline.h>
 #include <dbg_backtrace.h>
 #include "backtrace_info.h"
+#include "bt_memo.h"
 #include "../../thread_data.h"
 
 extern bool hpcrun_get_retain_recursion_mode();
@@ -189,6 +190,8 @@ hpcrun_generate_backtrace_no_trampoline(backtrace_info_t* bt,
   bt->fence = FENCE_BAD;
   bt->bottom_frame_elided = false;
   bt->partial_unwind = true;
+  bt->memo_frame = NULL;
+  bt->memoized = false;
 
   step_state ret = STEP_ERROR; // default return value from stepper
 
@@ -206,6 +209,12 @@ hpcrun_generate_backtrace_no_trampoline(backtrace_info_t* bt,
   hpcrun_unw_cursor_t cursor;
   hpcrun_unw_init_cursor(&cursor, context);
 
+  // the backtrace memo and the trampoline both short-circuit unwinds;
+  // only one of them is used
+  bool use_memo = hpcrun_bt_memo_enabled() && ! ENABLED(USE_TRAMP);
+  frame_t* memo_scan = td->bt_memo.frame_beg;
+  frame_t* memo_hit = NULL;
+
   int steps_taken = 0;
   do {
     void* ip;
@@ -238,6 +247,16 @@ hpcrun_generate_backtrace_no_trampoline(backtrace_info_t* bt,
 	break;
       }
     }
+
+    if (use_memo && td->btbuf_cur > td->btbuf_beg) {
+      memo_hit = hpcrun_bt_memo_lookup(&td->bt_memo, &cursor, &memo_scan);
+      if (memo_hit) {
+	// no need to unwind further. the outer frames are in the memo.
+	bt->fence = td->bt_memo.fence;
+	ret = STEP_STOP;
+	break;
+      }
+    }
     
     hpcrun_ensure_btbuf_avail();
 
@@ -274,6 +293,24 @@ hpcrun_generate_backtrace_no_trampoline(backtrace_info_t* bt,
   frame_t* bt_beg  = td->btbuf_beg;      // innermost, inclusive
   frame_t* bt_last = td->btbuf_cur - 1; // outermost, inclusive
 
+  if (use_memo && ret == STEP_STOP) {
+    // complete backtraces are assembled in the memo buffer, in front of
+    // the reused memo frames, if any
+    frame_t* first = hpcrun_bt_memo_splice(&td->bt_memo, td->btbuf_beg,
+					   td->btbuf_cur, &memo_hit);
+    if (first) {
+      bt_beg  = first;
+      bt_last = td->bt_memo.buf_end - 1;
+      bt->memo_frame = memo_hit;
+      bt->memoized = true;
+    }
+    else if (memo_hit) {
+      // out of memory: the outer frames are lost
+      hpcrun_stats_num_samples_dropped_inc();
+      ret = STEP_ERROR;
+    }
+  }
+
   if (skipInner) {
     if (ENABLED(USE_TRAMP)){
       //
@@ -26,6 +26,8 @@ typedef struct {
   bool     bottom_frame_elided:1; // true if bottom frame has been elided 
   bool     partial_unwind:1; // true if not a full unwind
   bool     collapsed:1; // callstack collapsed by hpctoolkit, e.g. OpenMP placeholders 
+  bool     memoized:1; // true when the frames are in the backtrace memo buffer
+  frame_t* memo_frame; // innermost frame reused from the backtrace memo, if any
   void    *trace_pc;  // in/out value: modified to adjust trace when modifying backtrace
 } backtrace_info_t;
 
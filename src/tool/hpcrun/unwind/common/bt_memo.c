@@ -0,0 +1,374 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+//***************************************************************************
+// system include files
+//***************************************************************************
+
+#include <stdint.h>
+#include <string.h>
+
+//***************************************************************************
+// local include files
+//***************************************************************************
+
+#include <memory/hpcrun-malloc.h>
+#include <messages/messages.h>
+
+#include "bt_memo.h"
+#include "../../thread_data.h"
+
+//***************************************************************************
+// local constants & macros
+//***************************************************************************
+
+#define UNIT_TEST 0
+
+#define BT_MEMO_INIT_SZ 128
+
+//***************************************************************************
+// local variables
+//***************************************************************************
+
+static bool bt_memo_enabled = false;
+
+//***************************************************************************
+// interface functions
+//***************************************************************************
+
+void
+hpcrun_bt_memo_set_enabled(bool enabled)
+{
+  TMSG(BT_MEMO, "backtrace memo %s", enabled ? "enabled" : "disabled");
+  bt_memo_enabled = enabled;
+}
+
+
+bool
+hpcrun_bt_memo_enabled(void)
+{
+  return bt_memo_enabled;
+}
+
+
+void
+hpcrun_bt_memo_init(bt_memo_t* memo)
+{
+  // buffers are allocated at the first splice
+  memset(memo, 0, sizeof(*memo));
+}
+
+
+void
+hpcrun_bt_memo_invalidate(void)
+{
+  thread_data_t* td = hpcrun_get_thread_data();
+  td->bt_memo.valid = false;
+}
+
+
+frame_t*
+hpcrun_bt_memo_lookup(bt_memo_t* memo, hpcrun_unw_cursor_t* cursor,
+		      frame_t** scan)
+{
+  if (! memo->valid) return NULL;
+
+  // memoized frames are ordered by increasing sp, as are the frames of
+  // an unwind, so the scan never moves back
+  void* sp = cursor->sp;
+  frame_t* f = *scan;
+  while (f < memo->buf_end && (uintptr_t) f->cursor.sp < (uintptr_t) sp) f++;
+  *scan = f;
+
+  for (; f < memo->buf_end && f->cursor.sp == sp; f++) {
+    // the innermost memoized frame was interrupted, not calling
+    if (f == memo->frame_beg) continue;
+    if (f->cursor.pc_unnorm != cursor->pc_unnorm) continue;
+
+    frame_t* g;
+    for (g = f; g < memo->buf_end - 1; g++) {
+      void** ra_loc = (void**) g->ra_loc;
+      if (ra_loc == NULL || (uintptr_t) ra_loc < (uintptr_t) sp
+	  || *ra_loc != (g + 1)->cursor.pc_unnorm) break;
+    }
+    if (g == memo->buf_end - 1) {
+      TMSG(BT_MEMO, "hit at sp = %p, pc = %p, reusing %d frames",
+	   sp, cursor->pc_unnorm, (int) (memo->buf_end - f));
+      return f;
+    }
+
+    // the return address into g + 1 changed, so no frame inside g + 1
+    // can be reused either
+    *scan = g + 1;
+    return NULL;
+  }
+  return NULL;
+}
+
+
+frame_t*
+hpcrun_bt_memo_splice(bt_memo_t* memo, frame_t* beg, frame_t* end,
+		      frame_t** hit)
+{
+  memo->valid = false;
+
+  frame_t* outer = (hit && *hit) ? *hit : memo->buf_end;
+  size_t n_new = end - beg;
+  size_t n_old = memo->buf_end - outer;
+
+  if (memo->buf_beg == NULL || (size_t) (outer - memo->buf_beg) < n_new) {
+    size_t size = 2 * (n_new + n_old);
+    if (size < BT_MEMO_INIT_SZ) size = BT_MEMO_INIT_SZ;
+
+    // like the cached backtrace of the trampoline, an outgrown buffer
+    // is not reclaimed
+    frame_t* buf = hpcrun_malloc(size * sizeof(frame_t));
+    cct_node_t** nodes = hpcrun_malloc(size * sizeof(cct_node_t*));
+    if (buf == NULL || nodes == NULL) return NULL;
+
+    if (n_old > 0) {
+      memcpy(buf + size - n_old, outer, n_old * sizeof(frame_t));
+      memcpy(nodes + size - n_old, hpcrun_bt_memo_nodes(memo, outer),
+	     n_old * sizeof(cct_node_t*));
+    }
+    memo->buf_beg = buf;
+    memo->buf_end = buf + size;
+    memo->nodes = nodes;
+    memo->frame_beg = memo->buf_end;
+
+    outer = memo->buf_end - n_old;
+    if (hit && *hit) *hit = outer;
+  }
+
+  frame_t* first = outer - n_new;
+  memcpy(first, beg, n_new * sizeof(frame_t));
+  return first;
+}
+
+
+void
+hpcrun_bt_memo_commit(bt_memo_t* memo, frame_t* begin,
+		      cct_node_t* root, fence_enum_t fence)
+{
+  memo->frame_beg = begin;
+  memo->root = root;
+  memo->fence = fence;
+  memo->valid = true;
+}
+
+
+
+//***************************************************************************
+// unit test
+//***************************************************************************
+
+#if UNIT_TEST
+
+// set UNIT_TEST to 1 and build with the hpcrun include paths:
+//   cc -O2 -D_GNU_SOURCE -I... bt_memo.c
+//
+// a synthetic recursive program keeps a stack of call sites in memory,
+// the way a real stack holds return addresses.  between samples it
+// returns from and makes recursive calls at random, sometimes deep
+// enough to replace frames near main with frames from other call
+// sites.  each sample is unwound twice: in full, and the way
+// hpcrun_generate_backtrace does with the memo.  both must agree.
+
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define FRAME_WORDS 4
+#define MAX_DEPTH   4096
+#define NUM_SAMPLES 200000
+
+static void* stack[(MAX_DEPTH + 1) * FRAME_WORDS];
+static int   depth;
+
+static frame_t truth[MAX_DEPTH];
+static frame_t fresh[MAX_DEPTH];
+
+static thread_data_t test_td;
+
+static thread_data_t*
+test_get_thread_data(void)
+{
+  return &test_td;
+}
+
+thread_data_t* (*hpcrun_get_thread_data)(void) = test_get_thread_data;
+
+int
+debug_flag_get(dbg_category flag)
+{
+  return 0;
+}
+
+void
+hpcrun_pmsg(const char* tag, const char* fmt, ...)
+{
+}
+
+void*
+hpcrun_malloc(size_t size)
+{
+  return malloc(size);
+}
+
+// frame k (0 = main) occupies words [sp_k, sp_k + FRAME_WORDS); the
+// word at sp_k + FRAME_WORDS - 1 holds the return address into k - 1
+static void**
+frame_sp(int k)
+{
+  return &stack[(MAX_DEPTH - k) * FRAME_WORDS];
+}
+
+static void*
+call_site(void)
+{
+  return (void*) (uintptr_t) (0x1000 + 0x10 * (rand() % 3));
+}
+
+static void
+push_frame(void)
+{
+  frame_sp(depth)[FRAME_WORDS - 1] = call_site();
+  depth++;
+}
+
+// unwind the synthetic stack, innermost frame first
+static int
+unwind(frame_t* out, void* pc, int limit)
+{
+  int n = 0;
+  for (int k = depth - 1; k >= 0 && n < limit; k--, n++) {
+    memset(&out[n], 0, sizeof(frame_t));
+    out[n].cursor.sp = frame_sp(k);
+    out[n].cursor.pc_unnorm = pc;
+    out[n].ra_loc = (k > 0) ? &frame_sp(k)[FRAME_WORDS - 1] : NULL;
+    pc = (k > 0) ? frame_sp(k)[FRAME_WORDS - 1] : NULL;
+  }
+  return n;
+}
+
+static double
+elapsed(struct timespec* t0, struct timespec* t1)
+{
+  return (t1->tv_sec - t0->tv_sec) + 1e-9 * (t1->tv_nsec - t0->tv_nsec);
+}
+
+int
+main(int argc, char** argv)
+{
+  int max = (argc > 1) ? atoi(argv[1]) : 1000;
+  if (max < 4 || max > MAX_DEPTH) max = 1000;
+
+  bt_memo_t* memo = &test_td.bt_memo;
+  hpcrun_bt_memo_init(memo);
+  srand(1);
+
+  for (depth = 0; depth < max / 2; ) push_frame();
+
+  long frames_total = 0, frames_unwound = 0, hits = 0;
+  struct timespec t0, t1;
+  double t_full = 0, t_memo = 0;
+
+  for (int i = 0; i < NUM_SAMPLES; i++) {
+    // run the program: mostly shallow returns and calls, rarely a
+    // return most of the way to main
+    int r = rand() % 1000;
+    int pops = (r == 0) ? depth - 1 : rand() % 8;
+    int pushes = rand() % 8;
+    for (; pops > 0 && depth > 1; pops--) depth--;
+    for (; pushes > 0 && depth < max; pushes--) push_frame();
+
+    void* pc = (void*) (uintptr_t) (0x5000 + rand() % 64);
+
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    int n = unwind(truth, pc, MAX_DEPTH);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    t_full += elapsed(&t0, &t1);
+
+    // unwind with the memo, as in hpcrun_generate_backtrace
+    clock_gettime(CLOCK_MONOTONIC, &t0);
+    frame_t* scan = memo->frame_beg;
+    frame_t* hit = NULL;
+    int k;
+    for (k = 0; k < n; k++) {
+      if (k > 0) {
+	hit = hpcrun_bt_memo_lookup(memo, &truth[k].cursor, &scan);
+	if (hit) break;
+      }
+      fresh[k] = truth[k];
+    }
+    frame_t* first = hpcrun_bt_memo_splice(memo, fresh, fresh + k, &hit);
+    hpcrun_bt_memo_commit(memo, first, NULL, FENCE_MAIN);
+    clock_gettime(CLOCK_MONOTONIC, &t1);
+    t_memo += elapsed(&t0, &t1);
+
+    assert(memo->buf_end - first == n);
+    for (int j = 0; j < n; j++) {
+      assert(first[j].cursor.sp == truth[j].cursor.sp);
+      assert(first[j].cursor.pc_unnorm == truth[j].cursor.pc_unnorm);
+    }
+
+    frames_total += n;
+    frames_unwound += k;
+    if (hit) hits++;
+  }
+
+  printf("max depth %d, %d samples: %ld memo hits, "
+	 "%ld of %ld frames unwound (%.1f%%)\n",
+	 max, NUM_SAMPLES, hits, frames_unwound, frames_total,
+	 100.0 * frames_unwound / frames_total);
+  printf("array walk: %.0f ns/sample, memo lookup and splice: %.0f ns/sample\n",
+	 1e9 * t_full / NUM_SAMPLES, 1e9 * t_memo / NUM_SAMPLES);
+  return 0;
+}
+
+#endif
@@ -0,0 +1,144 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+#ifndef hpcrun_bt_memo_h
+#define hpcrun_bt_memo_h
+
+//***************************************************************************
+// file: bt_memo.h
+//
+// purpose:
+//     a per-thread memo of the last complete backtrace and the cct node
+//     that each of its frames was inserted at.  a later unwind that
+//     reaches a frame of the memo (same sp and pc) whose outer frames
+//     are unchanged stops there; the outer frames are reused and cct
+//     insertion resumes below the memoized node.
+//
+//     the outer frames are unchanged if every return address slot
+//     (ra_loc) recorded for them still holds the return address into
+//     the next outer frame.  unwinders that do not record ra_loc never
+//     get a memo hit.
+//
+//***************************************************************************
+
+//***************************************************************************
+// system include files
+//***************************************************************************
+
+#include <stdbool.h>
+
+//***************************************************************************
+// local include files
+//***************************************************************************
+
+#include <cct/cct.h>
+#include <hpcrun/frame.h>
+#include <unwind/common/fence_enum.h>
+
+//***************************************************************************
+// types
+//***************************************************************************
+
+//
+// memoized frames sit at the end of the buffer, innermost first.  a
+// new backtrace that reuses frame_beg..buf_end puts its own (inner)
+// frames directly in front of them, so a memo hit copies only the new
+// frames.
+//
+typedef struct bt_memo_t {
+  frame_t*     buf_beg;   // beginning of the memo buffer
+  frame_t*     buf_end;   // end of the memo buffer & of memoized frames
+  frame_t*     frame_beg; // innermost memoized frame
+  cct_node_t** nodes;     // nodes[f - buf_beg]: cct node after inserting f
+  cct_node_t*  root;      // cct node the memoized backtrace was inserted at
+  fence_enum_t fence;     // fence that stopped the memoized unwind
+  bool         valid;
+} bt_memo_t;
+
+//***************************************************************************
+// interface functions
+//***************************************************************************
+
+void hpcrun_bt_memo_set_enabled(bool enabled);
+
+bool hpcrun_bt_memo_enabled(void);
+
+void hpcrun_bt_memo_init(bt_memo_t* memo);
+
+// forget the memo of the current thread.  required whenever cct nodes
+// may be freed or the cct is replaced.
+void hpcrun_bt_memo_invalidate(void);
+
+//
+// if the frame at 'cursor' is a memoized frame whose outer frames are
+// unchanged, return it.  *scan is a position in the memo that carries
+// over between the calls for one unwind; start it at memo->frame_beg.
+//
+frame_t* hpcrun_bt_memo_lookup(bt_memo_t* memo, hpcrun_unw_cursor_t* cursor,
+			       frame_t** scan);
+
+//
+// put the new frames [beg, end) in front of memoized frame 'hit' (or
+// at the end of the memo buffer, if hit is NULL) and return the new
+// innermost frame.  the memo becomes invalid until it is committed.
+// returns NULL if the memo buffer can't grow.
+//
+frame_t* hpcrun_bt_memo_splice(bt_memo_t* memo, frame_t* beg, frame_t* end,
+			       frame_t** hit);
+
+// after the frames [begin, buf_end) were inserted at root, make them
+// the memo
+void hpcrun_bt_memo_commit(bt_memo_t* memo, frame_t* begin,
+			   cct_node_t* root, fence_enum_t fence);
+
+static inline cct_node_t**
+hpcrun_bt_memo_nodes(bt_memo_t* memo, frame_t* f)
+{
+  return memo->nodes + (f - memo->buf_beg);
+}
+
+#endif // hpcrun_bt_memo_h
@@ -56,6 +56,12 @@
 btuwi_status_t
 build_intervals(char  *ins, unsigned int len, unwinder_t uw);
 
+// copy the native recipe 'recipe' to 'buf' in a form that can be saved
+// in the persistent recipe cache, if buf is not NULL.  returns the size
+// of a native recipe, or 0 if native recipes can't be saved.
+size_t
+native_recipe_export(void *buf, const void *recipe);
+
 //***************************************************************************
 
 #endif // unwind_interval_h
@@ -134,6 +134,37 @@ step_state
 hpcrun_unw_step(hpcrun_unw_cursor_t* c, int *steps_taken);
 
 
+//***************************************************************************
+// unwinding a copy of a user stack (only on x86-64)
+//
+// the copy holds the stack from 'sp' up and was taken elsewhere, e.g.,
+// by the kernel for a perf sample.  no memory outside the copy is read,
+// so the unwind may run in any thread, any time before the load
+// modules of the frames are unmapped.
+//***************************************************************************
+
+typedef struct hpcrun_unw_snapshot_s {
+  void *pc;
+  void *sp;
+  void *bp;
+  const char *stack;   // copy of [sp, sp + stack_size)
+  size_t stack_size;
+} hpcrun_unw_snapshot_t;
+
+typedef struct hpcrun_unw_snapshot_frame_s {
+  ip_normalized_t ip_norm;
+  ip_normalized_t the_function;
+} hpcrun_unw_snapshot_frame_t;
+
+// fills frames[] innermost first and returns the number of frames.
+// *fence is FENCE_MAIN or FENCE_THREAD if the unwind reached the
+// bottom of the stack, and FENCE_BAD if it stopped early.
+int
+hpcrun_unw_snapshot(hpcrun_unw_snapshot_t *snap,
+		    hpcrun_unw_snapshot_frame_t *frames, int max_frames,
+		    int *fence);
+
+
 //***************************************************************************
 //
 // services provided by HPCToolkit's unwinder
@@ -0,0 +1,550 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+/*
+ * Persistent unwind recipe cache.
+ *
+ * A cache file holds the native recipes of one load module, identified
+ * by its GNU build-id.  Addresses in the file are offsets from the
+ * start of the module's text (dso_info->start_addr), so a file stays
+ * valid wherever the module is loaded.  Layout:
+ *
+ *   uwc_header_t
+ *   uwc_fcn_t       fcns[num_fcns]            sorted by start
+ *   uwc_interval_t  intervals[num_intervals]  each followed by a recipe
+ *
+ * A function's intervals are contiguous, starting at fcns[i].first.
+ *
+ * Files are written at process exit to a temporary name and renamed
+ * into place, so readers never see a partial file.  When processes
+ * race, the last rename wins; each writer merges the recipes it read
+ * from the old file with the ones it built, so no recipe is lost
+ * unless two writers start from the same old file.
+ */
+
+//******************************************************************************
+// global include files
+//******************************************************************************
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+//******************************************************************************
+// local include files
+//******************************************************************************
+
+#include <env.h>
+#include <fnbounds/fnbounds_interface.h>
+#include <lib/prof-lean/stdatomic.h>
+#include <memory/hpcrun-malloc.h>
+#include <messages/messages.h>
+
+#include "unwind-interval.h"
+#include "uw_recipe_cache.h"
+
+//******************************************************************************
+// macros
+//******************************************************************************
+
+#define UWC_MAGIC    "HPCUWC\0\0"
+#define UWC_VERSION  1
+#define UWC_SUFFIX   ".uwc"
+
+
+#define ROUND8(n) (((n) + 7) & ~((size_t) 7))
+
+//******************************************************************************
+// types
+//******************************************************************************
+
+typedef struct uwc_header_s {
+  char     magic[8];
+  uint32_t version;
+  uint32_t recipe_size;
+  uint64_t span;            // end_addr - start_addr of the module
+  uint64_t num_fcns;
+  uint64_t num_intervals;
+} uwc_header_t;
+
+typedef struct uwc_fcn_s {
+  uint64_t start;
+  uint64_t end;
+  uint64_t first;
+  uint64_t count;
+} uwc_fcn_t;
+
+typedef struct uwc_interval_s {
+  uint64_t start;
+  uint64_t end;
+  char     recipe[];
+} uwc_interval_t;
+
+// recipes built in this process for one function
+typedef struct uwc_record_s {
+  struct uwc_record_s *next;
+  uint64_t start;
+  uint64_t end;
+  uint64_t count;
+  char     intervals[];     // count uwc_interval_t
+} uwc_record_t;
+
+typedef struct uwc_module_s {
+  struct uwc_module_s *next;
+  _Atomic(load_module_t *) lm;   // NULL once unmapped
+  uintptr_t base;
+  uint64_t  span;
+  char      build_id[2 * FNBOUNDS_BUILD_ID_MAX + 1];
+
+  // the cache file, if one existed when the module was mapped
+  void     *file;
+  size_t    file_size;
+  const uwc_fcn_t *fcns;
+  const char *intervals;
+  uint64_t  num_fcns;
+
+  _Atomic(uwc_record_t *) records;
+} uwc_module_t;
+
+// a function to write: from the old file or from a record
+typedef struct uwc_out_fcn_s {
+  uint64_t start;
+  uint64_t end;
+  uint64_t count;
+  const char *intervals;
+} uwc_out_fcn_t;
+
+//******************************************************************************
+// local data
+//******************************************************************************
+
+static bool cache_enabled = false;
+static char cache_dir[PATH_MAX];
+
+static size_t recipe_size;     // bytes of a native recipe
+static size_t interval_size;   // bytes of a uwc_interval_t with its recipe
+
+static _Atomic(uwc_module_t *) modules = ATOMIC_VAR_INIT(NULL);
+
+//******************************************************************************
+// private operations
+//******************************************************************************
+
+static void
+cache_file_path(char *path, size_t size, const uwc_module_t *mod)
+{
+  snprintf(path, size, "%s/%s" UWC_SUFFIX, cache_dir, mod->build_id);
+}
+
+
+// check every function of a cache file whose size matches its header:
+// functions are sorted, disjoint and within the module, their
+// intervals are in the file and each interval lies in its function
+static bool
+cache_file_valid(const uwc_header_t *hdr, uint64_t span)
+{
+  const uwc_fcn_t *fcns = (const uwc_fcn_t *) (hdr + 1);
+  const char *intervals = (const char *) (fcns + hdr->num_fcns);
+
+  uint64_t prev_end = 0;
+  for (uint64_t i = 0; i < hdr->num_fcns; i++) {
+    const uwc_fcn_t *f = &fcns[i];
+    if (f->start < prev_end || f->start >= f->end || f->end > span
+	|| f->count > hdr->num_intervals
+	|| f->first > hdr->num_intervals - f->count) return false;
+    prev_end = f->end;
+
+    const char *ival = intervals + f->first * interval_size;
+    for (uint64_t j = 0; j < f->count; j++, ival += interval_size) {
+      const uwc_interval_t *u = (const uwc_interval_t *) ival;
+      if (u->start < f->start || u->start >= u->end || u->end > f->end)
+	return false;
+    }
+  }
+  return true;
+}
+
+
+// map the cache file of mod, if there is a usable one
+static void
+cache_file_map(uwc_module_t *mod)
+{
+  char path[PATH_MAX];
+  cache_file_path(path, sizeof(path), mod);
+
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) return;
+
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < sizeof(uwc_header_t)) {
+    close(fd);
+    return;
+  }
+  void *file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (file == MAP_FAILED) return;
+
+  const uwc_header_t *hdr = (const uwc_header_t *) file;
+  size_t fcn_bytes = hdr->num_fcns * sizeof(uwc_fcn_t);
+  size_t need = sizeof(*hdr) + fcn_bytes + hdr->num_intervals * interval_size;
+  if (memcmp(hdr->magic, UWC_MAGIC, sizeof(hdr->magic)) != 0
+      || hdr->version != UWC_VERSION
+      || hdr->recipe_size != recipe_size
+      || hdr->span != mod->span
+      || hdr->num_fcns > st.st_size / sizeof(uwc_fcn_t)
+      || hdr->num_intervals > st.st_size / interval_size
+      || need != st.st_size
+      || !cache_file_valid(hdr, mod->span)) {
+    TMSG(UW_RECIPE_MAP, "unwind cache: ignore stale or damaged %s", path);
+    munmap(file, st.st_size);
+    return;
+  }
+
+  mod->file = file;
+  mod->file_size = st.st_size;
+  mod->fcns = (const uwc_fcn_t *) (hdr + 1);
+  mod->intervals = (const char *) (mod->fcns + hdr->num_fcns);
+  mod->num_fcns = hdr->num_fcns;
+
+  TMSG(UW_RECIPE_MAP, "unwind cache: mapped %s, %ld functions",
+       path, (long) hdr->num_fcns);
+}
+
+
+static uwc_module_t *
+module_find(load_module_t *lm)
+{
+  uwc_module_t *mod = atomic_load_explicit(&modules, memory_order_acquire);
+  for (; mod != NULL; mod = mod->next) {
+    if (atomic_load_explicit(&mod->lm, memory_order_acquire) == lm)
+      return mod;
+  }
+  return NULL;
+}
+
+
+static int
+out_fcn_cmp(const void *a, const void *b)
+{
+  const uwc_out_fcn_t *l = (const uwc_out_fcn_t *) a;
+  const uwc_out_fcn_t *r = (const uwc_out_fcn_t *) b;
+  if (l->start != r->start) return l->start < r->start ? -1 : 1;
+  // at equal start, prefer the one listed first (recipes from this run)
+  return (l < r) ? -1 : (l > r);
+}
+
+
+static bool
+write_all(int fd, const void *buf, size_t len)
+{
+  const char *p = (const char *) buf;
+  while (len > 0) {
+    ssize_t n = write(fd, p, len);
+    if (n < 0) {
+      if (errno == EINTR) continue;
+      return false;
+    }
+    p += n;
+    len -= n;
+  }
+  return true;
+}
+
+
+// merge the recipes of mod built in this process with those of its
+// old cache file and write a new cache file
+static void
+module_write(uwc_module_t *mod)
+{
+  uwc_record_t *records = atomic_load_explicit(&mod->records, memory_order_acquire);
+  if (records == NULL) return;
+
+  uint64_t num = mod->num_fcns;
+  for (uwc_record_t *r = records; r != NULL; r = r->next) num++;
+
+  size_t bytes = num * sizeof(uwc_out_fcn_t);
+  uwc_out_fcn_t *out = mmap(NULL, bytes, PROT_READ | PROT_WRITE,
+			    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+  if (out == MAP_FAILED) return;
+
+  uint64_t n = 0;
+  for (uwc_record_t *r = records; r != NULL; r = r->next) {
+    out[n++] = (uwc_out_fcn_t) { r->start, r->end, r->count, r->intervals };
+  }
+  for (uint64_t i = 0; i < mod->num_fcns; i++) {
+    const uwc_fcn_t *f = &mod->fcns[i];
+    out[n++] = (uwc_out_fcn_t)
+      { f->start, f->end, f->count, mod->intervals + f->first * interval_size };
+  }
+  qsort(out, n, sizeof(*out), out_fcn_cmp);
+
+  // drop duplicates and overlaps, keeping the first at each start
+  uint64_t kept = 0, num_intervals = 0;
+  for (uint64_t i = 0; i < n; i++) {
+    if (kept > 0 && out[i].start < out[kept - 1].end) continue;
+    out[kept++] = out[i];
+    num_intervals += out[i].count;
+  }
+
+  char path[PATH_MAX], tmp[PATH_MAX];
+  cache_file_path(path, sizeof(path), mod);
+  snprintf(tmp, sizeof(tmp), "%s.%d", path, (int) getpid());
+
+  int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    EMSG("unwind cache: unable to create %s", tmp);
+    munmap(out, bytes);
+    return;
+  }
+
+  uwc_header_t hdr;
+  memset(&hdr, 0, sizeof(hdr));
+  memcpy(hdr.magic, UWC_MAGIC, sizeof(hdr.magic));
+  hdr.version = UWC_VERSION;
+  hdr.recipe_size = recipe_size;
+  hdr.span = mod->span;
+  hdr.num_fcns = kept;
+  hdr.num_intervals = num_intervals;
+
+  bool ok = write_all(fd, &hdr, sizeof(hdr));
+  uint64_t first = 0;
+  for (uint64_t i = 0; ok && i < kept; i++) {
+    uwc_fcn_t f = { out[i].start, out[i].end, first, out[i].count };
+    ok = write_all(fd, &f, sizeof(f));
+    first += out[i].count;
+  }
+  for (uint64_t i = 0; ok && i < kept; i++) {
+    ok = write_all(fd, out[i].intervals, out[i].count * interval_size);
+  }
+  ok = (close(fd) == 0) && ok;
+
+  if (ok && rename(tmp, path) == 0) {
+    TMSG(UW_RECIPE_MAP, "unwind cache: wrote %s, %ld functions",
+	 path, (long) kept);
+  } else {
+    EMSG("unwind cache: unable to write %s", path);
+    unlink(tmp);
+  }
+  munmap(out, bytes);
+}
+
+//******************************************************************************
+// interface operations
+//******************************************************************************
+
+void
+uw_recipe_cache_init(void)
+{
+  const char *dir = getenv(HPCRUN_UNWIND_CACHE);
+  if (dir == NULL || dir[0] == '\0') return;
+
+  recipe_size = native_recipe_export(NULL, NULL);
+  if (recipe_size == 0) return;
+  interval_size = ROUND8(sizeof(uwc_interval_t) + recipe_size);
+
+  if (strlen(dir) >= sizeof(cache_dir) - (2 * FNBOUNDS_BUILD_ID_MAX + 32)) {
+    EMSG("unwind cache: directory name too long: %s", dir);
+    return;
+  }
+  strcpy(cache_dir, dir);
+  if (mkdir(cache_dir, 0755) != 0 && errno != EEXIST) {
+    EMSG("unwind cache: unable to create directory %s", cache_dir);
+    return;
+  }
+  cache_enabled = true;
+}
+
+
+void
+uw_recipe_cache_notify_map(load_module_t *lm)
+{
+  if (!cache_enabled || lm == NULL || lm->dso_info == NULL
+      || lm->name == NULL) return;
+
+  char build_id[2 * FNBOUNDS_BUILD_ID_MAX + 1];
+  if (!fnbounds_build_id(lm->name, build_id)) return;
+
+  // a module mapped again after an unmap keeps its records and file
+  uintptr_t base = (uintptr_t) lm->dso_info->start_addr;
+  uint64_t span = (uintptr_t) lm->dso_info->end_addr - base;
+  uwc_module_t *mod = atomic_load_explicit(&modules, memory_order_acquire);
+  for (; mod != NULL; mod = mod->next) {
+    if (strcmp(mod->build_id, build_id) == 0 && mod->span == span
+	&& atomic_load_explicit(&mod->lm, memory_order_relaxed) == NULL) {
+      mod->base = base;
+      atomic_store_explicit(&mod->lm, lm, memory_order_release);
+      return;
+    }
+  }
+
+  mod = hpcrun_malloc(sizeof(*mod));
+  memset(mod, 0, sizeof(*mod));
+  atomic_init(&mod->lm, lm);
+  mod->base = base;
+  mod->span = span;
+  strcpy(mod->build_id, build_id);
+  atomic_init(&mod->records, NULL);
+  cache_file_map(mod);
+
+  uwc_module_t *head = atomic_load_explicit(&modules, memory_order_relaxed);
+  do {
+    mod->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(&modules, &head, mod,
+		 memory_order_release, memory_order_relaxed));
+}
+
+
+void
+uw_recipe_cache_notify_unmap(load_module_t *lm)
+{
+  if (!cache_enabled || lm == NULL) return;
+
+  // the module's records are still written at exit; its cache file
+  // stays mapped, since a concurrent fetch may be reading it
+  uwc_module_t *mod = module_find(lm);
+  if (mod != NULL)
+    atomic_store_explicit(&mod->lm, NULL, memory_order_relaxed);
+}
+
+
+bool
+uw_recipe_cache_fetch(load_module_t *lm, void *start, void *end,
+		      btuwi_status_t *stat)
+{
+  if (!cache_enabled) return false;
+
+  uwc_module_t *mod = module_find(lm);
+  if (mod == NULL || mod->num_fcns == 0) return false;
+
+  uint64_t fstart = (uintptr_t) start - mod->base;
+  uint64_t fend = (uintptr_t) end - mod->base;
+
+  uint64_t lo = 0, hi = mod->num_fcns;
+  while (lo < hi) {
+    uint64_t mid = lo + (hi - lo) / 2;
+    if (mod->fcns[mid].start < fstart) lo = mid + 1;
+    else hi = mid;
+  }
+  if (lo == mod->num_fcns) return false;
+
+  const uwc_fcn_t *f = &mod->fcns[lo];
+  if (f->start != fstart || f->end != fend || f->count == 0) return false;
+
+  bitree_uwi_t *first = NULL, *last = NULL;
+  const char *ival = mod->intervals + f->first * interval_size;
+  for (uint64_t i = 0; i < f->count; i++, ival += interval_size) {
+    const uwc_interval_t *src = (const uwc_interval_t *) ival;
+    bitree_uwi_t *u = bitree_uwi_malloc(NATIVE_UNWINDER, recipe_size);
+    uwi_t *uwi = bitree_uwi_rootval(u);
+    uwi->interval.start = mod->base + src->start;
+    uwi->interval.end = mod->base + src->end;
+    memcpy(uwi->recipe, src->recipe, recipe_size);
+    if (last) bitree_uwi_set_rightsubtree(last, u);
+    else first = u;
+    last = u;
+  }
+
+  memset(stat, 0, sizeof(*stat));
+  stat->first = first;
+  stat->count = f->count;
+  return true;
+}
+
+
+void
+uw_recipe_cache_save(load_module_t *lm, void *start, void *end,
+		     bitree_uwi_t *first, int count)
+{
+  if (!cache_enabled || count <= 0) return;
+
+  uwc_module_t *mod = module_find(lm);
+  if (mod == NULL) return;
+
+  uwc_record_t *rec = hpcrun_malloc(sizeof(*rec) + count * interval_size);
+  if (rec == NULL) return;
+  rec->start = (uintptr_t) start - mod->base;
+  rec->end = (uintptr_t) end - mod->base;
+  rec->count = count;
+
+  char *ival = rec->intervals;
+  bitree_uwi_t *u = first;
+  for (int i = 0; i < count; i++, ival += interval_size) {
+    uwc_interval_t *dst = (uwc_interval_t *) ival;
+    memset(dst, 0, interval_size);
+    uwi_t *uwi = bitree_uwi_rootval(u);
+    dst->start = uwi->interval.start - mod->base;
+    dst->end = uwi->interval.end - mod->base;
+    native_recipe_export(dst->recipe, uwi->recipe);
+    u = bitree_uwi_rightsubtree(u);
+  }
+
+  uwc_record_t *head = atomic_load_explicit(&mod->records, memory_order_relaxed);
+  do {
+    rec->next = head;
+  } while (!atomic_compare_exchange_weak_explicit(&mod->records, &head, rec,
+		 memory_order_release, memory_order_relaxed));
+}
+
+
+void
+uw_recipe_cache_fini(void)
+{
+  if (!cache_enabled) return;
+
+  uwc_module_t *mod = atomic_load_explicit(&modules, memory_order_acquire);
+  for (; mod != NULL; mod = mod->next) {
+    module_write(mod);
+  }
+}
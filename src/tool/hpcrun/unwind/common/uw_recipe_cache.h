@@ -0,0 +1,100 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+/*
+ * Interface to the persistent unwind recipe cache.
+ *
+ * Native unwind recipes computed for a load module are saved at
+ * process exit in a file named by the module's build-id, in the
+ * directory given by HPCRUN_UNWIND_CACHE.  When a module with a saved
+ * file is mapped in a later run, the file is mapped read-only and
+ * recipes for the functions it covers are copied out instead of
+ * analyzing the function's binary again.
+ */
+
+#ifndef _UW_RECIPE_CACHE_H_
+#define _UW_RECIPE_CACHE_H_
+
+#include <stdbool.h>
+
+#include <hpcrun/loadmap.h>
+#include "binarytree_uwi.h"
+
+// read HPCRUN_UNWIND_CACHE; the cache stays disabled if it is not set
+void
+uw_recipe_cache_init(void);
+
+void
+uw_recipe_cache_notify_map(load_module_t *lm);
+
+void
+uw_recipe_cache_notify_unmap(load_module_t *lm);
+
+/*
+ * if the cache file of lm has recipes for the function [start, end),
+ * return true and a list of fresh intervals (chained through right
+ * subtrees) in *stat, otherwise return false.
+ * safe to call from a signal handler.
+ */
+bool
+uw_recipe_cache_fetch(load_module_t *lm, void *start, void *end,
+		      btuwi_status_t *stat);
+
+/*
+ * remember the list of intervals built for the function [start, end)
+ * of lm, to be written to the cache file of lm at exit.
+ * safe to call from a signal handler.
+ */
+void
+uw_recipe_cache_save(load_module_t *lm, void *start, void *end,
+		     bitree_uwi_t *first, int count);
+
+// write cache files for all modules with newly built recipes
+void
+uw_recipe_cache_fini(void);
+
+#endif  /* !_UW_RECIPE_CACHE_H_ */
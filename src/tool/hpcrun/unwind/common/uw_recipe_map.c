@@ -83,6 +83,8 @@
 #include "thread_data.h"
 #include "uw_hash.h"
 #include "uw_recipe_map.h"
+#include "uw_recipe_cache.h"
+#include "uw_recipe_prefetch.h"
 #include "unwind-interval.h"
 #include <fnbounds/fnbounds_interface.h>
 #include <lib/prof-lean/cskiplist.h>
@@ -90,6 +92,8 @@
 #include <lib/prof-lean/binarytree.h>
 #include "binarytree_uwi.h"
 #include "segv_handler.h"
+#include <handling_sample.h>
+#include <hpcrun_stats.h>
 #include <messages/messages.h>
 
 // libmonitor functions
@@ -99,9 +103,11 @@
 // global include files
 //******************************************************************************
 
+#include <sched.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 
 //---------------------------------------------------------------------
 // macros
@@ -111,6 +117,10 @@
 
 #define NUM_NODES 10
 
+// a wait for the other side of an unmap yields a few times, then sleeps
+#define BACKOFF_YIELDS    16
+#define BACKOFF_SLEEP_NS  (50 * 1000)
+
 //******************************************************************************
 // type
 //******************************************************************************
@@ -566,10 +576,66 @@ uw_recipe_map_notify_map(load_module_t* lm)
   for (uw = 0; uw < NUM_UNWINDERS; uw++)
     uw_recipe_map_unpoison((uintptr_t)start, (uintptr_t)end, uw);
 
+  uw_recipe_cache_notify_map(lm);
+  uw_recipe_prefetch_notify_map(lm);
+
   uw_recipe_map_report_and_dump("*** map: after unpoisoning", start, end);
 }
 
 
+//******************************************************************************
+// unwinds outside a sample handler
+//******************************************************************************
+
+/*
+ * A thread that unwinds for another one, like the perf user stack
+ * helper, looks up recipes in any module while other threads may unmap
+ * one.  An unmap waits until no such unwind is in progress, and no new
+ * one starts before the unmap is done.  Each side announces itself
+ * before it checks the other, so one of them always sees the other.
+ */
+
+static atomic_int unmaps_in_progress = ATOMIC_VAR_INIT(0);
+static atomic_int detached_unwinds = ATOMIC_VAR_INIT(0);
+
+
+// nanosleep and sched_yield are safe in a sample handler
+static void
+backoff(int *tries)
+{
+  if (*tries < BACKOFF_YIELDS) {
+    (*tries)++;
+    sched_yield();
+  } else {
+    struct timespec ts = { 0, BACKOFF_SLEEP_NS };
+    nanosleep(&ts, NULL);
+  }
+}
+
+
+void
+uw_recipe_map_detached_begin(void)
+{
+  int tries = 0;
+  for (;;) {
+    atomic_fetch_add(&detached_unwinds, 1);
+    if (atomic_load(&unmaps_in_progress) == 0) return;
+    atomic_fetch_sub(&detached_unwinds, 1);
+
+    while (atomic_load(&unmaps_in_progress) != 0) {
+      backoff(&tries);
+    }
+  }
+}
+
+
+void
+uw_recipe_map_detached_end(void)
+{
+  atomic_fetch_sub(&detached_unwinds, 1);
+}
+
+
 static void
 uw_recipe_map_notify_unmap(load_module_t* lm)
 {
@@ -578,6 +644,16 @@ uw_recipe_map_notify_unmap(load_module_t* lm)
   void* end = lm->dso_info->end_addr;
   uw_recipe_map_report_and_dump("*** unmap: before poisoning", start, end);
 
+  // wait for the prefetch thread to leave lm before deleting its entries
+  uw_recipe_prefetch_notify_unmap(lm);
+
+  // and for the unwinds done for other threads to finish
+  atomic_fetch_add(&unmaps_in_progress, 1);
+  int tries = 0;
+  while (atomic_load(&detached_unwinds) != 0) {
+    backoff(&tries);
+  }
+
   // Remove intervals in the range [start, end) from the unwind interval tree.
   TMSG(UW_RECIPE_MAP, "uw_recipe_map_delete_range from %p to %p", start, end);
   unwinder_t uw;
@@ -591,6 +667,10 @@ uw_recipe_map_notify_unmap(load_module_t* lm)
   thread_data_t *td = hpcrun_get_thread_data();
   uw_hash_delete_range(td->uw_hash_table, start, end);
 
+  uw_recipe_cache_notify_unmap(lm);
+
+  atomic_fetch_sub(&unmaps_in_progress, 1);
+
   uw_recipe_map_report_and_dump("*** unmap: after poisoning", start, end);
 }
 
@@ -636,6 +716,8 @@ uw_recipe_map_init(void)
       cskl_new(lsentinel, rsentinel, SKIPLIST_HEIGHT,
 	       ilmstat_btuwi_pair_cmp, ilmstat_btuwi_pair_inrange, my_alloc);
 
+  uw_recipe_cache_init();
+  uw_recipe_prefetch_init();
   uw_recipe_map_notify_init();
 
   // initialize the map with a POISONED node ({([0, UINTPTR_MAX), NULL), NEVER}, NULL)
@@ -654,7 +736,8 @@ uw_recipe_map_lookup_helper
  void *addr, 
  unwinder_t uw, 
  unwindr_info_t *unwr_info,
- ilmstat_btuwi_pair_t **callers_ilm_btui // ptr to caller's ilm_btui
+ ilmstat_btuwi_pair_t **callers_ilm_btui, // ptr to caller's ilm_btui
+ bool *hashed // set if the recipe came from the thread's hash table
 )
 {
   // fill unwr_info with appropriate values to indicate that the lookup fails and the unwind recipe
@@ -676,6 +759,8 @@ uw_recipe_map_lookup_helper
   ilmstat_btuwi_pair_t* ilm_btui = NULL;
   uw_hash_entry_t *e = NULL;
 
+  *hashed = false;
+
   // With -e cputime, sometimes addr is 0
   if (addr != NULL) {
     e = uw_hash_lookup(td->uw_hash_table, uw, addr);
@@ -703,6 +788,7 @@ uw_recipe_map_lookup_helper
       unwr_info->btuwi = e->btuwi;
       // if we find ilm_btui, we do not need to update btuwi
       oldstat = READY;
+      *hashed = true;
     }
   } else {
     TMSG(UW_RECIPE_MAP, "BAD fnbounds_enclosing_addr failed: addr %p", addr);
@@ -714,6 +800,97 @@ uw_recipe_map_lookup_helper
 }
 
 
+/*
+ * return the map entry for the function [fcn_start, fcn_end) of lm,
+ * inserting a DEFERRED entry if there is none
+ */
+static ilmstat_btuwi_pair_t *
+uw_recipe_map_fcn_entry
+(
+ void *fcn_start,
+ void *fcn_end,
+ load_module_t *lm,
+ unwinder_t uw
+)
+{
+  // bounding addresses found; set DEFERRED state and pair it with
+  // (bitree_uwi_t*)NULL and try to insert into map:
+  ilmstat_btuwi_pair_t *ilm_btui =
+    ilmstat_btuwi_pair_malloc((uintptr_t)fcn_start, (uintptr_t)fcn_end, lm,
+      DEFERRED, my_alloc);
+
+  csklnode_t *node = cskl_insert(unwinder_to_cskiplist[uw], ilm_btui, my_alloc);
+  if (ilm_btui !=  (ilmstat_btuwi_pair_t*)node->val) {
+    // interval_ldmod_pair ([fcn_start, fcn_end), lm) is already in the map,
+    // so free the unused copy and use the mapped one
+    ilmstat_btuwi_pair_free(ilm_btui, uw);
+    ilm_btui = (ilmstat_btuwi_pair_t*)node->val;
+  }
+  return ilm_btui;
+}
+
+
+/*
+ * build the tree of intervals for ilm_btui if its state is still
+ * oldstat (DEFERRED), otherwise wait for the thread building it.
+ * return the final state, READY or NEVER.
+ */
+static tree_stat_t
+uw_recipe_map_build_fcn
+(
+ thread_data_t* td,
+ ilmstat_btuwi_pair_t *ilm_btui,
+ tree_stat_t oldstat,
+ unwinder_t uw
+)
+{
+  if (atomic_compare_exchange_strong_explicit(&ilm_btui->stat, &oldstat, FORTHCOMING,
+                memory_order_release, memory_order_relaxed)) {
+    // it is my responsibility to build the tree of intervals for the function
+    void *fcn_start = (void*)ilm_btui->interval.start;
+    void *fcn_end   = (void*)ilm_btui->interval.end;
+
+    // ----------------------------------------------------------
+    // potentially crash in this statement. need to save the state 
+    // ----------------------------------------------------------
+
+    sigjmp_buf_t *oldjmp = td->current_jmp_buf;       // store the outer sigjmp
+
+    td->current_jmp_buf  = &(td->bad_interval);
+
+    int ljmp = sigsetjmp(td->bad_interval.jb, 1);
+    if (ljmp == 0) {
+      btuwi_status_t btuwi_stat;
+      if (uw != NATIVE_UNWINDER ||
+          !uw_recipe_cache_fetch(ilm_btui->lm, fcn_start, fcn_end, &btuwi_stat)) {
+        btuwi_stat = build_intervals(fcn_start, fcn_end - fcn_start, uw);
+        if (btuwi_stat.error != 0) {
+          TMSG(UW_RECIPE_MAP, "build_intervals: fcn range %p to %p: error %d",
+         fcn_start, fcn_end, btuwi_stat.error);
+        } else if (uw == NATIVE_UNWINDER) {
+          uw_recipe_cache_save(ilm_btui->lm, fcn_start, fcn_end,
+                               btuwi_stat.first, btuwi_stat.count);
+        }
+      }
+      ilm_btui->btuwi = bitree_uwi_rebalance(btuwi_stat.first, btuwi_stat.count);
+      atomic_store_explicit(&ilm_btui->stat, READY, memory_order_release);
+
+      td->current_jmp_buf = oldjmp;   // restore the outer sigjmp
+      return READY;
+    } else {
+      td->current_jmp_buf = oldjmp;   // restore the outer sigjmp
+      EMSG("Fail to get interval %p to %p", fcn_start, fcn_end);
+      atomic_store_explicit(&ilm_btui->stat, NEVER, memory_order_release);
+      return NEVER;
+    }
+  }
+
+  while (FORTHCOMING == oldstat)
+    oldstat = atomic_load_explicit(&ilm_btui->stat, memory_order_acquire);
+  return oldstat;
+}
+
+
 /*
  *
  */
@@ -727,7 +904,9 @@ uw_recipe_map_lookup_noinsert
 {
   thread_data_t* td    = hpcrun_get_thread_data();
   ilmstat_btuwi_pair_t *ilm_btui = NULL;
-  tree_stat_t stat = uw_recipe_map_lookup_helper(td, addr, uw, unwr_info, &ilm_btui);
+  bool hashed;
+  tree_stat_t stat =
+    uw_recipe_map_lookup_helper(td, addr, uw, unwr_info, &ilm_btui, &hashed);
 
   if (stat == READY) {
     unwr_info->treestat = READY;
@@ -746,9 +925,18 @@ uw_recipe_map_lookup(void *addr, unwinder_t uw, unwindr_info_t *unwr_info)
 {
   thread_data_t* td    = hpcrun_get_thread_data();
   ilmstat_btuwi_pair_t *ilm_btui = NULL;
-  tree_stat_t oldstat = uw_recipe_map_lookup_helper(td, addr, uw, unwr_info, &ilm_btui);
+  bool hashed;
+  tree_stat_t oldstat =
+    uw_recipe_map_lookup_helper(td, addr, uw, unwr_info, &ilm_btui, &hashed);
+
+  if (oldstat == READY) {
+    if (hashed) hpcrun_stats_recipe_hash_hit_inc();
+    else hpcrun_stats_recipe_map_hit_inc();
+  } else {
+    // cold path: the recipes for the enclosing routine are built (or
+    // waited for) in this sample
+    hpcrun_stats_recipe_miss_inc();
 
-  if (oldstat != READY) {
     // unwind recipe currently unavailable, prepare to build recipes for the enclosing
     // routine 
     if (!ilm_btui) {
@@ -764,68 +952,18 @@ uw_recipe_map_lookup(void *addr, unwinder_t uw, unwindr_info_t *unwr_info)
       return false;
     }
 
-    // bounding addresses found; set DEFERRED state and pair it with
-    // (bitree_uwi_t*)NULL and try to insert into map:
-    ilm_btui =
-      ilmstat_btuwi_pair_malloc((uintptr_t)fcn_start, (uintptr_t)fcn_end, lm,
-        DEFERRED, my_alloc);
-    
-    csklnode_t *node = cskl_insert(unwinder_to_cskiplist[uw], ilm_btui, my_alloc);
-    if (ilm_btui !=  (ilmstat_btuwi_pair_t*)node->val) {
-      // interval_ldmod_pair ([fcn_start, fcn_end), lm) is already in the map,
-      // so free the unused copy and use the mapped one
-      ilmstat_btuwi_pair_free(ilm_btui, uw);
-      ilm_btui = (ilmstat_btuwi_pair_t*)node->val;
-    }
+    ilm_btui = uw_recipe_map_fcn_entry(fcn_start, fcn_end, lm, uw);
     }
 #if UW_RECIPE_MAP_DEBUG
     assert(ilm_btui != NULL);
 #endif
-    
-    if (atomic_compare_exchange_strong_explicit(&ilm_btui->stat, &oldstat, FORTHCOMING,
-                  memory_order_release, memory_order_relaxed)) {
-      // it is my responsibility to build the tree of intervals for the function
-      void *fcn_start = (void*)ilm_btui->interval.start;
-      void *fcn_end   = (void*)ilm_btui->interval.end;
-
-      // ----------------------------------------------------------
-      // potentially crash in this statement. need to save the state 
-      // ----------------------------------------------------------
 
-      sigjmp_buf_t *oldjmp = td->current_jmp_buf;       // store the outer sigjmp
-
-      td->current_jmp_buf  = &(td->bad_interval);
-
-      int ljmp = sigsetjmp(td->bad_interval.jb, 1);
-      if (ljmp == 0) {
-        btuwi_status_t btuwi_stat = build_intervals(fcn_start, fcn_end - fcn_start, uw);
-        if (btuwi_stat.error != 0) {
-          TMSG(UW_RECIPE_MAP, "build_intervals: fcn range %p to %p: error %d",
-         fcn_start, fcn_end, btuwi_stat.error);
-        }
-        ilm_btui->btuwi = bitree_uwi_rebalance(btuwi_stat.first, btuwi_stat.count);
-        atomic_store_explicit(&ilm_btui->stat, READY, memory_order_release);
-
-        td->current_jmp_buf = oldjmp;   // restore the outer sigjmp
-
-      } else {
-        td->current_jmp_buf = oldjmp;   // restore the outer sigjmp
-        EMSG("Fail to get interval %p to %p", fcn_start, fcn_end);
-        atomic_store_explicit(&ilm_btui->stat, NEVER, memory_order_release);
-        // I am going to switch an unwinder because it does not help
-        //uw_hash_delete(td->uw_hash_table, addr);
-        return false;
-      }
-    }
-    else {
-      while (FORTHCOMING == oldstat)
-        oldstat = atomic_load_explicit(&ilm_btui->stat, memory_order_acquire);
-      if (oldstat == NEVER) {
-        // addr is in the range of some poisoned load module
-        // I am going to switch an unwinder because it does not help
-        //uw_hash_delete(td->uw_hash_table, addr);
-        return false;
-      }
+    if (uw_recipe_map_build_fcn(td, ilm_btui, oldstat, uw) == NEVER) {
+      // addr is in the range of some poisoned load module, or building
+      // the intervals failed.
+      // I am going to switch an unwinder because it does not help
+      //uw_hash_delete(td->uw_hash_table, addr);
+      return false;
     }
 
     // I am going to update my btuwi by searching the binary tree
@@ -845,3 +983,53 @@ uw_recipe_map_lookup(void *addr, unwinder_t uw, unwindr_info_t *unwr_info)
 
   return (unwr_info->btuwi != NULL);
 }
+
+
+/*
+ * build the native recipes of every function of lm that has no
+ * recipes yet.  called on the prefetch thread, which has its own
+ * thread data; stop early if *cancel becomes true.
+ */
+long
+uw_recipe_map_prefetch(load_module_t *lm, atomic_bool *cancel)
+{
+  dso_info_t *dso = lm->dso_info;
+  if (dso == NULL || dso->table == NULL || dso->nsymbols < 2) return 0;
+
+  thread_data_t* td = hpcrun_get_thread_data();
+  uintptr_t reloc = dso->is_relocatable ? dso->start_to_ref_dist : 0;
+  long built = 0;
+
+  // a segv while decoding is caught by the segv handler only for a
+  // thread that is handling a sample
+  hpcrun_set_handling_sample(td);
+
+  // table[i] is the start of function i, and table[nsymbols - 1] is
+  // the end of the last one
+  unsigned long i;
+  for (i = 0; i + 1 < dso->nsymbols; i++) {
+    if (atomic_load_explicit(cancel, memory_order_acquire)) break;
+
+    void *fcn_start = (void *) ((uintptr_t) dso->table[i] + reloc);
+    void *fcn_end   = (void *) ((uintptr_t) dso->table[i + 1] + reloc);
+    if (fcn_end <= fcn_start) continue;
+
+    ilmstat_btuwi_pair_t *ilm_btui =
+      uw_recipe_map_inrange_find((uintptr_t) fcn_start, NATIVE_UNWINDER);
+    if (ilm_btui != NULL) continue;   // already present, or poisoned
+
+    ilm_btui = uw_recipe_map_fcn_entry(fcn_start, fcn_end, lm, NATIVE_UNWINDER);
+    tree_stat_t stat = atomic_load_explicit(&ilm_btui->stat, memory_order_acquire);
+    if (stat == DEFERRED &&
+        uw_recipe_map_build_fcn(td, ilm_btui, stat, NATIVE_UNWINDER) == READY) {
+      built++;
+    }
+  }
+
+  hpcrun_clear_handling_sample(td);
+
+  hpcrun_stats_recipe_prefetch_inc(built);
+  TMSG(UW_RECIPE_MAP, "prefetch %s: %ld functions", dso->name, built);
+
+  return built;
+}
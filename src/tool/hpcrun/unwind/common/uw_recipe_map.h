@@ -52,6 +52,10 @@
 #ifndef _UW_RECIPE_MAP_H_
 #define _UW_RECIPE_MAP_H_
 
+#include <lib/prof-lean/stdatomic.h>
+#include <stdbool.h>
+
+#include <hpcrun/loadmap.h>
 #include "unwindr_info.h"
 
 typedef struct ilmstat_btuwi_pair_s ilmstat_btuwi_pair_t;
@@ -76,4 +80,26 @@ uw_recipe_map_lookup(void *addr, unwinder_t uw, unwindr_info_t *unwr_info);
 bool
 uw_recipe_map_lookup_noinsert(void *addr, unwinder_t uw, unwindr_info_t *unwr_info);
 
+
+/*
+ * build the native recipes of all functions of lm that are not in the
+ * map yet, stopping early if *cancel becomes true.  must be called
+ * outside a signal handler, on a thread with its own thread data.
+ * returns the number of functions whose recipes were built.
+ */
+long
+uw_recipe_map_prefetch(load_module_t *lm, atomic_bool *cancel);
+
+
+/*
+ * bracket an unwind done outside a sample of the calling thread, e.g.,
+ * for a copy of another thread's stack.  an unmap waits until the
+ * unwind ends, and begin waits until an unmap in progress is done.
+ */
+void
+uw_recipe_map_detached_begin(void);
+
+void
+uw_recipe_map_detached_end(void);
+
 #endif  /* !_UW_RECIPE_MAP_H_ */
@@ -0,0 +1,368 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+/*
+ * Eager construction of unwind recipes for hot load modules.
+ *
+ * Requests are pushed on a lock-free stack by the loadmap notifier,
+ * which may run in a sample handler, and the helper thread is woken
+ * with sem_post.  The helper takes the whole stack at once and
+ * processes it oldest first.
+ *
+ * The helper is started without libmonitor and gives itself thread
+ * data, since hpcrun_malloc and the recipe free lists are per thread.
+ * Per-thread data exists only once the process is threaded, so
+ * requests made before that wait until the first thread is created.
+ * Modules are never parsed inline on the mapping thread; in a process
+ * that never creates threads, recipes are built on demand as before.
+ *
+ * Unmapping a module sets the cancel flag of its requests and waits
+ * until the helper is no longer inside it.  The helper checks the flag
+ * before each function, so the wait is at most one recipe build.  The
+ * helper publishes the module it works on before it checks the flag,
+ * and the unmapper sets the flag before it reads the module, so one of
+ * them always sees the other.
+ */
+
+//******************************************************************************
+// global include files
+//******************************************************************************
+
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <string.h>
+#include <time.h>
+
+//******************************************************************************
+// local include files
+//******************************************************************************
+
+#include <env.h>
+#include <lib/prof-lean/stdatomic.h>
+#include <handling_sample.h>
+#include <sample_sources_all.h>
+#include <thread_data.h>
+#include <thread_use.h>
+#include <memory/hpcrun-malloc.h>
+#include <messages/messages.h>
+
+#include "uw_recipe_map.h"
+#include "uw_recipe_prefetch.h"
+
+// libmonitor functions
+#include <monitor.h>
+
+//******************************************************************************
+// macros
+//******************************************************************************
+
+#define MAX_PATTERNS 32
+
+// a wait for the helper yields a few times, then sleeps
+#define BACKOFF_YIELDS    16
+#define BACKOFF_SLEEP_NS  (50 * 1000)
+
+// the helper is not a monitor thread and has no thread id of its own
+#define PREFETCH_THREAD_ID (-1)
+
+//******************************************************************************
+// types
+//******************************************************************************
+
+typedef struct prefetch_req_s {
+  struct prefetch_req_s *next;      // pending stack, then work list
+  struct prefetch_req_s *all_next;  // every request ever made
+  load_module_t *lm;
+  atomic_bool cancel;
+} prefetch_req_t;
+
+//******************************************************************************
+// private data
+//******************************************************************************
+
+static char *patterns[MAX_PATTERNS];
+static int num_patterns = 0;
+
+static _Atomic(prefetch_req_t *) pending = ATOMIC_VAR_INIT(NULL);
+static _Atomic(prefetch_req_t *) all_reqs = ATOMIC_VAR_INIT(NULL);
+
+// module the helper is working on, or NULL
+static _Atomic(load_module_t *) active_lm = ATOMIC_VAR_INIT(NULL);
+
+static atomic_bool stop = ATOMIC_VAR_INIT(false);
+static atomic_bool started = ATOMIC_VAR_INIT(false);
+static atomic_bool idle = ATOMIC_VAR_INIT(true);
+
+static sem_t work;
+
+//******************************************************************************
+// private operations
+//******************************************************************************
+
+// nanosleep and sched_yield are safe in a sample handler
+static void
+backoff(int *tries)
+{
+  if (*tries < BACKOFF_YIELDS) {
+    (*tries)++;
+    sched_yield();
+  } else {
+    struct timespec ts = { 0, BACKOFF_SLEEP_NS };
+    nanosleep(&ts, NULL);
+  }
+}
+
+
+static bool
+is_hot(load_module_t *lm)
+{
+  if (lm->name == NULL) return false;
+
+  int i;
+  for (i = 0; i < num_patterns; i++) {
+    if (strstr(lm->name, patterns[i]) != NULL) return true;
+  }
+  return false;
+}
+
+
+static void
+prefetch_one(prefetch_req_t *req)
+{
+  atomic_store(&active_lm, req->lm);
+  if (!atomic_load(&req->cancel)) {
+    uw_recipe_map_prefetch(req->lm, &req->cancel);
+  }
+  atomic_store(&active_lm, NULL);
+}
+
+
+// process pending requests in the order they were made
+static void
+prefetch_drain(void)
+{
+  prefetch_req_t *list = atomic_exchange(&pending, NULL);
+  prefetch_req_t *rev = NULL;
+  while (list) {
+    prefetch_req_t *next = list->next;
+    list->next = rev;
+    rev = list;
+    list = next;
+  }
+  for (; rev; rev = rev->next) {
+    if (atomic_load_explicit(&stop, memory_order_acquire)) break;
+    prefetch_one(rev);
+  }
+}
+
+
+static void *
+prefetch_thread(void *arg)
+{
+  // the helper never takes samples.  faults stay unblocked: the segv
+  // handler recovers from a fault in a recipe build, and a blocked
+  // synchronous fault would kill the process.
+  sigset_t mask;
+  sigfillset(&mask);
+  sigdelset(&mask, SIGSEGV);
+  sigdelset(&mask, SIGBUS);
+  sigdelset(&mask, SIGILL);
+  sigdelset(&mask, SIGFPE);
+  monitor_real_pthread_sigmask(SIG_BLOCK, &mask, NULL);
+
+  thread_data_t *td = hpcrun_allocate_thread_data(PREFETCH_THREAD_ID);
+  hpcrun_set_thread_data(td);
+  hpcrun_thread_data_init(PREFETCH_THREAD_ID, NULL, 0,
+			  hpcrun_get_num_sample_sources());
+
+  TMSG(UW_RECIPE_MAP, "unwind recipe prefetch thread started");
+
+  while (!atomic_load_explicit(&stop, memory_order_acquire)) {
+    atomic_store(&idle, true);
+    while (sem_wait(&work) != 0 && errno == EINTR);
+    atomic_store(&idle, false);
+    if (atomic_load_explicit(&stop, memory_order_acquire)) break;
+    prefetch_drain();
+  }
+  atomic_store(&idle, true);
+
+  return NULL;
+}
+
+
+// called outside a sample handler, with the process threaded
+static void
+prefetch_thread_start(void)
+{
+  int expected = false;  // atomic_bool holds an int
+  if (!atomic_compare_exchange_strong(&started, &expected, true)) return;
+
+  pthread_t helper;
+
+  // Create the helper without libmonitor watching
+  monitor_disable_new_threads();
+  int ret = pthread_create(&helper, NULL, prefetch_thread, NULL);
+  monitor_enable_new_threads();
+
+  if (ret == 0) {
+    pthread_detach(helper);
+  } else {
+    EMSG("unable to start unwind recipe prefetch thread");
+    atomic_store(&stop, true);
+  }
+}
+
+//******************************************************************************
+// interface operations
+//******************************************************************************
+
+void
+uw_recipe_prefetch_init(void)
+{
+  const char *env = getenv(HPCRUN_UNWIND_PREFETCH);
+  num_patterns = 0;
+  atomic_store(&pending, NULL);
+  atomic_store(&all_reqs, NULL);
+  atomic_store(&active_lm, NULL);
+  atomic_store(&stop, false);
+  atomic_store(&started, false);
+  atomic_store(&idle, true);
+
+  if (env == NULL || *env == '\0') return;
+
+  char *list = hpcrun_malloc(strlen(env) + 1);
+  strcpy(list, env);
+
+  char *save = NULL;
+  char *tok;
+  for (tok = strtok_r(list, ":", &save); tok != NULL && num_patterns < MAX_PATTERNS;
+       tok = strtok_r(NULL, ":", &save)) {
+    patterns[num_patterns++] = tok;
+  }
+
+  sem_init(&work, 0, 0);
+  TMSG(UW_RECIPE_MAP, "unwind recipe prefetch: %d hot module names", num_patterns);
+}
+
+
+void
+uw_recipe_prefetch_notify_map(load_module_t *lm)
+{
+  if (num_patterns == 0 || atomic_load(&stop) || !is_hot(lm)) return;
+
+  prefetch_req_t *req = hpcrun_malloc(sizeof(prefetch_req_t));
+  req->lm = lm;
+  atomic_init(&req->cancel, false);
+
+  req->all_next = atomic_load(&all_reqs);
+  while (!atomic_compare_exchange_weak(&all_reqs, &req->all_next, req));
+  req->next = atomic_load(&pending);
+  while (!atomic_compare_exchange_weak(&pending, &req->next, req));
+
+  // Otherwise the request waits for the next map outside a handler,
+  // or for the first thread to be created
+  if (hpcrun_is_handling_sample()) {
+    if (atomic_load(&started)) sem_post(&work);
+  } else if (hpcrun_using_threads_p()) {
+    prefetch_thread_start();
+    sem_post(&work);
+  }
+}
+
+
+void
+uw_recipe_prefetch_notify_threaded(void)
+{
+  if (num_patterns == 0 || atomic_load(&stop)) return;
+  if (atomic_load(&pending) == NULL) return;
+
+  prefetch_thread_start();
+  sem_post(&work);
+}
+
+
+void
+uw_recipe_prefetch_notify_unmap(load_module_t *lm)
+{
+  if (num_patterns == 0) return;
+
+  prefetch_req_t *req;
+  for (req = atomic_load(&all_reqs); req; req = req->all_next) {
+    if (req->lm == lm) atomic_store(&req->cancel, true);
+  }
+
+  int tries = 0;
+  while (atomic_load(&active_lm) == lm) {
+    backoff(&tries);
+  }
+}
+
+
+void
+uw_recipe_prefetch_fini(void)
+{
+  if (num_patterns == 0) return;
+
+  atomic_store(&stop, true);
+
+  prefetch_req_t *req;
+  for (req = atomic_load(&all_reqs); req; req = req->all_next) {
+    atomic_store(&req->cancel, true);
+  }
+  if (atomic_load(&started)) {
+    sem_post(&work);
+
+    int tries = 0;
+    while (!atomic_load(&idle)) {
+      backoff(&tries);
+    }
+  }
+}
@@ -0,0 +1,83 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+/*
+ * Eager construction of unwind recipes for hot load modules.
+ *
+ * HPCRUN_UNWIND_PREFETCH is a colon-separated list of names.  When a
+ * load module whose path contains one of them is mapped, the recipes
+ * of all its functions are built on a helper thread, which starts
+ * once the process is threaded.  Samples in those modules then find
+ * their recipes ready instead of building them in the handler.
+ */
+
+#ifndef _UW_RECIPE_PREFETCH_H_
+#define _UW_RECIPE_PREFETCH_H_
+
+#include <hpcrun/loadmap.h>
+
+// read HPCRUN_UNWIND_PREFETCH; prefetching stays disabled if it is not set
+void
+uw_recipe_prefetch_init(void);
+
+// queue lm for prefetching if it is a hot module
+void
+uw_recipe_prefetch_notify_map(load_module_t *lm);
+
+// start the helper for requests made before the process was threaded
+void
+uw_recipe_prefetch_notify_threaded(void);
+
+// stop prefetching lm and wait until the helper thread has left it
+void
+uw_recipe_prefetch_notify_unmap(load_module_t *lm);
+
+// stop the helper thread and wait until it is idle
+void
+uw_recipe_prefetch_fini(void);
+
+#endif  /* !_UW_RECIPE_PREFETCH_H_ */
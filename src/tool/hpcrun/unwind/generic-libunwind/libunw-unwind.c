@@ -191,6 +191,13 @@ build_intervals(char  *ins, unsigned int len, unwinder_t uw)
   return libunw_build_intervals(ins, len);
 }
 
+size_t
+native_recipe_export(void *buf, const void *recipe)
+{
+  // only libunwind recipes, which vary in size
+  return 0;
+}
+
 void
 uw_recipe_tostr(void *uwr, char str[], unwinder_t uw)
 {
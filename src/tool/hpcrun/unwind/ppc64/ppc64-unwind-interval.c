@@ -104,6 +104,13 @@ build_intervals(char  *ins, unsigned int len, unwinder_t uw)
   return stat;
 }
 
+size_t
+native_recipe_export(void *buf, const void *recipe)
+{
+  if (buf != NULL) memcpy(buf, recipe, sizeof(ppc64recipe_t));
+  return sizeof(ppc64recipe_t);
+}
+
 
 //***************************************************************************
 // unwind_interval interface
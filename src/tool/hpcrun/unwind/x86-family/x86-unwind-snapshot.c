@@ -0,0 +1,218 @@
+// -*-Mode: C++;-*- // technically C99
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+
+//
+// Unwind a copy of a user stack with the x86 unwind recipes.
+//
+// The steps follow unw_step_sp, unw_step_bp and unw_step_std in
+// x86-unwind.c, except that every load from the stack goes through the
+// copy, and that an unwind which cannot continue stops instead of
+// trolling: the frames found so far are a partial unwind.
+//
+
+//******************************************************************************
+// system includes
+//******************************************************************************
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+
+//******************************************************************************
+// external includes
+//******************************************************************************
+
+#include <monitor.h>
+
+//******************************************************************************
+// local includes
+//******************************************************************************
+
+#include <unwind/common/unwind.h>
+#include <unwind/common/fence_enum.h>
+#include <unwind/common/uw_recipe_map.h>
+#include <utilities/ip-normalized.h>
+#include <messages/messages.h>
+
+#include "x86-unwind-interval.h"
+
+//******************************************************************************
+// private operations
+//******************************************************************************
+
+static bool
+snapshot_load(hpcrun_unw_snapshot_t *snap, void *addr, void **val)
+{
+  uintptr_t lo = (uintptr_t) snap->sp;
+  uintptr_t a = (uintptr_t) addr;
+
+  if (a < lo || a - lo > snap->stack_size ||
+      snap->stack_size - (a - lo) < sizeof(void *)) {
+    return false;
+  }
+  memcpy(val, snap->stack + (a - lo), sizeof(void *));
+  return true;
+}
+
+
+// the registers of the frame being unwound
+typedef struct {
+  void *pc;
+  void *sp;
+  void *bp;
+} snapshot_regs_t;
+
+
+static bool
+snapshot_step_sp(hpcrun_unw_snapshot_t *snap, x86recipe_t *xr,
+		 snapshot_regs_t *r, snapshot_regs_t *next)
+{
+  void *next_bp = r->bp;
+  if (xr->reg.bp_status != BP_UNCHANGED &&
+      !snapshot_load(snap, r->sp + xr->reg.sp_bp_pos, &next_bp)) {
+    return false;
+  }
+
+  void **ra_loc = (void **)(r->sp + xr->reg.sp_ra_pos);
+  if (!snapshot_load(snap, ra_loc, &next->pc)) return false;
+
+  if (xr->ra_status == RA_BP_FRAME || xr->ra_status == RA_STD_FRAME) {
+    // see the sanity check of BP in unw_step_sp
+    if ((uintptr_t) next_bp < (uintptr_t) r->sp &&
+	(uintptr_t) r->bp > (uintptr_t) r->sp) {
+      next_bp = r->bp;
+    }
+  }
+
+  next->sp = ra_loc + 1;
+  next->bp = next_bp;
+
+  // unwind must move the stack pointer
+  return next->sp > r->sp;
+}
+
+
+static bool
+snapshot_step_bp(hpcrun_unw_snapshot_t *snap, x86recipe_t *xr,
+		 snapshot_regs_t *r, snapshot_regs_t *next)
+{
+  if (r->sp > r->bp) return false;
+
+  void **ra_loc = (void **)(r->bp + xr->reg.bp_ra_pos);
+  if (!snapshot_load(snap, r->bp + xr->reg.bp_bp_pos, &next->bp) ||
+      !snapshot_load(snap, ra_loc, &next->pc)) {
+    return false;
+  }
+  next->sp = ra_loc + 1;
+
+  return next->sp > r->sp;
+}
+
+//******************************************************************************
+// interface operations
+//******************************************************************************
+
+int
+hpcrun_unw_snapshot(hpcrun_unw_snapshot_t *snap,
+		    hpcrun_unw_snapshot_frame_t *frames, int max_frames,
+		    int *fence)
+{
+  snapshot_regs_t r = { snap->pc, snap->sp, snap->bp };
+  unwindr_info_t info;
+  int n = 0;
+
+  *fence = FENCE_BAD;
+
+  // the innermost pc is not a return address
+  if (!uw_recipe_map_lookup(r.pc, NATIVE_UNWINDER, &info)) return 0;
+
+  while (n < max_frames) {
+    if (monitor_unwind_process_bottom_frame(r.pc)) {
+      *fence = FENCE_MAIN;
+      break;
+    }
+    if (monitor_unwind_thread_bottom_frame(r.pc)) {
+      *fence = FENCE_THREAD;
+      break;
+    }
+
+    frames[n].ip_norm = hpcrun_normalize_ip(r.pc, info.lm);
+    frames[n].the_function =
+      hpcrun_normalize_ip((void *) info.interval.start, info.lm);
+    n++;
+
+    x86recipe_t *xr = info.btuwi ? UWI_RECIPE(info.btuwi) : NULL;
+    if (xr == NULL) break;
+
+    snapshot_regs_t next;
+    bool ok;
+    switch (xr->ra_status) {
+    case RA_SP_RELATIVE:
+      ok = snapshot_step_sp(snap, xr, &r, &next);
+      break;
+    case RA_BP_FRAME:
+      ok = snapshot_step_bp(snap, xr, &r, &next);
+      break;
+    case RA_STD_FRAME:
+      ok = snapshot_step_bp(snap, xr, &r, &next) ||
+	snapshot_step_sp(snap, xr, &r, &next);
+      break;
+    default:
+      ok = false;
+    }
+    if (!ok) break;
+
+    r = next;
+    if (!uw_recipe_map_lookup(((char *) r.pc) - 1, NATIVE_UNWINDER, &info)) {
+      break;
+    }
+  }
+
+  TMSG(UNW, "snapshot unwind: %d frames, %s", n, fence_enum_name(*fence));
+
+  return n;
+}
@@ -57,6 +57,7 @@
 #include <stdio.h>
 #include <setjmp.h>
 #include <stdbool.h>
+#include <string.h>
 #include <assert.h>
 
 #include <sys/types.h>
@@ -290,6 +291,18 @@ build_intervals(char *ins, unsigned int len, unwinder_t uw)
   return libunw_build_intervals(ins, len);
 }
 
+size_t
+native_recipe_export(void *buf, const void *recipe)
+{
+  if (buf != NULL) {
+    // prev_canonical is only used while building intervals
+    x86recipe_t *r = (x86recipe_t *) buf;
+    memcpy(r, recipe, sizeof(*r));
+    r->prev_canonical = NULL;
+  }
+  return sizeof(x86recipe_t);
+}
+
 
 static step_state
 hpcrun_unw_step_real(hpcrun_unw_cursor_t* cursor)
@@ -120,6 +120,11 @@ Options: General\n\
                            indicates that the port will be auto-negotiated with\n\
                            the client. Specifying 1 indicates that the xml will\n\
                            be transferred on the main data port.\n\
+  -P, --pyramid <n>    After merging the trace files of a database, also\n\
+                           build a pyramid of 2, 4, ..., 2^n divisions per\n\
+                           rank (1 <= n <= 16) and answer coarse views from\n\
+                           it. Each rank with more than 2^n records takes\n\
+                           about 24 * 2^n bytes. Off by default.\n\
 \n\
 ";
 
@@ -149,6 +154,8 @@ CmdLineParser::OptArgDesc Args::optArgs[] = {
      CLP::isOptArg_long },
   {  'x' , "xmlport",       CLP::ARG_REQ,  CLP::DUPOPT_CLOB, NULL,
      CLP::isOptArg_long },
+  {  'P' , "pyramid",       CLP::ARG_REQ,  CLP::DUPOPT_CLOB, NULL,
+     CLP::isOptArg_long },
   CmdLineParser_OptArgDesc_NULL_MACRO // SGI's compiler requires this version
 };
 
@@ -178,6 +185,7 @@ Args::Ctor()
   compression = true;
   mainPort = DEFAULT_PORT;//21590
   xmlPort = 0;
+  pyramidLevels = 0;
 }
 
 
@@ -270,6 +278,12 @@ Args::parse(int argc, const char* const argv[])
       if (xmlPort < 1024 && xmlPort > 1)
     	   ARG_ERROR("Ports must be greater than 1024.")
     }
+    if (parser.isOpt("pyramid")) {
+      const string& arg = parser.getOptArg("pyramid");
+      pyramidLevels = (int) CmdLineParser::toLong(arg);
+      if (pyramidLevels < 1 || pyramidLevels > 16)
+    	   ARG_ERROR("The pyramid must have 1 to 16 levels.")
+    }
   }
   catch (const CmdLineParser::ParseError& x) {
     ARG_ERROR(x.what());
@@ -113,6 +113,7 @@ public:
   int mainPort;       // default: 21590
   int xmlPort;        // default: 0
   bool compression;   // default: true
+  int pyramidLevels;  // default: 0 (no pyramid)
 
 private:
   void
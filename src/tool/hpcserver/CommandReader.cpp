@@ -0,0 +1,200 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   Reads the commands of a connection on its own thread, so that a DATA
+//   request can be cancelled by the ones that come after it.
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#include "CommandReader.hpp"
+#include "Constants.hpp"
+
+#include <iostream>
+#include <sys/socket.h>
+
+using namespace std;
+namespace TraceviewerServer
+{
+	CommandReader::CommandReader(DataSocketStream* _socket, bool _cancelSuperseded)
+	{
+		socket = _socket;
+		cancelSuperseded = _cancelSuperseded;
+		current = NULL;
+		pthread_mutex_init(&lock, NULL);
+		pthread_cond_init(&available, NULL);
+
+		reading = true;
+		if (pthread_create(&thread, NULL, readLoop, this) != 0)
+		{
+			cerr << "Could not start the command reader" << endl;
+			throw ERROR_STREAM_OPEN_FAILED;
+		}
+	}
+
+	CommandReader::~CommandReader()
+	{
+		pthread_mutex_lock(&lock);
+		bool stillReading = reading;
+		pthread_mutex_unlock(&lock);
+		//Only if the server gave up on the connection
+		if (stillReading)
+			shutdown(socket->getDescriptor(), SHUT_RD);
+		pthread_join(thread, NULL);
+
+		while (!pending.empty())
+		{
+			delete pending.front();
+			pending.pop_front();
+		}
+		delete current;
+		pthread_cond_destroy(&available);
+		pthread_mutex_destroy(&lock);
+	}
+
+	void* CommandReader::readLoop(void* arg)
+	{
+		CommandReader* reader = (CommandReader*) arg;
+		while (reader->push(reader->read()))
+			;
+		return NULL;
+	}
+
+	ServerCommand* CommandReader::read()
+	{
+		ServerCommand* command = new ServerCommand();
+		command->cancelled = false;
+		try
+		{
+			command->command = socket->readInt();
+			if (command->command == DATA)
+			{
+				command->processStart = socket->readInt();
+				command->processEnd = socket->readInt();
+				command->timeStart = socket->readLong();
+				command->timeEnd = socket->readLong();
+				command->verticalResolution = socket->readInt();
+				command->horizontalResolution = socket->readInt();
+			}
+			else if (command->command == FLTR)
+			{
+				socket->readByte();//Padding
+				command->excludeMatches = socket->readByte();
+				int count = socket->readShort();
+				for (int i = 0; i < count; ++i)
+				{
+					BinaryRepresentationOfFilter filt;
+					filt.processMin = socket->readInt();
+					filt.processMax = socket->readInt();
+					filt.processStride = socket->readInt();
+					filt.threadMin = socket->readInt();
+					filt.threadMax = socket->readInt();
+					filt.threadStride = socket->readInt();
+					command->filters.push_back(filt);
+				}
+			}
+		}
+		catch (ErrorCode& e)
+		{
+			command->error = e;
+		}
+		return command;
+	}
+
+	//Returns whether there are more commands to read
+	bool CommandReader::push(ServerCommand* command)
+	{
+		pthread_mutex_lock(&lock);
+		if (cancelSuperseded && command->error == 0 && command->command != FLTR)
+		{
+			//Filters still apply to the requests after them
+			for (size_t i = 0; i < pending.size(); i++)
+			{
+				if (pending[i]->command == DATA)
+					pending[i]->cancelled = true;
+			}
+			if (current != NULL && current->command == DATA)
+				current->cancelled = true;
+		}
+		pending.push_back(command);
+		if (command->error != 0 || (command->command != DATA && command->command != FLTR))
+			reading = false;
+		bool more = reading;
+		pthread_cond_signal(&available);
+		pthread_mutex_unlock(&lock);
+		return more;
+	}
+
+	ServerCommand* CommandReader::next()
+	{
+		pthread_mutex_lock(&lock);
+		while (pending.empty())
+			pthread_cond_wait(&available, &lock);
+		ServerCommand* command = pending.front();
+		pending.pop_front();
+		current = command;
+		pthread_mutex_unlock(&lock);
+		return command;
+	}
+
+	void CommandReader::finished(ServerCommand* command)
+	{
+		pthread_mutex_lock(&lock);
+		if (current == command)
+			current = NULL;
+		pthread_mutex_unlock(&lock);
+		delete command;
+	}
+
+} /* namespace TraceviewerServer */
@@ -0,0 +1,130 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   Reads the commands of a connection on its own thread, so that a DATA
+//   request can be cancelled by the ones that come after it.
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#ifndef COMMANDREADER_HPP_
+#define COMMANDREADER_HPP_
+
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <pthread.h>
+
+#include "DataSocketStream.hpp"
+#include "Filter.hpp"
+#include "TimeCPID.hpp" //For Time
+
+namespace TraceviewerServer
+{
+	struct ServerCommand
+	{
+		//DATA, FLTR, DONE, OPEN or whatever else the client sent
+		int command;
+		//The ErrorCode thrown while reading, if the connection broke
+		int error;
+
+		//DATA
+		int processStart;
+		int processEnd;
+		Time timeStart;
+		Time timeEnd;
+		int verticalResolution;
+		int horizontalResolution;
+		//Set by the reader thread once a later command makes the reply useless
+		//to the client, and read by the threads computing the reply
+		std::atomic<bool> cancelled;
+
+		//FLTR
+		bool excludeMatches;
+		std::vector<BinaryRepresentationOfFilter> filters;
+	};
+
+	class CommandReader
+	{
+	public:
+		//With cancelSuperseded, a DATA request is cancelled when another
+		//DATA, DONE or OPEN is read after it. Reading stops after DONE,
+		//OPEN, an unknown command or an error, so the rest of the stream
+		//belongs to the caller again.
+		CommandReader(DataSocketStream* socket, bool cancelSuperseded);
+		virtual ~CommandReader();
+
+		//Waits for the next command. Pass it to finished when it is done.
+		ServerCommand* next();
+		void finished(ServerCommand* command);
+
+	private:
+		static void* readLoop(void* arg);
+		ServerCommand* read();
+		bool push(ServerCommand* command);
+
+		DataSocketStream* socket;
+		bool cancelSuperseded;
+		pthread_t thread;
+		bool reading;
+
+		pthread_mutex_t lock;
+		pthread_cond_t available;
+		std::deque<ServerCommand*> pending;
+		//The command between next and finished
+		ServerCommand* current;
+	};
+
+} /* namespace TraceviewerServer */
+#endif /* COMMANDREADER_HPP_ */
@@ -99,6 +99,7 @@ void Communication::sendParseOpenDB(string pathToDB)
 	}
 	copy(pathToDB.begin(), pathToDB.end(), cmdPathToDB.ofile.path);
 	cmdPathToDB.ofile.path[pathToDB.size()] = '\0';
+	cmdPathToDB.ofile.compression = traceCompression;
 
 	COMM_WORLD.Bcast(&cmdPathToDB, sizeof(cmdPathToDB), MPI_PACKED,
 			MPICommunication::SOCKET_SERVER);
@@ -118,9 +119,11 @@ void Communication::sendStartGetData(SpaceTimeDataController* contr, int process
 	COMM_WORLD.Bcast(&toBcast, sizeof(toBcast), MPI_PACKED,
 		MPICommunication::SOCKET_SERVER);
 }
-void Communication::sendEndGetData(DataSocketStream* stream, ProgressBar* prog, SpaceTimeDataController* controller)
+int Communication::sendEndGetData(DataSocketStream* stream, ProgressBar* prog, SpaceTimeDataController* controller,
+		const std::atomic<bool>* cancelled)
 {
 	int ranksDone = 1;//1 for the MPI rank that deals with the sockets
+	int linesSent = 0;
 	int size = COMM_WORLD.Get_size();
 
 	bool first = false;
@@ -136,19 +139,24 @@ void Communication::sendEndGetData(DataSocketStream* stream, ProgressBar* prog,
 				LOGTIMESTAMPEDMSG("First line computed.")
 			}
 
+			char CompressedTraceLine[msg.data.compressedSize];
+			COMM_WORLD.Recv(CompressedTraceLine, msg.data.compressedSize, MPI_BYTE, msg.data.rankID,
+					MPI_ANY_TAG);
+
+			//The slaves finish a cancelled request, but its lines are dropped
+			if (*cancelled)
+				continue;
+
 			stream->writeInt(msg.data.line);
 			stream->writeInt(msg.data.entries);
 			stream->writeLong(msg.data.begtime); // Begin time
 			stream->writeLong(msg.data.endtime); //End time
 			stream->writeInt(msg.data.compressedSize);
 
-			char CompressedTraceLine[msg.data.compressedSize];
-			COMM_WORLD.Recv(CompressedTraceLine, msg.data.compressedSize, MPI_BYTE, msg.data.rankID,
-					MPI_ANY_TAG);
-
 			stream->writeRawData(CompressedTraceLine, msg.data.compressedSize);
 
 			stream->flush();
+			linesSent++;
 			if (first)
 			{
 				LOGTIMESTAMPEDMSG("First line sent.")
@@ -167,6 +175,7 @@ void Communication::sendEndGetData(DataSocketStream* stream, ProgressBar* prog,
 		}
 	}
 	LOGTIMESTAMPEDMSG("All data done.")
+	return linesSent;
 }
 void Communication::sendStartFilter(int count, bool excludeMatches)
 {
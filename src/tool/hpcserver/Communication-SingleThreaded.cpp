@@ -58,6 +58,11 @@
 //***************************************************************************
 
 #include <stdint.h>                     // for uint64_t
+#include <unistd.h>                     // for sysconf
+#include <pthread.h>                    // for pthread_create, etc
+#include <algorithm>                    // for min, max
+#include <deque>                        // for deque
+#include <exception>                    // for exception_ptr
 #include <iostream>                     // for operator<<, basic_ostream, etc
 #include <string>                       // for string
 #include <vector>                       // for vector, vector<>::iterator
@@ -101,47 +106,231 @@ void Communication::sendStartGetData(SpaceTimeDataController* contr, int process
 
 
 }
-void Communication::sendEndGetData(DataSocketStream* stream, ProgressBar* prog, SpaceTimeDataController* controller)
+//At most this many threads compress and send trace lines while the lines
+//after them are computed
+static const int MAX_ENCODE_THREADS = 16;
+
+//What the thread computing the lines shares with the ones sending them
+struct LineSendJob
+{
+	SpaceTimeDataController* controller;
+	DataSocketStream* stream;
+	ProgressBar* prog;
+	const std::atomic<bool>* cancelled;
+
+	//Under the pool's lock: lines read in and not yet taken by a sender, how
+	//many lines are being sent, and the first error a sender ran into
+	deque<int> ready;
+	int inFlight;
+	exception_ptr error;
+
+	//Held while a line is written to the socket
+	pthread_mutex_t sending;
+	int sent;
+};
+
+//The threads that send lines, started for the first DATA request and kept
+//for the ones after it
+struct LineSendPool
+{
+	pthread_mutex_t lock;
+	//A line is ready, or the job has changed
+	pthread_cond_t changed;
+	//The last line in flight has been sent
+	pthread_cond_t drained;
+	LineSendJob* job;
+	int numThreads;
+};
+
+static LineSendPool sendPool = { PTHREAD_MUTEX_INITIALIZER, PTHREAD_COND_INITIALIZER,
+		PTHREAD_COND_INITIALIZER, NULL, -1 };
+
+static void encodeTraceLine(vector<TimeCPID>& data, DataCompressionLayer* comprStr)
+{
+	DEBUGCOUT(2) << "Sending process timeline with " << data.size() << " entries" << endl;
+
+	vector<TimeCPID>::iterator it;
+	Time currentTime = data[0].timestamp;
+	for (it = data.begin(); it != data.end(); ++it)
+	{
+		comprStr->writeInt( (int)(it->timestamp - currentTime));
+		comprStr->writeInt( it->cpid);
+		currentTime = it->timestamp;
+	}
+	comprStr->flush();
+}
+
+static void sendTraceLine(LineSendJob* job, int line)
 {
-	// TODO: Make this so that the Lines get sent as soon as they are
-	// filled.
+	ProcessTimeline* timeline = job->controller->traces[line];
+	vector<TimeCPID>& data = *timeline->data->listCPID;
+	DataCompressionLayer compressed(traceCompression);
+	encodeTraceLine(data, &compressed);
 
-	controller->fillTraces();
-	for (int i = 0; i < controller->tracesLength; i++)
+	pthread_mutex_lock(&job->sending);
+	try
 	{
+		if (!*job->cancelled)
+		{
+			DataSocketStream* stream = job->stream;
+			stream->writeInt( timeline->line());
+			stream->writeInt( data.size());
+			// Begin time
+			stream->writeLong( data[0].timestamp);
+			//End time
+			stream->writeLong( data[data.size() - 1].timestamp);
 
-		ProcessTimeline* timeline = controller->traces[i];
-		stream->writeInt( timeline->line());
-		vector<TimeCPID> data = *timeline->data->listCPID;
-		stream->writeInt( data.size());
-		// Begin time
-		stream->writeLong( data[0].timestamp);
-		//End time
-		stream->writeLong( data[data.size() - 1].timestamp);
+			int outputBufferLen = compressed.getOutputLength();
+			char* outputBuffer = (char*)compressed.getOutputBuffer();
 
-		DataCompressionLayer comprStr;
+			stream->writeInt(outputBufferLen);
 
-		vector<TimeCPID>::iterator it;
-		DEBUGCOUT(2) << "Sending process timeline with " << data.size() << " entries" << endl;
+			stream->writeRawData(outputBuffer, outputBufferLen);
+			stream->flush();
+			job->sent++;
+			job->prog->incrementProgress();
+		}
+	}
+	catch (...)
+	{
+		pthread_mutex_unlock(&job->sending);
+		throw;
+	}
+	pthread_mutex_unlock(&job->sending);
+}
 
+static void* sendWorker(void* arg)
+{
+	LineSendPool* pool = (LineSendPool*) arg;
+	pthread_mutex_lock(&pool->lock);
+	while (true)
+	{
+		while (pool->job == NULL || pool->job->ready.empty())
+			pthread_cond_wait(&pool->changed, &pool->lock);
+		LineSendJob* job = pool->job;
+		int line = job->ready.front();
+		job->ready.pop_front();
+		job->inFlight++;
+		bool skip = *job->cancelled || job->error;
+		pthread_mutex_unlock(&pool->lock);
 
-		Time currentTime = data[0].timestamp;
-		for (it = data.begin(); it != data.end(); ++it)
+		//An error on this thread would terminate the process, so it is
+		//passed to the one waiting for the job
+		exception_ptr error;
+		if (!skip)
 		{
-			comprStr.writeInt( (int)(it->timestamp - currentTime));
-			comprStr.writeInt( it->cpid);
-			currentTime = it->timestamp;
+			try
+			{
+				sendTraceLine(job, line);
+			}
+			catch (...)
+			{
+				error = current_exception();
+			}
 		}
-		comprStr.flush();
-		int outputBufferLen = comprStr.getOutputLength();
-		char* outputBuffer = (char*)comprStr.getOutputBuffer();
 
-		stream->writeInt(outputBufferLen);
+		pthread_mutex_lock(&pool->lock);
+		if (error && !job->error)
+			job->error = error;
+		if (--job->inFlight == 0 && job->ready.empty())
+			pthread_cond_broadcast(&pool->drained);
+	}
+	return NULL;
+}
 
-		stream->writeRawData(outputBuffer, outputBufferLen);
-		prog->incrementProgress();
+//Returns the pool, with no threads if none could be started
+static LineSendPool* getSendPool()
+{
+	if (sendPool.numThreads < 0)
+	{
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		int numThreads = min((int) max(cpus, 1L), MAX_ENCODE_THREADS);
+		sendPool.numThreads = 0;
+		for (; sendPool.numThreads < numThreads; sendPool.numThreads++)
+		{
+			pthread_t worker;
+			if (pthread_create(&worker, NULL, sendWorker, &sendPool) != 0)
+				break;
+			pthread_detach(worker);
+		}
 	}
-	stream->flush();
+	return &sendPool;
+}
+
+static bool lineFilled(int line, void* arg)
+{
+	LineSendJob* job = (LineSendJob*) arg;
+	pthread_mutex_lock(&sendPool.lock);
+	job->ready.push_back(line);
+	bool failed = (bool) job->error;
+	pthread_cond_signal(&sendPool.changed);
+	pthread_mutex_unlock(&sendPool.lock);
+	return !*job->cancelled && !failed;
+}
+
+//Waits until the senders are done with the job and takes it from the pool
+static void finishJob(LineSendPool* pool, LineSendJob* job)
+{
+	pthread_mutex_lock(&pool->lock);
+	while (!job->ready.empty() || job->inFlight > 0)
+		pthread_cond_wait(&pool->drained, &pool->lock);
+	pool->job = NULL;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+int Communication::sendEndGetData(DataSocketStream* stream, ProgressBar* prog, SpaceTimeDataController* controller,
+		const std::atomic<bool>* cancelled)
+{
+	//The lines are read in on this thread, since the trace file is not
+	//thread safe, and compressed and sent by the pool as soon as they are
+	//ready. The client puts them in place by their line number.
+	LineSendJob job;
+	job.controller = controller;
+	job.stream = stream;
+	job.prog = prog;
+	job.cancelled = cancelled;
+	job.inFlight = 0;
+	job.sent = 0;
+	pthread_mutex_init(&job.sending, NULL);
+
+	LineSendPool* pool = getSendPool();
+	try
+	{
+		if (pool->numThreads == 0)
+		{
+			//Without a thread to spare, the lines are sent after they are computed
+			controller->fillTraces();
+			for (int i = 0; i < controller->tracesLength && !*cancelled; i++)
+				sendTraceLine(&job, i);
+		}
+		else
+		{
+			pthread_mutex_lock(&pool->lock);
+			pool->job = &job;
+			pthread_mutex_unlock(&pool->lock);
+			try
+			{
+				controller->fillTraces(lineFilled, &job);
+			}
+			catch (...)
+			{
+				finishJob(pool, &job);
+				throw;
+			}
+			finishJob(pool, &job);
+			//Rethrown here, where runServer catches it
+			if (job.error)
+				rethrow_exception(job.error);
+		}
+	}
+	catch (...)
+	{
+		pthread_mutex_destroy(&job.sending);
+		throw;
+	}
+
+	pthread_mutex_destroy(&job.sending);
+	return job.sent;
 }
 
 void Communication::sendStartFilter(int count, bool excludeMatches)
@@ -61,6 +61,7 @@
 #ifndef COMMUNICATION_H_
 #define COMMUNICATION_H_
 
+#include <atomic>
 #include <string>
 
 #include "TimeCPID.hpp" //For Time
@@ -84,7 +85,10 @@ public:
 	static void sendParseOpenDB(string pathToDB);
 	static void sendStartGetData(SpaceTimeDataController* contr, int processStart, int processEnd,
 			Time timeStart, Time timeEnd, int verticalResolution, int horizontalResolution);
-	static void sendEndGetData(DataSocketStream* stream, ProgressBar* prog, SpaceTimeDataController* controller);
+	//Sends the lines as they are computed, until all are sent or *cancelled
+	//is set, and returns how many were sent
+	static int sendEndGetData(DataSocketStream* stream, ProgressBar* prog, SpaceTimeDataController* controller,
+			const std::atomic<bool>* cancelled);
 	static void sendStartFilter(int count, bool excludeMatches);
 	static void sendFilter(BinaryRepresentationOfFilter filt);
 
@@ -96,6 +96,23 @@ enum Header {
 	SLAVE_DONE = 0x534C444E
 };
 
+//A client that speaks protocol 0x00010003 may send the next command while
+//the reply to a DATA request is still coming. A DATA request followed by
+//another DATA, DONE or OPEN is cancelled and its reply cut short, so every
+//reply ends with this line number and the number of lines sent.
+static const int END_OF_DATA_REPLY = -1;
+
+//Codec of the trace lines in a DATA reply, sent as the compression type
+//in the reply to OPEN. A client that speaks protocol 0x00010002 lists the
+//codecs it can decode after the database path, and the server picks the
+//first one it has.
+enum CompressionType {
+	COMPRESSION_NONE = 0,
+	COMPRESSION_ZLIB = 1,
+	COMPRESSION_LZ4 = 2,
+	COMPRESSION_ZSTD = 3
+};
+
 enum ServerNextAction {
 	CLOSE_SERVER = 0,
 	START_NEW_CONNECTION_IMMEDIATELY=1
@@ -113,7 +130,8 @@ enum ErrorCode {
 	ERROR_GET_RAM_SIZE_FAILED = -4456,
 	ERROR_READ_TOO_LITTLE = -5200,
 	ERROR_STREAM_CLOSED = -12,
-	ERROR_SOCKET_IN_USE = -1111
+	ERROR_SOCKET_IN_USE = -1111,
+	ERROR_MERGE_FAILED = -5300
 };
 
 }
@@ -64,6 +64,8 @@
 #include "FileUtils.hpp"
 #include "FileData.hpp"
 #include "SpaceTimeDataController.hpp"
+#include "Server.hpp"
+#include "TracePyramid.hpp"
 
 namespace TraceviewerServer
 {
@@ -146,6 +148,10 @@ namespace TraceviewerServer
 						location->fileTrace = outputFile;
 						if (FileUtils::getFileSize(location->fileTrace) > MIN_TRACE_SIZE)
 						{
+							//Without a pyramid the views are read from the trace file
+							if (pyramidLevels > 0)
+								TracePyramid::build(outputFile, pyramidLevels,
+										SpaceTimeDataController::DEFAULT_HEADER_SIZE);
 							return true;
 						}
 						else
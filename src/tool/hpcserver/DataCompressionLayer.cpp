@@ -63,47 +63,124 @@
 
 #include <iostream> //For cerr
 #include <cassert>
+#include <cstring>
 #include <algorithm> //For copy
 #include <zlib.h>
 
+#include <dlfcn.h>
+#include <pthread.h>
+
 using namespace std;
 namespace TraceviewerServer
 {
+	//The block codecs are looked up at run time so that hpcserver does not
+	//depend on them. Only the compression side is needed.
+	typedef size_t ZstdCompressFn(void*, size_t, const void*, size_t, int);
+	typedef size_t ZstdCompressBoundFn(size_t);
+	typedef unsigned ZstdIsErrorFn(size_t);
+	typedef int Lz4CompressFn(const char*, char*, int, int);
+	typedef int Lz4CompressBoundFn(int);
+
+	static ZstdCompressFn* zstdCompress = NULL;
+	static ZstdCompressBoundFn* zstdCompressBound = NULL;
+	static ZstdIsErrorFn* zstdIsError = NULL;
+	static Lz4CompressFn* lz4Compress = NULL;
+	static Lz4CompressBoundFn* lz4CompressBound = NULL;
+	static pthread_once_t codecsLoaded = PTHREAD_ONCE_INIT;
+
+	//zstd's fastest level still compresses trace lines better than LZ4
+	static const int ZSTD_LEVEL = 1;
+
+	static void loadCodecs()
+	{
+		void* zstd = dlopen("libzstd.so.1", RTLD_NOW | RTLD_LOCAL);
+		if (zstd != NULL)
+		{
+			zstdCompress = (ZstdCompressFn*) dlsym(zstd, "ZSTD_compress");
+			zstdCompressBound = (ZstdCompressBoundFn*) dlsym(zstd, "ZSTD_compressBound");
+			zstdIsError = (ZstdIsErrorFn*) dlsym(zstd, "ZSTD_isError");
+			if (!zstdCompress || !zstdCompressBound || !zstdIsError)
+				zstdCompress = NULL;
+		}
+		void* lz4 = dlopen("liblz4.so.1", RTLD_NOW | RTLD_LOCAL);
+		if (lz4 != NULL)
+		{
+			lz4Compress = (Lz4CompressFn*) dlsym(lz4, "LZ4_compress_default");
+			lz4CompressBound = (Lz4CompressBoundFn*) dlsym(lz4, "LZ4_compressBound");
+			if (!lz4CompressBound)
+				lz4Compress = NULL;
+		}
+		DEBUGCOUT(1) << "zstd " << (zstdCompress ? "available" : "not available")
+				<< ", lz4 " << (lz4Compress ? "available" : "not available") << endl;
+	}
 
-	DataCompressionLayer::DataCompressionLayer()
+	bool DataCompressionLayer::isAvailable(CompressionType type)
+	{
+		switch (type)
+		{
+			case COMPRESSION_NONE:
+			case COMPRESSION_ZLIB:
+				return true;
+			case COMPRESSION_LZ4:
+				pthread_once(&codecsLoaded, loadCodecs);
+				return lz4Compress != NULL;
+			case COMPRESSION_ZSTD:
+				pthread_once(&codecsLoaded, loadCodecs);
+				return zstdCompress != NULL;
+		}
+		return false;
+	}
+
+	DataCompressionLayer::DataCompressionLayer(CompressionType _type)
 	{
 
 		//See: http://www.zlib.net/zpipe.c
 
+		if (!isAvailable(_type))
+			throw ERROR_COMPRESSION_FAILED;
+		type = _type;
+
 		bufferIndex = 0;
 		posInCompBuffer = 0;
 
 		inBuf = new char[BUFFER_SIZE];
+		inBufferCurrentSize = BUFFER_SIZE;
 		outBuf = new unsigned char[BUFFER_SIZE];
 		outBufferCurrentSize = BUFFER_SIZE;
 
 		progMonitor = NULL;
 
-		compressor.zalloc = Z_NULL;
-		compressor.zfree = Z_NULL;
-		compressor.opaque = Z_NULL;
-		int ret = deflateInit(&compressor, -1);
-		if (ret != Z_OK)
-			throw ret;
+		if (type == COMPRESSION_ZLIB)
+		{
+			compressor.zalloc = Z_NULL;
+			compressor.zfree = Z_NULL;
+			compressor.opaque = Z_NULL;
+			int ret = deflateInit(&compressor, -1);
+			if (ret != Z_OK)
+				throw ret;
+		}
 
 	}
 
-	DataCompressionLayer::DataCompressionLayer(z_stream customCompressor, ProgressBar* _progMonitor)
+	DataCompressionLayer::DataCompressionLayer(int windowBits, ProgressBar* _progMonitor)
 	{
+		type = COMPRESSION_ZLIB;
 		bufferIndex = 0;
 		posInCompBuffer = 0;
 
 		inBuf = new char[BUFFER_SIZE];
+		inBufferCurrentSize = BUFFER_SIZE;
 		outBuf = new unsigned char[BUFFER_SIZE];
 		outBufferCurrentSize = BUFFER_SIZE;
 
 		progMonitor = _progMonitor;
-		compressor = customCompressor;
+		//The stream is initialized in place, since zlib rejects a copied one
+		compressor.zalloc = Z_NULL;
+		compressor.zfree = Z_NULL;
+		compressor.opaque = Z_NULL;
+		int ret = deflateInit2(&compressor, Z_DEFAULT_COMPRESSION, Z_DEFLATED, windowBits, 8, Z_DEFAULT_STRATEGY);
+		if (ret != Z_OK)
+			throw ret;
 	}
 
 	void DataCompressionLayer::writeInt(int toWrite)
@@ -132,8 +209,7 @@ namespace TraceviewerServer
 		while (!feof(toWrite))
 		{
 			makeRoom(BUFFER_SIZE);
-			assert(bufferIndex == 0);
-			unsigned int read= fread(inBuf, sizeof(char), BUFFER_SIZE, toWrite);
+			unsigned int read= fread(inBuf + bufferIndex, sizeof(char), BUFFER_SIZE, toWrite);
 			bufferIndex += read;
 			pInc(read);
 		}
@@ -141,12 +217,29 @@ namespace TraceviewerServer
 	}
 	void DataCompressionLayer::flush()
 	{
-		softFlush(Z_FINISH);
+		if (type == COMPRESSION_ZLIB)
+			softFlush(Z_FINISH);
+		else
+			blockFlush();
 	}
 	void DataCompressionLayer::makeRoom(int count)
 	{
-		if (count + bufferIndex > BUFFER_SIZE)
+		if (count + bufferIndex <= inBufferCurrentSize)
+			return;
+		if (type == COMPRESSION_ZLIB)
+		{
 			softFlush(Z_NO_FLUSH);
+			return;
+		}
+		//The block codecs need all of the input at once
+		unsigned int newSize = inBufferCurrentSize;
+		while (count + bufferIndex > newSize)
+			newSize *= BUFFER_GROW_FACTOR;
+		char* newBuffer = new char[newSize];
+		copy(inBuf, inBuf + bufferIndex, newBuffer);
+		delete[] inBuf;
+		inBuf = newBuffer;
+		inBufferCurrentSize = newSize;
 	}
 	void DataCompressionLayer::softFlush(int flushType)
 	{
@@ -178,6 +271,36 @@ namespace TraceviewerServer
 		bufferIndex = 0;
 	}
 
+	void DataCompressionLayer::blockFlush()
+	{
+		size_t bound = bufferIndex;
+		if (type == COMPRESSION_LZ4)
+			bound = lz4CompressBound(bufferIndex);
+		else if (type == COMPRESSION_ZSTD)
+			bound = zstdCompressBound(bufferIndex);
+		while (outBufferCurrentSize < bound)
+			growOutputBuffer();
+
+		size_t outLen = bufferIndex;
+		if (type == COMPRESSION_NONE)
+			memcpy(outBuf, inBuf, bufferIndex);
+		else if (type == COMPRESSION_LZ4)
+		{
+			int ret = lz4Compress(inBuf, (char*) outBuf, bufferIndex, outBufferCurrentSize);
+			if (ret <= 0 && bufferIndex > 0)
+				throw ERROR_COMPRESSION_FAILED;
+			outLen = ret;
+		}
+		else
+		{
+			outLen = zstdCompress(outBuf, outBufferCurrentSize, inBuf, bufferIndex, ZSTD_LEVEL);
+			if (zstdIsError(outLen))
+				throw ERROR_COMPRESSION_FAILED;
+		}
+		posInCompBuffer = outLen;
+		bufferIndex = 0;
+	}
+
 	void DataCompressionLayer::growOutputBuffer()
 	{
 		unsigned char* newBuffer = new unsigned char[outBufferCurrentSize * BUFFER_GROW_FACTOR];
@@ -205,7 +328,8 @@ namespace TraceviewerServer
 	}
 	DataCompressionLayer::~DataCompressionLayer()
 	{
-		deflateEnd(&compressor);
+		if (type == COMPRESSION_ZLIB)
+			deflateEnd(&compressor);
 		delete[] inBuf;
 		delete[] outBuf;
 	}
@@ -60,6 +60,7 @@
 #include <stdint.h>
 #include <cstdio>
 
+#include "Constants.hpp"
 #include "ProgressBar.hpp"
 /*
  * CompressingDataSocketLayer.h
@@ -78,9 +79,10 @@ namespace TraceviewerServer
 	class DataCompressionLayer
 	{
 	public:
-		DataCompressionLayer();
-		//Advanced constructor:
-		DataCompressionLayer(z_stream customCompressor, ProgressBar* progMonitor);
+		DataCompressionLayer(CompressionType type = COMPRESSION_ZLIB);
+		//Advanced constructor: zlib with the given deflateInit2 windowBits,
+		//e.g. 16+15 for a gzip stream with a window of 15 bits
+		DataCompressionLayer(int windowBits, ProgressBar* progMonitor);
 
 		virtual ~DataCompressionLayer();
 		void writeInt(int);
@@ -91,20 +93,28 @@ namespace TraceviewerServer
 		unsigned char* getOutputBuffer();
 		int getOutputLength();
 
+		//LZ4 and zstd are loaded when first asked for, if the libraries
+		//are installed. zlib and no compression are always available.
+		static bool isAvailable(CompressionType type);
+
 	private:
 		//Checks to make sure there is enough room in the buffer for count
 		//bytes. If there is not, it makes room by flushing the buffer.
 		void makeRoom(int count);
 		void softFlush(int flushType);
+		//Compresses all of the input at once, for the block codecs
+		void blockFlush();
 
 		//Increment the progress bar if it isn't NULL
 		void pInc(unsigned int count);
 
 		void growOutputBuffer();
 
+		CompressionType type;
 		unsigned int bufferIndex;
 		z_stream compressor;
 		char* inBuf;
+		unsigned int inBufferCurrentSize;
 		unsigned char* outBuf;
 		unsigned int posInCompBuffer;
 
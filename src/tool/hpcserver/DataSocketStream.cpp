@@ -127,7 +127,10 @@ namespace TraceviewerServer
 		socketDesc = accept(unopenedSocketFD, (sockaddr*) &client, &len);
 		if (socketDesc < 0)
 			cerr << "Error on accept" << endl;
-		file = fdopen(socketDesc, "r+b"); //read, write, binary
+		//Separate streams, so that one thread can wait for the next command
+		//while another one writes a reply
+		file = fdopen(socketDesc, "wb");
+		readFile = fdopen(dup(socketDesc), "rb");
 	}
 
 	int DataSocketStream::getPort()
@@ -154,6 +157,7 @@ namespace TraceviewerServer
 	DataSocketStream::~DataSocketStream()
 	{
 		fclose(file);
+		fclose(readFile);
 		shutdown(socketDesc, SHUT_RDWR);
 		close(socketDesc);
 		close(unopenedSocketFD);
@@ -202,7 +206,7 @@ namespace TraceviewerServer
 	int DataSocketStream::readInt()
 	{
 		char Af[SIZEOF_INT];
-		int err = fread(Af, 1, SIZEOF_INT, file);
+		int err = fread(Af, 1, SIZEOF_INT, readFile);
 		if (err != SIZEOF_INT)
 			throw ERROR_READ_TOO_LITTLE;
 		return ByteUtilities::readInt(Af);
@@ -212,7 +216,7 @@ namespace TraceviewerServer
 	Long DataSocketStream::readLong()
 	{
 		char Af[SIZEOF_LONG];
-		int err = fread(Af, 1, SIZEOF_LONG, file);
+		int err = fread(Af, 1, SIZEOF_LONG, readFile);
 		if (err != SIZEOF_LONG)
 			throw ERROR_READ_TOO_LITTLE;
 		return ByteUtilities::readLong(Af);
@@ -222,7 +226,7 @@ namespace TraceviewerServer
 	short DataSocketStream::readShort()
 	{
 		char Af[SIZEOF_SHORT];
-		int err = fread(Af, 1, SIZEOF_SHORT, file);
+		int err = fread(Af, 1, SIZEOF_SHORT, readFile);
 		if (err != 2)
 			throw ERROR_READ_TOO_LITTLE;
 		return ByteUtilities::readShort(Af);
@@ -230,7 +234,7 @@ namespace TraceviewerServer
 	char DataSocketStream::readByte()
 	{
 		char Af[SIZEOF_BYTE];
-		int err = fread(Af, 1, SIZEOF_BYTE, file);
+		int err = fread(Af, 1, SIZEOF_BYTE, readFile);
 		if (err != 1)
 			throw ERROR_READ_TOO_LITTLE;
 		return Af[0];
@@ -242,7 +246,7 @@ namespace TraceviewerServer
 		short Len = readShort();
 
 		char* Msg = new char[Len + 1];
-		int err = fread(Msg, 1, Len, file);
+		int err = fread(Msg, 1, Len, readFile);
 		if (err != Len)
 			throw ERROR_READ_TOO_LITTLE;
 
@@ -110,6 +110,7 @@ namespace TraceviewerServer
 		SocketFD unopenedSocketFD;
 		void checkForErrors(int);
 		FILE* file;
+		FILE* readFile;
 	};
 
 } /* namespace TraceviewerServer */
@@ -67,11 +67,13 @@
 
 #include "DebugUtils.hpp"
 #include "FilteredBaseData.hpp"
+#include "TracePyramid.hpp"
 
 namespace TraceviewerServer {
 FilteredBaseData::FilteredBaseData(string filename, int _headerSize) {
 	baseDataFile = new BaseDataFile(filename, _headerSize);
 	headerSize = _headerSize;
+	pyramid = NULL;
 	baseOffsets = baseDataFile->getOffsets();
 	//Filters are default, which is allow everything, so this will initialize the vector
 	filter();
@@ -134,4 +136,18 @@ short* FilteredBaseData::getThreadIDs()
 {
 	return baseDataFile->threadIDs;
 }
+
+void FilteredBaseData::setPyramid(TracePyramid* _pyramid)
+{
+	pyramid = _pyramid;
+}
+
+bool FilteredBaseData::samplePyramid(int pseudoRank, Time timeStart,
+		double pixelLength, int numPixels, vector<TimeCPID>& samples)
+{
+	assert((unsigned int)pseudoRank < rankMapping.size());
+	if (pyramid == NULL)
+		return false;
+	return pyramid->sample(rankMapping[pseudoRank], timeStart, pixelLength, numPixels, samples);
+}
 }
@@ -64,6 +64,7 @@
 #include "BaseDataFile.hpp"
 #include "FilterSet.hpp"
 #include "FileUtils.hpp"//For FileOffset
+#include "TimeCPID.hpp"
 
 #include <vector>
 #include <stdint.h>
@@ -71,6 +72,8 @@
 using std::vector;
 namespace TraceviewerServer
 {
+	class TracePyramid;
+
 	class FilteredBaseData {
 	public:
 		FilteredBaseData(string filename, int _headerSize);
@@ -85,6 +88,11 @@ namespace TraceviewerServer
 		int getNumberOfRanks();
 		int* getProcessIDs();
 		short* getThreadIDs();
+
+		//The pyramid is owned by the caller and may be NULL
+		void setPyramid(TracePyramid* _pyramid);
+		bool samplePyramid(int pseudoRank, Time timeStart, double pixelLength,
+				int numPixels, vector<TimeCPID>& samples);
 	private:
 
 		void filter();
@@ -96,6 +104,7 @@ namespace TraceviewerServer
 		//pool to the real ranks from the filtered pool.
 		vector<int> rankMapping;
 		int headerSize;
+		TracePyramid* pyramid;
 	};
 
 
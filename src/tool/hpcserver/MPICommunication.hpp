@@ -79,6 +79,7 @@ namespace TraceviewerServer
 		typedef struct
 		{
 			char path[1024];
+			int compression;//CompressionType of the trace lines
 		} open_file_command;
 		typedef struct
 		{
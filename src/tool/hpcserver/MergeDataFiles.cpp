@@ -69,22 +69,55 @@
 #include <algorithm>
 #include <cstdlib>
 #include <cstdio>
+#include <fstream>
 #include <sstream>
 
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
 using namespace std;
 typedef int64_t Long;
 namespace TraceviewerServer
 {
+	//State shared by the threads that copy the trace files. Everything but
+	//the entries, the file descriptors and the buffer size is under lock.
+	struct MergeJob
+	{
+		vector<MergeEntry>* entries;
+		vector<char>* done;
+		int outFd;
+		int journalFd;
+		pthread_mutex_t lock;
+		size_t next;
+		vector<unsigned int> unjournaled;
+		FileOffset unjournaledBytes;
+		ProgressBar* prog;
+		bool failed;
+	};
+
+	/*
+	 * The merged file is written in place: its header gives the offset of
+	 * every trace file, so each file is copied straight to its offset by
+	 * one of several threads. While the merge runs, outputFile.merging
+	 * records which files are already in place, so a merge that was
+	 * interrupted picks up where it stopped. The end marker is written
+	 * last, and the journal is removed once it is on disk.
+	 */
 	MergeDataAttribute MergeDataFiles::merge(string directory, string globInputFile,
 			string outputFile)
 	{
 		 int lastDot = globInputFile.find_last_of('.');
 		 string suffix = globInputFile.substr(lastDot);
 
+		string journalFile = outputFile + ".merging";
+		bool resuming = FileUtils::exists(journalFile);
+
 		DEBUGCOUT(2) << "Checking to see if " << outputFile << " exists" << endl;
 
 
-		if (FileUtils::exists(outputFile))
+		if (FileUtils::exists(outputFile) && !resuming)
 		{
 
 			DEBUGCOUT(2) << "Exists" << endl;
@@ -105,17 +138,6 @@ namespace TraceviewerServer
 			return FAIL_NO_DATA;
 		}
 
-		DataOutputFileStream dos(outputFile.c_str());
-
-		//-----------------------------------------------------
-		// 1. write the header:
-		//  int type (0: unknown, 1: mpi, 2: openmp, 3: hybrid, ...
-		//	int num_files
-		//-----------------------------------------------------
-
-		int type = 0;
-		dos.writeInt(type);
-
 		vector<string> allPaths = FileUtils::getAllFilesInDir(directory);
 		vector<string> filteredFileNames;
 		vector<string>::iterator it;
@@ -129,20 +151,21 @@ namespace TraceviewerServer
 		//To sort them, we need a random access iterator, which means we need to load all of them into a vector
 		sort(filteredFileNames.begin(), filteredFileNames.end());
 
-		dos.writeInt(filteredFileNames.size());
-		const Long num_metric_header = 2 * SIZEOF_INT; // type of app (4 bytes) + num procs (4 bytes)
-		 Long num_metric_index = filteredFileNames.size()
-				* (SIZEOF_LONG + 2 * SIZEOF_INT);
-		FileOffset currentOffset = num_metric_header + num_metric_index;
-
-		int name_format = 0; // FIXME hack:some hpcprof revisions have different format name !!
 		//-----------------------------------------------------
-		// 2. Record the process ID, thread ID and the currentOffset
+		// 1. Record the process ID, thread ID and the offset of every file.
 		//   It will also detect if the application is mp, mt, or hybrid
 		//	 no accelator is supported
+		//  header:
+		//	int type (0: unknown, 1: mpi, 2: openmp, 3: hybrid, ...
+		//	int num_files
 		//  for all files:
-		//		int proc-id, int thread-id, long currentOffset
+		//		int proc-id, int thread-id, long offset
 		//-----------------------------------------------------
+		int type = 0;
+		vector<MergeEntry> entries;
+		vector<int> procs, threads;
+
+		int name_format = 0; // FIXME hack:some hpcprof revisions have different format name !!
 		vector<string>::iterator it2;
 		for (it2 = filteredFileNames.begin(); it2 < filteredFileNames.end(); it2++)
 		{
@@ -169,48 +192,132 @@ namespace TraceviewerServer
 				string Token_To_Parse = tokens[name_format + num_tokens - PROC_POS];
 				proc = atoi(Token_To_Parse.c_str());
 			}
-			dos.writeInt(proc);
 			if (proc != 0)
 				type |= MULTI_PROCESSES;
 			 int Thread = atoi(tokens[name_format + num_tokens - THREAD_POS].c_str());
-			dos.writeInt(Thread);
 			if (Thread != 0)
 				type |= MULTI_THREADING;
-			dos.writeLong(currentOffset);
-			currentOffset += FileUtils::getFileSize(Filename);
+
+			MergeEntry entry;
+			entry.path = Filename;
+			entry.size = FileUtils::getFileSize(Filename);
+			entries.push_back(entry);
+			procs.push_back(proc);
+			threads.push_back(Thread);
+		}
+
+		const Long num_metric_header = 2 * SIZEOF_INT; // type of app (4 bytes) + num procs (4 bytes)
+		 Long num_metric_index = entries.size()
+				* (SIZEOF_LONG + 2 * SIZEOF_INT);
+		FileOffset currentOffset = num_metric_header + num_metric_index;
+
+		vector<char> header(currentOffset);
+		char* pos = &header[0];
+		ByteUtilities::writeInt(pos, type);
+		ByteUtilities::writeInt(pos + SIZEOF_INT, entries.size());
+		pos += num_metric_header;
+		for (size_t i = 0; i < entries.size(); i++)
+		{
+			entries[i].offset = currentOffset;
+			currentOffset += entries[i].size;
+			ByteUtilities::writeInt(pos, procs[i]);
+			ByteUtilities::writeInt(pos + SIZEOF_INT, threads[i]);
+			ByteUtilities::writeLong(pos + 2 * SIZEOF_INT, entries[i].offset);
+			pos += SIZEOF_LONG + 2 * SIZEOF_INT;
 		}
+		FileOffset dataEnd = currentOffset;
+
 		//-----------------------------------------------------
-		// 3. Copy all data from the multiple files into one file
+		// 2. Start or resume the merged file
 		//-----------------------------------------------------
-		ProgressBar prog("Merging database", filteredFileNames.size());
-		for (it2 = filteredFileNames.begin(); it2 < filteredFileNames.end(); it2++)
+		vector<char> done(entries.size(), 0);
+		if (resuming && (!FileUtils::exists(outputFile)
+				|| FileUtils::getFileSize(outputFile) < dataEnd
+				|| !readJournal(journalFile, entries.size(), dataEnd, done)))
 		{
-			string i = *it2;
+			cout << "Partial merge of " << outputFile << " does not match the trace files. Starting over" << endl;
+			remove(journalFile.c_str());
+			resuming = false;
+		}
+		if (!resuming && !createJournal(journalFile, entries.size(), dataEnd))
+		{
+			cerr << "Could not create " << journalFile << ": " << strerror(errno) << endl;
+			throw (int) ERROR_MERGE_FAILED;
+		}
 
-			ifstream dis(i.c_str(), ios_base::binary | ios_base::in);
-			char data[PAGE_SIZE_GUESS];
-			dis.read(data, PAGE_SIZE_GUESS);
-			int bytesRead = dis.gcount();
-			while (bytesRead > 0)
+		MergeJob job;
+		job.entries = &entries;
+		job.done = &done;
+		job.outFd = open(outputFile.c_str(), O_RDWR | O_CREAT | (resuming ? 0 : O_TRUNC), 0644);
+		job.journalFd = open(journalFile.c_str(), O_WRONLY | O_APPEND);
+		if (job.outFd < 0 || job.journalFd < 0)
+		{
+			cerr << "Could not open " << outputFile << " for merging: " << strerror(errno) << endl;
+			if (job.outFd >= 0) close(job.outFd);
+			if (job.journalFd >= 0) close(job.journalFd);
+			throw (int) ERROR_MERGE_FAILED;
+		}
+		pthread_mutex_init(&job.lock, NULL);
+		job.next = 0;
+		job.unjournaledBytes = 0;
+		job.failed = (pwrite(job.outFd, &header[0], header.size(), 0) != (ssize_t) header.size())
+				|| (ftruncate(job.outFd, dataEnd) != 0);
+
+		//-----------------------------------------------------
+		// 3. Copy the data of every file to its offset
+		//-----------------------------------------------------
+		size_t remaining = count(done.begin(), done.end(), 0);
+		if (resuming)
+			cout << "Resuming merge: " << entries.size() - remaining << " of "
+					<< entries.size() << " files already merged" << endl;
+
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		size_t numThreads = min((size_t) max(cpus, 1L), min(remaining, (size_t) MAX_MERGE_THREADS));
+		DEBUGCOUT(2) << "Merging " << remaining << " files with " << numThreads << " threads" << endl;
+		{
+			ProgressBar prog("Merging database", max(remaining, (size_t) 1));
+			job.prog = &prog;
+
+			vector<pthread_t> workers(numThreads);
+			size_t started = 0;
+			if (!job.failed)
 			{
-				dos.write(data, bytesRead);
-				dis.read(data, PAGE_SIZE_GUESS);
-				bytesRead = dis.gcount();
+				for (; started + 1 < numThreads; started++)
+				{
+					if (pthread_create(&workers[started], NULL, mergeWorker, &job) != 0)
+						break;
+				}
+				mergeWorker(&job);
 			}
-			dis.close();
-			prog.incrementProgress();
+			for (size_t i = 0; i < started; i++)
+				pthread_join(workers[i], NULL);
+			if (remaining == 0)
+				prog.incrementProgress();
 		}
-		insertMarker(&dos);
-		dos.close();
+
 		//-----------------------------------------------------
-		// 4. FIXME: write the type of the application
-		//  	the type of the application is computed in step 2
-		//		Ideally, this step has to be in the beginning !
+		// 4. Finish: the marker goes in only after all the data is on disk
 		//-----------------------------------------------------
-		//While we don't actually want to do any input operations, adding the input flag prevents the file from being truncated to 0 bytes
-		DataOutputFileStream f(outputFile.c_str(), ios_base::in | ios_base::out | ios_base::binary);
-		f.writeInt(type);
-		f.close();
+		pthread_mutex_lock(&job.lock);
+		if (!job.failed && !flushJournal(&job))
+			job.failed = true;
+		pthread_mutex_unlock(&job.lock);
+		if (!job.failed)
+		{
+			char marker[SIZEOF_LONG];
+			ByteUtilities::writeLong(marker, MARKER_END_MERGED_FILE);
+			job.failed = (pwrite(job.outFd, marker, SIZEOF_LONG, dataEnd) != SIZEOF_LONG)
+					|| (fdatasync(job.outFd) != 0);
+		}
+		close(job.journalFd);
+		close(job.outFd);
+		pthread_mutex_destroy(&job.lock);
+		if (job.failed)
+		{
+			cerr << "Merging " << outputFile << " failed. It will be resumed the next time the database is opened" << endl;
+			throw (int) ERROR_MERGE_FAILED;
+		}
+		remove(journalFile.c_str());
 
 		//-----------------------------------------------------
 		// 5. remove old files
@@ -220,11 +327,163 @@ namespace TraceviewerServer
 	}
 
 
+	void* MergeDataFiles::mergeWorker(void* arg)
+	{
+		MergeJob* job = (MergeJob*) arg;
+		vector<MergeEntry>& entries = *job->entries;
+		char* buffer = new char[COPY_BUFFER_SIZE];
+
+		pthread_mutex_lock(&job->lock);
+		while (!job->failed)
+		{
+			while (job->next < entries.size() && (*job->done)[job->next])
+				job->next++;
+			if (job->next == entries.size())
+				break;
+			unsigned int i = job->next++;
+			pthread_mutex_unlock(&job->lock);
+
+			bool copied = copyFile(entries[i], job->outFd, buffer);
+
+			pthread_mutex_lock(&job->lock);
+			if (!copied)
+			{
+				job->failed = true;
+				break;
+			}
+			(*job->done)[i] = 1;
+			job->unjournaled.push_back(i);
+			job->unjournaledBytes += entries[i].size;
+			job->prog->incrementProgress();
+			if ((job->unjournaled.size() >= JOURNAL_BATCH_FILES
+					|| job->unjournaledBytes >= JOURNAL_BATCH_BYTES)
+					&& !flushJournal(job))
+				job->failed = true;
+		}
+		pthread_mutex_unlock(&job->lock);
 
-	void MergeDataFiles::insertMarker(DataOutputFileStream* dos)
+		delete[] buffer;
+		return NULL;
+	}
+
+
+	//Copies one trace file to its offset in the merged file, in the kernel
+	//if it can, through buffer otherwise.
+	bool MergeDataFiles::copyFile(const MergeEntry& entry, int outFd, char* buffer)
 	{
-		dos->writeLong(MARKER_END_MERGED_FILE);
+		int inFd = open(entry.path.c_str(), O_RDONLY);
+		if (inFd < 0)
+		{
+			cerr << "Could not open " << entry.path << ": " << strerror(errno) << endl;
+			return false;
+		}
+
+		FileOffset copied = 0;
+#ifdef SYS_copy_file_range
+		while (copied < entry.size)
+		{
+			loff_t inOff = copied;
+			loff_t outOff = entry.offset + copied;
+			ssize_t n = syscall(SYS_copy_file_range, inFd, &inOff, outFd, &outOff,
+					entry.size - copied, 0);
+			if (n <= 0)
+				break;
+			copied += n;
+		}
+#endif
+		errno = 0;
+		while (copied < entry.size)
+		{
+			size_t chunk = min(entry.size - copied, (FileOffset) COPY_BUFFER_SIZE);
+			ssize_t n = pread(inFd, buffer, chunk, copied);
+			if (n <= 0)
+				break;
+			if (pwrite(outFd, buffer, n, entry.offset + copied) != n)
+				break;
+			copied += n;
+		}
+		close(inFd);
+
+		if (copied < entry.size)
+			cerr << "Could not copy " << entry.path << " into the merged file: "
+					<< (errno ? strerror(errno) : "file is shorter than expected") << endl;
+		return copied == entry.size;
+	}
+
+
+	//Called with the job lock held. Takes the files copied since the last
+	//call, then drops the lock while it syncs the merged file and records
+	//them as done, so the other threads keep copying. Each record is one
+	//append, so records of threads that flush at once do not mix.
+	bool MergeDataFiles::flushJournal(MergeJob* job)
+	{
+		if (job->unjournaled.empty())
+			return true;
+		vector<unsigned int> batch;
+		batch.swap(job->unjournaled);
+		job->unjournaledBytes = 0;
+		pthread_mutex_unlock(&job->lock);
+
+		bool ok = (fdatasync(job->outFd) == 0);
+		if (ok)
+		{
+			vector<char> record(batch.size() * SIZEOF_INT);
+			for (size_t i = 0; i < batch.size(); i++)
+				ByteUtilities::writeInt(&record[i * SIZEOF_INT], batch[i]);
+			ok = (write(job->journalFd, &record[0], record.size()) == (ssize_t) record.size());
+		}
+
+		pthread_mutex_lock(&job->lock);
+		return ok;
+	}
+
+
+	//The journal starts with a marker, the number of files and the size of
+	//the merged data, so a journal left by a different set of trace files
+	//is not reused. Then come the indices of the files already merged. A
+	//torn index at the end is ignored.
+	bool MergeDataFiles::createJournal(string journalFile, unsigned int numFiles,
+			FileOffset dataEnd)
+	{
+		char record[2 * SIZEOF_LONG + SIZEOF_INT];
+		ByteUtilities::writeLong(record, MARKER_MERGE_JOURNAL);
+		ByteUtilities::writeInt(record + SIZEOF_LONG, numFiles);
+		ByteUtilities::writeLong(record + SIZEOF_LONG + SIZEOF_INT, dataEnd);
+
+		int fd = open(journalFile.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+			return false;
+		bool ok = (write(fd, record, sizeof(record)) == (ssize_t) sizeof(record))
+				&& (fsync(fd) == 0);
+		close(fd);
+		return ok;
+	}
+
+
+	bool MergeDataFiles::readJournal(string journalFile, unsigned int numFiles,
+			FileOffset dataEnd, vector<char>& done)
+	{
+		ifstream f(journalFile.c_str(), ios_base::binary | ios_base::in);
+		char record[2 * SIZEOF_LONG + SIZEOF_INT];
+		f.read(record, sizeof(record));
+		if (f.gcount() != sizeof(record)
+				|| (uint64_t) ByteUtilities::readLong(record) != MARKER_MERGE_JOURNAL
+				|| (unsigned int) ByteUtilities::readInt(record + SIZEOF_LONG) != numFiles
+				|| (FileOffset) ByteUtilities::readLong(record + SIZEOF_LONG + SIZEOF_INT) != dataEnd)
+			return false;
+
+		char index[SIZEOF_INT];
+		while (f.read(index, SIZEOF_INT))
+		{
+			unsigned int i = ByteUtilities::readInt(index);
+			if (i >= numFiles)
+				return false;
+			done[i] = 1;
+		}
+		return true;
 	}
+
+
 	bool MergeDataFiles::isMergedFileCorrect(string* filename)
 	{
 		ifstream f(filename->c_str(), ios_base::binary | ios_base::in);
@@ -59,7 +59,7 @@
 #ifndef MERGEDATAFILES_H_
 #define MERGEDATAFILES_H_
 
-#include "DataOutputFileStream.hpp"
+#include "FileUtils.hpp"
 #include <vector>
 #include <string>
 #include <stdint.h>
@@ -73,6 +73,16 @@ namespace TraceviewerServer
 		SUCCESS_MERGED, SUCCESS_ALREADY_CREATED, FAIL_NO_DATA, STATUS_UNKNOWN
 	};
 
+	//One .hpctrace file and where its data goes in the merged file
+	struct MergeEntry
+	{
+		string path;
+		FileOffset offset;
+		FileOffset size;
+	};
+
+	struct MergeJob;
+
 	class MergeDataFiles
 	{
 	public:
@@ -81,18 +91,24 @@ namespace TraceviewerServer
 		static vector<string> splitString(string, char);
 	private:
 		static const uint64_t MARKER_END_MERGED_FILE = 0xFFFFFFFFDEADF00D;
-		static const int PAGE_SIZE_GUESS = 4096;
+		static const uint64_t MARKER_MERGE_JOURNAL = 0x4D455247454A524EULL; // "MERGEJRN"
+		static const int COPY_BUFFER_SIZE = 1 << 20;
+		static const int MAX_MERGE_THREADS = 16;
+		//Files are recorded as done in batches, after the data is synced
+		static const unsigned int JOURNAL_BATCH_FILES = 1024;
+		static const FileOffset JOURNAL_BATCH_BYTES = 256 << 20;
 		static const int PROC_POS = 5;
 		static const int THREAD_POS = 4;
-		static void insertMarker(DataOutputFileStream*);
 		static bool isMergedFileCorrect(string*);
 		static bool removeFiles(vector<string>);
 		//This was in Util.java in a modified form but is more useful here
 		static bool atLeastOneValidFile(string);
 
-
-
-
+		static bool readJournal(string, unsigned int, FileOffset, vector<char>&);
+		static bool createJournal(string, unsigned int, FileOffset);
+		static bool flushJournal(MergeJob*);
+		static bool copyFile(const MergeEntry&, int, char*);
+		static void* mergeWorker(void*);
 	};
 
 } /* namespace TraceviewerServer */
@@ -81,14 +81,17 @@
 #include <zlib.h>
 #include <algorithm> //for min of int64_t
 #include <string>
+#include <vector>
 
 using namespace std;
 
 namespace TraceviewerServer
 {
 	bool useCompression = true;
+	CompressionType traceCompression = COMPRESSION_ZLIB;
 	int mainPortNumber = DEFAULT_PORT;
 	int xmlPortNumber = 0;
+	int pyramidLevels = 0;
 
 	Server::Server()
 	{
@@ -183,18 +186,22 @@ namespace TraceviewerServer
 		// ------------------------------------------------------------------
 		// main loop for a communication session
 		// as long as the client doesn't send OPEN or DONE, we remain in 
-		// in this loop 
+		// in this loop. The commands are read ahead on another thread, so
+		// that a newer request can cancel the one being answered.
 		// ------------------------------------------------------------------
+		CommandReader reader(socketptr, agreedUponProtocolVersion >= PROTOCOL_VERSION_CANCEL);
 		while (true)
 		{
-			int nextCommand = socketptr->readInt();
-			switch (nextCommand)
+			ServerCommand* nextCommand = reader.next();
+			if (nextCommand->error != 0)
+				throw (ErrorCode) nextCommand->error;
+			switch (nextCommand->command)
 			{
 				case DATA:
 #ifdef HPCTOOLKIT_PROFILE
 					hpctoolkit_sampling_start();
 #endif
-					getAndSendData(socketptr);
+					getAndSendData(socketptr, nextCommand);
 #ifdef HPCTOOLKIT_PROFILE
 					hpctoolkit_sampling_stop();
 #endif
@@ -203,7 +210,7 @@ namespace TraceviewerServer
 #ifdef HPCTOOLKIT_PROFILE
 					hpctoolkit_sampling_start();
 #endif
-					filter(socketptr);
+					filter(nextCommand);
 #ifdef HPCTOOLKIT_PROFILE
 					hpctoolkit_sampling_stop();
 #endif
@@ -216,6 +223,7 @@ namespace TraceviewerServer
 					cerr << "Unknown command received" << endl;
 					return ERROR_UNKNOWN_COMMAND;
 			}
+			reader.finished(nextCommand);
 		}
 
 		return CLOSE_SERVER;
@@ -241,12 +249,9 @@ namespace TraceviewerServer
 		int numFiles = controller->getNumRanks();
 		socket->writeInt(numFiles);
 
-		// This is an int so that it is possible to have different compression
-		// algorithms in the future. For now, it is just
-		// 0=no compression, 1= normal compression
-		int compressionType;
-		compressionType = useCompression ? 1 : 0;
-		socket->writeInt(compressionType);
+		// The codec of the trace lines, a CompressionType:
+		// 0=no compression, 1=zlib, 2=LZ4, 3=zstd
+		socket->writeInt(traceCompression);
 
 		//Send ValuesX
 		int* rankProcessIds = controller->getValuesXProcessID();
@@ -279,18 +284,8 @@ namespace TraceviewerServer
 		{
 			ProgressBar prog("Compressing XML", uncompressedFileSize);
 			FILE* in = fopen(controller->getExperimentXML().c_str(), "r");
-			//From http://zlib.net/zpipe.c with some editing
-			z_stream compressor;
-			compressor.zalloc = Z_NULL;
-			compressor.zfree = Z_NULL;
-			compressor.opaque = Z_NULL;
-
 			//This makes a gzip stream with a window of 15 bits
-			int ret = deflateInit2(&compressor, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16+15, 8, Z_DEFAULT_STRATEGY);
-			if (ret != Z_OK)
-				throw ret;
-
-			DataCompressionLayer compL(compressor, &prog);
+			DataCompressionLayer compL(16+15, &prog);
 			compL.writeFile(in);
 
 			fclose(in);
@@ -308,6 +303,7 @@ namespace TraceviewerServer
 	void Server::checkProtocolVersions(DataSocketStream* receiver)
 	{
 		int clientProtocolVersion = receiver->readInt();
+		agreedUponProtocolVersion = clientProtocolVersion;
 
 		if (clientProtocolVersion != SERVER_PROTOCOL_MAX_VERSION)
 			cout << "The client is using protocol version 0x" << hex << clientProtocolVersion<<
@@ -330,6 +326,7 @@ namespace TraceviewerServer
 		checkProtocolVersions(receiver);
 
 		string pathToDB = receiver->readString();
+		traceCompression = chooseCompression(receiver);
 		DBOpener DBO;
 		cout << "Opening database: " << pathToDB << endl;
 		SpaceTimeDataController* controller = DBO.openDbAndCreateStdc(pathToDB);
@@ -343,6 +340,34 @@ namespace TraceviewerServer
 
 	}
 
+	//Older clients decode zlib or no compression. Newer ones send how many
+	//codecs they decode, then the codecs, most preferred first.
+	CompressionType Server::chooseCompression(DataSocketStream* receiver)
+	{
+		vector<int> clientCodecs;
+		if (agreedUponProtocolVersion >= PROTOCOL_VERSION_CODECS)
+		{
+			int count = receiver->readInt();
+			for (int i = 0; i < count; i++)
+				clientCodecs.push_back(receiver->readInt());
+		}
+
+		if (!useCompression)
+			return COMPRESSION_NONE;
+		for (size_t i = 0; i < clientCodecs.size(); i++)
+		{
+			CompressionType type = (CompressionType) clientCodecs[i];
+			if (type >= COMPRESSION_NONE && type <= COMPRESSION_ZSTD
+					&& DataCompressionLayer::isAvailable(type))
+			{
+				DEBUGCOUT(1) << "Compressing trace lines with codec " << type << endl;
+				return type;
+			}
+		}
+		//Every client decodes zlib
+		return COMPRESSION_ZLIB;
+	}
+
 	void Server::sendDBOpenFailed(DataSocketStream* socket)
 	{
 		socket->writeInt(NODB);
@@ -352,15 +377,15 @@ namespace TraceviewerServer
 
 
 
-	void Server::getAndSendData(DataSocketStream* stream)
+	void Server::getAndSendData(DataSocketStream* stream, ServerCommand* request)
 	{
 		LOGTIMESTAMPEDMSG("Front end received data request.")
-		int processStart = stream->readInt();
-		int processEnd = stream->readInt();
-		Time timeStart = stream->readLong();
-		Time timeEnd = stream->readLong();
-		int verticalResolution = stream->readInt();
-		int horizontalResolution = stream->readInt();
+		int processStart = request->processStart;
+		int processEnd = request->processEnd;
+		Time timeStart = request->timeStart;
+		Time timeEnd = request->timeEnd;
+		int verticalResolution = request->verticalResolution;
+		int horizontalResolution = request->horizontalResolution;
 
 		DEBUGCOUT(2) << "Time end: " << timeEnd <<endl;
 
@@ -374,33 +399,39 @@ namespace TraceviewerServer
 					<< endl;
 			throw(ERROR_INVALID_PARAMETERS);
 		}
-		Communication::sendStartGetData(controller, processStart, processEnd, timeStart, timeEnd, verticalResolution, horizontalResolution);
-		LOGTIMESTAMPEDMSG("Back end received data request.")
 
 		stream->writeInt(HERE);
-		stream->flush();
+		int linesSent = 0;
+		//A request that was superseded while it waited is answered at once
+		if (!request->cancelled)
+		{
+			Communication::sendStartGetData(controller, processStart, processEnd, timeStart, timeEnd, verticalResolution, horizontalResolution);
+			LOGTIMESTAMPEDMSG("Back end received data request.")
 
-		ProgressBar prog("Computing traces", min(processEnd - processStart, verticalResolution));
+			stream->flush();
 
-		Communication::sendEndGetData(stream, &prog, controller);
+			ProgressBar prog("Computing traces", min(processEnd - processStart, verticalResolution));
 
+			linesSent = Communication::sendEndGetData(stream, &prog, controller, &request->cancelled);
+		}
+		if (agreedUponProtocolVersion >= PROTOCOL_VERSION_CANCEL)
+		{
+			stream->writeInt(END_OF_DATA_REPLY);
+			stream->writeInt(linesSent);
+		}
+		stream->flush();
+		if (request->cancelled)
+			DEBUGCOUT(1) << "Data request cancelled after " << linesSent << " lines" << endl;
 	}
 
-	void Server::filter(DataSocketStream* stream)
+	void Server::filter(ServerCommand* command)
 	{
-		stream->readByte();//Padding
-		bool excludeMatches = stream->readByte();
-		int count = stream->readShort();
+		bool excludeMatches = command->excludeMatches;
+		int count = command->filters.size();
 		Communication::sendStartFilter(count, excludeMatches);
 		FilterSet filters(excludeMatches);
 		for (int i = 0; i < count; ++i) {
-			BinaryRepresentationOfFilter filt;//This makes the MPI code easier and the non-mpi code about the same
-			filt.processMin = stream->readInt();
-			filt.processMax = stream->readInt();
-			filt.processStride = stream->readInt();
-			filt.threadMin = stream->readInt();
-			filt.threadMax = stream->readInt();
-			filt.threadStride = stream->readInt();
+			BinaryRepresentationOfFilter filt = command->filters[i];//This makes the MPI code easier and the non-mpi code about the same
 			DEBUGCOUT(2) << "Filter proc: " << filt.processMin <<":" << filt.processMax <<":"<<filt.processStride<<",";
 			DEBUGCOUT(2) << "Filter thread: " << filt.threadMax <<":" << filt.threadMax <<":"<<filt.threadStride<<endl;
 
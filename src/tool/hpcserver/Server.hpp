@@ -60,16 +60,22 @@
 #ifndef Server_H_
 #define Server_H_
 
+#include "Constants.hpp"
 #include "DataSocketStream.hpp"
 #include "SpaceTimeDataController.hpp"
+#include "CommandReader.hpp"
 
 
 
 namespace TraceviewerServer
 {
 	extern bool useCompression;
+	//Codec of the trace lines, agreed on when the database is opened
+	extern CompressionType traceCompression;
 	extern int mainPortNumber;
 	extern int xmlPortNumber;
+	//Levels of the trace pyramid to build and use, 0 for none
+	extern int pyramidLevels;
 	class Server
 	{
 
@@ -84,17 +90,22 @@ namespace TraceviewerServer
 
 		void parseInfo(DataSocketStream*);
 		SpaceTimeDataController* parseOpenDB(DataSocketStream*);
-		void filter(DataSocketStream*);
-		void getAndSendData(DataSocketStream*);
+		void filter(ServerCommand*);
+		void getAndSendData(DataSocketStream*, ServerCommand*);
 		void sendXML(DataSocketStream*);
 		void sendDBOpenFailed(DataSocketStream*);
 		void checkProtocolVersions(DataSocketStream* receiver);
+		CompressionType chooseCompression(DataSocketStream* receiver);
 
 		SpaceTimeDataController* controller;
 
 		//Currently not really used, but pretty necessary for future extensions
 		int agreedUponProtocolVersion;
-		static const int SERVER_PROTOCOL_MAX_VERSION = 0x00010001;
+		static const int SERVER_PROTOCOL_MAX_VERSION = 0x00010003;
+		//First version in which OPEN lists the codecs the client decodes
+		static const int PROTOCOL_VERSION_CODECS = 0x00010002;
+		//First version in which DATA requests can be cancelled
+		static const int PROTOCOL_VERSION_CANCEL = 0x00010003;
 
 	};
 }/* namespace TraceviewerServer */
@@ -110,6 +110,7 @@ namespace TraceviewerServer
 						DBOpener DBO;
 						controller = DBO.openDbAndCreateStdc(string(Message.ofile.path));
 					}
+					traceCompression = (CompressionType) Message.ofile.compression;
 					break;
 				case INFO:
 					controller->setInfo(Message.minfo.minBegTime, Message.minfo.maxEndTime,
@@ -270,9 +271,9 @@ namespace TraceviewerServer
 			unsigned char* outputBuffer = NULL;
 			DataCompressionLayer* compr = NULL;
 			int outputBufferLen;
-			if (useCompression)
+			if (traceCompression != COMPRESSION_NONE)
 			{
-				compr = new DataCompressionLayer();
+				compr = new DataCompressionLayer(traceCompression);
 
 				locs->compressed = true;
 				locs->compMsg = compr;
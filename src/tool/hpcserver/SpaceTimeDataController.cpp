@@ -58,6 +58,7 @@
 //***************************************************************************
 #include "SpaceTimeDataController.hpp"
 #include "FileData.hpp"
+#include "Server.hpp"
 #include <iostream>
 using namespace std;
 namespace TraceviewerServer
@@ -76,6 +77,7 @@ namespace TraceviewerServer
 		//For now, it's not an issue, and the data dependencies make changing this
 		//complicated.
 		dataTrace = new FilteredBaseData(locations->fileTrace, DEFAULT_HEADER_SIZE);
+		pyramid = NULL;
 		height = dataTrace->getNumberOfRanks();
 		experimentXML = locations->fileXML;
 		fileTrace = locations->fileTrace;
@@ -92,6 +94,10 @@ namespace TraceviewerServer
 		headerSize = _headerSize;
 		delete dataTrace;
 		dataTrace = new FilteredBaseData(fileTrace, headerSize);
+
+		delete pyramid;
+		pyramid = (pyramidLevels > 0) ? TracePyramid::open(fileTrace, headerSize) : NULL;
+		dataTrace->setPyramid(pyramid);
 	}
 
 	int SpaceTimeDataController::getNumRanks()
@@ -125,21 +131,26 @@ namespace TraceviewerServer
 	}
 
 	//Don't call if in MPI mode
-	void SpaceTimeDataController::fillTraces()
+	int SpaceTimeDataController::fillTraces(TraceFilledFn* filled, void* arg)
 	{
 		//Traces might be null. resetTraces will fix that.
 		resetTraces();
 
 
 		//Taken straight from TimelineThread
+		int numFilled = 0;
 		ProcessTimeline* nextTrace = getNextTrace();
 		while (nextTrace != NULL)
 		{
 			nextTrace->readInData();
 			addNextTrace(nextTrace);
+			numFilled++;
+			if (filled != NULL && !filled(nextTrace->line(), arg))
+				break;
 
 			nextTrace = getNextTrace();
 		}
+		return numFilled;
 	}
 
 	 int* SpaceTimeDataController::getValuesXProcessID()
@@ -159,7 +170,7 @@ namespace TraceviewerServer
 
 		deleteTraces();
 
-		traces = new ProcessTimeline*[numTraces];
+		traces = new ProcessTimeline*[numTraces]();//Lines not read in are NULL
 		tracesLength = numTraces;
 		tracesInitialized = true;
 
@@ -185,6 +196,7 @@ namespace TraceviewerServer
 	{
 		delete attributes;
 		delete dataTrace;
+		delete pyramid;
 
 		//The MPI implementation actually doesn't use the Traces array at all!
 		//It does call getNextTrace, but changedBounds is always true so
@@ -64,6 +64,7 @@
 #include "FilteredBaseData.hpp"
 #include "FilterSet.hpp"
 #include "TimeCPID.hpp"
+#include "TracePyramid.hpp"
 
 #include <string>
 
@@ -79,7 +80,10 @@ namespace TraceviewerServer
 		void setInfo(Time, Time, int);
 		ProcessTimeline* getNextTrace();
 		void addNextTrace(ProcessTimeline*);
-		void fillTraces();
+		//Calls filled(line, arg) after each line is read in, and stops
+		//early if it returns false. Returns the number of lines read in.
+		typedef bool TraceFilledFn(int line, void* arg);
+		int fillTraces(TraceFilledFn* filled = NULL, void* arg = NULL);
 		ProcessTimeline* fillTrace(bool);
 		void applyFilters(FilterSet filters);
 		//The number of processes in the database, independent of the current display size
@@ -92,11 +96,14 @@ namespace TraceviewerServer
 		ImageTraceAttributes* attributes;
 		ProcessTimeline** traces;
 		int tracesLength;
+
+		static const int DEFAULT_HEADER_SIZE = 24;
 	private:
 		void resetTraces();
 		void deleteTraces();
 
 		FilteredBaseData* dataTrace;
+		TracePyramid* pyramid;
 		int headerSize;
 
 		// The minimum beginning and maximum ending time stamp across all traces (in microseconds).
@@ -108,8 +115,6 @@ namespace TraceviewerServer
 
 		bool tracesInitialized;
 
-		static const int DEFAULT_HEADER_SIZE = 24;
-
 	};
 
 } /* namespace TraceviewerServer */
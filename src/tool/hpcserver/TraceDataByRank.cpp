@@ -112,8 +112,10 @@ namespace TraceviewerServer
 		{
 			// the data is too big: try to fit the "big" data into the display
 
-			//fills in the rest of the data for this process timeline
-			sampleTimeLine(startLoc, endLoc, 0, numPixelsH, 0, pixelLength, timeStart);
+			// a view coarser than the finest level of the pyramid is sampled from it,
+			// otherwise fills in the rest of the data for this process timeline
+			if (!data->samplePyramid(rank, timeStart, pixelLength, numPixelsH, *listCPID))
+				sampleTimeLine(startLoc, endLoc, 0, numPixelsH, 0, pixelLength, timeStart);
 		}
 		// --------------------------------------------------------------------------------------------------
 		// get the last data if necessary: the rightmost time is still less then the upper limit
@@ -0,0 +1,376 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   A precomputed multi-resolution view of the merged trace file. For each
+//   rank and each power-of-two division of the time span of the database,
+//   it holds the trace record nearest to every division, so coarse views
+//   are sampled with a few sequential reads instead of searches.
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#include "TracePyramid.hpp"
+#include "ByteUtilities.hpp"
+#include "Constants.hpp"
+#include "DebugUtils.hpp"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <sstream>
+
+#include <fcntl.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+using namespace std;
+namespace TraceviewerServer
+{
+	//What the threads that build a pyramid share
+	struct PyramidBuildJob
+	{
+		const char* trace;
+		vector<FileOffset> minLocs;
+		vector<FileOffset> numRecords;
+		vector<FileOffset> rankOffsets;
+		int maxLevel;
+		Time beginTime;
+		Time endTime;
+		int outFd;
+		int next;
+		bool failed;
+	};
+
+	string TracePyramid::pyramidFile(string traceFile)
+	{
+		return traceFile + ".pyramid";
+	}
+
+	bool TracePyramid::upToDate(string traceFile, int maxLevel, int headerSize)
+	{
+		Header header;
+		FILE* f = fopen(pyramidFile(traceFile).c_str(), "r");
+		if (f == NULL)
+			return false;
+		bool read = (fread(&header, sizeof(header), 1, f) == 1);
+		fclose(f);
+		return read && header.magic == PYRAMID_MAGIC && header.version == PYRAMID_VERSION
+				&& header.maxLevel == (uint32_t) maxLevel && header.headerSize == headerSize
+				&& header.traceSize == FileUtils::getFileSize(traceFile);
+	}
+
+	bool TracePyramid::build(string traceFile, int maxLevel, int headerSize)
+	{
+		if (upToDate(traceFile, maxLevel, headerSize))
+			return true;
+
+		FileOffset traceSize = FileUtils::getFileSize(traceFile);
+		int traceFd = ::open(traceFile.c_str(), O_RDONLY);
+		if (traceFd < 0)
+			return false;
+		void* map = mmap(NULL, traceSize, PROT_READ, MAP_SHARED, traceFd, 0);
+		close(traceFd);
+		if (map == MAP_FAILED)
+			return false;
+
+		//Find every rank's records the way BaseDataFile and TraceDataByRank do
+		PyramidBuildJob job;
+		job.trace = (const char*) map;
+		job.maxLevel = maxLevel;
+		char* pos = (char*) map;
+		int numRanks = ByteUtilities::readInt(pos + SIZEOF_INT);
+		pos += 2 * SIZEOF_INT;
+		vector<FileOffset> starts(numRanks);
+		for (int i = 0; i < numRanks; i++)
+		{
+			starts[i] = ByteUtilities::readLong(pos + 2 * SIZEOF_INT);
+			pos += SIZEOF_LONG + 2 * SIZEOF_INT;
+		}
+
+		size_t finest = (size_t) 1 << maxLevel;
+		size_t entries = entriesPerRank(maxLevel);
+		FileOffset nextOffset = sizeof(Header) + numRanks * sizeof(FileOffset);
+		job.beginTime = (Time) -1;
+		job.endTime = 0;
+		for (int i = 0; i < numRanks; i++)
+		{
+			FileOffset minLoc = starts[i] + headerSize;
+			FileOffset maxLoc = (i + 1 < numRanks) ? starts[i + 1] - SIZE_OF_TRACE_RECORD
+					: traceSize - SIZE_OF_TRACE_RECORD - SIZEOF_END_OF_FILE_MARKER;
+			FileOffset records = (maxLoc >= minLoc) ? (maxLoc - minLoc) / SIZE_OF_TRACE_RECORD + 1 : 0;
+			job.minLocs.push_back(minLoc);
+			job.numRecords.push_back(records);
+			if (records > 0)
+			{
+				job.beginTime = min(job.beginTime, (Time) ByteUtilities::readLong((char*) job.trace + minLoc));
+				job.endTime = max(job.endTime, (Time) ByteUtilities::readLong((char*) job.trace
+						+ minLoc + (records - 1) * SIZE_OF_TRACE_RECORD));
+			}
+			//With fewer records than divisions, reading the records is as cheap
+			if (records > finest)
+			{
+				job.rankOffsets.push_back(nextOffset);
+				nextOffset += entries * (sizeof(Time) + sizeof(int32_t));
+			}
+			else
+				job.rankOffsets.push_back(0);
+		}
+
+		string tmpFile;
+		{
+			stringstream ss;
+			ss << pyramidFile(traceFile) << ".tmp." << getpid();
+			tmpFile = ss.str();
+		}
+		job.outFd = ::open(tmpFile.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		job.failed = (job.outFd < 0) || job.endTime <= job.beginTime
+				|| ftruncate(job.outFd, nextOffset) != 0;
+		job.next = 0;
+
+		if (!job.failed)
+		{
+			Header header;
+			header.magic = PYRAMID_MAGIC;
+			header.version = PYRAMID_VERSION;
+			header.maxLevel = maxLevel;
+			header.numRanks = numRanks;
+			header.headerSize = headerSize;
+			header.traceSize = traceSize;
+			header.beginTime = job.beginTime;
+			header.endTime = job.endTime;
+			size_t offsetsSize = numRanks * sizeof(FileOffset);
+			job.failed = pwrite(job.outFd, &header, sizeof(header), 0) != sizeof(header)
+					|| pwrite(job.outFd, &job.rankOffsets[0], offsetsSize, sizeof(header))
+							!= (ssize_t) offsetsSize;
+		}
+
+		if (!job.failed)
+		{
+			cout << "Building trace pyramid with " << finest << " divisions" << endl;
+			long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+			int numThreads = max(1, min((int) max(cpus, 1L), min(numRanks, MAX_BUILD_THREADS)));
+			vector<pthread_t> workers(numThreads);
+			int started = 0;
+			for (; started + 1 < numThreads; started++)
+			{
+				if (pthread_create(&workers[started], NULL, buildWorker, &job) != 0)
+					break;
+			}
+			buildWorker(&job);
+			for (int i = 0; i < started; i++)
+				pthread_join(workers[i], NULL);
+		}
+
+		munmap(map, traceSize);
+		if (job.outFd >= 0)
+			close(job.outFd);
+		//Another process may be building the same pyramid; the rename is atomic
+		if (job.failed || rename(tmpFile.c_str(), pyramidFile(traceFile).c_str()) != 0)
+		{
+			cerr << "Could not build the trace pyramid for " << traceFile << endl;
+			remove(tmpFile.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	void* TracePyramid::buildWorker(void* arg)
+	{
+		PyramidBuildJob* job = (PyramidBuildJob*) arg;
+		int maxLevel = job->maxLevel;
+		size_t finest = (size_t) 1 << maxLevel;
+		size_t entries = entriesPerRank(maxLevel);
+		double span = job->endTime - job->beginTime;
+		vector<Time> times(entries);
+		vector<int32_t> cpids(entries);
+
+		int rank;
+		while ((rank = __sync_fetch_and_add(&job->next, 1)) < (int) job->rankOffsets.size())
+		{
+			if (job->rankOffsets[rank] == 0)
+				continue;
+			const char* records = job->trace + job->minLocs[rank];
+			FileOffset numRecords = job->numRecords[rank];
+
+			//The finest level, in one pass over the records
+			FileOffset k = 0;
+			Time kTime = ByteUtilities::readLong((char*) records);
+			size_t finestStart = levelStart(maxLevel);
+			for (size_t j = 0; j <= finest; j++)
+			{
+				Time t = job->beginTime + (Time) (span * j / finest);
+				while (k + 1 < numRecords)
+				{
+					Time nextTime = ByteUtilities::readLong((char*) records + (k + 1) * SIZE_OF_TRACE_RECORD);
+					if (nextTime > t)
+						break;
+					k++;
+					kTime = nextTime;
+				}
+				//Like findTimeInInterval, take the left record only if it is closer
+				FileOffset nearest = k;
+				if (k + 1 < numRecords && kTime <= t)
+				{
+					Time rightTime = ByteUtilities::readLong((char*) records + (k + 1) * SIZE_OF_TRACE_RECORD);
+					if (!(t - kTime < rightTime - t))
+						nearest = k + 1;
+				}
+				const char* record = records + nearest * SIZE_OF_TRACE_RECORD;
+				times[finestStart + j] = ByteUtilities::readLong((char*) record);
+				cpids[finestStart + j] = ByteUtilities::readInt((char*) record + SIZEOF_LONG);
+			}
+
+			//Division j of level l starts where division j << (maxLevel - l) of
+			//the finest level does
+			for (int level = 0; level < maxLevel; level++)
+			{
+				int shift = maxLevel - level;
+				for (size_t j = 0; j <= ((size_t) 1 << level); j++)
+				{
+					times[levelStart(level) + j] = times[finestStart + (j << shift)];
+					cpids[levelStart(level) + j] = cpids[finestStart + (j << shift)];
+				}
+			}
+
+			FileOffset offset = job->rankOffsets[rank];
+			size_t timesSize = entries * sizeof(Time);
+			size_t cpidsSize = entries * sizeof(int32_t);
+			if (pwrite(job->outFd, &times[0], timesSize, offset) != (ssize_t) timesSize
+					|| pwrite(job->outFd, &cpids[0], cpidsSize, offset + timesSize) != (ssize_t) cpidsSize)
+				job->failed = true;
+		}
+		return NULL;
+	}
+
+	TracePyramid* TracePyramid::open(string traceFile, int headerSize)
+	{
+		string file = pyramidFile(traceFile);
+		if (!FileUtils::exists(file))
+			return NULL;
+		size_t size = FileUtils::getFileSize(file);
+		if (size < sizeof(Header))
+			return NULL;
+
+		int fd = ::open(file.c_str(), O_RDONLY);
+		if (fd < 0)
+			return NULL;
+		void* map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+		close(fd);
+		if (map == MAP_FAILED)
+			return NULL;
+
+		Header* header = (Header*) map;
+		if (header->magic != PYRAMID_MAGIC || header->version != PYRAMID_VERSION
+				|| header->headerSize != headerSize
+				|| header->traceSize != FileUtils::getFileSize(traceFile)
+				|| size < sizeof(Header) + header->numRanks * sizeof(FileOffset))
+		{
+			DEBUGCOUT(1) << "Not using the out of date trace pyramid " << file << endl;
+			munmap(map, size);
+			return NULL;
+		}
+		DEBUGCOUT(1) << "Using trace pyramid " << file << " with "
+				<< (1 << header->maxLevel) << " divisions" << endl;
+		return new TracePyramid(header, size);
+	}
+
+	TracePyramid::TracePyramid(Header* _header, size_t _mappedSize)
+	{
+		header = _header;
+		mappedSize = _mappedSize;
+		rankOffsets = (FileOffset*) (header + 1);
+	}
+
+	bool TracePyramid::sample(int rank, Time timeStart, double pixelLength, int numPixels,
+			vector<TimeCPID>& samples)
+	{
+		if (rank < 0 || (uint32_t) rank >= header->numRanks || rankOffsets[rank] == 0
+				|| numPixels <= 0 || pixelLength <= 0)
+			return false;
+
+		//The coarsest level with a division per pixel
+		double span = header->endTime - header->beginTime;
+		int maxLevel = header->maxLevel;
+		int level = 0;
+		while (level < maxLevel && ((size_t) 1 << level) * pixelLength < span)
+			level++;
+		size_t divisions = (size_t) 1 << level;
+		if (divisions * pixelLength < span)
+			return false;
+
+		size_t entries = entriesPerRank(maxLevel);
+		const Time* times = (const Time*) ((char*) header + rankOffsets[rank]) + levelStart(level);
+		const int32_t* cpids = (const int32_t*) ((const Time*) ((char*) header + rankOffsets[rank]) + entries)
+				+ levelStart(level);
+
+		//The records at the edges of the view are added by the caller
+		double scale = divisions / span;
+		double begin = (double) timeStart - (double) header->beginTime;
+		for (int p = 1; p < numPixels; p++)
+		{
+			long j = lround((begin + p * pixelLength) * scale);
+			j = max(0L, min(j, (long) divisions));
+			samples.push_back(TimeCPID(times[j], cpids[j]));
+		}
+		return true;
+	}
+
+	TracePyramid::~TracePyramid()
+	{
+		munmap(header, mappedSize);
+	}
+
+} /* namespace TraceviewerServer */
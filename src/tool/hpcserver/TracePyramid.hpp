@@ -0,0 +1,135 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   A precomputed multi-resolution view of the merged trace file. For each
+//   rank and each power-of-two division of the time span of the database,
+//   it holds the trace record nearest to every division, so coarse views
+//   are sampled with a few sequential reads instead of searches.
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#ifndef TRACEPYRAMID_H_
+#define TRACEPYRAMID_H_
+
+#include <string>
+#include <vector>
+#include <stdint.h>
+
+#include "FileUtils.hpp" //For FileOffset
+#include "TimeCPID.hpp"
+
+using namespace std;
+namespace TraceviewerServer
+{
+	class TracePyramid
+	{
+	public:
+		//Builds traceFile.pyramid with levels 0 to maxLevel, unless an up to
+		//date one exists. Returns false if there is no usable pyramid.
+		static bool build(string traceFile, int maxLevel, int headerSize);
+		//Returns NULL if there is no pyramid for this trace file and header size
+		static TracePyramid* open(string traceFile, int headerSize);
+		virtual ~TracePyramid();
+
+		//Appends the record nearest to each pixel boundary strictly inside a
+		//view, as TraceDataByRank::sampleTimeLine does, from the coarsest level
+		//with at least one division per pixel. Returns false, and leaves samples
+		//alone, if the rank has no pyramid or the view is finer than the finest
+		//level.
+		bool sample(int rank, Time timeStart, double pixelLength, int numPixels,
+				vector<TimeCPID>& samples);
+
+	private:
+		struct Header
+		{
+			uint64_t magic;
+			uint32_t version;
+			uint32_t maxLevel;
+			uint32_t numRanks;
+			int32_t headerSize;
+			uint64_t traceSize;
+			Time beginTime;
+			Time endTime;
+		};
+
+		static const uint64_t PYRAMID_MAGIC = 0x44494D4152595054ULL; // "TPYRAMID"
+		static const uint32_t PYRAMID_VERSION = 1;
+		static const int MAX_BUILD_THREADS = 16;
+
+		TracePyramid(Header* header, size_t mappedSize);
+
+		static string pyramidFile(string traceFile);
+		static bool upToDate(string traceFile, int maxLevel, int headerSize);
+		static void* buildWorker(void*);
+
+		//Level l has 2^l divisions and 2^l + 1 entries, one per division boundary
+		static size_t levelStart(int level)
+		{
+			return ((size_t) 1 << level) - 1 + level;
+		}
+		static size_t entriesPerRank(int maxLevel)
+		{
+			return levelStart(maxLevel + 1);
+		}
+
+		Header* header;
+		size_t mappedSize;
+		//Offset of each rank's entries in the file, 0 if the rank has none.
+		//The times of all levels come first, then the call path ids.
+		FileOffset* rankOffsets;
+	};
+
+} /* namespace TraceviewerServer */
+#endif /* TRACEPYRAMID_H_ */
@@ -64,11 +64,15 @@
 #include <cstdio>
 #include <cassert>
 #include <iostream>
+#include <vector>
+#include <dlfcn.h>
+#include <sys/time.h>
 using namespace std;
 
 using namespace TraceviewerServer;
 
 int inf(FILE *source, FILE *dest);
+static void codecTest();
 
 void compressionTest() {
 	srand(3321);
@@ -96,6 +100,8 @@ void compressionTest() {
 		assert(checkval == readval);
 	}
 	cout << "Compression correctness verified."<<endl;
+
+	codecTest();
 }
 /* Decompress from file source to file dest until stream ends or EOF.
  * inf() returns Z_OK on success, Z_MEM_ERROR if memory could not be
@@ -161,3 +167,113 @@ int inf(FILE *source, FILE *dest)
 	(void)inflateEnd(&strm);
 	return ret == Z_STREAM_END ? Z_OK : Z_DATA_ERROR;
 }
+
+//Trace lines like the ones in a DATA reply: timestamp deltas and call
+//path ids, with runs of the same call path
+static const int NUM_LINES = 4000;
+static const int LINE_ENTRIES = 2000;
+static vector<vector<int> > lines;
+
+static DataCompressionLayer* encodeLine(CompressionType type, vector<int>& line)
+{
+	DataCompressionLayer* layer = new DataCompressionLayer(type);
+	for (size_t j = 0; j < line.size(); j++)
+		layer->writeInt(line[j]);
+	layer->flush();
+	return layer;
+}
+
+static double seconds()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+//Decompresses one line with the library the client would use
+static bool decodeLine(CompressionType type, DataCompressionLayer* layer, vector<int>& line)
+{
+	vector<char> out(line.size() * SIZEOF_INT + 16);
+	size_t outLen = out.size();
+	const char* in = (const char*) layer->getOutputBuffer();
+	size_t inLen = layer->getOutputLength();
+	if (type == COMPRESSION_ZLIB)
+	{
+		uLongf len = outLen;
+		if (uncompress((Bytef*) &out[0], &len, (const Bytef*) in, inLen) != Z_OK)
+			return false;
+		outLen = len;
+	}
+	else if (type == COMPRESSION_LZ4)
+	{
+		typedef int DecompressFn(const char*, char*, int, int);
+		DecompressFn* decompress = (DecompressFn*) dlsym(dlopen("liblz4.so.1", RTLD_NOW), "LZ4_decompress_safe");
+		int ret = decompress(in, &out[0], inLen, outLen);
+		if (ret < 0)
+			return false;
+		outLen = ret;
+	}
+	else if (type == COMPRESSION_ZSTD)
+	{
+		typedef size_t DecompressFn(void*, size_t, const void*, size_t);
+		DecompressFn* decompress = (DecompressFn*) dlsym(dlopen("libzstd.so.1", RTLD_NOW), "ZSTD_decompress");
+		outLen = decompress(&out[0], outLen, in, inLen);
+	}
+	else
+	{
+		copy(in, in + inLen, out.begin());
+		outLen = inLen;
+	}
+	if (outLen != line.size() * SIZEOF_INT)
+		return false;
+	for (size_t j = 0; j < line.size(); j++)
+		if (ByteUtilities::readInt(&out[j * SIZEOF_INT]) != line[j])
+			return false;
+	return true;
+}
+
+static void codecTest()
+{
+	srand(3321);
+	lines.resize(NUM_LINES);
+	for (int i = 0; i < NUM_LINES; i++)
+	{
+		int cpid = rand() % 500;
+		for (int j = 0; j < LINE_ENTRIES; j++)
+		{
+			if (rand() % 4 == 0)
+				cpid = rand() % 500;
+			lines[i].push_back(1000 + rand() % 64);
+			lines[i].push_back(cpid);
+		}
+	}
+	double inputMB = (double) NUM_LINES * LINE_ENTRIES * SIZEOF_DELTASAMPLE / (1 << 20);
+
+	const char* names[] = { "none", "zlib", "lz4", "zstd" };
+	cout << "Compressing " << NUM_LINES << " trace lines (" << inputMB << " MB)" << endl;
+	for (int t = COMPRESSION_NONE; t <= COMPRESSION_ZSTD; t++)
+	{
+		CompressionType type = (CompressionType) t;
+		if (!DataCompressionLayer::isAvailable(type))
+		{
+			cout << "  " << names[t] << ": not available" << endl;
+			continue;
+		}
+		vector<DataCompressionLayer*> layers(NUM_LINES);
+		double start = seconds();
+		for (int i = 0; i < NUM_LINES; i++)
+			layers[i] = encodeLine(type, lines[i]);
+		double elapsed = seconds() - start;
+
+		long compressedBytes = 0;
+		for (int i = 0; i < NUM_LINES; i++)
+		{
+			assert(decodeLine(type, layers[i], lines[i]));
+			compressedBytes += layers[i]->getOutputLength();
+			delete layers[i];
+		}
+		cout << "  " << names[t] << ": " << inputMB / elapsed << " MB/s, ratio "
+				<< inputMB * (1 << 20) / compressedBytes << endl;
+	}
+	cout << "Codec correctness verified." << endl;
+}
@@ -0,0 +1,218 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   [The purpose of this file]
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#include "../DataCompressionLayer.hpp"
+#include "../MergeDataFiles.hpp"
+#include "../ByteUtilities.hpp"
+#include "../Constants.hpp"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstdio>
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <sys/time.h>
+#include <unistd.h>
+using namespace std;
+
+using namespace TraceviewerServer;
+
+static const int NUM_TRACE_FILES = 2000;
+
+static string traceName(string dir, int i)
+{
+	stringstream ss;
+	ss << dir << "/app-" << (i / 4) << "-" << (i % 4) << "-a8c00270-1234-0.hpctrace";
+	return ss.str();
+}
+
+//Every file gets its own contents, some are empty and some are larger than
+//the copy buffer
+static string traceData(int i, char fill)
+{
+	size_t size = (i % 97 == 0) ? 0 : (i % 500 == 1) ? (3 << 20) + i : 24 + 12 * (i % 300);
+	string data(size, fill);
+	for (size_t j = 0; j < size; j += 7)
+		data[j] = (char) (i * 31 + j);
+	return data;
+}
+
+static void writeTraces(string dir, char fill)
+{
+	for (int i = 0; i < NUM_TRACE_FILES; i++)
+	{
+		ofstream f(traceName(dir, i).c_str(), ios_base::binary | ios_base::out);
+		string data = traceData(i, fill);
+		f.write(data.data(), data.size());
+	}
+}
+
+static string readAll(string path)
+{
+	ifstream f(path.c_str(), ios_base::binary | ios_base::in);
+	stringstream ss;
+	ss << f.rdbuf();
+	return ss.str();
+}
+
+static double seconds()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+void mergeTest() {
+	char dirTemplate[] = "/tmp/hpcserver-merge-XXXXXX";
+	string dir = mkdtemp(dirTemplate);
+	string output = dir + "/experiment.mt";
+
+	//A full merge, checked against the trace files
+	writeTraces(dir, 'x');
+	double start = seconds();
+	MergeDataAttribute att = MergeDataFiles::merge(dir, "*.hpctrace", output);
+	cout << "Merged " << NUM_TRACE_FILES << " trace files in " << seconds() - start << " s" << endl;
+	assert(att == SUCCESS_MERGED);
+	assert(!FileUtils::exists(traceName(dir, 0)));
+
+	string merged = readAll(output);
+	char* buf = &merged[0];
+	assert(ByteUtilities::readInt(buf) == (MULTI_PROCESSES | MULTI_THREADING));
+	assert(ByteUtilities::readInt(buf + SIZEOF_INT) == NUM_TRACE_FILES);
+	vector<string> names;
+	for (int i = 0; i < NUM_TRACE_FILES; i++)
+		names.push_back(traceName(dir, i));
+	vector<int> order(NUM_TRACE_FILES);
+	for (int i = 0; i < NUM_TRACE_FILES; i++)
+		order[i] = i;
+	//The files are merged in the order of their names
+	sort(order.begin(), order.end(), [&](int a, int b) { return names[a] < names[b]; });
+	FileOffset dataEnd = 0;
+	for (int k = 0; k < NUM_TRACE_FILES; k++)
+	{
+		int i = order[k];
+		char* entry = buf + 2 * SIZEOF_INT + k * (SIZEOF_LONG + 2 * SIZEOF_INT);
+		assert(ByteUtilities::readInt(entry) == i / 4);
+		assert(ByteUtilities::readInt(entry + SIZEOF_INT) == i % 4);
+		FileOffset offset = ByteUtilities::readLong(entry + 2 * SIZEOF_INT);
+		string data = traceData(i, 'x');
+		assert(merged.compare(offset, data.size(), data) == 0);
+		dataEnd = offset + data.size();
+	}
+	assert(merged.size() == dataEnd + SIZEOF_LONG);
+	assert(MergeDataFiles::merge(dir, "*.hpctrace", output) == SUCCESS_ALREADY_CREATED);
+	cout << "Merge correctness verified." << endl;
+
+	//An interrupted merge: every third file is recorded as done and its
+	//trace file is changed, so copying it again would show
+	writeTraces(dir, 'x');
+	string partial = merged.substr(0, dataEnd);
+	char journalHeader[2 * SIZEOF_LONG + SIZEOF_INT];
+	ByteUtilities::writeLong(journalHeader, 0x4D455247454A524EULL);
+	ByteUtilities::writeInt(journalHeader + SIZEOF_LONG, NUM_TRACE_FILES);
+	ByteUtilities::writeLong(journalHeader + SIZEOF_LONG + SIZEOF_INT, dataEnd);
+	string journal(journalHeader, sizeof(journalHeader));
+	for (int k = 0; k < NUM_TRACE_FILES; k++)
+	{
+		char* entry = buf + 2 * SIZEOF_INT + k * (SIZEOF_LONG + 2 * SIZEOF_INT);
+		FileOffset offset = ByteUtilities::readLong(entry + 2 * SIZEOF_INT);
+		string data = traceData(order[k], 'x');
+		if (k % 3 == 0)
+		{
+			char index[SIZEOF_INT];
+			ByteUtilities::writeInt(index, k);
+			journal.append(index, SIZEOF_INT);
+			ofstream f(names[order[k]].c_str(), ios_base::binary | ios_base::out);
+			string changed = traceData(order[k], 'y');
+			f.write(changed.data(), changed.size());
+		}
+		else
+			partial.replace(offset, data.size(), data.size(), '?');
+	}
+	journal.append("\0\0", 2); //torn index
+	{
+		ofstream f(output.c_str(), ios_base::binary | ios_base::out);
+		f.write(partial.data(), partial.size());
+		ofstream j((output + ".merging").c_str(), ios_base::binary | ios_base::out);
+		j.write(journal.data(), journal.size());
+	}
+	assert(MergeDataFiles::merge(dir, "*.hpctrace", output) == SUCCESS_MERGED);
+	assert(readAll(output) == merged);
+	assert(!FileUtils::exists(output + ".merging"));
+	cout << "Resumed merge verified." << endl;
+
+	//A journal left by other trace files is not trusted
+	writeTraces(dir, 'x');
+	ByteUtilities::writeInt(journalHeader + SIZEOF_LONG, NUM_TRACE_FILES + 1);
+	{
+		ofstream f(output.c_str(), ios_base::binary | ios_base::out);
+		f.write(partial.data(), partial.size());
+		ofstream j((output + ".merging").c_str(), ios_base::binary | ios_base::out);
+		j.write(journalHeader, sizeof(journalHeader));
+		j.write(journal.data() + sizeof(journalHeader), journal.size() - sizeof(journalHeader));
+	}
+	assert(MergeDataFiles::merge(dir, "*.hpctrace", output) == SUCCESS_MERGED);
+	assert(readAll(output) == merged);
+	cout << "Stale merge journal discarded." << endl;
+
+	remove(output.c_str());
+	rmdir(dir.c_str());
+}
@@ -0,0 +1,284 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   [The purpose of this file]
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#include "../TracePyramid.hpp"
+#include "../TraceDataByRank.hpp"
+#include "../FilteredBaseData.hpp"
+#include "../ByteUtilities.hpp"
+#include "../Constants.hpp"
+
+#include <cstdlib>
+#include <cstdio>
+#include <cassert>
+#include <cmath>
+#include <fstream>
+#include <iostream>
+#include <sys/time.h>
+#include <unistd.h>
+using namespace std;
+
+using namespace TraceviewerServer;
+
+static const int HEADER_SIZE = 24;
+static const int RECORDS_PER_RANK = 1024;
+static const int PYRAMID_LEVELS = 7;
+static const int VIEW_WIDTH = 1 << PYRAMID_LEVELS;
+static const int VIEW_HEIGHT = 1024;
+
+static Time recordTime(int rank, int k)
+{
+	return 1000000 + (Time) k * 1000 + (rank * 7919 + k * 104729) % 900;
+}
+
+static int recordCPID(int rank, int k)
+{
+	return (rank * 31 + k * 17) % 5000;
+}
+
+//A merged trace file as MergeDataFiles writes it
+static void writeMergedTrace(string file, int numRanks)
+{
+	size_t headerLength = 2 * SIZEOF_INT + numRanks * (SIZEOF_LONG + 2 * SIZEOF_INT);
+	size_t rankLength = HEADER_SIZE + RECORDS_PER_RANK * SIZE_OF_TRACE_RECORD;
+	ofstream f(file.c_str(), ios_base::binary | ios_base::out);
+
+	vector<char> header(headerLength);
+	ByteUtilities::writeInt(&header[0], MULTI_PROCESSES);
+	ByteUtilities::writeInt(&header[SIZEOF_INT], numRanks);
+	for (int r = 0; r < numRanks; r++)
+	{
+		char* entry = &header[2 * SIZEOF_INT + r * (SIZEOF_LONG + 2 * SIZEOF_INT)];
+		ByteUtilities::writeInt(entry, r);
+		ByteUtilities::writeInt(entry + SIZEOF_INT, 0);
+		ByteUtilities::writeLong(entry + 2 * SIZEOF_INT, headerLength + r * rankLength);
+	}
+	f.write(&header[0], headerLength);
+
+	vector<char> rank(rankLength, 0);
+	for (int r = 0; r < numRanks; r++)
+	{
+		for (int k = 0; k < RECORDS_PER_RANK; k++)
+		{
+			char* record = &rank[HEADER_SIZE + k * SIZE_OF_TRACE_RECORD];
+			ByteUtilities::writeLong(record, recordTime(r, k));
+			ByteUtilities::writeInt(record + SIZEOF_LONG, recordCPID(r, k));
+		}
+		f.write(&rank[0], rankLength);
+	}
+	char marker[SIZEOF_LONG];
+	ByteUtilities::writeLong(marker, 0xFFFFFFFFDEADF00DULL);
+	f.write(marker, SIZEOF_LONG);
+}
+
+//The record nearest to t, preferring the later one as findTimeInInterval does
+static int nearestRecord(int rank, Time t)
+{
+	int k = 0;
+	while (k + 1 < RECORDS_PER_RANK && recordTime(rank, k + 1) <= t)
+		k++;
+	if (k + 1 < RECORDS_PER_RANK && recordTime(rank, k) <= t
+			&& !(t - recordTime(rank, k) < recordTime(rank, k + 1) - t))
+		k++;
+	return k;
+}
+
+static double seconds()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+//Reads width pixels from begin to end of VIEW_HEIGHT ranks, spread over all
+//of them, into lines and returns the number of samples
+static long readView(FilteredBaseData* data, int numRanks, Time begin, Time end, int width,
+		vector<vector<TimeCPID> >& lines)
+{
+	double pixelLength = (double) (end - begin) / width;
+	long samples = 0;
+	lines.resize(VIEW_HEIGHT);
+	for (int line = 0; line < VIEW_HEIGHT; line++)
+	{
+		TraceDataByRank trace(data, (long) line * numRanks / VIEW_HEIGHT, width, HEADER_SIZE);
+		trace.getData(begin, end - begin, pixelLength);
+		lines[line] = *trace.listCPID;
+		samples += trace.listCPID->size();
+	}
+	return samples;
+}
+
+//The pyramid must give the lines the trace file gives when the pixel
+//boundaries are division boundaries. Otherwise the records at the edges
+//must still be the same, and each sample in between must be the record
+//nearest to a time within half a division of its pixel boundary.
+static void checkView(FilteredBaseData* data, TracePyramid* pyramid, int numRanks,
+		Time begin, Time end, int width, double division)
+{
+	vector<vector<TimeCPID> > exact, sampled;
+	data->setPyramid(NULL);
+	readView(data, numRanks, begin, end, width, exact);
+	data->setPyramid(pyramid);
+	readView(data, numRanks, begin, end, width, sampled);
+	double pixelLength = (double) (end - begin) / width;
+	for (int line = 0; line < VIEW_HEIGHT; line++)
+	{
+		int rank = (long) line * numRanks / VIEW_HEIGHT;
+		size_t n = exact[line].size();
+		assert(sampled[line].size() == n);
+		bool edgeBefore = exact[line][0].timestamp < begin;
+		for (size_t i = 0; i < n; i++)
+		{
+			int p = i + (edgeBefore ? 0 : 1);
+			if (division == 0 || i == 0 || i + 1 == n)
+			{
+				assert(exact[line][i].timestamp == sampled[line][i].timestamp);
+				assert(exact[line][i].cpid == sampled[line][i].cpid);
+				continue;
+			}
+			Time t = (Time) (p * pixelLength + begin);
+			Time lo = recordTime(rank, nearestRecord(rank, (Time) (t - division / 2)));
+			Time hi = recordTime(rank, nearestRecord(rank, (Time) (t + division / 2) + 1));
+			assert(lo <= sampled[line][i].timestamp && sampled[line][i].timestamp <= hi);
+		}
+	}
+}
+
+static void checkSamples(TracePyramid* pyramid, int rank, Time begin, Time end)
+{
+	vector<TimeCPID> samples;
+	double pixelLength = (double) (end - begin) / VIEW_WIDTH;
+	assert(pyramid->sample(rank, begin, pixelLength, VIEW_WIDTH, samples));
+	//Every pixel boundary is a division boundary of the finest level
+	assert(samples.size() == (size_t) VIEW_WIDTH - 1);
+	for (int p = 1; p < VIEW_WIDTH; p++)
+	{
+		Time t = begin + (Time) ((double) (end - begin) * p / VIEW_WIDTH);
+		int k = nearestRecord(rank, t);
+		assert(samples[p - 1].timestamp == recordTime(rank, k));
+		assert(samples[p - 1].cpid == recordCPID(rank, k));
+	}
+
+	//Views finer than the finest level are read from the trace file
+	samples.clear();
+	assert(!pyramid->sample(rank, begin, pixelLength / 4, VIEW_WIDTH, samples));
+	assert(samples.empty());
+}
+
+void pyramidTest() {
+	char dirTemplate[] = "/tmp/hpcserver-pyramid-XXXXXX";
+	string dir = mkdtemp(dirTemplate);
+	string file = dir + "/experiment.mt";
+
+	int rankCounts[] = { 4096, 16384, 65536 };
+	for (int i = 0; i < 3; i++)
+	{
+		int numRanks = rankCounts[i];
+		writeMergedTrace(file, numRanks);
+		Time begin = recordTime(0, 0), end = recordTime(0, RECORDS_PER_RANK - 1);
+		for (int r = 0; r < numRanks; r++)
+		{
+			begin = min(begin, recordTime(r, 0));
+			end = max(end, recordTime(r, RECORDS_PER_RANK - 1));
+		}
+
+		double start = seconds();
+		assert(TracePyramid::build(file, PYRAMID_LEVELS, HEADER_SIZE));
+		double buildTime = seconds() - start;
+		TracePyramid* pyramid = TracePyramid::open(file, HEADER_SIZE);
+		assert(pyramid != NULL);
+		assert(TracePyramid::open(file, HEADER_SIZE + 1) == NULL);
+		for (int r = 0; r < numRanks; r += numRanks / 16)
+			checkSamples(pyramid, r, begin, end);
+
+		FilteredBaseData data(file, HEADER_SIZE);
+		//The full view, and half of it at the same resolution, whose edges
+		//come from records outside the view
+		checkView(&data, pyramid, numRanks, begin, end, VIEW_WIDTH, 0);
+		double span = end - begin;
+		checkView(&data, pyramid, numRanks, begin + (Time) (span / 3),
+				begin + (Time) (span / 3) + (end - begin) / 2, VIEW_WIDTH / 2,
+				span / VIEW_WIDTH);
+
+		vector<vector<TimeCPID> > lines;
+		data.setPyramid(NULL);
+		readView(&data, numRanks, begin, end, VIEW_WIDTH, lines); //warm the page cache
+		start = seconds();
+		long exactSamples = readView(&data, numRanks, begin, end, VIEW_WIDTH, lines);
+		double exactTime = seconds() - start;
+
+		data.setPyramid(pyramid);
+		readView(&data, numRanks, begin, end, VIEW_WIDTH, lines);
+		start = seconds();
+		long pyramidSamples = readView(&data, numRanks, begin, end, VIEW_WIDTH, lines);
+		double pyramidTime = seconds() - start;
+		assert(pyramidSamples == exactSamples);
+
+		cout << numRanks << " ranks: pyramid built in " << buildTime << " s, "
+				<< FileUtils::getFileSize(file + ".pyramid") / (1 << 20) << " MB; "
+				<< VIEW_WIDTH << "x" << VIEW_HEIGHT << " full view in "
+				<< exactTime * 1000 << " ms from the trace (" << exactSamples << " samples), "
+				<< pyramidTime * 1000 << " ms from the pyramid (" << pyramidSamples << " samples)" << endl;
+
+		delete pyramid;
+		remove((file + ".pyramid").c_str());
+		remove(file.c_str());
+	}
+	rmdir(dir.c_str());
+	cout << "Pyramid test passed." << endl;
+}
@@ -0,0 +1,442 @@
+// -*-Mode: C++;-*-
+
+// * BeginRiceCopyright *****************************************************
+//
+// $HeadURL$
+// $Id$
+//
+// --------------------------------------------------------------------------
+// Part of HPCToolkit (hpctoolkit.org)
+//
+// Information about sources of support for research and development of
+// HPCToolkit is at 'hpctoolkit.org' and in 'README.Acknowledgments'.
+// --------------------------------------------------------------------------
+//
+// Copyright ((c)) 2002-2020, Rice University
+// All rights reserved.
+//
+// Redistribution and use in source and binary forms, with or without
+// modification, are permitted provided that the following conditions are
+// met:
+//
+// * Redistributions of source code must retain the above copyright
+//   notice, this list of conditions and the following disclaimer.
+//
+// * Redistributions in binary form must reproduce the above copyright
+//   notice, this list of conditions and the following disclaimer in the
+//   documentation and/or other materials provided with the distribution.
+//
+// * Neither the name of Rice University (RICE) nor the names of its
+//   contributors may be used to endorse or promote products derived from
+//   this software without specific prior written permission.
+//
+// This software is provided by RICE and contributors "as is" and any
+// express or implied warranties, including, but not limited to, the
+// implied warranties of merchantability and fitness for a particular
+// purpose are disclaimed. In no event shall RICE or contributors be
+// liable for any direct, indirect, incidental, special, exemplary, or
+// consequential damages (including, but not limited to, procurement of
+// substitute goods or services; loss of use, data, or profits; or
+// business interruption) however caused and on any theory of liability,
+// whether in contract, strict liability, or tort (including negligence
+// or otherwise) arising in any way out of the use of this software, even
+// if advised of the possibility of such damage.
+//
+// ******************************************************* EndRiceCopyright *
+
+//***************************************************************************
+//
+// File:
+//   $HeadURL$
+//
+// Purpose:
+//   [The purpose of this file]
+//
+// Description:
+//   [The set of functions, macros, etc. defined in the file]
+//
+//***************************************************************************
+
+#include "../Server.hpp"
+#include "../ByteUtilities.hpp"
+#include "../Constants.hpp"
+
+#include <cstdlib>
+#include <cstdio>
+#include <cassert>
+#include <fstream>
+#include <iostream>
+#include <vector>
+#include <pthread.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+using namespace std;
+
+using namespace TraceviewerServer;
+
+static const int NUM_RANKS = 1024;
+static const int RECORDS_PER_RANK = 8192;
+static const int HEADER_SIZE = 24;
+static const int VIEW_WIDTH = 1024;
+static const int VIEW_HEIGHT = 1024;
+//A zoom or pan step every this many seconds, as when the wheel is turned
+static const double STEP_INTERVAL = 0.02;
+static const int ZOOM_STEPS = 8;
+static const int PAN_STEPS = 8;
+
+static const int PROTOCOL_VERSION_SEQUENTIAL = 0x00010002;
+static const int PROTOCOL_VERSION_CANCEL = 0x00010003;
+
+static Time recordTime(int rank, int k)
+{
+	return (Time) k * 1000 + (rank * 7919 + k * 104729) % 900;
+}
+
+static void writeDatabase(string dir)
+{
+	ofstream xml((dir + "/experiment.xml").c_str());
+	xml << "<?xml version=\"1.0\"?><HPCToolkitExperiment></HPCToolkitExperiment>" << endl;
+
+	size_t headerLength = 2 * SIZEOF_INT + NUM_RANKS * (SIZEOF_LONG + 2 * SIZEOF_INT);
+	size_t rankLength = HEADER_SIZE + RECORDS_PER_RANK * SIZE_OF_TRACE_RECORD;
+	ofstream f((dir + "/experiment.mt").c_str(), ios_base::binary | ios_base::out);
+	vector<char> header(headerLength);
+	ByteUtilities::writeInt(&header[0], MULTI_PROCESSES);
+	ByteUtilities::writeInt(&header[SIZEOF_INT], NUM_RANKS);
+	for (int r = 0; r < NUM_RANKS; r++)
+	{
+		char* entry = &header[2 * SIZEOF_INT + r * (SIZEOF_LONG + 2 * SIZEOF_INT)];
+		ByteUtilities::writeInt(entry, r);
+		ByteUtilities::writeInt(entry + SIZEOF_INT, 0);
+		ByteUtilities::writeLong(entry + 2 * SIZEOF_INT, headerLength + r * rankLength);
+	}
+	f.write(&header[0], headerLength);
+
+	vector<char> rank(rankLength, 0);
+	for (int r = 0; r < NUM_RANKS; r++)
+	{
+		for (int k = 0; k < RECORDS_PER_RANK; k++)
+		{
+			char* record = &rank[HEADER_SIZE + k * SIZE_OF_TRACE_RECORD];
+			ByteUtilities::writeLong(record, recordTime(r, k));
+			ByteUtilities::writeInt(record + SIZEOF_LONG, (r + k) % 5000);
+		}
+		f.write(&rank[0], rankLength);
+	}
+	char marker[SIZEOF_LONG];
+	ByteUtilities::writeLong(marker, 0xFFFFFFFFDEADF00DULL);
+	f.write(marker, SIZEOF_LONG);
+}
+
+static double seconds()
+{
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return tv.tv_sec + 1e-6 * tv.tv_usec;
+}
+
+static void sleepUntil(double time)
+{
+	double now = seconds();
+	if (now < time)
+		usleep((useconds_t) ((time - now) * 1e6));
+}
+
+//A free port for the server, found by binding to port 0
+static int freePort()
+{
+	int fd = socket(PF_INET, SOCK_STREAM, 0);
+	sockaddr_in address;
+	memset(&address, 0, sizeof(address));
+	address.sin_family = AF_INET;
+	address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	assert(bind(fd, (sockaddr*) &address, sizeof(address)) == 0);
+	socklen_t len = sizeof(address);
+	getsockname(fd, (sockaddr*) &address, &len);
+	close(fd);
+	return ntohs(address.sin_port);
+}
+
+static void* runServer(void*)
+{
+	try
+	{
+		Server server;
+	}
+	catch (ErrorCode& e)
+	{
+		cerr << "Server error " << e << endl;
+		abort();
+	}
+	return NULL;
+}
+
+//The client side of the protocol, as hpctraceviewer speaks it
+class LoopbackClient
+{
+public:
+	LoopbackClient(int port)
+	{
+		fd = socket(PF_INET, SOCK_STREAM, 0);
+		sockaddr_in address;
+		memset(&address, 0, sizeof(address));
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		//The server may not be listening yet
+		int tries = 0;
+		while (connect(fd, (sockaddr*) &address, sizeof(address)) != 0)
+		{
+			assert(++tries < 500);
+			close(fd);
+			fd = socket(PF_INET, SOCK_STREAM, 0);
+			usleep(10000);
+		}
+		int one = 1;
+		setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+		in = fdopen(dup(fd), "rb");
+		out = fdopen(fd, "wb");
+		pthread_mutex_init(&writing, NULL);
+	}
+	~LoopbackClient()
+	{
+		fclose(in);
+		fclose(out);
+		pthread_mutex_destroy(&writing);
+	}
+
+	void writeInt(int value)
+	{
+		char buffer[SIZEOF_INT];
+		ByteUtilities::writeInt(buffer, value);
+		fwrite(buffer, SIZEOF_INT, 1, out);
+	}
+	void writeLong(uint64_t value)
+	{
+		char buffer[SIZEOF_LONG];
+		ByteUtilities::writeLong(buffer, value);
+		fwrite(buffer, SIZEOF_LONG, 1, out);
+	}
+	void writeString(string value)
+	{
+		char buffer[SIZEOF_SHORT];
+		ByteUtilities::writeShort(buffer, value.length());
+		fwrite(buffer, SIZEOF_SHORT, 1, out);
+		fwrite(value.data(), value.length(), 1, out);
+	}
+	void read(char* buffer, size_t length)
+	{
+		assert(fread(buffer, 1, length, in) == length);
+	}
+	int readInt()
+	{
+		char buffer[SIZEOF_INT];
+		read(buffer, SIZEOF_INT);
+		return ByteUtilities::readInt(buffer);
+	}
+	uint64_t readLong()
+	{
+		char buffer[SIZEOF_LONG];
+		read(buffer, SIZEOF_LONG);
+		return ByteUtilities::readLong(buffer);
+	}
+
+	void open(string database, int protocolVersion)
+	{
+		writeInt(OPEN);
+		writeInt(protocolVersion);
+		writeString(database);
+		writeInt(1);
+		writeInt(COMPRESSION_ZLIB);
+		fflush(out);
+
+		assert(readInt() == DBOK);
+		readInt(); //XML port, the main one here
+		int numRanks = readInt();
+		assert(numRanks == NUM_RANKS);
+		readInt(); //Codec
+		vector<char> valuesX(numRanks * (SIZEOF_INT + SIZEOF_SHORT));
+		read(&valuesX[0], valuesX.size());
+		assert(readInt() == EXML);
+		vector<char> xml(readInt());
+		read(&xml[0], xml.size());
+
+		writeInt(INFO);
+		writeLong(0);
+		writeLong(recordTime(0, RECORDS_PER_RANK - 1));
+		writeInt(HEADER_SIZE);
+		fflush(out);
+	}
+
+	void requestData(Time timeStart, Time timeEnd)
+	{
+		pthread_mutex_lock(&writing);
+		writeInt(DATA);
+		writeInt(0);
+		writeInt(NUM_RANKS);
+		writeLong(timeStart);
+		writeLong(timeEnd);
+		writeInt(VIEW_HEIGHT);
+		writeInt(VIEW_WIDTH);
+		fflush(out);
+		pthread_mutex_unlock(&writing);
+	}
+
+	//Returns the number of lines in the reply
+	int readReply(bool cancellable)
+	{
+		assert(readInt() == HERE);
+		int expected = min(VIEW_HEIGHT, NUM_RANKS);
+		int lines = 0;
+		while (true)
+		{
+			if (!cancellable && lines == expected)
+				return lines;
+			int line = readInt();
+			if (line == END_OF_DATA_REPLY)
+			{
+				assert(readInt() == lines);
+				return lines;
+			}
+			assert(line >= 0 && line < expected);
+			readInt(); //Entries
+			readLong(); //Begin time
+			readLong(); //End time
+			vector<char> compressed(readInt());
+			read(&compressed[0], compressed.size());
+			lines++;
+		}
+	}
+
+	void done()
+	{
+		writeInt(DONE);
+		fflush(out);
+	}
+
+private:
+	int fd;
+	FILE* in;
+	FILE* out;
+	pthread_mutex_t writing;
+};
+
+struct View
+{
+	Time start;
+	Time end;
+};
+
+//Zooms into the middle of the trace, then pans right
+static vector<View> replaySteps()
+{
+	vector<View> steps;
+	double start = 0, end = recordTime(0, RECORDS_PER_RANK - 1);
+	for (int i = 0; i < ZOOM_STEPS; i++)
+	{
+		double shrink = (end - start) * 0.1;
+		start += shrink;
+		end -= shrink;
+		View v = { (Time) start, (Time) end };
+		steps.push_back(v);
+	}
+	for (int i = 0; i < PAN_STEPS; i++)
+	{
+		double shift = (end - start) * 0.1;
+		start += shift;
+		end += shift;
+		View v = { (Time) start, (Time) end };
+		steps.push_back(v);
+	}
+	return steps;
+}
+
+struct Replay
+{
+	LoopbackClient* client;
+	vector<View> steps;
+	double begin;
+};
+
+//Sends each step when it happens, without waiting for replies
+static void* sendSteps(void* arg)
+{
+	Replay* replay = (Replay*) arg;
+	for (size_t i = 0; i < replay->steps.size(); i++)
+	{
+		sleepUntil(replay->begin + i * STEP_INTERVAL);
+		replay->client->requestData(replay->steps[i].start, replay->steps[i].end);
+	}
+	return NULL;
+}
+
+static void replay(string dir, int protocolVersion)
+{
+	mainPortNumber = freePort();
+	xmlPortNumber = 1;
+	pthread_t server;
+	pthread_create(&server, NULL, runServer, NULL);
+
+	LoopbackClient client(mainPortNumber);
+	client.open(dir, protocolVersion);
+	bool cancellable = (protocolVersion >= PROTOCOL_VERSION_CANCEL);
+
+	Replay replay;
+	replay.client = &client;
+	replay.steps = replaySteps();
+	int numSteps = replay.steps.size();
+	long lines = 0;
+	int lastLines = 0;
+	replay.begin = seconds();
+	if (cancellable)
+	{
+		pthread_t sender;
+		pthread_create(&sender, NULL, sendSteps, &replay);
+		for (int i = 0; i < numSteps; i++)
+		{
+			lastLines = client.readReply(true);
+			lines += lastLines;
+		}
+		pthread_join(sender, NULL);
+	}
+	else
+	{
+		//A step that happens during a reply is sent after it
+		for (int i = 0; i < numSteps; i++)
+		{
+			sleepUntil(replay.begin + i * STEP_INTERVAL);
+			client.requestData(replay.steps[i].start, replay.steps[i].end);
+			lastLines = client.readReply(false);
+			lines += lastLines;
+		}
+	}
+	double end = seconds();
+	assert(lastLines == min(VIEW_HEIGHT, NUM_RANKS));
+
+	client.done();
+	pthread_join(server, NULL);
+
+	double lastStep = replay.begin + (numSteps - 1) * STEP_INTERVAL;
+	cout << "Protocol 0x" << hex << protocolVersion << dec << ": " << numSteps
+			<< " zoom and pan steps " << STEP_INTERVAL * 1000 << " ms apart, "
+			<< lines << " lines received, last view complete "
+			<< (end - lastStep) * 1000 << " ms after the last step" << endl;
+}
+
+void serverTest() {
+	char dirTemplate[] = "/tmp/hpcserver-loopback-XXXXXX";
+	string dir = mkdtemp(dirTemplate);
+	writeDatabase(dir);
+
+	replay(dir, PROTOCOL_VERSION_SEQUENTIAL);
+	replay(dir, PROTOCOL_VERSION_CANCEL);
+
+	remove((dir + "/experiment.xml").c_str());
+	remove((dir + "/experiment.mt").c_str());
+	rmdir(dir.c_str());
+	cout << "Server loopback test passed." << endl;
+}
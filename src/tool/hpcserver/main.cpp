@@ -74,6 +74,7 @@ int main(int argc, char *argv[])
 	TraceviewerServer::useCompression = args.compression;
 	TraceviewerServer::xmlPortNumber = args.xmlPort;
 	TraceviewerServer::mainPortNumber = args.mainPort;
+	TraceviewerServer::pyramidLevels = args.pyramidLevels;
 
 	try
 	{
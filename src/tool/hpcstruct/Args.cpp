@@ -169,6 +169,8 @@ Options for Developers:\n\
   --jobs-struct <num>  Use <num> threads for the MakeStructure() phase only.\n\
   --jobs-parse  <num>  Use <num> threads for the ParseAPI::parse() phase only.\n\
   --jobs-symtab <num>  Use <num> threads for the Symtab phase (if possible).\n\
+  --gpu-inst-json      Write GPU instruction files as JSON instead of the\n\
+                       binary format.\n\
   --show-gaps          Feature to show unclaimed vma ranges (gaps)\n\
                        in the control-flow graph.\n\
   --time               Display stats on hpcstruct's time and space usage.\n\
@@ -188,6 +190,7 @@ CmdLineParser::OptArgDesc Args::optArgs[] = {
 
   // Structure recovery options
   {  0 ,  "gpucfg",         CLP::ARG_REQ,  CLP::DUPOPT_CLOB,  NULL,  NULL },
+  {  0 ,  "gpu-inst-json",  CLP::ARG_NONE, CLP::DUPOPT_CLOB,  NULL,  NULL },
   { 'I', "include",         CLP::ARG_REQ,  CLP::DUPOPT_CAT,  ":",
      NULL },
   { 'R', "replace-path",    CLP::ARG_REQ,  CLP::DUPOPT_CAT,  CLP_SEPARATOR,
@@ -246,6 +249,7 @@ Args::Ctor()
   searchPathStr = ".";
   show_gaps = false;
   compute_gpu_cfg = false;
+  gpu_inst_json = false;
 }
 
 
@@ -392,6 +396,10 @@ Args::parse(int argc, const char* const argv[])
       show_gaps = true;
     }
 
+    if (parser.isOpt("gpu-inst-json")) {
+      gpu_inst_json = true;
+    }
+
     // Check for other options: Output options
     if (parser.isOpt("output")) {
       out_filenm = parser.getOptArg("output");
@@ -116,6 +116,7 @@ public:
   bool show_time;
   long gpu_size;
   bool compute_gpu_cfg;
+  bool gpu_inst_json;
 
   // Parsed Data: optional arguments
   std::string searchPathStr;          // default: "."
@@ -267,6 +267,7 @@ realmain(int argc, char* argv[])
 
   opts.show_time = args.show_time;
   opts.compute_gpu_cfg = args.compute_gpu_cfg;
+  opts.gpu_inst_json = args.gpu_inst_json;
   opts.gpu_size = args.gpu_size;
 
   // ------------------------------------------------------------